@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace kv {
+
+// Incremental backups of an append-only log.
+//
+// Between compactions the log only grows, so every byte before a record
+// boundary is immutable. A backup directory holds a MANIFEST plus numbered
+// chunk files; each run copies only [previous end, last complete record)
+// into a new chunk. Writers are never paused: the copy is taken through one
+// open handle, and a torn final record is trimmed off the chunk.
+//
+// If the log was rewritten since the last run (compaction), the stored
+// fingerprint of the previous tail no longer matches and the run starts a
+// new full generation instead.
+
+struct BackupResult {
+  bool full = false;          // started a new generation
+  uint64_t generation = 0;
+  uint64_t chunk_seq = 0;     // 0 when there was nothing new to copy
+  uint64_t bytes_copied = 0;
+  uint64_t log_end = 0;       // log offset covered by the backup
+};
+
+bool BackupLog(const std::string& log_path, const std::string& backup_dir, BackupResult* result,
+               std::string* err);
+
+// Rebuilds a log at `out_log` from the manifest's current generation.
+// Every chunk's checksum is verified before the result replaces `out_log`.
+bool RestoreLog(const std::string& backup_dir, const std::string& out_log, uint64_t* bytes,
+                std::string* err);
+
+}  // namespace kv
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "kvstore/log_format.h"
+
+namespace kv {
+
+// Per-record value codecs, stored as c=<id> in the PUT header.
+enum class Codec : uint8_t {
+  kNone = 0,
+  kLz = 1,      // LZ77 block, no dictionary
+  kLzDict = 2,  // LZ77 block against the log's shared dictionary
+};
+
+// A shared dictionary: sample bytes that compressed values may reference as
+// if they preceded the value. The match table over the dictionary is built
+// once here instead of on every compression.
+class LzDictionary {
+ public:
+  explicit LzDictionary(std::string bytes);
+
+  const std::string& bytes() const { return bytes_; }
+  uint32_t id() const { return id_; }  // content hash, recorded as d=<id>
+
+ private:
+  friend bool LzCompress(const char*, size_t, const LzDictionary*, std::string*);
+
+  std::string bytes_;
+  uint32_t id_ = 0;
+  std::vector<uint32_t> table_;
+};
+
+// LZ4-style block format (token, literals, 16-bit offset, match length).
+// Appends to `out`; returns false and leaves `out` untouched when the result
+// would not be smaller than the input.
+bool LzCompress(const char* src, size_t n, const LzDictionary* dict, std::string* out);
+
+// Replaces `out` with exactly `raw_size` decoded bytes; false on corrupt input.
+bool LzDecompress(const char* src, size_t n, size_t raw_size, const LzDictionary* dict,
+                  std::string* out);
+
+// Turns a record's stored bytes back into its value. Fails on corrupt input
+// or when the record needs a dictionary other than `dict`.
+bool DecodeValue(const ValueEncoding& enc, const LzDictionary* dict, const std::string& stored,
+                 std::string* value);
+
+// Picks the byte ranges shared by most samples, up to `max_bytes`.
+std::string TrainDictionary(const std::vector<std::string>& samples, size_t max_bytes);
+
+// <log>.dict: "KVDICT 1 <id> <size>\n<bytes>"
+std::string DictionaryPath(const std::string& log_path);
+bool SaveDictionary(const std::string& path, const LzDictionary& dict);
+std::unique_ptr<LzDictionary> LoadDictionary(const std::string& path);
+
+}  // namespace kv
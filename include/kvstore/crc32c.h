@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace kv {
+
+// CRC32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the CPU has it
+// (checked once at startup) and a table-driven fallback otherwise.
+//
+// `crc` is a previous result to extend, so
+//   Crc32c(b, nb, Crc32c(a, na)) == Crc32c(a + b).
+uint32_t Crc32c(const char* data, size_t n, uint32_t crc = 0);
+inline uint32_t Crc32c(const std::string& s, uint32_t crc = 0) {
+  return Crc32c(s.data(), s.size(), crc);
+}
+
+// True when Crc32c runs on the hardware instruction.
+bool Crc32cHardware();
+
+// The portable implementation, exposed for tests and benchmarks.
+uint32_t Crc32cPortable(const char* data, size_t n, uint32_t crc = 0);
+
+}  // namespace kv
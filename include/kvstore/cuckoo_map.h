@@ -0,0 +1,427 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "kvstore/hash.h"
+#include "kvstore/large_pages.h"
+
+namespace kv {
+
+// Concurrent hash map from string keys to V (libcuckoo-style bucketized
+// cuckoo hashing). Every key lives in one of two buckets of four slots, so a
+// lookup checks at most eight slots and the table stays correct up to ~95%
+// full. Each slot has an 8-bit tag (partial key) from the key's hash; the four
+// tags of a bucket are one 32-bit word, matched all at once (SWAR) before any
+// key is compared. The second bucket is derived from the first and the tag
+// alone, so entries can be moved without rehashing their keys.
+//
+// Buckets are guarded by a fixed array of striped spinlocks; an operation
+// holds the (at most two) stripes of its key's buckets, so operations on
+// different keys run in parallel. An insert that finds both buckets full
+// searches breadth-first for a short chain of moves that frees a slot, and
+// performs it one locked pair of buckets at a time. Only growing the table
+// takes every stripe.
+//
+// With a MemoryPlacement the bucket array is mapped with MapLarge (huge
+// pages, a NUMA node) rather than taken from the heap.
+template <typename V>
+class CuckooMap {
+ public:
+  static constexpr size_t kSlots = 4;
+  static constexpr size_t kLocks = 1024;
+
+  explicit CuckooMap(size_t capacity = 0, const MemoryPlacement& placement = MemoryPlacement())
+      : placement_(placement) {
+    Allocate(BucketsFor(capacity));
+  }
+  CuckooMap(const CuckooMap&) = delete;
+  CuckooMap& operator=(const CuckooMap&) = delete;
+
+  // `hash` must be HashKey(key).
+  bool Find(const std::string& key, V* out) const { return Find(key, HashKey(key), out); }
+  bool Find(const std::string& key, uint64_t hash, V* out) const {
+    const uint8_t tag = TagOf(hash);
+    for (;;) {
+      const size_t mask = mask_.load(std::memory_order_acquire);
+      const size_t b1 = hash & mask, b2 = AltBucket(b1, tag, mask);
+      PairLock lock(this, b1, b2);
+      if (mask != mask_.load(std::memory_order_relaxed)) continue;  // grown meanwhile
+      int s;
+      if ((s = FindIn(b1, tag, key)) >= 0) {
+        *out = buckets_[b1].values[s];
+      } else if ((s = FindIn(b2, tag, key)) >= 0) {
+        *out = buckets_[b2].values[s];
+      } else {
+        return false;
+      }
+      return true;
+    }
+  }
+
+  // Inserts or overwrites. Returns true if the key was present, with its
+  // previous value in *old (if given).
+  bool Put(const std::string& key, V value, V* old = nullptr) {
+    return Put(key, HashKey(key), std::move(value), old);
+  }
+  bool Put(const std::string& key, uint64_t hash, V value, V* old = nullptr) {
+    const uint8_t tag = TagOf(hash);
+    for (;;) {
+      const size_t mask = mask_.load(std::memory_order_acquire);
+      const size_t b1 = hash & mask, b2 = AltBucket(b1, tag, mask);
+      {
+        PairLock lock(this, b1, b2);
+        if (mask != mask_.load(std::memory_order_relaxed)) continue;
+        for (size_t b : {b1, b2}) {
+          int s = FindIn(b, tag, key);
+          if (s < 0) continue;
+          if (old) *old = std::move(buckets_[b].values[s]);
+          buckets_[b].values[s] = std::move(value);
+          return true;
+        }
+        for (size_t b : {b1, b2}) {
+          int s = FreeSlot(b);
+          if (s < 0) continue;
+          Fill(b, s, tag, key, std::move(value));
+          size_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+      }
+      // Both buckets full: free a slot in one of them, then try again.
+      if (!MakeRoom(b1, b2, mask)) Grow(mask);
+    }
+  }
+
+  // Returns true if the key was present, with its value in *old (if given).
+  bool Erase(const std::string& key, V* old = nullptr) { return Erase(key, HashKey(key), old); }
+  bool Erase(const std::string& key, uint64_t hash, V* old = nullptr) {
+    const uint8_t tag = TagOf(hash);
+    for (;;) {
+      const size_t mask = mask_.load(std::memory_order_acquire);
+      const size_t b1 = hash & mask, b2 = AltBucket(b1, tag, mask);
+      PairLock lock(this, b1, b2);
+      if (mask != mask_.load(std::memory_order_relaxed)) continue;
+      for (size_t b : {b1, b2}) {
+        int s = FindIn(b, tag, key);
+        if (s < 0) continue;
+        Bucket& bucket = buckets_[b];
+        if (old) *old = std::move(bucket.values[s]);
+        SetTag(&bucket, s, 0);
+        std::string().swap(bucket.keys[s]);
+        bucket.values[s] = V();
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+      return false;
+    }
+  }
+
+  // Holds every stripe: no other operation runs until it is destroyed. A
+  // null map makes it a no-op.
+  class AllLocked {
+   public:
+    explicit AllLocked(const CuckooMap* map) : map_(map) {
+      if (map_) map_->LockAll();
+    }
+    ~AllLocked() {
+      if (map_) map_->UnlockAll();
+    }
+    AllLocked(const AllLocked&) = delete;
+    AllLocked& operator=(const AllLocked&) = delete;
+
+   private:
+    const CuckooMap* map_;
+  };
+
+  void Clear() {
+    AllLocked lock(this);
+    Allocate(BucketsFor(0));
+    size_.store(0, std::memory_order_relaxed);
+  }
+
+  // Takes no locks: the caller keeps writers out (reads may run alongside),
+  // or holds an AllLocked to modify values in place.
+  template <typename Fn>
+  void ForEach(Fn&& fn) {
+    const size_t n = mask_.load(std::memory_order_acquire) + 1;
+    for (size_t b = 0; b < n; b++) {
+      Bucket& bucket = buckets_[b];
+      for (size_t s = 0; s < kSlots; s++) {
+        if (TagAt(bucket, s) != 0) fn(static_cast<const std::string&>(bucket.keys[s]), bucket.values[s]);
+      }
+    }
+  }
+
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+  size_t capacity() const { return (mask_.load(std::memory_order_relaxed) + 1) * kSlots; }
+  double load_factor() const { return static_cast<double>(size()) / static_cast<double>(capacity()); }
+
+ private:
+  static constexpr size_t kMinBuckets = 16;
+  static constexpr int kMaxPathDepth = 5;      // moves in one displacement chain
+  static constexpr size_t kMaxSearched = 512;  // buckets one search may visit
+
+  struct Bucket {
+    uint32_t tags = 0;  // slot i in byte i; 0 = empty
+    std::string keys[kSlots];
+    V values[kSlots];
+  };
+
+  struct alignas(64) Spinlock {
+    std::atomic<bool> held{false};
+    void lock() {
+      for (int spins = 0;; spins++) {
+        if (!held.exchange(true, std::memory_order_acquire)) return;
+        while (held.load(std::memory_order_relaxed)) {
+          // The holder may be descheduled (more threads than cores): yield
+          // rather than burn its time slice.
+          if (++spins > 64) std::this_thread::yield();
+        }
+      }
+    }
+    void unlock() { held.store(false, std::memory_order_release); }
+  };
+
+  // The stripes of two buckets, taken in index order so that pairs can't
+  // deadlock.
+  class PairLock {
+   public:
+    PairLock(const CuckooMap* map, size_t b1, size_t b2)
+        : l1_(&map->locks_[std::min(b1 % kLocks, b2 % kLocks)]),
+          l2_(&map->locks_[std::max(b1 % kLocks, b2 % kLocks)]) {
+      l1_->lock();
+      if (l2_ != l1_) l2_->lock();
+    }
+    ~PairLock() {
+      if (l2_ != l1_) l2_->unlock();
+      l1_->unlock();
+    }
+    PairLock(const PairLock&) = delete;
+    PairLock& operator=(const PairLock&) = delete;
+
+   private:
+    Spinlock* l1_;
+    Spinlock* l2_;
+  };
+
+  static uint8_t TagOf(uint64_t hash) {
+    uint8_t tag = static_cast<uint8_t>(hash >> 56);
+    return tag ? tag : 1;
+  }
+  // An involution: AltBucket(AltBucket(b, t), t) == b.
+  static size_t AltBucket(size_t bucket, uint8_t tag, size_t mask) {
+    return (bucket ^ static_cast<size_t>((tag + 1ull) * 0xc6a4a7935bd1e995ull)) & mask;
+  }
+  static uint8_t TagAt(const Bucket& b, size_t slot) {
+    return static_cast<uint8_t>(b.tags >> (8 * slot));
+  }
+  static void SetTag(Bucket* b, size_t slot, uint8_t tag) {
+    b->tags = (b->tags & ~(0xffu << (8 * slot))) | (static_cast<uint32_t>(tag) << (8 * slot));
+  }
+  // Bit 8*i+7 set where byte i of `tags` may equal `tag` (exact where it
+  // matters: a byte above a true match can be a false positive, which the
+  // caller's re-check discards).
+  static uint32_t MatchTags(uint32_t tags, uint8_t tag) {
+    const uint32_t x = tags ^ (0x01010101u * tag);
+    return (x - 0x01010101u) & ~x & 0x80808080u;
+  }
+
+  static size_t BucketsFor(size_t capacity) {
+    size_t n = kMinBuckets;
+    while (n * kSlots < capacity) n <<= 1;
+    return n;
+  }
+
+  // Destroys and frees a bucket array from Allocate().
+  struct FreeBuckets {
+    size_t count = 0;
+    MemoryPlacement placement;  // disabled: from new[]
+    void operator()(Bucket* b) const {
+      if (!placement.enabled()) {
+        delete[] b;
+        return;
+      }
+      for (size_t i = 0; i < count; i++) b[i].~Bucket();
+      UnmapLarge(b, count * sizeof(Bucket), placement);
+    }
+  };
+
+  void Allocate(size_t buckets) {
+    void* mem = placement_.enabled() ? MapLarge(buckets * sizeof(Bucket), placement_) : nullptr;
+    if (mem) {
+      Bucket* b = static_cast<Bucket*>(mem);
+      for (size_t i = 0; i < buckets; i++) new (&b[i]) Bucket();
+      buckets_ = BucketArray(b, FreeBuckets{buckets, placement_});
+    } else {
+      buckets_ = BucketArray(new Bucket[buckets], FreeBuckets{buckets, MemoryPlacement()});
+    }
+    mask_.store(buckets - 1, std::memory_order_release);
+  }
+
+  // Caller holds the bucket's stripe.
+  int FindIn(size_t b, uint8_t tag, const std::string& key) const {
+    const Bucket& bucket = buckets_[b];
+    for (uint32_t m = MatchTags(bucket.tags, tag); m != 0; m &= m - 1) {
+      const size_t s = static_cast<size_t>(__builtin_ctz(m)) / 8;
+      if (TagAt(bucket, s) == tag && bucket.keys[s] == key) return static_cast<int>(s);
+    }
+    return -1;
+  }
+  int FreeSlot(size_t b) const {
+    const uint32_t m = MatchTags(buckets_[b].tags, 0);
+    if (m == 0) return -1;
+    return __builtin_ctz(m) / 8;  // the lowest match is always exact
+  }
+  void Fill(size_t b, int s, uint8_t tag, const std::string& key, V value) {
+    Bucket& bucket = buckets_[b];
+    SetTag(&bucket, s, tag);
+    bucket.keys[s] = key;
+    bucket.values[s] = std::move(value);
+  }
+
+  // Breadth-first search from b1 and b2 for a bucket with a free slot, then
+  // moves entries back along the path, last move first, so that a slot in
+  // b1 or b2 ends up free. Each move holds the stripes of its two buckets
+  // and re-checks that the entry is still there and still belongs in both;
+  // if not, the search starts over. False if no short path exists.
+  bool MakeRoom(size_t b1, size_t b2, size_t mask) {
+    struct Node {
+      size_t bucket;
+      int parent;  // node whose entry moves here; -1 for b1, b2
+      int slot;    // which of the parent's slots
+      int depth;
+    };
+    for (int attempt = 0; attempt < 4; attempt++) {
+      std::vector<Node> nodes = {{b1, -1, 0, 0}, {b2, -1, 0, 0}};
+      int found = -1, free_slot = -1;
+      for (size_t i = 0; i < nodes.size() && found < 0 && i < kMaxSearched; i++) {
+        const Node n = nodes[i];
+        uint32_t tags;
+        {
+          PairLock lock(this, n.bucket, n.bucket);
+          if (mask != mask_.load(std::memory_order_relaxed)) return true;  // grown: retry the insert
+          tags = buckets_[n.bucket].tags;
+        }
+        const uint32_t free = MatchTags(tags, 0);
+        if (free != 0) {
+          found = static_cast<int>(i);
+          free_slot = __builtin_ctz(free) / 8;
+          break;
+        }
+        if (n.depth >= kMaxPathDepth) continue;
+        for (size_t s = 0; s < kSlots; s++) {
+          const uint8_t t = static_cast<uint8_t>(tags >> (8 * s));
+          nodes.push_back({AltBucket(n.bucket, t, mask), static_cast<int>(i), static_cast<int>(s), n.depth + 1});
+        }
+      }
+      if (found < 0) return false;
+
+      bool moved_all = true;
+      for (int to = found, to_slot = free_slot; nodes[to].parent >= 0 && moved_all;) {
+        const Node& from = nodes[nodes[to].parent];
+        const int from_slot = nodes[to].slot;
+        PairLock lock(this, from.bucket, nodes[to].bucket);
+        if (mask != mask_.load(std::memory_order_relaxed)) return true;
+        Bucket& src = buckets_[from.bucket];
+        Bucket& dst = buckets_[nodes[to].bucket];
+        const uint8_t t = TagAt(src, from_slot);
+        moved_all = t != 0 && TagAt(dst, to_slot) == 0 && AltBucket(from.bucket, t, mask) == nodes[to].bucket;
+        if (!moved_all) break;
+        SetTag(&dst, to_slot, t);
+        dst.keys[to_slot] = std::move(src.keys[from_slot]);
+        dst.values[to_slot] = std::move(src.values[from_slot]);
+        SetTag(&src, from_slot, 0);
+        to_slot = from_slot;
+        to = nodes[to].parent;
+      }
+      if (moved_all) return true;
+    }
+    return false;
+  }
+
+  // Doubles the bucket count unless someone else already grew the table.
+  void Grow(size_t seen_mask) {
+    AllLocked lock(this);
+    if (mask_.load(std::memory_order_relaxed) != seen_mask) return;
+    std::vector<std::pair<std::string, V>> items;
+    items.reserve(size());
+    for (size_t b = 0; b <= seen_mask; b++) {
+      Bucket& bucket = buckets_[b];
+      for (size_t s = 0; s < kSlots; s++) {
+        if (TagAt(bucket, s) != 0) items.emplace_back(std::move(bucket.keys[s]), std::move(bucket.values[s]));
+      }
+    }
+    for (size_t buckets = (seen_mask + 1) * 2;; buckets *= 2) {
+      Allocate(buckets);
+      if (Rehash(&items)) return;
+    }
+  }
+
+  // Places every item by random-walk cuckoo insertion (no other thread runs).
+  // On failure moves them all back into *items and returns false.
+  bool Rehash(std::vector<std::pair<std::string, V>>* items) {
+    const size_t mask = mask_.load(std::memory_order_relaxed);
+    uint64_t rng = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < items->size(); i++) {
+      std::string key = std::move((*items)[i].first);
+      V value = std::move((*items)[i].second);
+      uint8_t tag = TagOf(HashKey(key));
+      size_t b = HashKey(key) & mask;
+      bool placed = false;
+      for (int kicks = 0; kicks < 500 && !placed; kicks++) {
+        for (size_t c : {b, AltBucket(b, tag, mask)}) {
+          int s = FreeSlot(c);
+          if (s < 0) continue;
+          Fill(c, s, tag, key, std::move(value));
+          placed = true;
+          break;
+        }
+        if (placed) break;
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        const size_t s = rng % kSlots;
+        Bucket& victim = buckets_[b];
+        const uint8_t vtag = TagAt(victim, s);
+        std::swap(key, victim.keys[s]);
+        std::swap(value, victim.values[s]);
+        SetTag(&victim, s, tag);
+        tag = vtag;
+        b = AltBucket(b, tag, mask);
+      }
+      if (placed) continue;
+      // Put everything back for a bigger table.
+      std::vector<std::pair<std::string, V>> rest;
+      rest.reserve(items->size());
+      rest.emplace_back(std::move(key), std::move(value));
+      for (size_t j = i + 1; j < items->size(); j++) rest.push_back(std::move((*items)[j]));
+      ForEach([&](const std::string& k, V& v) { rest.emplace_back(k, std::move(v)); });
+      items->swap(rest);
+      return false;
+    }
+    return true;
+  }
+
+  void LockAll() const {
+    for (auto& l : locks_) l.lock();
+  }
+  void UnlockAll() const {
+    for (size_t i = kLocks; i-- > 0;) locks_[i].unlock();
+  }
+
+  using BucketArray = std::unique_ptr<Bucket[], FreeBuckets>;
+  MemoryPlacement placement_;
+  BucketArray buckets_;
+  std::atomic<size_t> mask_{0};  // bucket count - 1; changes only under every stripe
+  std::atomic<size_t> size_{0};
+  mutable Spinlock locks_[kLocks];
+};
+
+}  // namespace kv
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace kv {
+
+// fsync(2) on a file, or on the directory holding `path` (which makes a
+// rename or creation in it durable).
+bool SyncFile(const std::string& path);
+bool SyncParentDir(const std::string& path);
+
+// Durably replaces `path` with the fully written file `tmp`: syncs tmp,
+// renames it over path (atomic on POSIX), then syncs the directory. A crash
+// at any point leaves either the old or the new file at `path`, never a mix
+// or nothing. On failure tmp is gone and `path` is the old file, except
+// when only the final directory sync failed: then it is already the new one.
+bool ReplaceFile(const std::string& tmp, const std::string& path, std::string* err = nullptr);
+
+// Page-cache and allocation hints. All are best effort: a filesystem that
+// does not support one simply ignores it.
+
+// Writes back, then drops, the cached pages of `path` (POSIX_FADV_DONTNEED),
+// for data that was written or read once and is not worth keeping cached.
+void DropCachedPages(const std::string& path);
+
+// Frees blocks allocated past the end of `path`, e.g. by fallocate with
+// FALLOC_FL_KEEP_SIZE, left behind when the writer did not trim them.
+void ReleasePreallocated(const std::string& path);
+
+// For one front-to-back pass over a file read through some other handle:
+// asks for the next kAhead bytes before the scan reaches them (WILLNEED), and
+// drops what the scan has passed (DONTNEED), so a full pass streams without
+// pushing the working set out of the page cache. POSIX_FADV_SEQUENTIAL would
+// only widen readahead on this object's own descriptor, hence WILLNEED.
+class ScanHints {
+ public:
+  static constexpr uint64_t kAhead = 8ull << 20;
+
+  explicit ScanHints(const std::string& path);
+  ~ScanHints();
+  ScanHints(const ScanHints&) = delete;
+  ScanHints& operator=(const ScanHints&) = delete;
+
+  // Everything before `offset` has been read.
+  void Advance(uint64_t offset);
+
+ private:
+  int fd_ = -1;
+  bool started_ = false;
+  uint64_t requested_ = 0;  // WILLNEED issued up to here
+  uint64_t dropped_ = 0;    // DONTNEED issued up to here
+};
+
+}  // namespace kv
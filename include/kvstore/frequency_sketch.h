@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace kv {
+
+// Approximate, aging access counter (count-min sketch with 8-bit counters, in
+// the style of TinyLFU). Safe to call from many readers at once: counters are
+// relaxed atomics and small races only blur the estimate.
+class FrequencySketch {
+ public:
+  // `counters` is rounded up to a power of two.
+  explicit FrequencySketch(size_t counters);
+
+  // Keyed by HashKey(key) (see hash.h), which callers usually have already.
+  // Records one access and returns the new estimate.
+  uint32_t Increment(uint64_t hash);
+  uint32_t Estimate(uint64_t hash) const;
+
+ private:
+  static constexpr int kRows = 4;
+
+  size_t mask_ = 0;
+  std::unique_ptr<std::atomic<uint8_t>[]> table_;
+  std::atomic<uint64_t> additions_{0};
+  uint64_t sample_size_ = 0;  // halve every counter after this many additions
+
+  size_t Slot(uint64_t h, int row) const;
+  void Age();
+};
+
+}  // namespace kv
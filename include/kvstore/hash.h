@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kv {
+
+// Fast non-cryptographic 64-bit hash (wyhash-style: 64x64->128 multiply
+// mixing, three independent lanes for long inputs). The persistent index
+// (<log>.idx) and hint files (<log>.hint) store it, so a change here
+// must bump their versions.
+uint64_t HashBytes(const void* data, size_t n, uint64_t seed = 0);
+
+inline uint64_t HashKey(const std::string& key) { return HashBytes(key.data(), key.size()); }
+
+// out[i] = HashKey(keys[i]). One tight loop, so the multiplies of adjacent
+// keys overlap in the pipeline.
+void HashKeys(const std::vector<std::string>& keys, uint64_t* out);
+
+// Lends a precomputed HashKey(key) to KeyHasher for the life of the scope,
+// on this thread, so a map lookup with `key` itself skips hashing it again.
+// `key` is matched by address, not by contents.
+class KnownHash {
+ public:
+  KnownHash(const std::string& key, uint64_t hash) : prev_key_(key_), prev_hash_(hash_) {
+    key_ = &key;
+    hash_ = hash;
+  }
+  ~KnownHash() {
+    key_ = prev_key_;
+    hash_ = prev_hash_;
+  }
+  KnownHash(const KnownHash&) = delete;
+  KnownHash& operator=(const KnownHash&) = delete;
+
+ private:
+  friend struct KeyHasher;
+  static inline thread_local const std::string* key_ = nullptr;
+  static inline thread_local uint64_t hash_ = 0;
+  const std::string* prev_key_;
+  uint64_t prev_hash_;
+};
+
+// Hasher for every key-indexed table (index, hot tier sketch).
+struct KeyHasher {
+  size_t operator()(const std::string& key) const {
+    if (&key == KnownHash::key_) return static_cast<size_t>(KnownHash::hash_);
+    return static_cast<size_t>(HashKey(key));
+  }
+};
+
+}  // namespace kv
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kv {
+
+// One key's entry in a hint file: where its latest value sits in the log.
+struct HintEntry {
+  uint64_t hash = 0;        // HashKey(key); the file is sorted by it
+  uint64_t key_offset = 0;  // into the key area that follows the entries
+  uint64_t value_offset = 0;
+  uint64_t size = 0;        // as stored
+  uint64_t raw_size = 0;
+  uint32_t key_len = 0;
+  uint32_t crc = 0;
+  uint8_t codec = 0;
+  uint8_t has_crc = 0;
+  uint8_t reserved[6] = {};
+};
+static_assert(sizeof(HintEntry) == 56, "on-disk layout");
+
+// <log>.hint: a snapshot of the index as of a log offset (`covers`), written
+// on Close and after compaction. A store opening in the background answers
+// reads from it, plus the log written after `covers`, while replay rebuilds
+// the real index. Only the header is checksummed, so that opening stays
+// O(1); values served through it are checked against their record CRC.
+//
+// Sorts `entries` by hash and fills in their key offsets.
+bool WriteHintFile(const std::string& path, uint64_t log_id, uint64_t covers,
+                   std::vector<std::pair<HintEntry, std::string>>* entries);
+
+// Read side: mmap'ed, binary search by hash.
+class HintFile {
+ public:
+  HintFile() = default;
+  ~HintFile();
+  HintFile(const HintFile&) = delete;
+  HintFile& operator=(const HintFile&) = delete;
+
+  // False if missing, damaged, or written for another log file (`log_id`,
+  // see LogFileId).
+  bool Open(const std::string& path, uint64_t log_id);
+  void Close();
+
+  uint64_t covers() const { return covers_; }
+  uint64_t count() const { return count_; }
+  bool Find(const std::string& key, uint64_t hash, HintEntry* out) const;
+
+ private:
+  char* map_ = nullptr;
+  size_t map_size_ = 0;
+  const HintEntry* entries_ = nullptr;
+  const char* keys_ = nullptr;
+  uint64_t keys_bytes_ = 0;
+  uint64_t count_ = 0;
+  uint64_t covers_ = 0;
+};
+
+}  // namespace kv
@@ -0,0 +1,112 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kv {
+
+// Lower value runs first.
+enum class IoPriority {
+  kRead = 0,
+  kWrite = 1,
+  kBackground = 2,  // compaction, scrubbing, admin
+};
+constexpr int kIoPriorities = 3;
+
+struct IoPoolOptions {
+  int threads = 4;
+  // Pin worker i to CPU (pin_first_cpu + i) mod the CPU count; -1 leaves
+  // them to the scheduler.
+  int pin_first_cpu = -1;
+  // Submit() fails when the priority's queue holds this many tasks. The
+  // background queue is short, so a burst of admin calls is refused at once
+  // instead of tying up the callers' threads while it waits its turn.
+  size_t max_queued = 1024;
+  size_t max_background_queued = 2;
+  // Background tasks running at once; the other workers stay free for reads
+  // and writes. Compactions of one store would only queue on its lock.
+  int background_threads = 1;
+  // A task that has waited this long runs next whatever its priority, so a
+  // steady stream of reads cannot starve the other queues forever.
+  std::chrono::milliseconds aging{100};
+};
+
+struct IoQueueStats {
+  uint64_t queued = 0;     // waiting now
+  uint64_t executed = 0;
+  uint64_t rejected = 0;   // queue full
+  uint64_t cancelled = 0;  // Run() gave up before the task started
+  uint64_t wait_us_total = 0;
+  uint64_t wait_us_max = 0;
+  uint64_t wait_us_p50 = 0;  // upper bounds of power-of-two buckets
+  uint64_t wait_us_p99 = 0;
+};
+
+// Fixed pool of threads for storage calls, fed from one FIFO queue per
+// priority, so a request never waits for a disk read or a compaction on the
+// thread that owns its connection. Workers take the oldest task of the most
+// urgent non-empty queue, except that a task older than `aging` goes first,
+// and run at most `background_threads` background tasks at a time. Queue
+// wait (submission to start) is recorded per priority.
+class IoPool {
+ public:
+  explicit IoPool(const IoPoolOptions& options = IoPoolOptions());
+  // Runs what is already queued, then joins the workers.
+  ~IoPool();
+  IoPool(const IoPool&) = delete;
+  IoPool& operator=(const IoPool&) = delete;
+
+  // False if the priority's queue is full.
+  bool Submit(IoPriority priority, std::function<void()> fn);
+
+  // Runs fn on the pool and waits for it. False, with fn never run, if the
+  // queue is full or fn has not started within `timeout`; once it starts,
+  // waits for it to finish. fn may refer to the caller's stack.
+  bool Run(IoPriority priority, const std::function<void()>& fn, std::chrono::milliseconds timeout);
+
+  IoQueueStats Stats(IoPriority priority) const;
+  int threads() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  static constexpr int kWaitBuckets = 32;  // bucket b: wait < 2^b us
+
+  struct Task {
+    std::function<void()> fn;
+    Clock::time_point queued_at;
+    int priority = 0;
+  };
+  struct Queue {
+    std::deque<Task> tasks;
+    uint64_t executed = 0;
+    uint64_t rejected = 0;
+    uint64_t cancelled = 0;
+    uint64_t wait_us_total = 0;
+    uint64_t wait_us_max = 0;
+    uint64_t wait_hist[kWaitBuckets] = {};
+  };
+
+  void Work(int index);
+  // The queue the next task comes from, or -1 if none may run now; caller
+  // holds mu_.
+  int PickLocked(Clock::time_point now) const;
+  // Pops from queue `p` and records the wait; caller holds mu_.
+  Task PopLocked(int p, Clock::time_point now);
+
+  IoPoolOptions options_;
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  Queue queues_[kIoPriorities];
+  size_t queued_ = 0;
+  int running_background_ = 0;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace kv
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kv {
+
+// FSST-style static symbol table for short strings such as keys: up to 255
+// symbols of 1-8 bytes, each replaced by a one-byte code; other bytes are
+// escaped. Encoding is deterministic, so two keys are equal exactly when
+// their encodings are, and lookups can hash and compare encoded keys.
+class KeySymbolTable {
+ public:
+  static constexpr uint8_t kEscape = 255;
+  static constexpr size_t kMaxSymbolLen = 8;
+
+  // Builds a table from sample keys (a few hundred to a few thousand is plenty).
+  static std::unique_ptr<KeySymbolTable> Train(const std::vector<std::string>& samples);
+
+  void Encode(const std::string& key, std::string* out) const;
+  std::string Decode(const std::string& code) const;
+
+  size_t symbols() const { return symbols_.size(); }
+
+ private:
+  explicit KeySymbolTable(std::vector<std::string> symbols);
+
+  std::vector<std::string> symbols_;  // code -> bytes
+  // Symbols as little-endian words for 8-byte compares: symbol `code` matches
+  // input word w when (w & sym_mask_[code]) == sym_word_[code].
+  std::vector<uint64_t> sym_word_;
+  std::vector<uint64_t> sym_mask_;
+  // Symbols of 2+ bytes grouped by their first two bytes, longest first:
+  // group b0b1 is multi_[multi_start_[b0b1] .. multi_start_[b0b1 + 1]).
+  std::vector<uint32_t> multi_start_;
+  std::vector<uint8_t> multi_;
+  int16_t single_[256];  // code of the 1-byte symbol for each byte, or -1
+};
+
+}  // namespace kv
@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <cstdint>
 #include <optional>
@@ -6,48 +8,548 @@
 #include <unordered_map>
 #include <shared_mutex>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "kvstore/compression.h"
+#include "kvstore/cuckoo_map.h"
+#include "kvstore/frequency_sketch.h"
+#include "kvstore/hash.h"
+#include "kvstore/hint_file.h"
+#include "kvstore/key_codec.h"
+#include "kvstore/large_pages.h"
+#include "kvstore/log_format.h"
+#include "kvstore/log_tail.h"
+#include "kvstore/persistent_index.h"
+#include "kvstore/rate_limiter.h"
+#include "kvstore/sorted_table.h"
+#include "kvstore/static_table.h"
 
 namespace kv {
 
 struct Entry {
   uint64_t offset = 0;  // where value bytes begin in the log file
-  uint64_t size = 0;    // number of bytes in the value
+  uint64_t size = 0;    // number of bytes in the value (as stored, i.e. compressed)
   bool in_memory = false;
-  std::string cached;   // optional cache (used for non-persistent mode)
+  uint8_t codec = 0;    // Codec of the stored bytes
+  bool has_crc = false; // the record carries a checksum (see log_format.h)
+  uint64_t raw_size = 0;  // decoded size when codec != 0
+  std::string cached;   // optional cache (non-persistent mode, or a hot value in persistent mode)
+  uint32_t hot_slot = 0;  // position in KVStore::hot_ while a persistent entry is in_memory
+  uint32_t crc = 0;
+};
+
+// Where Compact() places records in the new log.
+enum class CompactionOrder {
+  kIndex,     // index iteration order: effectively random
+  kKey,       // sorted by key, so neighbouring keys share pages
+  kCoAccess,  // keys read by the same MultiGet together, then by key
+};
+
+struct Options {
+  // Persistent mode only. Frequently read values stay resident in Entry::cached
+  // (as in in-memory mode) up to this many bytes; colder values are read from
+  // the log. Promotion and eviction follow an access-frequency sketch.
+  // 0 disables the hot tier. Ignored with persistent_index,
+  // concurrent_index or mutable_log_bytes: Stats().hot_bytes stays 0.
+  uint64_t hot_cache_bytes = 0;
+
+  // Persistent mode only. Values of at least this many bytes are LZ-compressed
+  // in the log when that makes them smaller; 0 disables compression.
+  uint64_t compress_min_bytes = 0;
+  // With compression on, train a shared dictionary (<log>.dict) from the first
+  // values written and compress later values against it. Small values with
+  // common structure (JSON documents, say) rarely compress on their own.
+  bool compress_dictionary = false;
+
+  // Keep index keys encoded with a symbol table trained on the first keys
+  // inserted. Saves memory when keys share structure (user:123:profile);
+  // lookups encode the probe key once and compare encoded keys.
+  bool compress_keys = false;
+
+  // Keep the newest part of the log in memory (a FASTER-style hybrid log)
+  // instead of writing every record to the file. A Put to a key whose record
+  // is in the mutable region, the newest `mutable_log_bytes`, overwrites that
+  // record in place when the new one is the same length (same value size,
+  // stored raw), so counters and sessions that rewrite the same keys add no
+  // log. When the region fills it turns read-only, where updates append a new
+  // record, and the read-only region before it is written to the file. Up to
+  // twice this many bytes of acknowledged writes are lost if the process dies;
+  // Write(), Close() and Compact() flush everything first. 0 disables;
+  // ignored with persistent_index or concurrent_index. The hot tier is not
+  // used in this mode.
+  uint64_t mutable_log_bytes = 0;
+
+  // Check the record checksum of every value read from the log by Get.
+  // Replay and compaction always check.
+  bool verify_checksums = false;
+
+  // Keep the index in <log>.idx, an mmap'ed hash table, instead of
+  // rebuilding it in memory from the whole log on open: opening replays only
+  // the log written since the table's last checkpoint, and index memory is
+  // page cache rather than heap. Costs a log read per lookup to confirm the
+  // key. The hot tier and key compression are not used in this mode.
+  bool persistent_index = false;
+
+  // Return from the constructor at once and replay the log on a background
+  // thread. Until it finishes, Get answers from <log>.hint (written on Close
+  // and after compaction) plus the log written since; without a usable hint
+  // it waits for the replay. Writes wait for the replay. See Recovery().
+  // Ignored with persistent_index, which opens without a full replay anyway.
+  bool background_recovery = false;
+
+  // Index keys in a CuckooMap (striped locks) instead of an unordered_map
+  // behind the store's reader-writer lock. Get takes no store-wide lock, so
+  // reads run alongside writes and each other; in memory, writes to
+  // different keys run in parallel too, while with a log they still take
+  // turns appending. Readers may see a WriteBatch partly applied. The hot
+  // tier and key compression are not used in this mode; ignored with
+  // persistent_index.
+  bool concurrent_index = false;
+
+  // The path names a StaticTable (kvtool build) rather than a log. The store
+  // is read-only: the file is mmap'ed, nothing is replayed, and writes
+  // return false. Only verify_checksums applies.
+  bool static_table = false;
+
+  // The path names a SortedTable (kvtool compact --sorted). Read-only like
+  // static_table, but only the table's block index and filter are held in
+  // memory, so it serves key sets larger than RAM, and Scan() walks it in
+  // key order. Only verify_checksums applies.
+  bool sorted_table = false;
+
+  // Compact() splits the live keys into partitions by key hash and rewrites
+  // them on this many threads, each into its own precomputed range of the new
+  // log, which is still committed with one rename. 1 keeps the single pass in
+  // index order. Not used with persistent_index.
+  int compaction_threads = 1;
+
+  // Record layout of the compacted log, so that keys read together share
+  // pages. kCoAccess has MultiGet note which keys it was asked for (up to
+  // kMaxCoAccessKeys keys, the latest group a key was read in wins).
+  CompactionOrder compaction_order = CompactionOrder::kIndex;
+
+  // Persistent mode only. Grows the log's allocation this many bytes at a
+  // time (fallocate, keeping the file size) rather than block by block as
+  // appends arrive: fewer metadata updates and less fragmentation. The
+  // excess is released on Close and when the log is next opened. 0 disables.
+  uint64_t preallocate_bytes = 0;
+
+  // Page-cache hints: point reads use a descriptor marked POSIX_FADV_RANDOM,
+  // so a Get does not read ahead pages it won't use; replay and compaction
+  // stream through the log and then drop what they read or wrote
+  // (POSIX_FADV_DONTNEED), so they don't push the working set out.
+  bool access_hints = false;
+
+  // Back the in-memory index with huge pages, so random lookups over a large
+  // index miss the TLB less: the unordered_map's nodes and buckets (from 2 MB
+  // chunks), or the concurrent index's bucket array. kExplicit draws on the
+  // hugetlb pool and falls back to transparent huge pages. Values (Entry::
+  // cached) stay on the heap.
+  HugePages huge_pages = HugePages::kOff;
+  // Prefer this NUMA node for the same structures. -1 leaves it to the
+  // kernel, which uses the node of whichever thread first touches a page:
+  // usually the one that replayed the log, not the ones that serve it. A
+  // store opened for one socket's threads can pass CurrentNumaNode().
+  int numa_node = -1;
+
+  // Publish how far the log has been written to <log>.wm (log_tail.h), for
+  // read_only_follower stores in other processes on this host. Costs an
+  // atomic store per append, plus a wake-up syscall while a follower is
+  // waiting for one.
+  bool publish_watermark = false;
+
+  // The path names a log that a store in another process on this host
+  // writes with publish_watermark. The store is read-only: it maps the log,
+  // builds its own index from it, then follows the writer's watermark,
+  // applying whole records and batches as they are published and replaying
+  // the log again after the writer compacts it. Writes return false; see
+  // Follower() for how far behind it is. Only verify_checksums, huge_pages,
+  // numa_node and follow_poll_ms apply.
+  bool read_only_follower = false;
+  // A publish wakes the follower at once; while the writer is idle it
+  // rechecks this often, which bounds FollowerStatus::staleness_ms.
+  int follow_poll_ms = 10;
+
+  // Budget for background I/O (Scrub, Compact). Share one limiter between
+  // stores to cap them together; null means unthrottled. Compact() holds the
+  // store's write lock throughout, so throttling it makes writers wait longer.
+  std::shared_ptr<RateLimiter> background_io;
+};
+
+struct ScrubOptions {
+  // Copy damaged ranges to <log>.quarantine and drop the index entries that
+  // point into them or disagree with the log (see KVStore::Scrub).
+  bool quarantine = false;
+};
+
+struct ScrubReport {
+  struct BadRange {
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    std::string reason;
+  };
+  uint64_t bytes_scanned = 0;
+  uint64_t records = 0;
+  uint64_t checksum_failures = 0;
+  uint64_t index_mismatches = 0;  // entries whose offset/size/crc match no record
+  uint64_t keys_quarantined = 0;
+  std::vector<BadRange> bad_ranges;
+  // False when a compaction replaced the log mid-scan; the index was not
+  // cross-checked and nothing was quarantined.
+  bool complete = true;
+
+  bool clean() const { return bad_ranges.empty() && index_mismatches == 0; }
+};
+
+struct RecoveryStatus {
+  bool ready = true;           // the index is complete; every call is served normally
+  bool serving_reads = false;  // not ready, but Get is answered from the hint file
+  bool failed = false;         // replay failed (see error); reads miss, writes fail
+  std::string error;
+  uint64_t replayed_bytes = 0;
+  uint64_t total_bytes = 0;
+};
+
+struct FollowerStatus {
+  bool following = false;        // Options::read_only_follower
+  uint64_t applied_bytes = 0;    // of the log, in this store's index
+  uint64_t published_bytes = 0;  // the writer's watermark
+  // Time since the index last held everything the writer had published:
+  // no read misses a write older than this.
+  uint64_t staleness_ms = 0;
+  uint64_t reloads = 0;  // replays after the writer replaced the log
+  std::string error;     // why following is stuck, if it is
+};
+
+// A group of writes applied atomically: after a crash either all of them
+// are recovered or none are.
+struct WriteBatch {
+  struct Op {
+    std::string key;
+    std::optional<std::string> value;  // nullopt == delete
+  };
+  std::vector<Op> ops;
+
+  void Put(const std::string& key, const std::string& value) { ops.push_back({key, value}); }
+  void Del(const std::string& key) { ops.push_back({key, std::nullopt}); }
+};
+
+struct StoreStats {
+  uint64_t keys = 0;
+  uint64_t puts = 0;
+  uint64_t gets = 0;
+  uint64_t dels = 0;
+  uint64_t log_bytes = 0;      // current size of the log
+  uint64_t garbage_bytes = 0;  // superseded bytes Compact() would reclaim
+  uint64_t compactions = 0;
+  uint64_t hot_hits = 0;     // Gets served from memory (hot tier)
+  uint64_t hot_misses = 0;   // Gets that went to the log
+  uint64_t hot_bytes = 0;    // value bytes resident in the hot tier
+  uint64_t hot_keys = 0;
+  uint64_t compressed_values = 0;  // values written compressed
+  uint64_t compress_in_bytes = 0;  // ...their raw size
+  uint64_t compress_out_bytes = 0; // ...and their size in the log
+  uint64_t decompress_ns = 0;      // time Gets spent decompressing
+  bool has_dictionary = false;
+  uint64_t checksum_verifies = 0;  // values checked on read
+  uint64_t checksum_failures = 0;  // ...that did not match, plus bad records skipped at replay
+  uint64_t checksum_ns = 0;        // time spent checking on read
+  uint64_t scrubs = 0;
+  uint64_t scrub_problems = 0;     // bad ranges plus index mismatches found by Scrub
+  uint64_t in_place_updates = 0;   // Puts that overwrote a record in the hybrid log's mutable region
+  uint64_t unflushed_bytes = 0;    // hybrid log held in memory, not yet in the file
 };
 
 class KVStore {
  public:
   KVStore();
-  explicit KVStore(const std::string& log_path);
+  // In-memory, like KVStore(); only concurrent_index, huge_pages and
+  // numa_node apply.
+  explicit KVStore(const Options& options);
+  explicit KVStore(const std::string& log_path, const Options& options = Options());
+  ~KVStore();
 
   bool Put(const std::string& key, const std::string& value);
   std::optional<std::string> Get(const std::string& key) const;
+  // `hash` must be HashKey(key); callers that already have it skip rehashing.
+  std::optional<std::string> Get(const std::string& key, uint64_t hash) const;
+  // Hashes all keys in one pass, then looks them up under a single lock.
+  std::vector<std::optional<std::string>> MultiGet(const std::vector<std::string>& keys) const;
   bool Del(const std::string& key);
+  bool Write(const WriteBatch& batch);
+
+  // Calls fn(key, value) for each key in [start, end) in key order (empty
+  // `end`: to the last key) until it returns false. Sorted tables only; false
+  // otherwise, or if a block could not be read or failed its checksum.
+  bool Scan(const std::string& start, const std::string& end,
+            const std::function<bool(const std::string&, const std::string&)>& fn) const;
+
+  StoreStats Stats() const;
 
   // Week 3:
   bool Compact();  // rewrite log to keep only latest live keys
 
+  // Walks the log as of the call, checking record framing and every
+  // checksum, then cross-checks each index entry against the record it points
+  // at. Reads go through Options::background_io and no lock is held while
+  // scanning, so foreground requests are not stalled.
+  ScrubReport Scrub(const ScrubOptions& options = ScrubOptions());
+
+  // Progress of Options::background_recovery; lock-free, so it answers while
+  // the replay holds the store.
+  RecoveryStatus Recovery() const;
+  // Tests only: runs on the background recovery thread once the hint is
+  // loaded, before the replay, so a test can hold the replay back.
+  static inline std::function<void()> before_replay_for_testing;
+
+  // Options::read_only_follower: how far behind the writer this store is.
+  FollowerStatus Follower() const;
+
   void Close();
 
  private:
+  friend class NamespaceStore;  // locks several stores for cross-namespace batches
+
   bool persistence_enabled_ = false;
   std::string log_path_;
+  Options options_;
   mutable std::shared_mutex mu_;
-  std::unordered_map<std::string, Entry> index_;
+  // mutable: Get() may promote a value into the hot tier (under a unique lock)
+  using Index = std::unordered_map<std::string, Entry, KeyHasher, std::equal_to<std::string>,
+                                   ArenaAllocator<std::pair<const std::string, Entry>>>;
+  mutable Index index_;
   std::ofstream log_out_;
-  mutable std::ifstream log_in_;
+  mutable int log_fd_ = -1;  // for reads (pread), opened lazily under io_mu_
+  // Options::preallocate_bytes: descriptor for fallocate, and how far the
+  // allocation reaches; guarded by mu_
+  int prealloc_fd_ = -1;
+  uint64_t prealloc_end_ = 0;
   mutable std::mutex io_mu_;
 
+  // metrics; counters are atomic because Get only holds a shared lock
+  mutable std::atomic<uint64_t> gets_{0};
+  std::atomic<uint64_t> puts_{0};
+  std::atomic<uint64_t> dels_{0};
+  uint64_t log_bytes_ = 0;    // guarded by mu_
+  uint64_t live_bytes_ = 0;   // bytes of records the index points at; guarded by mu_
+  uint64_t compactions_ = 0;  // guarded by mu_
+
+  // hot tier (Options::hot_cache_bytes); hot_ and hot_bytes_ are guarded by mu_
+  using IndexNode = Index::value_type;
+  std::unique_ptr<FrequencySketch> sketch_;
+  mutable std::vector<IndexNode*> hot_;
+  mutable uint64_t hot_bytes_ = 0;
+  mutable uint64_t hot_rng_ = 0x9e3779b97f4a7c15ull;
+  mutable std::atomic<uint64_t> hot_hits_{0};
+  mutable std::atomic<uint64_t> hot_misses_{0};
+
+  // compression (Options::compress_min_bytes); guarded by mu_ unless noted
+  // Published once through dict_ (any thread may load it); dict_owner_ keeps
+  // it alive with the store.
+  std::unique_ptr<LzDictionary> dict_owner_;
+  std::atomic<const LzDictionary*> dict_{nullptr};
+  std::vector<std::string> dict_samples_;
+  bool dict_trained_ = false;           // training ran (it may have found nothing)
+  uint64_t compressed_values_ = 0;
+  uint64_t compress_in_bytes_ = 0;
+  uint64_t compress_out_bytes_ = 0;
+  mutable std::atomic<uint64_t> decompress_ns_{0};
+
+  // checksums; atomic because Get only holds a shared lock
+  mutable std::atomic<uint64_t> checksum_verifies_{0};
+  mutable std::atomic<uint64_t> checksum_failures_{0};
+  mutable std::atomic<uint64_t> checksum_ns_{0};
+
+  std::atomic<uint64_t> scrubs_{0};
+  std::atomic<uint64_t> scrub_problems_{0};
+
+  // persistent index (Options::persistent_index); stands in for index_
+  std::unique_ptr<PersistentIndex> pindex_;
+  uint64_t pindex_checkpointed_ = 0;  // log offset of the last checkpoint; guarded by mu_
+
+  // background recovery (Options::background_recovery). The replay thread
+  // holds mu_ throughout; Get bypasses it through the hint while
+  // hint_state_ is kServing, under a shared hint_mu_.
+  enum class RecoveryState { kReplaying, kReady, kFailed };
+  enum class HintState { kLoading, kServing, kUnavailable, kRetired };
+  std::thread recovery_thread_;
+  std::atomic<RecoveryState> recovery_state_{RecoveryState::kReady};
+  std::atomic<uint64_t> replayed_bytes_{0};
+  std::atomic<uint64_t> replay_total_{0};
+  mutable std::mutex recovery_mu_;  // guards the three below
+  mutable std::condition_variable recovery_cv_;
+  HintState hint_state_ = HintState::kUnavailable;
+  std::string recovery_error_;
+  mutable std::shared_mutex hint_mu_;
+  HintFile hint_;
+  std::unordered_map<std::string, std::optional<Entry>> hint_tail_;  // log past hint_.covers()
+
+  // Options::concurrent_index; stands in for index_. Get skips mu_, so
+  // Compact() makes compaction_seq_ odd while it moves offsets and swaps the
+  // log, and a Get that overlaps that retries under mu_.
+  using ConcurrentIndex = CuckooMap<Entry>;
+  std::unique_ptr<ConcurrentIndex> cindex_;
+  std::atomic<uint64_t> compaction_seq_{0};
+
+  // hybrid log (Options::mutable_log_bytes); guarded by mu_ unless noted.
+  // Log addresses from hlog_flushed_ on are in hlog_tail_ rather than the
+  // file; from hlog_read_only_ on they are the mutable region.
+  std::string hlog_tail_;
+  std::atomic<uint64_t> hlog_flushed_{0};  // atomic: hinted Gets check it without mu_
+  uint64_t hlog_read_only_ = 0;
+  std::atomic<uint64_t> in_place_updates_{0};
+
+  // Options::compaction_order == kCoAccess: key hash -> co-access group
+  static constexpr size_t kMaxCoAccessKeys = 1 << 20;
+  mutable std::mutex co_access_mu_;  // guards the two below
+  mutable std::unordered_map<uint64_t, uint64_t> co_access_;
+  mutable uint64_t co_access_groups_ = 0;
+
+  // Options::publish_watermark, and the writer's mark a follower reads
+  std::unique_ptr<LogWatermark> watermark_;
+  uint64_t watermark_file_id_ = 0;  // LogFileId of the log; guarded by mu_
+
+  // Options::read_only_follower. Only the follow thread replaces or remaps
+  // mapped_, holding mu_ exclusively; Gets read values from it under a
+  // shared mu_.
+  std::unique_ptr<MappedLog> mapped_;
+  std::thread follow_thread_;
+  std::atomic<bool> follow_stop_{false};
+  std::atomic<uint64_t> followed_bytes_{0};
+  std::atomic<int64_t> caught_up_ns_{0};  // steady clock
+  std::atomic<uint64_t> follow_reloads_{0};
+  mutable std::mutex follow_mu_;  // guards follow_error_
+  std::string follow_error_;
+
+  // Options::static_table; set in the constructor, read-only afterwards
+  std::unique_ptr<StaticTable> static_;
+  // Options::sorted_table; likewise
+  std::unique_ptr<SortedTable> sorted_;
+
+  // key compression (Options::compress_keys); set once under a unique lock
+  std::unique_ptr<KeySymbolTable> key_table_;
+
   bool OpenFiles();
+  // Options::huge_pages and numa_node
+  MemoryPlacement Placement() const { return MemoryPlacement{options_.huge_pages, options_.numa_node}; }
+  void PlaceIndex();  // after cindex_ and pindex_ are chosen
   void CloseFiles();
 
+  // index key for `key`: itself, or its encoding in *scratch (caller holds mu_)
+  const std::string& IndexKey(const std::string& key, std::string* scratch) const;
+  std::string UserKey(const std::string& index_key) const;
+  void MaybeTrainKeys();
+
+  // index updates that keep garbage accounting in sync (caller holds mu_)
+  void IndexPut(const std::string& key, Entry e, const std::string* value = nullptr);
+  bool IndexDel(const std::string& key);
+  bool WriteLocked(const WriteBatch& batch);
+  // Every index entry, whichever table holds it (caller holds mu_ exclusively
+  // to modify entries; with cindex_, under a ConcurrentIndex::AllLocked).
+  void ForEachEntry(const std::function<void(const std::string& index_key, Entry& e)>& fn);
+  // Get under a shared lock; sets *promote to the value's offset when it is
+  // worth promoting into the hot tier once the lock is dropped.
+  std::optional<std::string> GetLocked(const std::string& key, uint64_t hash,
+                                       std::optional<uint64_t>* promote) const;
+
+  // compression (caller holds mu_ exclusively for EncodeValue)
+  const std::string& EncodeValue(const std::string& value, std::string* scratch,
+                                 ValueEncoding* enc);
+  void SampleForDictionary(const std::string& value);
+  // Publishes a trained or loaded dictionary once; later calls are ignored.
+  void SetDictionary(std::unique_ptr<LzDictionary> dict);
+  const LzDictionary* Dictionary() const { return dict_.load(std::memory_order_acquire); }
+  ValueEncoding EncodingOf(const Entry& e) const;
+  std::optional<std::string> DecodeStored(const Entry& e, std::string stored) const;
+
+  // persistent index (caller holds mu_; exclusively for updates)
+  std::string IndexFilePath() const;
+  uint64_t OpenPersistentIndex();  // returns the log offset replay starts from
+  PersistentIndex::IsKey SlotHasKey(const std::string& key) const;
+  // Finds `key` and reads its whole record into *record.
+  const IndexSlot* FindSlot(const std::string& key, uint64_t hash, std::string* record) const;
+  // Parses the record a slot points at; *key, if given, gets its key.
+  bool SlotEntry(const IndexSlot& slot, const std::string& record, Entry* e,
+                 std::string* key = nullptr) const;
+  void MaybeCheckpointIndex();
+  bool CheckpointIndex(bool clean);
+  bool CompactPersistentIndex();
+
+  // Compact() writers (caller holds mu_ exclusively): write the live records
+  // to `tmp` and report where each entry's record landed, the keys whose
+  // value could not be read back, the file's size and its live bytes.
+  struct Moved {
+    Entry* entry;
+    uint64_t offset;
+    uint32_t crc;
+  };
+  struct LayoutItem {
+    Entry* entry;
+    std::string key;
+  };
+  // Live entries in Options::compaction_order (not kIndex).
+  std::vector<LayoutItem> LayoutOrder();
+  void NoteCoAccess(const std::vector<uint64_t>& hashes) const;
+  bool WriteCompacted(const std::string& tmp, std::vector<Moved>* moved,
+                      std::vector<std::string>* lost, uint64_t* size, uint64_t* live);
+  bool WriteCompactedPartitioned(const std::string& tmp, int threads, std::vector<Moved>* moved,
+                                 std::vector<std::string>* lost, uint64_t* size, uint64_t* live);
+
+  // background recovery
+  void RecoverInBackground();
+  void LoadHint();  // hint_ plus hint_tail_, then publishes hint_state_
+  // False if the hint can't answer (recovery finished or there is no hint);
+  // the caller then goes through the index, waiting on mu_ if need be.
+  bool GetFromHint(const std::string& key, uint64_t hash, std::optional<std::string>* value) const;
+  std::string HintFilePath() const;
+  bool HintsEnabled() const;
+  void WriteHint();  // caller holds mu_
+
+  // publish_watermark (caller holds mu_); new_file once the log was replaced
+  std::string WatermarkPath() const;
+  void PublishWatermark(bool new_file = false);
+
+  // read_only_follower
+  void OpenFollower();
+  // Maps the log the watermark names, indexes it up to the mark off to the
+  // side, then swaps the result in.
+  bool FollowReplay(std::string* err);
+  // Applies what was published past followed_bytes_, up to a chunk at a time.
+  bool FollowTail(const LogWatermark::Mark& mark, std::string* err);
+  void FollowLoop();
+  void ApplyFollowed(const LogRecord& rec, Index* index, uint64_t* live) const;
+
+  std::optional<std::string> GetStatic(const std::string& key) const;
+  std::optional<std::string> GetSorted(const std::string& key) const;
+
+  // hybrid log (caller holds mu_ exclusively)
+  bool HybridLog() const;
+  bool UpdateInPlace(const std::string& key, const std::string& value);
+  // Writes the log up to address `upto` from memory to the file.
+  bool FlushHybridLog(uint64_t upto);
+
+  // hot tier (caller holds mu_ exclusively)
+  void Promote(const std::string& key, uint64_t offset, const std::string& value) const;
+  bool AdmitHot(IndexNode* node, const std::string& value) const;
+  void EvictHot(IndexNode* node) const;
+
   // persistence
-  bool AppendPut(const std::string& key, const std::string& value, uint64_t* value_offset_out);
+  void Preallocate(uint64_t file_end);  // caller holds mu_ exclusively
+  bool AppendRecords(const std::string& records, uint64_t* start_offset_out);
+  // Fills e's offset/size/codec for the record it wrote.
+  bool AppendPut(const std::string& key, const std::string& value, Entry* e);
   bool AppendDel(const std::string& key);
 
-  void ReplayLog();
+  void RecoverInterruptedCompaction();
+  void ReplayLog();  // caller holds mu_ exclusively
+  // Throws if a record needs a codec or dictionary this store lacks.
+  Entry ReplayedEntry(const LogRecord& rec) const;
   std::optional<std::string> ReadValueAt(uint64_t offset, uint64_t size) const;
+  std::optional<std::string> ReadLogFile(uint64_t offset, uint64_t size) const;  // pread, no lock
+  bool VerifyStored(const std::string& key, const Entry& e, const std::string& stored) const;
 };
 
 }  // namespace kv
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kv {
+
+enum class HugePages {
+  kOff,
+  kTransparent,  // madvise(MADV_HUGEPAGE) on 2 MB-aligned mappings
+  kExplicit,     // MAP_HUGETLB from the reserved pool, else kTransparent
+};
+
+// Where large in-memory structures go (Options::huge_pages, numa_node).
+struct MemoryPlacement {
+  HugePages huge_pages = HugePages::kOff;
+  int numa_node = -1;  // preferred node; -1: the kernel's default (first touch)
+
+  bool enabled() const { return huge_pages != HugePages::kOff || numa_node >= 0; }
+};
+
+// The NUMA node of the CPU the calling thread runs on (0 if unknown).
+int CurrentNumaNode();
+
+// Anonymous zeroed memory placed as asked; nullptr if it could not be mapped.
+// NUMA placement is a preference (MPOL_PREFERRED), and huge pages are best
+// effort: the mapping still succeeds with small pages. Free with UnmapLarge
+// and the same size and placement.
+void* MapLarge(size_t bytes, const MemoryPlacement& placement);
+void UnmapLarge(void* p, size_t bytes, const MemoryPlacement& placement);
+
+// Allocations for one container carved from MapLarge'd 2 MB chunks: small
+// blocks (hash nodes) come from the chunks with a free list per size, larger
+// ones (bucket arrays) get a mapping each. Not thread-safe; the container it
+// serves already serializes its changes.
+class LargePageArena {
+ public:
+  static constexpr size_t kChunkBytes = 2u << 20;
+  static constexpr size_t kMaxSmallBytes = 64u << 10;
+
+  explicit LargePageArena(const MemoryPlacement& placement)
+      : placement_(placement), free_(kMaxSmallBytes / kAlign + 1) {}
+  ~LargePageArena();
+  LargePageArena(const LargePageArena&) = delete;
+  LargePageArena& operator=(const LargePageArena&) = delete;
+
+  void* Allocate(size_t bytes);  // throws std::bad_alloc
+  void Deallocate(void* p, size_t bytes);
+
+  uint64_t mapped_bytes() const { return mapped_bytes_; }
+
+ private:
+  static constexpr size_t kAlign = 16;
+
+  MemoryPlacement placement_;
+  std::vector<void*> free_;  // free-list heads by size class
+  std::vector<void*> chunks_;
+  char* next_ = nullptr;  // unused tail of the newest chunk
+  size_t left_ = 0;
+  uint64_t mapped_bytes_ = 0;
+};
+
+// Standard allocator over a shared LargePageArena; without one it is
+// std::allocator, so a container can default-construct with it.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() = default;
+  explicit ArenaAllocator(std::shared_ptr<LargePageArena> arena) : arena_(std::move(arena)) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (!arena_) return std::allocator<T>().allocate(n);
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t n) {
+    if (!arena_) return std::allocator<T>().deallocate(p, n);
+    arena_->Deallocate(p, n * sizeof(T));
+  }
+
+  const std::shared_ptr<LargePageArena>& arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+ private:
+  static_assert(alignof(T) <= 16, "arena blocks are 16-byte aligned");
+  std::shared_ptr<LargePageArena> arena_;
+};
+
+}  // namespace kv
@@ -0,0 +1,149 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kv {
+
+// Binary request/response protocol for clients on the same host, without
+// TCP or HTTP parsing. Every message is a frame: a u32 body length, then
+//
+//   request:  u8 op, u16 namespace length, u32 key length, namespace, key,
+//             value (the rest; Put only)
+//   response: u8 status, value (the rest; Get only)
+//
+// An empty namespace is the server's default store. Frames travel over a Unix
+// domain socket, or, after a kShm request on one, over a pair of
+// shared-memory rings (see LocalClient::Connect).
+enum class LocalOp : uint8_t {
+  kGet = 'G',
+  kPut = 'P',
+  kDel = 'D',
+  kShm = 'S',  // switch this connection to rings; the reply carries a memfd
+};
+
+enum class LocalStatus : uint8_t {
+  kOk = 0,
+  kNotFound = 1,  // Get of an absent key, Del of one that was not there
+  kError = 2,
+};
+
+struct LocalRequest {
+  LocalOp op = LocalOp::kGet;
+  std::string ns;
+  std::string key;
+  std::string value;
+};
+
+struct LocalResponse {
+  LocalStatus status = LocalStatus::kError;
+  std::string value;
+};
+
+using LocalHandler = std::function<LocalResponse(const LocalRequest&)>;
+
+// One direction of a shared-memory channel: a single-producer,
+// single-consumer ring of frames. Head and tail are free-running byte
+// counts on their own cache lines. A consumer that finds the ring empty
+// spins briefly (not on a single CPU), then sleeps on a futex in the shared
+// mapping, which the producer wakes only if someone is asleep.
+class ShmRing {
+ public:
+  static constexpr size_t kHeaderBytes = 256;
+
+  // Over `bytes` of shared memory (kHeaderBytes + a power of two), zeroed
+  // by whoever created it.
+  ShmRing(void* mem, size_t bytes);
+
+  size_t max_frame() const { return capacity_ - 4; }
+
+  // False if the frame would not fit in the free space.
+  bool Write(const std::string& body);
+  // Waits up to `timeout_ms` for a frame; false if none arrived. The other
+  // side can write anything into the mapping: a frame whose length or tail
+  // is out of bounds breaks the ring, and Read fails from then on.
+  bool Read(std::string* body, int timeout_ms);
+  bool broken() const { return broken_; }
+
+ private:
+  struct Header;
+
+  void CopyIn(uint64_t at, const char* src, size_t n);
+  void CopyOut(uint64_t at, char* dst, size_t n) const;
+
+  Header* h_;
+  char* data_;
+  size_t capacity_;
+  int spins_;
+  bool broken_ = false;
+};
+
+// Serves a LocalHandler on a Unix domain socket, one thread per connection;
+// a connection that switched to rings keeps its thread, polling them.
+class LocalServer {
+ public:
+  // Ring capacity per direction for kShm connections; larger frames fail.
+  static constexpr size_t kRingBytes = 4u << 20;
+
+  explicit LocalServer(LocalHandler handler) : handler_(std::move(handler)) {}
+  ~LocalServer() { Stop(); }
+  LocalServer(const LocalServer&) = delete;
+  LocalServer& operator=(const LocalServer&) = delete;
+
+  // Binds `path` (replacing a stale socket file) and starts accepting.
+  bool Listen(const std::string& path, std::string* err);
+  // Closes the listener and every connection, and waits for their threads.
+  void Stop();
+
+ private:
+  void AcceptLoop();
+  void Serve(int fd);
+  void ServeRings(int fd);
+
+  LocalHandler handler_;
+  std::string path_;
+  int listen_fd_ = -1;
+  std::atomic<bool> stop_{false};
+  std::thread acceptor_;
+  std::mutex mu_;  // guards conn_fds_
+  std::condition_variable idle_;
+  std::vector<int> conn_fds_;  // one per (detached) connection thread
+};
+
+// Client for a LocalServer. Not thread-safe: one outstanding call per
+// client, so give each thread its own.
+class LocalClient {
+ public:
+  LocalClient() = default;
+  ~LocalClient();
+  LocalClient(const LocalClient&) = delete;
+  LocalClient& operator=(const LocalClient&) = delete;
+
+  // With `shared_memory`, later calls go through a ring pair the server maps
+  // for this client (frames up to LocalServer::kRingBytes - 4), and the
+  // socket only tells each side that the other is gone.
+  bool Connect(const std::string& path, bool shared_memory, std::string* err);
+
+  // False if the call did not complete (server gone, frame too large).
+  bool Call(const LocalRequest& req, LocalResponse* resp);
+
+  LocalStatus Get(const std::string& key, std::string* value, const std::string& ns = "");
+  LocalStatus Put(const std::string& key, const std::string& value, const std::string& ns = "");
+  LocalStatus Del(const std::string& key, const std::string& ns = "");
+
+ private:
+  int fd_ = -1;
+  void* shm_ = nullptr;
+  size_t shm_bytes_ = 0;
+  std::unique_ptr<ShmRing> requests_;
+  std::unique_ptr<ShmRing> responses_;
+};
+
+}  // namespace kv
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace kv {
+
+// On-disk record layout (see docs/archtitecture.md):
+//   PUT <key> <value_size>[ c=<codec> r=<raw_size>[ d=<dict_id>]] crc=<8 hex>\n<value_bytes>\n
+//   DEL <key> crc=<8 hex>\n
+//   BEGIN <count>\n   followed by <count> PUT/DEL records applied atomically
+// crc is the CRC32C of the key followed by the stored value bytes (PUT) or of
+// the key alone (DEL). Records written before checksums existed have none.
+
+// How a PUT's stored bytes map back to the value (codecs: see compression.h).
+struct ValueEncoding {
+  uint8_t codec = 0;      // 0: stored bytes are the value
+  uint64_t raw_size = 0;  // decoded size when codec != 0
+  uint32_t dict_id = 0;   // shared dictionary the value was compressed against, if any
+};
+
+// Record headers separate fields with whitespace, so a key must be non-empty
+// and contain none.
+bool ValidKey(const std::string& key);
+
+// Encoders append a complete record to `out`. EncodePut can also hand back
+// the record's checksum.
+void EncodePut(std::string* out, const std::string& key, const std::string& value,
+               const ValueEncoding& enc = ValueEncoding(), uint32_t* crc_out = nullptr);
+void EncodeDel(std::string* out, const std::string& key);
+void EncodeBegin(std::string* out, uint64_t count);
+
+// Length of the PUT header line, i.e. value offset relative to record start.
+// Records from before checksums were added have no crc attribute.
+uint64_t PutHeaderSize(const std::string& key, uint64_t value_size,
+                       const ValueEncoding& enc = ValueEncoding(), bool has_crc = true);
+
+enum class RecordOp { kPut, kDel, kBegin };
+
+struct LogRecord {
+  RecordOp op = RecordOp::kPut;
+  std::string key;
+  uint64_t offset = 0;        // where the record header begins
+  uint64_t value_offset = 0;  // PUT only: where value bytes begin
+  uint64_t value_size = 0;    // PUT only: stored bytes
+  ValueEncoding enc;          // PUT only
+  uint64_t count = 0;         // BEGIN only: records in the batch
+  uint64_t end = 0;           // one past the record's final newline
+  bool has_crc = false;       // PUT/DEL
+  uint32_t crc = 0;
+  // False when a checksum was verified and did not match. DEL checksums are
+  // always verified; PUT checksums only by a LogReader with verify_values.
+  bool checksum_ok = true;
+};
+
+// Parses a PUT header line (without its newline) into rec's key,
+// value_size, enc, has_crc and crc.
+bool ParsePutHeader(const std::string& header, LogRecord* rec);
+
+// Checksum a PUT (value = stored bytes) or DEL (value empty) record carries.
+uint32_t RecordChecksum(const std::string& key, const char* value, size_t value_size);
+
+// Sequential scanner over an append-only log. Value bytes are skipped, not
+// read, so a full pass costs roughly one read of the headers, unless
+// `verify_values` asks for every PUT checksum to be checked.
+class LogReader {
+ public:
+  enum class Status {
+    kOk,         // more records may follow
+    kEof,        // clean end of file
+    kTruncated,  // final record is incomplete (crash mid-write)
+    kBadHeader,  // known op with unparsable fields
+    kUnknownOp,  // header line is not a record we understand
+  };
+
+  explicit LogReader(const std::string& path, bool verify_values = false);
+  // Scans [data, data + size) instead, e.g. a mapped log up to a published
+  // watermark; `size` stands in for the end of the file.
+  LogReader(const char* data, uint64_t size, bool verify_values = false);
+
+  bool is_open() const { return data_ != nullptr || in_.is_open(); }
+
+  // Reads the next record into `rec`. Returns false when scanning stops;
+  // status() says why and offset() is where the offending record begins.
+  bool Next(LogRecord* rec);
+
+  // Reads the next unit that takes effect atomically: a single PUT/DEL, or
+  // every record of a BEGIN batch (the BEGIN itself is not included). A batch
+  // cut short by the end of the log reports kTruncated at the BEGIN offset.
+  bool NextGroup(std::vector<LogRecord>* group);
+
+  // Restarts scanning at `offset`, which should be a record boundary.
+  void Seek(uint64_t offset);
+
+  Status status() const { return status_; }
+  uint64_t offset() const { return offset_; }
+
+ private:
+  // Input, from the file or the span.
+  Status ReadLine(std::string* line);  // kOk, kEof, or kTruncated for a line without its newline
+  bool ReadBytes(char* out, size_t n);
+  void SkipBytes(uint64_t n);
+  bool ReadNewline();
+
+  std::ifstream in_;
+  const char* data_ = nullptr;
+  uint64_t size_ = 0;
+  uint64_t pos_ = 0;  // in the span
+  bool verify_values_ = false;
+  std::string value_buf_;
+  Status status_ = Status::kOk;
+  uint64_t offset_ = 0;
+};
+
+const char* LogStatusName(LogReader::Status s);
+
+// Reads `rec`'s value through `in` and checks the trailing newline and, when
+// the record has one, the checksum.
+bool ReadRecordValue(std::ifstream& in, const LogRecord& rec, std::string* value);
+
+}  // namespace kv
@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace kv {
+
+// How far a log's writer has got, shared through <log>.wm with read-only
+// followers in other processes on the same host (Options::publish_watermark,
+// Options::read_only_follower). The file is one mmap'ed page: the writer
+// stores the log's identity (LogFileId) and the end of the last whole record
+// it wrote, and followers read the pair under a sequence lock, then parse the
+// log up to that point and no further, so they never see half a record or
+// half a batch. The mark counts what the writer handed to the kernel, not
+// what was fsynced: it survives the writer's crash, not the host's.
+class LogWatermark {
+ public:
+  struct Mark {
+    uint64_t file_id = 0;  // 0: nothing published yet
+    uint64_t bytes = 0;
+  };
+
+  LogWatermark() = default;
+  ~LogWatermark();
+  LogWatermark(const LogWatermark&) = delete;
+  LogWatermark& operator=(const LogWatermark&) = delete;
+
+  // The writer creates the file if need be; a follower needs it to exist.
+  bool Open(const std::string& path, bool writer, std::string* err);
+
+  // Writer only: one writer per log.
+  void Publish(uint64_t file_id, uint64_t bytes);
+
+  Mark Read() const;
+  // Bumped by every Publish; pass it to Wait to sleep until the next one.
+  uint32_t version() const;
+  // Returns after a Publish that follows `seen`, or after `timeout`. The
+  // writer makes the wake-up syscall only while someone is waiting.
+  void Wait(uint32_t seen, std::chrono::milliseconds timeout) const;
+
+ private:
+  struct Page;
+  Page* page_ = nullptr;
+};
+
+// A read-only shared mapping of a log that another process appends to. The
+// mapping reserves address space past the end of the file, so it rarely has
+// to be redone as the file grows; only bytes the writer has published are
+// ever touched.
+class MappedLog {
+ public:
+  MappedLog() = default;
+  ~MappedLog();
+  MappedLog(const MappedLog&) = delete;
+  MappedLog& operator=(const MappedLog&) = delete;
+
+  // Maps the file `path` names now; file_id() tells which one that was.
+  bool Open(const std::string& path, std::string* err);
+  // Makes [0, size) readable, remapping when size is past the reservation.
+  // Pointers from data() are invalid after a remap.
+  bool Reserve(uint64_t size);
+
+  const char* data() const { return data_; }
+  uint64_t mapped() const { return mapped_; }
+  uint64_t file_id() const { return file_id_; }
+
+ private:
+  int fd_ = -1;
+  const char* data_ = nullptr;
+  uint64_t mapped_ = 0;
+  uint64_t file_id_ = 0;
+};
+
+}  // namespace kv
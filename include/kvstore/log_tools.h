@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "kvstore/log_format.h"
+
+namespace kv {
+
+// Offline utilities that work directly on an AOF file (no KVStore needed).
+// They back the `kvtool` binary; see src/kvtool.cpp.
+
+struct ScanSummary {
+  uint64_t records = 0;
+  uint64_t puts = 0;
+  uint64_t dels = 0;
+  uint64_t file_size = 0;
+  uint64_t valid_bytes = 0;  // end of the last good record
+  LogReader::Status status = LogReader::Status::kEof;
+};
+
+// Latest PUT per live key, sorted by offset in the log.
+bool CollectLive(const std::string& path, std::vector<LogRecord>* live, ScanSummary* summary);
+
+enum class DumpFormat { kBinary, kJsonLines };
+
+// Streams every live key/value to `out`. Values are read by `threads` workers
+// in bounded batches and written in log order.
+bool DumpLog(const std::string& path, DumpFormat fmt, std::ostream& out, int threads,
+             std::string* err);
+
+// Appends every record from a dump to the log at `log_path`.
+bool LoadDump(std::istream& in, DumpFormat fmt, const std::string& log_path, uint64_t* loaded,
+              std::string* err);
+
+struct VerifyReport {
+  bool ok = true;
+  uint64_t records = 0;
+  uint64_t bytes = 0;              // bytes covered by valid records
+  uint64_t first_bad_offset = 0;   // only meaningful when !ok
+  std::string reason;
+};
+
+// Checks record framing, then re-reads every value on `threads` workers.
+VerifyReport VerifyLog(const std::string& path, int threads);
+
+struct LogStats {
+  ScanSummary scan;
+  uint64_t live_keys = 0;
+  uint64_t live_bytes = 0;        // bytes a compacted log would hold
+  double garbage_ratio = 0.0;     // 1 - live_bytes / file_size
+  uint64_t compressed_values = 0;        // live values stored with a codec
+  uint64_t compressed_raw_bytes = 0;     // ...their decoded size
+  uint64_t compressed_stored_bytes = 0;  // ...and their size in the log
+  // Power-of-two histograms over live records (decoded value sizes): bucket i counts sizes in [2^(i-1), 2^i).
+  std::vector<uint64_t> key_size_hist;
+  std::vector<uint64_t> value_size_hist;
+};
+
+bool ComputeLogStats(const std::string& path, LogStats* stats);
+
+// Writes a compacted copy of `in_path` to `out_path` (they may be equal, in
+// which case the result replaces the input atomically). Compressed records are
+// copied without re-encoding, along with the log's dictionary.
+bool CompactLogFile(const std::string& in_path, const std::string& out_path, int threads,
+                    std::string* err);
+
+struct StaticBuildReport {
+  uint64_t keys = 0;
+  uint64_t file_bytes = 0;
+  double index_bits_per_key = 0;  // perfect hash only, see StaticTable
+  uint32_t attempts = 0;
+};
+
+// Writes the live keys of a log as an immutable StaticTable (kvtool build).
+// Values are decoded, and checked against their checksums, on `threads`
+// workers.
+bool BuildStaticTable(const std::string& log_path, const std::string& out_path, int threads,
+                      StaticBuildReport* report, std::string* err);
+
+struct SortedBuildReport {
+  uint64_t keys = 0;
+  uint64_t blocks = 0;
+  uint64_t file_bytes = 0;
+  uint64_t resident_bytes = 0;  // index and filter, see SortedTable
+};
+
+// Writes the live keys of a log in key order as a SortedTable (kvtool compact
+// --sorted). Values are decoded and checked as in BuildStaticTable.
+bool CompactToSortedTable(const std::string& log_path, const std::string& out_path, int threads,
+                          SortedBuildReport* report, std::string* err);
+
+}  // namespace kv
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+
+namespace kv {
+
+// The set of live files in a store directory, kept in <dir>/MANIFEST so that
+// opening the directory never depends on listing it. The file is a snapshot
+// followed by version edits, each appended and fsynced before the change it
+// describes is relied on:
+//   kvmanifest 1
+//   file <name> <file> crc=<8 hex>   (snapshot)
+//   add <name> <file> crc=<8 hex>    (edits)
+//   del <name> crc=<8 hex>
+// crc is the CRC32C of the line before " crc=". Loading stops at the first
+// torn or damaged edit, which is then cut off. Checkpoint() rewrites the
+// manifest as a snapshot of just the current file set; that also happens by
+// itself every kCheckpointEdits edits.
+class Manifest {
+ public:
+  static constexpr int kCheckpointEdits = 64;
+
+  // Reads <dir>/MANIFEST if it exists. Returns false, with *err set, only if
+  // the manifest exists but cannot be used.
+  bool Open(const std::string& dir, std::string* err);
+  bool exists() const { return exists_; }
+
+  // name -> file, relative to the directory
+  const std::map<std::string, std::string>& files() const { return files_; }
+
+  bool Add(const std::string& name, const std::string& file);
+  bool Remove(const std::string& name);
+
+  // Replaces the manifest with a snapshot (atomic; see ReplaceFile).
+  bool Checkpoint();
+
+  uint64_t edits_since_checkpoint() const { return edits_; }
+
+ private:
+  std::string path_;
+  bool exists_ = false;
+  std::map<std::string, std::string> files_;
+  std::ofstream out_;
+  uint64_t edits_ = 0;
+
+  bool AppendEdit(const std::string& edit);
+};
+
+}  // namespace kv
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "kvstore/kvstore.h"
+#include "kvstore/manifest.h"
+
+namespace kv {
+
+// When a namespace is worth compacting; checked by NamespaceStore::CompactDue().
+struct CompactionPolicy {
+  double min_garbage_ratio = 0.5;           // garbage / log size
+  uint64_t min_garbage_bytes = 1ull << 20;  // skip tiny logs
+};
+
+struct NamespaceOp {
+  std::string ns;
+  std::string key;
+  std::optional<std::string> value;  // nullopt == delete
+};
+
+// Named, independent KVStores ("column families"). Each namespace has its own
+// index, lock, log (<dir>/<name>.aof), metrics and compaction policy, so one
+// tenant's overwrite storm neither blocks nor forces compaction of another.
+//
+// The namespaces are listed in <dir>/MANIFEST (see manifest.h), and opening
+// the directory replays exactly those logs, in parallel. A directory without
+// a manifest is listed once and gets one.
+//
+// Cross-namespace batches go through a one-slot redo log (<dir>/_batches.aof):
+// the whole batch is written and flushed there first (the commit point), then
+// applied to each namespace's log, then the slot is cleared. Recovery re-applies
+// a complete batch left in the slot; a torn one was never committed. Names and
+// keys are checked before the commit point; a namespace that still fails its
+// part (an I/O error, after retries) leaves the batch partly applied, and
+// Write returns false.
+class NamespaceStore {
+ public:
+  NamespaceStore();  // in-memory namespaces
+  // `options` applies to every namespace's store.
+  explicit NamespaceStore(const std::string& dir, const Options& options = Options());
+
+  // [A-Za-z0-9_-]{1,64}, not starting with '_' (reserved).
+  static bool ValidName(const std::string& name);
+
+  KVStore* Find(const std::string& name) const;  // nullptr if absent
+  KVStore* Open(const std::string& name);        // creates on first use; nullptr if invalid
+  std::vector<std::string> Names() const;
+
+  // Applies every op atomically, across any number of namespaces.
+  bool Write(const std::vector<NamespaceOp>& ops);
+
+  void SetCompactionPolicy(const std::string& name, const CompactionPolicy& policy);
+
+  // Compacts every namespace over its policy threshold; returns their names.
+  std::vector<std::string> CompactDue();
+
+ private:
+  struct Namespace {
+    std::unique_ptr<KVStore> store;
+    CompactionPolicy policy;
+  };
+
+  bool persistent_ = false;
+  std::string dir_;
+  Options options_;
+
+  mutable std::shared_mutex mu_;  // guards namespaces_ and manifest_ (not the stores themselves)
+  std::map<std::string, Namespace> namespaces_;
+  Manifest manifest_;
+
+  std::mutex batch_mu_;  // one cross-namespace batch at a time; taken before store locks
+  std::ofstream batch_log_;
+
+  std::string LogPathFor(const std::string& name) const;
+  std::string BatchLogPath() const;
+  void OpenAll();
+  void RecoverBatches();  // throws if a committed batch cannot be applied
+  void ClearBatchLog();
+};
+
+}  // namespace kv
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace kv {
+
+// One key's latest record in the log. Slots hold a hash, not the key: a
+// match is confirmed by reading the record's key from the log.
+struct IndexSlot {
+  uint64_t hash = 0;           // HashKey(key)
+  uint64_t record_offset = 0;  // where the PUT record (header line) begins
+  uint32_t record_len = 0;     // header through the value's trailing newline
+  uint32_t header_len = 0;     // 0: empty (record_len 0) or deleted (record_len 1)
+  uint64_t reserved = 0;
+
+  bool live() const { return header_len != 0; }
+  uint64_t value_offset() const { return record_offset + header_len; }
+  uint64_t value_size() const { return record_len - header_len - 1; }
+};
+static_assert(sizeof(IndexSlot) == 32, "slots must not straddle pages");
+
+// Open-addressing (linear probing) hash table of IndexSlots in a file, used
+// through mmap so that opening it costs nothing up front: pages fault in as
+// lookups touch them.
+//
+// The log is the table's write-ahead log. Updates go straight to the mapped
+// pages, which the kernel may write back at any time; Checkpoint() syncs
+// them and then records `applied`, the log offset the table is known to
+// cover. Recovery replays the log from `applied`. Re-applying a record the
+// table already reflects is harmless, and after an unclean shutdown the
+// counters are recomputed with Recount().
+class PersistentIndex {
+ public:
+  static constexpr uint64_t kMinCapacity = 1024;
+
+  // Says whether `slot` is the key being looked up (reads the log).
+  using IsKey = std::function<bool(const IndexSlot& slot)>;
+
+  PersistentIndex() = default;
+  ~PersistentIndex();
+  PersistentIndex(const PersistentIndex&) = delete;
+  PersistentIndex& operator=(const PersistentIndex&) = delete;
+
+  // Maps an existing table. False if it is missing, damaged, or was built
+  // for a different log file (`log_id`); Create() then starts over.
+  bool Open(const std::string& path, uint64_t log_id);
+  bool Create(const std::string& path, uint64_t log_id, uint64_t capacity = kMinCapacity);
+  void Close();
+
+  const IndexSlot* Find(uint64_t hash, const IsKey& is_key) const;
+  // Points the key at `slot`; *replaced is the slot it had (not live() if
+  // none). False only if the table is full and could not grow.
+  bool Put(const IndexSlot& slot, const IsKey& is_key, IndexSlot* replaced);
+  // Returns the removed slot (not live() if the key was absent).
+  IndexSlot Del(uint64_t hash, const IsKey& is_key);
+
+  void ForEach(const std::function<void(const IndexSlot&)>& fn) const;
+
+  uint64_t count() const { return count_; }
+  uint64_t live_bytes() const { return live_bytes_; }
+  uint64_t applied() const { return applied_; }
+  bool was_clean() const { return was_clean_; }  // last run ended with Checkpoint(.., true)
+  uint64_t capacity() const { return capacity_; }
+
+  // Syncs every page, then the header recording `applied`. `clean` marks an
+  // orderly shutdown, after which the counters need no Recount().
+  bool Checkpoint(uint64_t applied, bool clean);
+  // Recomputes the counters from the slots. False if a slot points past
+  // `log_size`: after a power loss the table's pages can be newer than the
+  // log's, and the table can't be trusted.
+  bool Recount(uint64_t log_size);
+
+ private:
+  struct Header;
+
+  std::string path_;
+  int fd_ = -1;
+  char* map_ = nullptr;
+  size_t map_size_ = 0;
+  IndexSlot* slots_ = nullptr;
+  uint64_t capacity_ = 0;
+  uint64_t count_ = 0;
+  uint64_t tombstones_ = 0;
+  uint64_t live_bytes_ = 0;
+  uint64_t applied_ = 0;
+  uint64_t log_id_ = 0;
+  bool was_clean_ = false;
+
+  bool Map(const std::string& path, size_t size, bool create);
+  void Unmap();
+  bool WriteHeader(bool clean);
+  // Where the key lives, or where it would be inserted (*found false).
+  size_t Probe(uint64_t hash, const IsKey& is_key, bool* found) const;
+  bool Grow();
+};
+
+// Identifies a log file (device and inode); a compaction or restore
+// replaces the file and so invalidates tables built for the old one.
+uint64_t LogFileId(const std::string& path);
+// The same id for a file already open, e.g. one mapped while it is replaced.
+uint64_t LogFileIdOf(int fd);
+
+}  // namespace kv
@@ -0,0 +1,248 @@
+#pragma once
+#include "kvstore/kvstore.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kv {
+
+// Replicates Put/Del across a group of 3 or 5 processes with Raft (leader
+// election, log replication, snapshots; no membership changes). Each node
+// keeps, under RaftOptions::dir:
+//
+//   raft.meta      current term, vote and snapshot point (replaced atomically)
+//   raft.log       entries past the snapshot, one record each:
+//                    E <index> <term> <P|D|N> <key_size> <value_size> crc=<8 hex>\n<key><value>\n
+//                  fsynced before the node acknowledges them
+//   state.aof      the state machine: a KVStore that committed entries are
+//                  applied to, in log order
+//   snapshot.aof   a compacted copy of state.aof as of the snapshot point,
+//                  which the leader streams to followers that fall behind it
+//
+// Applying a run of entries again over a state that already contains it
+// leaves the state unchanged, so after a restart the node re-applies
+// everything past the snapshot instead of tracking what reached state.aof.
+struct RaftPeer {
+  int id = 0;
+  std::string host;
+  int port = 0;
+};
+
+// "1=127.0.0.1:9101,2=127.0.0.1:9102,..."
+bool ParseRaftPeers(const std::string& spec, std::vector<RaftPeer>* peers, std::string* err);
+
+struct RaftOptions {
+  int id = 0;
+  std::vector<RaftPeer> peers;  // every member, this node included
+  std::string dir;
+  Options store_options;  // for state.aof
+
+  std::chrono::milliseconds heartbeat{50};
+  // A follower that hears nothing from a leader for a random time in
+  // [election_timeout, 2 * election_timeout) starts an election. One that has
+  // heard from a leader within election_timeout refuses to vote, which is
+  // what makes leases safe.
+  std::chrono::milliseconds election_timeout{300};
+  // The leader serves reads without a round trip until
+  // lease_fraction * election_timeout after it sent the latest heartbeat or
+  // append that a majority acknowledged. Below 1 to allow for clock drift.
+  double lease_fraction = 0.9;
+
+  // One AppendEntries carries up to this many entries / bytes of them, and
+  // up to max_inflight of them may await a reply per follower.
+  size_t max_batch_entries = 512;
+  size_t max_batch_bytes = 1 << 20;
+  int max_inflight = 8;
+
+  // Compact state.aof into a snapshot and drop the log before it once this
+  // many entries have been applied since the last one.
+  uint64_t snapshot_entries = 100000;
+  size_t snapshot_chunk_bytes = 1 << 20;
+
+  // fdatasync raft.log before acknowledging entries. Off only for tests and
+  // benchmarks of the protocol itself.
+  bool sync = true;
+  // Put/Del/Get give up after this long without a commit (or a lease).
+  std::chrono::milliseconds request_timeout{5000};
+};
+
+enum class RaftRole { kFollower, kCandidate, kLeader };
+
+struct RaftPeerStatus {
+  int id = 0;
+  bool connected = false;
+  uint64_t match_index = 0;
+  uint64_t next_index = 0;
+};
+
+struct RaftStatus {
+  int id = 0;
+  RaftRole role = RaftRole::kFollower;
+  uint64_t term = 0;
+  int leader = 0;  // 0: unknown
+  uint64_t last_index = 0;
+  uint64_t commit_index = 0;
+  uint64_t applied_index = 0;
+  uint64_t snapshot_index = 0;
+  int64_t lease_ms = 0;  // leader: lease left; <= 0 means reads must wait
+  uint64_t append_batches = 0;  // AppendEntries sent (leader) or accepted (follower)
+  uint64_t appended_entries = 0;
+  uint64_t log_syncs = 0;
+  uint64_t snapshots_taken = 0;
+  uint64_t snapshots_installed = 0;
+  std::vector<RaftPeerStatus> peers;
+};
+
+class RaftNode {
+ public:
+  explicit RaftNode(const RaftOptions& options);
+  // Stops, if still running.
+  ~RaftNode();
+  RaftNode(const RaftNode&) = delete;
+  RaftNode& operator=(const RaftNode&) = delete;
+
+  // Loads the node's state from disk, listens on its own peer address and
+  // starts the election timer.
+  bool Start(std::string* err);
+  void Stop();
+
+  // Commit through the log, then apply. False with *err set if this node is
+  // not the leader ("not leader"), loses leadership before the entry
+  // commits, or times out. Del sets *existed when the key was there.
+  bool Put(const std::string& key, const std::string& value, std::string* err);
+  bool Del(const std::string& key, bool* existed, std::string* err);
+  // Linearizable: served by the leader while its lease holds, once the
+  // state machine has caught up with the commit index. nullopt in *value
+  // for an absent key.
+  bool Get(const std::string& key, std::optional<std::string>* value, std::string* err);
+  // The local state machine as it stands, on any node: may be stale.
+  std::optional<std::string> GetLocal(const std::string& key);
+
+  RaftStatus Status();
+  int id() const { return options_.id; }
+
+ private:
+  struct Entry {
+    uint64_t term = 0;
+    char type = 'N';  // P: put, D: del, N: the no-op a new leader commits
+    std::string key;
+    std::string value;
+    uint64_t offset = 0;  // in raft.log
+  };
+  struct Link;
+  struct Waiter;
+  using Clock = std::chrono::steady_clock;
+
+  // Persistence (caller holds mu_).
+  bool LoadLocked(std::string* err);
+  bool SaveMetaLocked();
+  bool AppendToFileLocked(uint64_t from_index);
+  bool TruncateFileLocked(uint64_t from_index);
+  bool RewriteFileLocked();
+  bool SyncLogLocked();
+  uint64_t LastIndexLocked() const;
+  uint64_t TermAtLocked(uint64_t index) const;  // 0 if unknown
+  const Entry& EntryAtLocked(uint64_t index) const;
+
+  // Roles (caller holds mu_).
+  void BecomeFollowerLocked(uint64_t term, int leader);
+  void StartElectionLocked();
+  void BecomeLeaderLocked();
+  void ResetElectionTimerLocked();
+  void AdvanceCommitLocked();
+  // Send time of the newest message a majority has answered (counting now
+  // for this node), and the lease it buys.
+  Clock::time_point QuorumAckLocked() const;
+  Clock::time_point LeaseExpiryLocked() const;
+
+  bool Propose(char type, const std::string& key, const std::string& value, bool* result,
+               std::string* err);
+
+  // Threads.
+  void Ticker();
+  void Syncer();
+  void Applier();
+  void AcceptLoop();
+  void ServeConn(int fd);
+  void SendLoop(Link* link);
+  void ReadLoop(Link* link, int fd);
+
+  // Messages.
+  std::string HandleVote(const std::string& body);
+  std::string HandleAppend(const std::string& body);
+  std::string HandleSnapshot(const std::string& body);
+  void OnVoteReply(Link* link, const std::string& body);
+  void OnAppendReply(Link* link, const std::string& body);
+  void OnSnapshotReply(Link* link, const std::string& body);
+  // The next message for `link`, or "" if nothing is due; caller holds mu_.
+  std::string NextMessageLocked(Link* link, Clock::time_point now);
+
+  bool TakeSnapshot();  // on the applier thread, holding store_mu_ shared
+  bool InstallSnapshotLocked(uint64_t index, uint64_t term, const std::string& file);
+
+  std::string MetaPath() const;
+  std::string LogPath() const;
+  std::string StatePath() const;
+  std::string SnapshotPath() const;
+
+  RaftOptions options_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;          // any change of raft state
+  std::condition_variable applied_cv_;  // applied_ advanced
+  bool running_ = false;
+  bool stop_ = false;
+
+  // Persistent state.
+  uint64_t term_ = 0;
+  int voted_for_ = 0;
+  uint64_t snapshot_index_ = 0;
+  uint64_t snapshot_term_ = 0;
+  std::deque<Entry> log_;  // log_[i] has index snapshot_index_ + 1 + i
+  int log_fd_ = -1;
+  std::mutex log_io_mu_;        // the syncer's fdatasync vs. truncating or replacing raft.log
+  uint64_t log_gen_ = 0;        // bumped when raft.log is truncated or replaced
+  uint64_t log_end_ = 0;        // raft.log size
+  uint64_t written_index_ = 0;  // in raft.log
+  uint64_t synced_index_ = 0;   // in raft.log and fsynced
+
+  // Volatile state.
+  RaftRole role_ = RaftRole::kFollower;
+  int leader_ = 0;
+  uint64_t commit_index_ = 0;
+  uint64_t applied_ = 0;
+  uint64_t leader_term_start_ = 0;  // index of the leader's no-op
+  Clock::time_point election_deadline_;
+  Clock::time_point last_leader_contact_;
+  int votes_ = 0;
+  std::mt19937 rng_;
+  std::map<uint64_t, Waiter*> waiters_;  // by log index
+  std::vector<std::unique_ptr<Link>> links_;
+  Clock::time_point leader_since_;
+  uint64_t snapshot_recv_bytes_ = 0;  // of the snapshot being received
+  RaftStatus counters_;
+
+  // state.aof; replaced whole when a snapshot is installed. Shared by
+  // readers and the applier, exclusive for the swap.
+  std::shared_mutex store_mu_;
+  std::unique_ptr<KVStore> store_;
+
+  int listen_fd_ = -1;
+  std::mutex conns_mu_;
+  std::vector<int> conn_fds_;
+  std::condition_variable conns_idle_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace kv
@@ -0,0 +1,38 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace kv {
+
+// Token bucket over bytes, shared by background I/O (scrubbing) so it can be
+// capped as a whole, across stores. Acquire() blocks the caller until its
+// bytes fit; requests larger than the burst are allowed and simply wait longer.
+class RateLimiter {
+ public:
+  // 0 means unlimited. The burst is 100 ms worth of bytes (at least 64 KiB).
+  explicit RateLimiter(uint64_t bytes_per_sec);
+
+  void Acquire(uint64_t bytes);
+
+  void SetRate(uint64_t bytes_per_sec);
+  uint64_t rate() const;
+
+  uint64_t total_bytes() const;  // bytes acquired so far
+  uint64_t waited_us() const;    // time callers spent blocked
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  mutable std::mutex mu_;
+  uint64_t rate_ = 0;
+  double burst_ = 0;
+  double available_ = 0;  // may go negative: debt the next callers wait off
+  Clock::time_point last_;
+  uint64_t total_bytes_ = 0;
+  uint64_t waited_us_ = 0;
+
+  void RefillLocked(Clock::time_point now);
+};
+
+}  // namespace kv
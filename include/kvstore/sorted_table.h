@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace kv {
+
+// An immutable key-sorted file (`kvtool compact --sorted`, then
+// Options::sorted_table). Layout:
+//
+//   data blocks | filter | index | footer (72 bytes)
+//
+// Data blocks hold ~4 KB of entries in key order. Keys are prefix-compressed
+// against the previous key, except at a restart point every 16 entries,
+// where they are stored whole; the restart offsets close the block, so a
+// lookup binary-searches them and decodes at most 16 entries. Each block is
+// followed by its CRC32C.
+//
+// The index has one entry per block, the block's last key, stored in
+// Eytzinger (BFS) order: a lookup descends it as an implicit binary tree,
+// without a data-dependent branch, and the first levels share cache lines.
+// The filter is a Bloom filter over every key (10 bits per key, ~1% false
+// positives), so most absent keys cost no block read. Only the index and the
+// filter are held in memory; blocks are read with pread as needed.
+class SortedTable {
+ public:
+  SortedTable() = default;
+  ~SortedTable();
+  SortedTable(const SortedTable&) = delete;
+  SortedTable& operator=(const SortedTable&) = delete;
+
+  // Reads the footer, index and filter, checking their checksums.
+  bool Open(const std::string& path, std::string* err);
+  void Close();
+
+  // With `verify`, the block's checksum is checked first; a mismatch sets
+  // *damaged and reads as absent.
+  bool Find(const std::string& key, std::string* value, bool verify, bool* damaged) const;
+
+  // Calls fn(key, value) for each key in [start, end) in order (empty `end`:
+  // no bound) until it returns false. Blocks are read front to back. False
+  // if a block could not be read or, with `verify`, failed its checksum.
+  bool Scan(const std::string& start, const std::string& end, bool verify,
+            const std::function<bool(const std::string&, const std::string&)>& fn) const;
+
+  uint64_t count() const { return count_; }
+  uint64_t blocks() const { return handles_.size(); }
+  uint64_t file_bytes() const { return file_bytes_; }
+  uint64_t resident_bytes() const;  // index and filter
+
+ private:
+  struct Handle {
+    uint64_t offset;
+    uint64_t size;  // without the crc trailer
+  };
+  struct IndexEntry {
+    uint32_t key_offset;  // into index_keys_
+    uint32_t key_len;
+    uint32_t block;
+  };
+
+  // First block whose last key is >= key; blocks() if none.
+  size_t LowerBoundBlock(const std::string& key) const;
+  bool ReadBlock(size_t block, bool verify, std::string* out) const;
+  bool MayContain(const std::string& key) const;
+
+  int fd_ = -1;
+  uint64_t file_bytes_ = 0;
+  uint64_t count_ = 0;
+  std::vector<Handle> handles_;     // file order
+  std::vector<IndexEntry> index_;   // Eytzinger order, 1-based (index_[0] unused)
+  std::string index_keys_;
+  std::string filter_;
+  uint32_t probes_ = 0;
+};
+
+// Writes a SortedTable in one pass from keys added in strictly increasing
+// order, to <path>.tmp, which Finish() moves into place.
+class SortedTableWriter {
+ public:
+  static constexpr size_t kBlockBytes = 4096;
+  static constexpr int kRestartInterval = 16;
+
+  bool Open(const std::string& path, std::string* err);
+  // False if `key` is not greater than the previous key or the write failed.
+  bool Add(const std::string& key, const std::string& value);
+  bool Finish(std::string* err);
+
+  uint64_t count() const { return count_; }
+
+ private:
+  bool FlushBlock();
+
+  std::string path_;
+  std::string tmp_;
+  std::ofstream out_;
+  uint64_t offset_ = 0;
+  uint64_t count_ = 0;
+  bool failed_ = false;
+
+  std::string block_;
+  std::vector<uint32_t> restarts_;
+  int since_restart_ = 0;
+  std::string last_key_;
+
+  struct BlockMeta {
+    uint64_t offset;
+    uint64_t size;
+    std::string last_key;
+  };
+  std::vector<BlockMeta> blocks_;
+  std::vector<uint64_t> hashes_;  // of every key, for the filter
+};
+
+}  // namespace kv
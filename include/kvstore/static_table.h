@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace kv {
+
+// An immutable key/value file for data that is built once and only read
+// (`kvtool build`, then Options::static_table). Layout:
+//
+//   header | pilots (u16 per bucket) | remap (u32 per spare slot)
+//          | slots (u64 per key: 16-bit fingerprint, 48-bit data offset)
+//          | data (records: u32 key_len, u32 value_len, u32 crc, key, value)
+//
+// The index is a minimal perfect hash (PTHash-style hash-and-displace):
+// keys are hashed into buckets, and each bucket stores the pilot that sends
+// all of its keys to free positions. Positions range over n / 0.99 slots,
+// and the few that land past n are remapped into the holes below it, so
+// every key gets its own one of n slots. That costs about 4.7 bits per key;
+// the slot array adds 8 bytes. A key not in the table still maps to some
+// slot, so the fingerprint rejects almost all of them and the stored key
+// the rest. Values are stored decoded, in log order.
+class StaticTable {
+ public:
+  StaticTable() = default;
+  ~StaticTable();
+  StaticTable(const StaticTable&) = delete;
+  StaticTable& operator=(const StaticTable&) = delete;
+
+  // Maps the file; checks the header and that the sections fit the file.
+  bool Open(const std::string& path, std::string* err);
+  void Close();
+
+  struct Record {
+    const char* value = nullptr;  // points into the mapping
+    uint64_t size = 0;
+    uint32_t crc = 0;  // RecordChecksum(key, value)
+  };
+  bool Find(const std::string& key, Record* rec) const;
+
+  uint64_t count() const { return count_; }
+  uint64_t file_bytes() const { return map_size_; }
+  double index_bits_per_key() const;  // pilots and remap, without the slots
+
+ private:
+  char* map_ = nullptr;
+  size_t map_size_ = 0;
+  uint64_t count_ = 0;
+  uint64_t buckets_ = 0;
+  uint64_t positions_ = 0;  // >= count_; positions past count_ go through remap_
+  uint64_t seed_ = 0;
+  const uint16_t* pilots_ = nullptr;
+  const uint32_t* remap_ = nullptr;
+  const uint64_t* slots_ = nullptr;
+  const char* data_ = nullptr;
+  uint64_t data_bytes_ = 0;
+};
+
+// Writes a StaticTable in one pass. Begin() builds the hash function from
+// every key and the value sizes (so data offsets are known up front); the
+// records then follow through AppendData(), in the same order as the keys.
+class StaticTableWriter {
+ public:
+  bool Begin(const std::string& path, const std::vector<std::string>& keys,
+             const std::vector<uint64_t>& value_sizes, std::string* err);
+  // Whole records, as encoded by EncodeStaticRecord.
+  bool AppendData(const std::string& records);
+  // Checks that every record arrived, then moves the file into place.
+  bool Finish(std::string* err);
+
+  uint32_t attempts() const { return attempts_; }  // seeds tried until the hash worked
+
+  static void EncodeStaticRecord(std::string* out, const std::string& key, const std::string& value);
+
+ private:
+  std::string path_;
+  std::string tmp_;
+  std::ofstream out_;
+  uint64_t data_expected_ = 0;
+  uint64_t data_written_ = 0;
+  uint32_t attempts_ = 0;
+};
+
+}  // namespace kv
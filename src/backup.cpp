@@ -0,0 +1,326 @@
+#include "kvstore/backup.h"
+#include "kvstore/compression.h"
+#include "kvstore/file_util.h"
+#include "kvstore/log_format.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace kv {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr uint64_t kFingerprintBytes = 4096;
+constexpr size_t kCopyBlock = 1 << 20;
+constexpr char kDictFile[] = "DICTIONARY";  // copy of <log>.dict, if the log has one
+
+struct Chunk {
+  uint64_t seq = 0;
+  std::string file;
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  uint64_t checksum = 0;
+};
+
+struct Manifest {
+  uint64_t generation = 0;
+  uint64_t next_seq = 1;
+  std::vector<Chunk> chunks;
+  // Fingerprints of the log's first and last kFingerprintBytes as of end().
+  uint64_t head_fp = 0;
+  uint64_t tail_fp = 0;
+
+  uint64_t end() const { return chunks.empty() ? 0 : chunks.back().end; }
+};
+
+uint64_t Fnv1a(uint64_t h, const char* p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    h ^= static_cast<unsigned char>(p[i]);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+constexpr uint64_t kFnvBasis = 14695981039346656037ull;
+
+// Hashes [begin, end) of an open stream.
+bool HashRange(std::istream& in, uint64_t begin, uint64_t end, uint64_t* out) {
+  in.clear();
+  in.seekg(static_cast<std::streamoff>(begin), std::ios::beg);
+  std::vector<char> buf(kCopyBlock);
+  uint64_t h = kFnvBasis;
+  uint64_t left = end - begin;
+  while (left > 0) {
+    size_t n = static_cast<size_t>(std::min<uint64_t>(left, buf.size()));
+    if (!in.read(buf.data(), static_cast<std::streamsize>(n))) return false;
+    h = Fnv1a(h, buf.data(), n);
+    left -= n;
+  }
+  *out = h;
+  return true;
+}
+
+bool Fingerprints(std::istream& in, uint64_t end, uint64_t* head, uint64_t* tail) {
+  uint64_t head_end = std::min(end, kFingerprintBytes);
+  uint64_t tail_begin = end > kFingerprintBytes ? end - kFingerprintBytes : 0;
+  return HashRange(in, 0, head_end, head) && HashRange(in, tail_begin, end, tail);
+}
+
+std::string ManifestPath(const std::string& dir) { return (fs::path(dir) / "MANIFEST").string(); }
+
+bool LoadManifest(const std::string& dir, Manifest* m, std::string* err) {
+  std::ifstream in(ManifestPath(dir));
+  if (!in) return true;  // first backup
+
+  std::string line;
+  if (!std::getline(in, line) || line != "kvbackup 1") {
+    if (err) *err = "unrecognized backup manifest in " + dir;
+    return false;
+  }
+  while (std::getline(in, line)) {
+    std::istringstream iss(line);
+    std::string tag;
+    iss >> tag;
+    if (tag == "generation") {
+      iss >> m->generation;
+    } else if (tag == "next_seq") {
+      iss >> m->next_seq;
+    } else if (tag == "fingerprint") {
+      iss >> m->head_fp >> m->tail_fp;
+    } else if (tag == "chunk") {
+      Chunk c;
+      iss >> c.seq >> c.file >> c.begin >> c.end >> c.checksum;
+      m->chunks.push_back(c);
+    } else if (!tag.empty()) {
+      if (err) *err = "bad manifest line: " + line;
+      return false;
+    }
+    if (!iss && !tag.empty()) {
+      if (err) *err = "bad manifest line: " + line;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Written to a temp file and renamed so a crash leaves the old or new manifest.
+bool StoreManifest(const std::string& dir, const Manifest& m) {
+  const std::string path = ManifestPath(dir);
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    if (!out) return false;
+    out << "kvbackup 1\n"
+        << "generation " << m.generation << "\n"
+        << "next_seq " << m.next_seq << "\n"
+        << "fingerprint " << m.head_fp << " " << m.tail_fp << "\n";
+    for (const auto& c : m.chunks) {
+      out << "chunk " << c.seq << " " << c.file << " " << c.begin << " " << c.end << " "
+          << c.checksum << "\n";
+    }
+    out.flush();
+    if (!out) return false;
+  }
+  return ReplaceFile(tmp, path);
+}
+
+std::string ChunkName(uint64_t seq) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "chunk-%06llu.aof", static_cast<unsigned long long>(seq));
+  return buf;
+}
+
+// Removes chunk files the manifest no longer references (old generations,
+// leftovers of an interrupted run).
+void RemoveUnreferenced(const std::string& dir, const Manifest& m) {
+  std::error_code ec;
+  for (const auto& ent : fs::directory_iterator(dir, ec)) {
+    std::string name = ent.path().filename().string();
+    if (name.rfind("chunk-", 0) != 0) continue;
+    bool live = false;
+    for (const auto& c : m.chunks) live = live || c.file == name;
+    if (!live) fs::remove(ent.path(), ec);
+  }
+}
+
+}  // namespace
+
+bool BackupLog(const std::string& log_path, const std::string& backup_dir, BackupResult* result,
+               std::string* err) {
+  std::error_code ec;
+  fs::create_directories(backup_dir, ec);
+
+  Manifest m;
+  if (!LoadManifest(backup_dir, &m, err)) return false;
+
+  // One handle for the whole run: if compaction swaps the log underneath us
+  // we keep reading the old, still-consistent file.
+  std::ifstream src(log_path, std::ios::binary);
+  if (!src) {
+    if (err) *err = "cannot open " + log_path;
+    return false;
+  }
+  src.seekg(0, std::ios::end);
+  const uint64_t size = static_cast<uint64_t>(src.tellg());
+
+  BackupResult res;
+  uint64_t begin = m.end();
+  bool full = m.chunks.empty();
+  if (!full) {
+    uint64_t head = 0, tail = 0;
+    full = size < begin || !Fingerprints(src, begin, &head, &tail) || head != m.head_fp ||
+           tail != m.tail_fp;
+  }
+  if (full && !m.chunks.empty()) {
+    m.generation++;
+    m.chunks.clear();
+  }
+  if (full) begin = 0;
+  res.full = full;
+  res.generation = m.generation;
+
+  // Copy everything past the previous end, then trim to the last complete record.
+  Chunk c;
+  c.seq = m.next_seq;
+  c.file = ChunkName(c.seq);
+  c.begin = begin;
+  const std::string chunk_path = (fs::path(backup_dir) / c.file).string();
+  {
+    std::ofstream out(chunk_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      if (err) *err = "cannot create " + chunk_path;
+      return false;
+    }
+    src.clear();
+    src.seekg(static_cast<std::streamoff>(begin), std::ios::beg);
+    std::vector<char> buf(kCopyBlock);
+    uint64_t left = size - begin;
+    while (left > 0) {
+      size_t n = static_cast<size_t>(std::min<uint64_t>(left, buf.size()));
+      if (!src.read(buf.data(), static_cast<std::streamsize>(n))) {
+        if (err) *err = "read failed on " + log_path;
+        return false;
+      }
+      out.write(buf.data(), static_cast<std::streamsize>(n));
+      left -= n;
+    }
+    out.flush();
+    if (!out) {
+      if (err) *err = "write failed on " + chunk_path;
+      return false;
+    }
+  }
+
+  uint64_t valid = 0;
+  {
+    LogReader reader(chunk_path);
+    std::vector<LogRecord> group;
+    while (reader.NextGroup(&group)) valid = group.back().end;
+  }
+  fs::resize_file(chunk_path, valid, ec);
+
+  if (valid > 0) {
+    c.end = begin + valid;
+    std::ifstream chunk_in(chunk_path, std::ios::binary);
+    if (!HashRange(chunk_in, 0, valid, &c.checksum) ||
+        !Fingerprints(src, c.end, &m.head_fp, &m.tail_fp)) {
+      if (err) *err = "read failed while checksumming";
+      return false;
+    }
+    m.chunks.push_back(c);
+    m.next_seq++;
+    res.chunk_seq = c.seq;
+    res.bytes_copied = valid;
+  }
+  res.log_end = m.end();
+
+  // The dictionary is written before any record that uses it, so the copy
+  // taken now covers every chunk up to this one.
+  if (fs::exists(DictionaryPath(log_path))) {
+    fs::copy_file(DictionaryPath(log_path), fs::path(backup_dir) / kDictFile,
+                  fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+      if (err) *err = "cannot copy dictionary: " + ec.message();
+      return false;
+    }
+  }
+
+  if ((valid > 0 || full) && !StoreManifest(backup_dir, m)) {
+    if (err) *err = "cannot write manifest in " + backup_dir;
+    return false;
+  }
+  RemoveUnreferenced(backup_dir, m);
+
+  if (result) *result = res;
+  return true;
+}
+
+bool RestoreLog(const std::string& backup_dir, const std::string& out_log, uint64_t* bytes,
+                std::string* err) {
+  Manifest m;
+  if (!LoadManifest(backup_dir, &m, err)) return false;
+  if (m.chunks.empty()) {
+    if (err) *err = "no backup in " + backup_dir;
+    return false;
+  }
+
+  const std::string tmp = out_log + ".restore";
+  uint64_t total = 0;
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      if (err) *err = "cannot create " + tmp;
+      return false;
+    }
+    std::vector<char> buf(kCopyBlock);
+    for (const auto& c : m.chunks) {
+      if (c.begin != total) {
+        if (err) *err = "gap before " + c.file;
+        return false;
+      }
+      std::ifstream in((fs::path(backup_dir) / c.file).string(), std::ios::binary);
+      uint64_t h = kFnvBasis;
+      uint64_t left = c.end - c.begin;
+      while (in && left > 0) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(left, buf.size()));
+        if (!in.read(buf.data(), static_cast<std::streamsize>(n))) break;
+        h = Fnv1a(h, buf.data(), n);
+        out.write(buf.data(), static_cast<std::streamsize>(n));
+        left -= n;
+      }
+      if (left > 0 || h != c.checksum) {
+        out.close();
+        std::remove(tmp.c_str());
+        if (err) *err = "chunk " + c.file + " is missing or corrupt";
+        return false;
+      }
+      total = c.end;
+    }
+    out.flush();
+    if (!out) {
+      if (err) *err = "write failed on " + tmp;
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  const fs::path dict = fs::path(backup_dir) / kDictFile;
+  if (fs::exists(dict)) {
+    fs::copy_file(dict, DictionaryPath(out_log), fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+      if (err) *err = "cannot restore dictionary: " + ec.message();
+      return false;
+    }
+  }
+  if (!ReplaceFile(tmp, out_log, err)) return false;
+  if (bytes) *bytes = total;
+  return true;
+}
+
+}  // namespace kv
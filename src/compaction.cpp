@@ -0,0 +1,213 @@
+#include "kvstore/kvstore.h"
+#include "kvstore/log_format.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace kv {
+
+namespace {
+
+constexpr size_t kWriteChunk = 1 << 20;
+constexpr int kPartitionsPerThread = 4;  // so one slow partition doesn't idle the rest
+
+bool PreadAll(int fd, uint64_t offset, uint64_t size, std::string* out) {
+  out->resize(size);
+  uint64_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pread(fd, &(*out)[done], size - done, static_cast<off_t>(offset + done));
+    if (n <= 0) return false;
+    done += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+bool PwriteAll(int fd, uint64_t offset, const std::string& data) {
+  uint64_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done, static_cast<off_t>(offset + done));
+    if (n <= 0) return false;
+    done += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+}  // namespace
+
+// A group id per MultiGet: the group of the first key already in one, so a
+// key read alongside a known group joins it, or else a fresh one. Keys past
+// the cap keep no group and are laid out by key after the grouped ones.
+void KVStore::NoteCoAccess(const std::vector<uint64_t>& hashes) const {
+  std::lock_guard<std::mutex> lock(co_access_mu_);
+  uint64_t group = 0;
+  for (uint64_t h : hashes) {
+    auto it = co_access_.find(h);
+    if (it != co_access_.end()) {
+      group = it->second;
+      break;
+    }
+  }
+  if (group == 0) group = ++co_access_groups_;
+  for (uint64_t h : hashes) {
+    auto it = co_access_.find(h);
+    if (it != co_access_.end()) it->second = group;
+    else if (co_access_.size() < kMaxCoAccessKeys) co_access_.emplace(h, group);
+  }
+}
+
+std::vector<KVStore::LayoutItem> KVStore::LayoutOrder() {
+  std::vector<LayoutItem> items;
+  items.reserve(cindex_ ? cindex_->size() : index_.size());
+  ForEachEntry([&](const std::string& index_key, Entry& entry) { items.push_back({&entry, UserKey(index_key)}); });
+  auto by_key = [](const LayoutItem& a, const LayoutItem& b) { return a.key < b.key; };
+  if (options_.compaction_order != CompactionOrder::kCoAccess) {
+    std::sort(items.begin(), items.end(), by_key);
+    return items;
+  }
+  std::vector<std::pair<uint64_t, size_t>> order;  // (group, item), ungrouped last
+  order.reserve(items.size());
+  {
+    std::lock_guard<std::mutex> lock(co_access_mu_);
+    for (size_t i = 0; i < items.size(); i++) {
+      auto it = co_access_.find(HashKey(items[i].key));
+      order.emplace_back(it == co_access_.end() ? UINT64_MAX : it->second, i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](const auto& a, const auto& b) {
+    return a.first != b.first ? a.first < b.first : by_key(items[a.second], items[b.second]);
+  });
+  std::vector<LayoutItem> sorted;
+  sorted.reserve(items.size());
+  for (const auto& o : order) sorted.push_back(std::move(items[o.second]));
+  return sorted;
+}
+
+// Every record's size is known from its index entry, so the new log is laid
+// out before anything is read: partition p starts where p - 1 ends. With
+// CompactionOrder::kIndex partitions are by key hash and records follow in
+// old-offset order, which keeps each worker's reads ascending; otherwise they
+// are consecutive runs of LayoutOrder(). Workers then fill their partitions'
+// ranges with pread/pwrite on their own descriptors. A value that cannot be read back is
+// left as blank lines, which replay skips, and its key is dropped as in
+// WriteCompacted().
+bool KVStore::WriteCompactedPartitioned(const std::string& tmp, int threads,
+                                        std::vector<Moved>* moved, std::vector<std::string>* lost,
+                                        uint64_t* size, uint64_t* live) {
+  struct Item {
+    Entry* entry;
+    std::string key;
+    ValueEncoding enc;
+    uint64_t offset;  // of the record in the new log
+  };
+  const size_t parts = static_cast<size_t>(threads) * kPartitionsPerThread;
+  std::vector<std::vector<Item>> partitions(parts);
+  if (options_.compaction_order == CompactionOrder::kIndex) {
+    ForEachEntry([&](const std::string& index_key, Entry& entry) {
+      std::string key = UserKey(index_key);
+      partitions[HashKey(key) % parts].push_back(Item{&entry, std::move(key), EncodingOf(entry), 0});
+    });
+    for (auto& items : partitions) {
+      std::sort(items.begin(), items.end(),
+                [](const Item& a, const Item& b) { return a.entry->offset < b.entry->offset; });
+    }
+  } else {
+    std::vector<LayoutItem> layout = LayoutOrder();
+    const size_t per = (layout.size() + parts - 1) / parts;
+    for (size_t i = 0; i < layout.size(); i++) {
+      partitions[i / per].push_back(Item{layout[i].entry, std::move(layout[i].key), EncodingOf(*layout[i].entry), 0});
+    }
+  }
+
+  std::vector<uint64_t> starts(parts + 1, 0);
+  for (size_t p = 0; p < parts; p++) {
+    auto& items = partitions[p];
+    uint64_t at = starts[p];
+    for (auto& it : items) {
+      it.offset = at;
+      at += PutHeaderSize(it.key, it.entry->size, it.enc) + it.entry->size + 1;
+    }
+    starts[p + 1] = at;
+  }
+  *size = starts[parts];
+
+  const int out_fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out_fd < 0) return false;
+  if (options_.preallocate_bytes > 0 && *size > 0) ::fallocate(out_fd, 0, 0, static_cast<off_t>(*size));
+  RateLimiter* limiter = options_.background_io.get();
+
+  std::vector<std::vector<Moved>> moved_by_part(parts);
+  std::vector<std::vector<std::string>> lost_by_part(parts);
+  std::atomic<uint64_t> blank_bytes{0};
+  std::atomic<size_t> next_part{0};
+  std::atomic<bool> failed{false};
+  auto worker = [&]() {
+    const int in_fd = ::open(log_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+      failed = true;
+      return;
+    }
+    std::string buf, value;
+    while (!failed) {
+      const size_t p = next_part.fetch_add(1);
+      if (p >= parts) break;
+      uint64_t buf_start = starts[p], read_bytes = 0;
+      auto flush = [&]() {
+        if (limiter) limiter->Acquire(read_bytes + buf.size());
+        read_bytes = 0;
+        if (!PwriteAll(out_fd, buf_start, buf)) failed = true;
+        buf_start += buf.size();
+        buf.clear();
+      };
+      for (const auto& it : partitions[p]) {
+        const Entry& entry = *it.entry;
+        // Compressed values are copied as stored; the hot tier only has them decoded.
+        const bool from_cache = entry.in_memory && entry.codec == 0;
+        bool ok = true;
+        if (from_cache) {
+          value = entry.cached;
+        } else {
+          ok = PreadAll(in_fd, entry.offset, entry.size, &value);
+          read_bytes += entry.size;
+        }
+        if (!ok) {
+          const uint64_t n = PutHeaderSize(it.key, entry.size, it.enc) + entry.size + 1;
+          buf.append(n, '\n');
+          blank_bytes += n;
+          lost_by_part[p].push_back(it.key);
+        } else if (!from_cache && !VerifyStored(it.key, entry, value)) {
+          failed = true;  // never launder a damaged value, as in WriteCompacted()
+          break;
+        } else {
+          Moved m{it.entry, it.offset + PutHeaderSize(it.key, value.size(), it.enc), 0};
+          EncodePut(&buf, it.key, value, it.enc, &m.crc);
+          moved_by_part[p].push_back(m);
+        }
+        if (buf.size() >= kWriteChunk) flush();
+      }
+      flush();
+    }
+    ::close(in_fd);
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+  worker();
+  for (auto& th : pool) th.join();
+  const bool closed = ::close(out_fd) == 0;
+  if (failed || !closed) return false;
+
+  *live = *size - blank_bytes.load();
+  moved->reserve(cindex_ ? cindex_->size() : index_.size());
+  for (size_t p = 0; p < parts; p++) {
+    moved->insert(moved->end(), moved_by_part[p].begin(), moved_by_part[p].end());
+    for (auto& key : lost_by_part[p]) lost->push_back(std::move(key));
+  }
+  return true;
+}
+
+}  // namespace kv
@@ -0,0 +1,288 @@
+#include "kvstore/compression.h"
+#include "kvstore/file_util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace kv {
+
+namespace {
+
+constexpr int kHashBits = 12;
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 65535;
+
+inline uint32_t Load32(const char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t Hash4(uint32_t v) { return (v * 2654435761u) >> (32 - kHashBits); }
+
+uint32_t Fnv1a32(const std::string& s) {
+  uint32_t h = 2166136261u;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 16777619u;
+  }
+  return h == 0 ? 1 : h;
+}
+
+void PutLength(std::string* out, size_t len) {
+  while (len >= 255) {
+    out->push_back(static_cast<char>(255));
+    len -= 255;
+  }
+  out->push_back(static_cast<char>(len));
+}
+
+bool GetLength(const char* src, size_t n, size_t* ip, size_t* len) {
+  unsigned char b = 0;
+  do {
+    if (*ip >= n) return false;
+    b = static_cast<unsigned char>(src[(*ip)++]);
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+// match_len == 0 marks the final, literals-only sequence.
+void EmitSequence(std::string* out, const char* lit, size_t lit_len, size_t offset,
+                  size_t match_len) {
+  size_t ml = match_len ? match_len - kMinMatch : 0;
+  uint8_t token = static_cast<uint8_t>((std::min<size_t>(lit_len, 15) << 4) |
+                                       std::min<size_t>(ml, 15));
+  out->push_back(static_cast<char>(token));
+  if (lit_len >= 15) PutLength(out, lit_len - 15);
+  out->append(lit, lit_len);
+  if (match_len == 0) return;
+  out->push_back(static_cast<char>(offset & 0xff));
+  out->push_back(static_cast<char>(offset >> 8));
+  if (ml >= 15) PutLength(out, ml - 15);
+}
+
+}  // namespace
+
+// ---------- Dictionary ----------
+LzDictionary::LzDictionary(std::string bytes)
+    : bytes_(std::move(bytes)), table_(size_t{1} << kHashBits, 0) {
+  // Offsets are 16-bit, so only the dictionary's last kMaxOffset bytes are reachable.
+  if (bytes_.size() > kMaxOffset) bytes_.erase(0, bytes_.size() - kMaxOffset);
+  id_ = Fnv1a32(bytes_);
+  for (size_t p = 0; p + kMinMatch <= bytes_.size(); p++) {
+    table_[Hash4(Load32(bytes_.data() + p))] = static_cast<uint32_t>(p + 1);
+  }
+}
+
+// ---------- Codec ----------
+bool LzCompress(const char* src, size_t n, const LzDictionary* dict, std::string* out) {
+  // Work in one address space: [dictionary][value].
+  const size_t dlen = dict ? dict->bytes_.size() : 0;
+  std::string joined;
+  const char* base = src;
+  if (dlen > 0) {
+    joined.reserve(dlen + n);
+    joined.append(dict->bytes_);
+    joined.append(src, n);
+    base = joined.data();
+  }
+  std::vector<uint32_t> table = dict ? dict->table_ : std::vector<uint32_t>(size_t{1} << kHashBits, 0);
+
+  const size_t start = out->size();
+  const size_t end = dlen + n;
+  const size_t limit = end > kMinMatch ? end - kMinMatch : 0;
+  size_t ip = dlen;
+  size_t anchor = dlen;
+
+  while (ip < limit) {
+    uint32_t seq = Load32(base + ip);
+    uint32_t h = Hash4(seq);
+    size_t cand = table[h];
+    table[h] = static_cast<uint32_t>(ip + 1);
+
+    if (cand != 0 && ip - (cand - 1) <= kMaxOffset && Load32(base + cand - 1) == seq) {
+      size_t m = cand - 1;
+      size_t len = kMinMatch;
+      while (ip + len < end && base[m + len] == base[ip + len]) len++;
+      EmitSequence(out, base + anchor, ip - anchor, ip - m, len);
+      ip += len;
+      anchor = ip;
+      continue;
+    }
+    ip++;
+  }
+  EmitSequence(out, base + anchor, end - anchor, 0, 0);
+
+  if (out->size() - start >= n) {
+    out->resize(start);
+    return false;
+  }
+  return true;
+}
+
+bool LzDecompress(const char* src, size_t n, size_t raw_size, const LzDictionary* dict,
+                  std::string* out) {
+  const std::string empty;
+  const std::string& d = dict ? dict->bytes() : empty;
+  const size_t dlen = d.size();
+
+  out->resize(raw_size);
+  char* op = &(*out)[0];
+  size_t o = 0;
+  size_t ip = 0;
+
+  while (ip < n) {
+    uint8_t token = static_cast<uint8_t>(src[ip++]);
+
+    size_t lit = token >> 4;
+    if (lit == 15 && !GetLength(src, n, &ip, &lit)) return false;
+    if (lit > n - ip || lit > raw_size - o) return false;
+    std::memcpy(op + o, src + ip, lit);
+    ip += lit;
+    o += lit;
+    if (ip == n) break;  // final sequence has no match
+
+    if (n - ip < 2) return false;
+    size_t off = static_cast<uint8_t>(src[ip]) | (static_cast<size_t>(static_cast<uint8_t>(src[ip + 1])) << 8);
+    ip += 2;
+    size_t ml = (token & 15);
+    if (ml == 15 && !GetLength(src, n, &ip, &ml)) return false;
+    ml += kMinMatch;
+    if (off == 0 || off > o + dlen || ml > raw_size - o) return false;
+
+    size_t s = 0;
+    if (off > o) {
+      // Starts inside the dictionary and may run on into the output.
+      size_t dpos = dlen - (off - o);
+      size_t n_dict = std::min(ml, dlen - dpos);
+      std::memcpy(op + o, d.data() + dpos, n_dict);
+      o += n_dict;
+      ml -= n_dict;
+    } else {
+      s = o - off;
+    }
+    if (ml <= o - s) {
+      std::memcpy(op + o, op + s, ml);
+      o += ml;
+    } else {
+      while (ml-- > 0) op[o++] = op[s++];  // overlapping: repeats the last `off` bytes
+    }
+  }
+  return o == raw_size;
+}
+
+bool DecodeValue(const ValueEncoding& enc, const LzDictionary* dict, const std::string& stored,
+                 std::string* value) {
+  switch (static_cast<Codec>(enc.codec)) {
+    case Codec::kNone:
+      *value = stored;
+      return true;
+    case Codec::kLz:
+      return LzDecompress(stored.data(), stored.size(), enc.raw_size, nullptr, value);
+    case Codec::kLzDict:
+      if (!dict || dict->id() != enc.dict_id) return false;
+      return LzDecompress(stored.data(), stored.size(), enc.raw_size, dict, value);
+  }
+  return false;
+}
+
+// ---------- Training ----------
+// Scores fixed-size segments of every sample by how many samples share their
+// 8-byte grams, then keeps the best segments. The highest scoring segments go
+// last, nearest to the data.
+std::string TrainDictionary(const std::vector<std::string>& samples, size_t max_bytes) {
+  constexpr size_t kGram = 8;
+  constexpr size_t kSegment = 64;
+
+  auto gram_hash = [](const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v * 0x9e3779b97f4a7c15ull;
+  };
+
+  std::unordered_map<uint64_t, uint32_t> doc_freq;
+  for (const auto& s : samples) {
+    std::unordered_set<uint64_t> seen;
+    for (size_t p = 0; p + kGram <= s.size(); p++) seen.insert(gram_hash(s.data() + p));
+    for (uint64_t g : seen) doc_freq[g]++;
+  }
+
+  struct Segment {
+    uint64_t score;
+    const std::string* sample;
+    size_t pos;
+    size_t len;
+  };
+  std::vector<Segment> segs;
+  std::unordered_set<std::string> unique;
+  for (const auto& s : samples) {
+    for (size_t pos = 0; pos < s.size(); pos += kSegment) {
+      size_t len = std::min(kSegment, s.size() - pos);
+      if (!unique.insert(s.substr(pos, len)).second) continue;
+      uint64_t score = 0;
+      for (size_t p = pos; p + kGram <= pos + len && p + kGram <= s.size(); p++) {
+        uint32_t f = doc_freq[gram_hash(s.data() + p)];
+        if (f > 1) score += f;
+      }
+      if (score > 0) segs.push_back({score, &s, pos, len});
+    }
+  }
+
+  std::sort(segs.begin(), segs.end(),
+            [](const Segment& a, const Segment& b) { return a.score > b.score; });
+  size_t total = 0;
+  size_t take = 0;
+  while (take < segs.size() && total + segs[take].len <= max_bytes) total += segs[take++].len;
+
+  std::string dict;
+  dict.reserve(total);
+  for (size_t i = take; i-- > 0;) dict.append(*segs[i].sample, segs[i].pos, segs[i].len);
+  return dict;
+}
+
+// ---------- Persistence ----------
+std::string DictionaryPath(const std::string& log_path) { return log_path + ".dict"; }
+
+bool SaveDictionary(const std::string& path, const LzDictionary& dict) {
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out << "KVDICT 1 " << dict.id() << " " << dict.bytes().size() << "\n";
+    out.write(dict.bytes().data(), static_cast<std::streamsize>(dict.bytes().size()));
+    out.flush();
+    if (!out) return false;
+  }
+  // Must be durable before any record that names it.
+  return ReplaceFile(tmp, path);
+}
+
+std::unique_ptr<LzDictionary> LoadDictionary(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return nullptr;
+
+  std::string header;
+  if (!std::getline(in, header)) return nullptr;
+  std::istringstream iss(header);
+  std::string magic;
+  int version = 0;
+  uint32_t id = 0;
+  size_t size = 0;
+  iss >> magic >> version >> id >> size;
+  if (!iss || magic != "KVDICT" || version != 1) return nullptr;
+
+  std::string bytes(size, '\0');
+  if (!in.read(&bytes[0], static_cast<std::streamsize>(size))) return nullptr;
+  auto dict = std::make_unique<LzDictionary>(std::move(bytes));
+  if (dict->id() != id) return nullptr;
+  return dict;
+}
+
+}  // namespace kv
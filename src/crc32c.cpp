@@ -0,0 +1,94 @@
+#include "kvstore/crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#define KV_CRC32C_X86 1
+#endif
+
+namespace kv {
+
+namespace {
+
+constexpr uint32_t kPoly = 0x82f63b78;  // reflected Castagnoli polynomial
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes.
+struct Tables {
+  uint32_t t[8][256];
+  Tables() {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t c = b;
+      for (int i = 0; i < 8; i++) c = (c >> 1) ^ (kPoly & (0u - (c & 1)));
+      t[0][b] = c;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      for (int k = 1; k < 8; k++) t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+    }
+  }
+};
+
+const Tables& GetTables() {
+  static const Tables tables;
+  return tables;
+}
+
+#ifdef KV_CRC32C_X86
+__attribute__((target("sse4.2"))) uint32_t Crc32cSse42(const char* data, size_t n, uint32_t crc) {
+  uint64_t c = ~crc;
+  while (n >= 8) {
+    uint64_t v;
+    std::memcpy(&v, data, sizeof(v));
+    c = _mm_crc32_u64(c, v);
+    data += 8;
+    n -= 8;
+  }
+  uint32_t c32 = static_cast<uint32_t>(c);
+  while (n-- > 0) c32 = _mm_crc32_u8(c32, static_cast<uint8_t>(*data++));
+  return ~c32;
+}
+#endif
+
+using CrcFn = uint32_t (*)(const char*, size_t, uint32_t);
+
+// Runtime dispatch, decided on first use.
+CrcFn Impl() {
+  static const CrcFn fn = [] {
+#ifdef KV_CRC32C_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) return static_cast<CrcFn>(Crc32cSse42);
+#endif
+    return static_cast<CrcFn>(Crc32cPortable);
+  }();
+  return fn;
+}
+
+}  // namespace
+
+uint32_t Crc32cPortable(const char* data, size_t n, uint32_t crc) {
+  const auto& t = GetTables().t;
+  const auto* p = reinterpret_cast<const unsigned char*>(data);
+  uint32_t c = ~crc;
+  while (n >= 8) {
+    uint32_t lo = c ^ (static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+                       static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24);
+    c = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+        t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    p += 8;
+    n -= 8;
+  }
+  while (n-- > 0) c = (c >> 8) ^ t[0][(c ^ *p++) & 0xff];
+  return ~c;
+}
+
+uint32_t Crc32c(const char* data, size_t n, uint32_t crc) { return Impl()(data, n, crc); }
+
+bool Crc32cHardware() {
+#ifdef KV_CRC32C_X86
+  return Impl() == Crc32cSse42;
+#else
+  return false;
+#endif
+}
+
+}  // namespace kv
@@ -0,0 +1,96 @@
+#include "kvstore/file_util.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace kv {
+
+static bool SyncPath(const std::string& path, int flags) {
+  int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+  if (fd < 0) return false;
+  int rc;
+  do {
+    rc = ::fsync(fd);
+  } while (rc != 0 && errno == EINTR);
+  ::close(fd);
+  return rc == 0;
+}
+
+bool SyncFile(const std::string& path) { return SyncPath(path, O_RDONLY); }
+
+bool SyncParentDir(const std::string& path) {
+  auto parent = std::filesystem::path(path).parent_path();
+  return SyncPath(parent.empty() ? "." : parent.string(), O_RDONLY | O_DIRECTORY);
+}
+
+bool ReplaceFile(const std::string& tmp, const std::string& path, std::string* err) {
+  if (!SyncFile(tmp)) {
+    if (err) *err = "fsync " + tmp + " failed: " + std::strerror(errno);
+    std::remove(tmp.c_str());
+    return false;
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    if (err) *err = "rename failed: " + std::string(std::strerror(errno));
+    std::remove(tmp.c_str());
+    return false;
+  }
+  if (!SyncParentDir(path)) {
+    if (err) *err = "fsync of directory failed: " + std::string(std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void DropCachedPages(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+  ::fdatasync(fd);  // DONTNEED skips dirty pages
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+void ReleasePreallocated(const std::string& path) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) return;
+  struct stat st;
+  // Truncating to the current size frees the blocks past it; punching a hole
+  // there is accepted but a no-op on some filesystems.
+  if (::fstat(fd, &st) == 0) ::ftruncate(fd, st.st_size);
+  ::close(fd);
+}
+
+ScanHints::ScanHints(const std::string& path) : fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {}
+
+ScanHints::~ScanHints() {
+  if (fd_ < 0) return;
+  if (started_) ::posix_fadvise(fd_, static_cast<off_t>(dropped_), 0, POSIX_FADV_DONTNEED);
+  ::close(fd_);
+}
+
+void ScanHints::Advance(uint64_t offset) {
+  if (fd_ < 0) return;
+  if (!started_) {  // pages before where the scan starts are not ours to drop
+    started_ = true;
+    requested_ = dropped_ = offset & ~uint64_t{4095};
+  }
+  if (offset + kAhead / 2 < requested_) return;  // every kAhead / 2 bytes
+  const uint64_t upto = offset + kAhead;
+  ::posix_fadvise(fd_, static_cast<off_t>(requested_), static_cast<off_t>(upto - requested_),
+                  POSIX_FADV_WILLNEED);
+  requested_ = upto;
+  // Whole pages only; the page being read stays.
+  const uint64_t drop_to = offset & ~uint64_t{4095};
+  if (drop_to > dropped_) {
+    ::posix_fadvise(fd_, static_cast<off_t>(dropped_), static_cast<off_t>(drop_to - dropped_),
+                    POSIX_FADV_DONTNEED);
+    dropped_ = drop_to;
+  }
+}
+
+}  // namespace kv
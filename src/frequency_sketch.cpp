@@ -0,0 +1,56 @@
+#include "kvstore/frequency_sketch.h"
+
+namespace kv {
+
+FrequencySketch::FrequencySketch(size_t counters) {
+  size_t n = 64;
+  while (n < counters) n <<= 1;
+  mask_ = n - 1;
+  table_.reset(new std::atomic<uint8_t>[n]);
+  for (size_t i = 0; i < n; i++) table_[i].store(0, std::memory_order_relaxed);
+  sample_size_ = 10 * n;
+}
+
+size_t FrequencySketch::Slot(uint64_t h, int row) const {
+  // Derive independent-enough row hashes from one key hash.
+  static const uint64_t kSeeds[kRows] = {0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full,
+                                         0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull};
+  uint64_t x = (h + kSeeds[row]) * 0xff51afd7ed558ccdull;
+  x ^= x >> 32;
+  return static_cast<size_t>(x) & mask_;
+}
+
+uint32_t FrequencySketch::Increment(uint64_t h) {
+  uint32_t est = 255;
+  for (int r = 0; r < kRows; r++) {
+    auto& c = table_[Slot(h, r)];
+    uint8_t v = c.load(std::memory_order_relaxed);
+    while (v < 255 && !c.compare_exchange_weak(v, static_cast<uint8_t>(v + 1),
+                                               std::memory_order_relaxed)) {
+    }
+    uint32_t now = v < 255 ? v + 1u : 255u;
+    if (now < est) est = now;
+  }
+  if (additions_.fetch_add(1, std::memory_order_relaxed) + 1 == sample_size_) Age();
+  return est;
+}
+
+uint32_t FrequencySketch::Estimate(uint64_t h) const {
+  uint32_t est = 255;
+  for (int r = 0; r < kRows; r++) {
+    uint32_t v = table_[Slot(h, r)].load(std::memory_order_relaxed);
+    if (v < est) est = v;
+  }
+  return est;
+}
+
+// Halving keeps the sketch biased toward recent accesses.
+void FrequencySketch::Age() {
+  for (size_t i = 0; i <= mask_; i++) {
+    uint8_t v = table_[i].load(std::memory_order_relaxed);
+    table_[i].store(static_cast<uint8_t>(v >> 1), std::memory_order_relaxed);
+  }
+  additions_.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace kv
@@ -0,0 +1,91 @@
+#include "kvstore/hash.h"
+
+#include <cstring>
+
+namespace kv {
+
+namespace {
+
+constexpr uint64_t kP0 = 0xa0761d6478bd642full;
+constexpr uint64_t kP1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t kP2 = 0x8ebc6af09c88c6e3ull;
+constexpr uint64_t kP3 = 0x589965cc75374cc3ull;
+
+inline void Mum(uint64_t* a, uint64_t* b) {
+  __uint128_t r = static_cast<__uint128_t>(*a) * *b;
+  *a = static_cast<uint64_t>(r);
+  *b = static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t Mix(uint64_t a, uint64_t b) {
+  Mum(&a, &b);
+  return a ^ b;
+}
+
+inline uint64_t Read8(const uint8_t* p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Read4(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// 1..3 bytes: first, middle and last byte.
+inline uint64_t Read3(const uint8_t* p, size_t n) {
+  return (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[n >> 1]) << 8) | p[n - 1];
+}
+
+}  // namespace
+
+uint64_t HashBytes(const void* data, size_t n, uint64_t seed) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  seed ^= Mix(seed ^ kP0, kP1);
+  uint64_t a = 0;
+  uint64_t b = 0;
+  if (n <= 16) {
+    if (n >= 4) {
+      // Two overlapping 4-byte reads from each end cover 4..16 bytes.
+      const size_t mid = (n >> 3) << 2;
+      a = (Read4(p) << 32) | Read4(p + mid);
+      b = (Read4(p + n - 4) << 32) | Read4(p + n - 4 - mid);
+    } else if (n > 0) {
+      a = Read3(p, n);
+    }
+  } else {
+    size_t i = n;
+    if (i > 48) {
+      uint64_t s1 = seed;
+      uint64_t s2 = seed;
+      do {
+        seed = Mix(Read8(p) ^ kP1, Read8(p + 8) ^ seed);
+        s1 = Mix(Read8(p + 16) ^ kP2, Read8(p + 24) ^ s1);
+        s2 = Mix(Read8(p + 32) ^ kP3, Read8(p + 40) ^ s2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= s1 ^ s2;
+    }
+    while (i > 16) {
+      seed = Mix(Read8(p) ^ kP1, Read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    // The last 16 bytes, overlapping what was already mixed if need be.
+    a = Read8(p + i - 16);
+    b = Read8(p + i - 8);
+  }
+  a ^= kP1;
+  b ^= seed;
+  Mum(&a, &b);
+  return Mix(a ^ kP0 ^ n, b ^ kP1);
+}
+
+void HashKeys(const std::vector<std::string>& keys, uint64_t* out) {
+  for (size_t i = 0; i < keys.size(); i++) out[i] = HashKey(keys[i]);
+}
+
+}  // namespace kv
@@ -0,0 +1,139 @@
+#include "kvstore/hint_file.h"
+#include "kvstore/crc32c.h"
+#include "kvstore/file_util.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace kv {
+
+namespace {
+
+constexpr char kMagic[8] = {'K', 'V', 'H', 'I', 'N', 'T', '1', '\0'};
+constexpr uint32_t kVersion = 1;  // bump when HashKey or the entry layout changes
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t log_id;
+  uint64_t covers;
+  uint64_t count;
+  uint64_t keys_bytes;
+  uint32_t crc;  // of everything above
+  uint32_t pad;
+};
+static_assert(sizeof(Header) == 56, "entries follow at a fixed offset");
+
+}  // namespace
+
+// ---------- Writing ----------
+bool WriteHintFile(const std::string& path, uint64_t log_id, uint64_t covers,
+                   std::vector<std::pair<HintEntry, std::string>>* entries) {
+  std::sort(entries->begin(), entries->end(),
+            [](const auto& a, const auto& b) { return a.first.hash < b.first.hash; });
+  uint64_t keys_bytes = 0;
+  for (auto& [e, key] : *entries) {
+    e.key_offset = keys_bytes;
+    e.key_len = static_cast<uint32_t>(key.size());
+    keys_bytes += key.size();
+  }
+
+  Header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.log_id = log_id;
+  h.covers = covers;
+  h.count = entries->size();
+  h.keys_bytes = keys_bytes;
+  h.crc = Crc32c(reinterpret_cast<const char*>(&h), offsetof(Header, crc));
+
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    for (const auto& [e, key] : *entries) out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+    for (const auto& [e, key] : *entries) {
+      out.write(key.data(), static_cast<std::streamsize>(key.size()));
+    }
+    out.flush();
+    if (!out) {
+      out.close();
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+  return ReplaceFile(tmp, path);
+}
+
+// ---------- Reading ----------
+HintFile::~HintFile() { Close(); }
+
+bool HintFile::Open(const std::string& path, uint64_t log_id) {
+  Close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    ::close(fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  void* p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) return false;
+  map_ = static_cast<char*>(p);
+  map_size_ = size;
+
+  Header h;
+  std::memcpy(&h, map_, sizeof(h));
+  const bool ok = std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && h.version == kVersion &&
+                  h.crc == Crc32c(reinterpret_cast<const char*>(&h), offsetof(Header, crc)) &&
+                  h.log_id == log_id &&
+                  size == sizeof(Header) + h.count * sizeof(HintEntry) + h.keys_bytes;
+  if (!ok) {
+    Close();
+    return false;
+  }
+  entries_ = reinterpret_cast<const HintEntry*>(map_ + sizeof(Header));
+  keys_ = map_ + sizeof(Header) + h.count * sizeof(HintEntry);
+  keys_bytes_ = h.keys_bytes;
+  count_ = h.count;
+  covers_ = h.covers;
+  return true;
+}
+
+void HintFile::Close() {
+  if (map_) ::munmap(map_, map_size_);
+  map_ = nullptr;
+  map_size_ = 0;
+  entries_ = nullptr;
+  keys_ = nullptr;
+  keys_bytes_ = count_ = covers_ = 0;
+}
+
+bool HintFile::Find(const std::string& key, uint64_t hash, HintEntry* out) const {
+  const HintEntry* end = entries_ + count_;
+  const HintEntry* it = std::lower_bound(
+      entries_, end, hash, [](const HintEntry& e, uint64_t h) { return e.hash < h; });
+  for (; it != end && it->hash == hash; ++it) {
+    if (it->key_offset + it->key_len > keys_bytes_) return false;  // damaged
+    if (it->key_len == key.size() &&
+        std::memcmp(keys_ + it->key_offset, key.data(), key.size()) == 0) {
+      *out = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace kv
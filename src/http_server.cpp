@@ -1,9 +1,24 @@
+#include "kvstore/io_pool.h"
 #include "kvstore/kvstore.h"
+#include "kvstore/local_transport.h"
+#include "kvstore/namespaces.h"
+#include "kvstore/raft.h"
 #include "httplib.h"
 
+#include <signal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 static int GetPort(int argc, char** argv) {
   int port = 8080;
@@ -14,14 +29,451 @@ static int GetPort(int argc, char** argv) {
   return port;
 }
 
+static int GetCompactIntervalS(int argc, char** argv) {
+  int secs = 10;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--compact-interval" && i + 1 < argc) secs = std::stoi(argv[++i]);
+  }
+  return secs;
+}
+
+// 0 disables the background scrubber.
+static int GetScrubIntervalS(int argc, char** argv) {
+  int secs = 300;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--scrub-interval" && i + 1 < argc) secs = std::stoi(argv[++i]);
+  }
+  return secs;
+}
+
+// Background I/O budget shared by every store, in MB/s.
+static uint64_t GetScrubRateMB(int argc, char** argv) {
+  uint64_t mb = 8;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--scrub-rate-mb" && i + 1 < argc) mb = std::stoull(argv[++i]);
+  }
+  return mb;
+}
+
+static int GetIntArg(int argc, char** argv, const std::string& flag, int def) {
+  for (int i = 1; i + 1 < argc; i++) {
+    if (argv[i] == flag) return std::stoi(argv[i + 1]);
+  }
+  return def;
+}
+
+static std::string GetStringArg(int argc, char** argv, const std::string& flag) {
+  for (int i = 1; i + 1 < argc; i++) {
+    if (argv[i] == flag) return argv[i + 1];
+  }
+  return "";
+}
+
+static bool HasFlag(int argc, char** argv, const std::string& flag) {
+  for (int i = 1; i < argc; i++) {
+    if (argv[i] == flag) return true;
+  }
+  return false;
+}
+
+// Body of POST /batch, one op per record:
+//   PUT <ns> <key> <value_size>\n<value_bytes>\n
+//   DEL <ns> <key>\n
+static bool ParseBatchBody(const std::string& body, std::vector<kv::NamespaceOp>* ops) {
+  size_t pos = 0;
+  while (pos < body.size()) {
+    size_t nl = body.find('\n', pos);
+    if (nl == std::string::npos) return false;
+    std::istringstream iss(body.substr(pos, nl - pos));
+    pos = nl + 1;
+
+    std::string op;
+    kv::NamespaceOp o;
+    iss >> op >> o.ns >> o.key;
+    if (o.ns.empty() || o.key.empty()) return false;
+    if (op == "PUT") {
+      size_t n = 0;
+      if (!(iss >> n) || pos + n + 1 > body.size() || body[pos + n] != '\n') return false;
+      o.value = body.substr(pos, n);
+      pos += n + 1;
+    } else if (op != "DEL") {
+      return false;
+    }
+    ops->push_back(std::move(o));
+  }
+  return true;
+}
+
+static std::string FormatStats(const kv::StoreStats& st) {
+  std::ostringstream out;
+  out << "keys=" << st.keys << "\n"
+      << "puts=" << st.puts << "\n"
+      << "gets=" << st.gets << "\n"
+      << "dels=" << st.dels << "\n"
+      << "log_bytes=" << st.log_bytes << "\n"
+      << "garbage_bytes=" << st.garbage_bytes << "\n"
+      << "compactions=" << st.compactions << "\n"
+      << "checksum_failures=" << st.checksum_failures << "\n"
+      << "scrubs=" << st.scrubs << "\n"
+      << "scrub_problems=" << st.scrub_problems << "\n";
+  return out.str();
+}
+
+// Storage calls run on an IoPool, so a slow read, flush or compaction holds
+// a pool thread rather than the connection's HTTP thread. Without a pool
+// (--io-threads 0) they run inline as before.
+struct IoDispatch {
+  std::unique_ptr<kv::IoPool> pool;
+  std::chrono::milliseconds timeout{5000};
+
+  // False, with a 503 in `res`, if fn could not start within the timeout.
+  bool Run(kv::IoPriority priority, const std::function<void()>& fn, httplib::Response& res) const {
+    if (!pool) {
+      fn();
+      return true;
+    }
+    if (pool->Run(priority, fn, timeout)) return true;
+    res.status = 503;
+    res.set_content("storage busy\n", "text/plain");
+    return false;
+  }
+};
+
+// GET /io_pool: per-priority queue depth, counts and queue wait.
+static std::string FormatIoPool(const kv::IoPool* pool) {
+  std::ostringstream out;
+  out << "threads=" << (pool ? pool->threads() : 0) << "\n";
+  if (!pool) return out.str();
+  static const char* kNames[] = {"read", "write", "background"};
+  for (int p = 0; p < kv::kIoPriorities; p++) {
+    kv::IoQueueStats st = pool->Stats(static_cast<kv::IoPriority>(p));
+    const std::string n = kNames[p];
+    out << n << "_queued=" << st.queued << "\n"
+        << n << "_executed=" << st.executed << "\n"
+        << n << "_rejected=" << st.rejected << "\n"
+        << n << "_timed_out=" << st.cancelled << "\n"
+        << n << "_wait_us_avg=" << (st.executed ? st.wait_us_total / st.executed : 0) << "\n"
+        << n << "_wait_us_p50=" << st.wait_us_p50 << "\n"
+        << n << "_wait_us_p99=" << st.wait_us_p99 << "\n"
+        << n << "_wait_us_max=" << st.wait_us_max << "\n";
+  }
+  return out.str();
+}
+
+// GET /raft: this node's role, log indexes, lease and counters, and what it
+// knows of each peer.
+static std::string FormatRaft(const kv::RaftStatus& st) {
+  static const char* kRoles[] = {"follower", "candidate", "leader"};
+  std::ostringstream out;
+  out << "id=" << st.id << "\n"
+      << "role=" << kRoles[static_cast<int>(st.role)] << "\n"
+      << "term=" << st.term << "\n"
+      << "leader=" << st.leader << "\n"
+      << "last_index=" << st.last_index << "\n"
+      << "commit_index=" << st.commit_index << "\n"
+      << "applied_index=" << st.applied_index << "\n"
+      << "snapshot_index=" << st.snapshot_index << "\n"
+      << "lease_ms=" << st.lease_ms << "\n"
+      << "append_batches=" << st.append_batches << "\n"
+      << "appended_entries=" << st.appended_entries << "\n"
+      << "log_syncs=" << st.log_syncs << "\n"
+      << "snapshots_taken=" << st.snapshots_taken << "\n"
+      << "snapshots_installed=" << st.snapshots_installed << "\n";
+  for (const auto& p : st.peers) {
+    out << "peer_" << p.id << "=connected:" << p.connected << " match:" << p.match_index
+        << " next:" << p.next_index << "\n";
+  }
+  return out.str();
+}
+
+// 503 for a node that cannot serve the call (not the leader, no quorum);
+// X-Raft-Leader names the leader when this node knows it.
+static void RaftUnavailable(int leader, const std::string& err, httplib::Response& res) {
+  res.status = 503;
+  if (leader != 0) res.set_header("X-Raft-Leader", std::to_string(leader));
+  res.set_content(err + "; leader=" + std::to_string(leader) + "\n", "text/plain");
+}
+
+// GET /health: the least recovered store decides the state. Load balancers
+// should send traffic on 200 only; 503 with state=serving_reads means reads
+// are already answered (see Options::background_recovery).
+static int FormatHealth(const std::vector<std::pair<std::string, kv::RecoveryStatus>>& stores,
+                        std::string* body) {
+  int rank = 0;  // 0 ready, 1 serving_reads, 2 recovering, 3 failed
+  uint64_t replayed = 0, total = 0;
+  std::ostringstream failures;
+  for (const auto& [name, st] : stores) {
+    int r = st.failed ? 3 : st.ready ? 0 : st.serving_reads ? 1 : 2;
+    rank = std::max(rank, r);
+    replayed += st.replayed_bytes;
+    total += st.total_bytes;
+    if (st.failed) failures << "failed=" << name << ": " << st.error << "\n";
+  }
+  static const char* kStates[] = {"ready", "serving_reads", "recovering", "failed"};
+  std::ostringstream out;
+  out << "state=" << kStates[rank] << "\n"
+      << "stores=" << stores.size() << "\n"
+      << "replayed_bytes=" << replayed << "\n"
+      << "total_bytes=" << total << "\n"
+      << "progress_pct=" << (total ? replayed * 100 / total : 100) << "\n"
+      << failures.str();
+  *body = out.str();
+  return rank == 0 ? 200 : 503;
+}
+
+static std::string FormatFollower(const kv::FollowerStatus& st, uint64_t keys, int max_staleness_ms) {
+  std::ostringstream out;
+  out << "applied_bytes=" << st.applied_bytes << "\n"
+      << "published_bytes=" << st.published_bytes << "\n"
+      << "lag_bytes=" << (st.published_bytes > st.applied_bytes ? st.published_bytes - st.applied_bytes : 0)
+      << "\n"
+      << "staleness_ms=" << st.staleness_ms << "\n"
+      << "max_staleness_ms=" << max_staleness_ms << "\n"
+      << "reloads=" << st.reloads << "\n"
+      << "keys=" << keys << "\n";
+  if (!st.error.empty()) out << "error=" << st.error << "\n";
+  return out.str();
+}
+
+// --read-only-follower: serves /get from data/http.aof while another
+// kv_http_server in the same directory writes it, through a store that
+// tails the writer's published watermark (Options::read_only_follower).
+// Reads run on the HTTP thread: they copy out of the shared mapping. Once
+// the store is more than max_staleness_ms behind, /get and /health answer
+// 503. Writes, namespaces, compaction and scrubbing are the writer's.
+static int RunFollower(int port, int max_staleness_ms, kv::Options options, const sigset_t& stop_signals) {
+  options.read_only_follower = true;
+  std::unique_ptr<kv::KVStore> store;
+  try {
+    store = std::make_unique<kv::KVStore>("data/http.aof", options);
+  } catch (const std::exception& e) {
+    std::cerr << "--read-only-follower: " << e.what() << "\n";
+    return 1;
+  }
+  auto stale = [&](const kv::FollowerStatus& st) {
+    return st.staleness_ms > static_cast<uint64_t>(max_staleness_ms);
+  };
+
+  httplib::Server svr;
+  svr.Get("/health", [&](const httplib::Request&, httplib::Response& res) {
+    std::string body;
+    res.status = FormatHealth({{"(default)", store->Recovery()}}, &body);
+    const kv::FollowerStatus st = store->Follower();
+    if (stale(st)) {
+      res.status = 503;
+      body += "stale=" + std::to_string(st.staleness_ms) + "ms\n";
+    }
+    res.set_content(body, "text/plain");
+  });
+
+  // GET /get?key=...; X-Staleness-Ms bounds how old the answer may be.
+  svr.Get("/get", [&](const httplib::Request& req, httplib::Response& res) {
+    auto key = req.get_param_value("key");
+    if (key.empty()) {
+      res.status = 400;
+      res.set_content("missing key\n", "text/plain");
+      return;
+    }
+    const kv::FollowerStatus st = store->Follower();
+    res.set_header("X-Staleness-Ms", std::to_string(st.staleness_ms));
+    if (stale(st)) {
+      res.status = 503;
+      res.set_content("stale: " + std::to_string(st.staleness_ms) + " ms behind the writer\n", "text/plain");
+      return;
+    }
+    auto v = store->Get(key);
+    if (!v) {
+      res.status = 404;
+      res.set_content("(nil)\n", "text/plain");
+      return;
+    }
+    res.status = 200;
+    res.set_content(*v, "text/plain");
+  });
+
+  // GET /follower
+  svr.Get("/follower", [&](const httplib::Request&, httplib::Response& res) {
+    res.status = 200;
+    res.set_content(FormatFollower(store->Follower(), store->Stats().keys, max_staleness_ms), "text/plain");
+  });
+
+  svr.Post(".*", [](const httplib::Request&, httplib::Response& res) {
+    res.status = 403;
+    res.set_content("read-only follower\n", "text/plain");
+  });
+
+  std::thread([&svr, stop_signals]() {
+    int sig = 0;
+    sigwait(&stop_signals, &sig);
+    svr.stop();
+  }).detach();
+
+  std::cout << "Following data/http.aof; listening on http://127.0.0.1:" << port << "\n";
+  svr.listen("127.0.0.1", port);
+  return 0;
+}
+
 int main(int argc, char** argv) {
+  // SIGINT/SIGTERM stop the server so the stores close cleanly (and write
+  // their hint files). Blocked here, before any thread starts, and taken
+  // with sigwait by the thread below.
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
   int port = GetPort(argc, argv);
+  int compact_interval_s = GetCompactIntervalS(argc, argv);
+  int scrub_interval_s = GetScrubIntervalS(argc, argv);
+  // Quarantining rewrites what the index serves, so it is the operator's call.
+  const bool scrub_quarantine = HasFlag(argc, argv, "--scrub-quarantine");
+
+  kv::Options options;
+  options.background_io = std::make_shared<kv::RateLimiter>(GetScrubRateMB(argc, argv) << 20);
+  // Listen at once; reads are served from hint files while logs replay.
+  options.background_recovery = HasFlag(argc, argv, "--background-recovery");
+
+  if (HasFlag(argc, argv, "--read-only-follower")) {
+    if (GetIntArg(argc, argv, "--raft-id", 0) > 0) {
+      std::cerr << "--read-only-follower cannot be combined with --raft-id\n";
+      return 1;
+    }
+    return RunFollower(port, GetIntArg(argc, argv, "--max-staleness-ms", 1000), options, stop_signals);
+  }
 
   std::filesystem::create_directories("data");
-  kv::KVStore store("data/http.aof");
+  kv::NamespaceStore namespaces("data/ns", options);
+
+  IoDispatch io;
+  if (int threads = GetIntArg(argc, argv, "--io-threads", 4); threads > 0) {
+    kv::IoPoolOptions pool_options;
+    pool_options.threads = threads;
+    pool_options.pin_first_cpu = GetIntArg(argc, argv, "--io-pin-cpu", -1);
+    pool_options.max_queued = static_cast<size_t>(GetIntArg(argc, argv, "--io-queue", 1024));
+    io.pool = std::make_unique<kv::IoPool>(pool_options);
+    io.timeout = std::chrono::milliseconds(GetIntArg(argc, argv, "--io-timeout-ms", 5000));
+  }
+
+  // Replicated mode (--raft-id N --raft-peers 1=host:port,...): /put, /get
+  // and /del go through the Raft group, whose state machine lives in
+  // --raft-dir (default data/raft), instead of data/http.aof. They run on
+  // the HTTP thread, not the pool: they wait on the network, and
+  // concurrent writers are what fills an AppendEntries batch.
+  std::unique_ptr<kv::RaftNode> raft;
+  if (int raft_id = GetIntArg(argc, argv, "--raft-id", 0); raft_id > 0) {
+    kv::RaftOptions raft_options;
+    raft_options.id = raft_id;
+    raft_options.dir = GetStringArg(argc, argv, "--raft-dir");
+    if (raft_options.dir.empty()) raft_options.dir = "data/raft";
+    raft_options.store_options = options;
+    std::string err;
+    if (!kv::ParseRaftPeers(GetStringArg(argc, argv, "--raft-peers"), &raft_options.peers, &err)) {
+      std::cerr << "--raft-peers: " << err << "\n";
+      return 1;
+    }
+    raft = std::make_unique<kv::RaftNode>(raft_options);
+    if (!raft->Start(&err)) {
+      std::cerr << err << "\n";
+      return 1;
+    }
+    std::cout << "Raft node " << raft_id << " of " << raft_options.peers.size() << "\n";
+  }
+
+  // The default store, unless Raft's state machine stands in for it. It
+  // publishes its watermark for --read-only-follower processes started in
+  // the same directory.
+  std::unique_ptr<kv::KVStore> store;
+  if (!raft) {
+    kv::Options store_options = options;
+    store_options.publish_watermark = true;
+    store = std::make_unique<kv::KVStore>("data/http.aof", store_options);
+  }
+
+  // Same operations over the local transport (--uds PATH), for co-located
+  // clients. Calls run on the connection's own thread, not the pool: a
+  // queue hop would cost more than the round trip it is there to save.
+  kv::LocalServer local([&](const kv::LocalRequest& req) {
+    kv::LocalResponse resp;
+    if (raft && req.ns.empty()) {
+      std::string err;
+      std::optional<std::string> v;
+      bool existed = false;
+      switch (req.op) {
+        case kv::LocalOp::kGet:
+          if (raft->Get(req.key, &v, &err)) {
+            resp.status = v ? kv::LocalStatus::kOk : kv::LocalStatus::kNotFound;
+            if (v) resp.value = std::move(*v);
+          }
+          break;
+        case kv::LocalOp::kPut:
+          if (raft->Put(req.key, req.value, &err)) resp.status = kv::LocalStatus::kOk;
+          break;
+        case kv::LocalOp::kDel:
+          if (raft->Del(req.key, &existed, &err)) {
+            resp.status = existed ? kv::LocalStatus::kOk : kv::LocalStatus::kNotFound;
+          }
+          break;
+        default:
+          break;
+      }
+      return resp;
+    }
+    kv::KVStore* s = req.ns.empty() ? store.get()
+                     : req.op == kv::LocalOp::kPut ? namespaces.Open(req.ns)
+                                                   : namespaces.Find(req.ns);
+    switch (req.op) {
+      case kv::LocalOp::kGet:
+        if (auto v = s ? s->Get(req.key) : std::nullopt) {
+          resp.status = kv::LocalStatus::kOk;
+          resp.value = std::move(*v);
+        } else {
+          resp.status = kv::LocalStatus::kNotFound;
+        }
+        break;
+      case kv::LocalOp::kPut:
+        resp.status = s && s->Put(req.key, req.value) ? kv::LocalStatus::kOk : kv::LocalStatus::kError;
+        break;
+      case kv::LocalOp::kDel:
+        resp.status = s && s->Del(req.key) ? kv::LocalStatus::kOk : kv::LocalStatus::kNotFound;
+        break;
+      default:
+        break;
+    }
+    return resp;
+  });
+  if (std::string uds = GetStringArg(argc, argv, "--uds"); !uds.empty()) {
+    std::string err;
+    if (!local.Listen(uds, &err)) {
+      std::cerr << err << "\n";
+      return 1;
+    }
+    std::cout << "Listening on unix:" << uds << "\n";
+  }
 
   httplib::Server svr;
 
+  // GET /health
+  svr.Get("/health", [&](const httplib::Request&, httplib::Response& res) {
+    std::vector<std::pair<std::string, kv::RecoveryStatus>> stores;
+    if (store) stores.emplace_back("(default)", store->Recovery());
+    for (const auto& name : namespaces.Names()) {
+      if (kv::KVStore* s = namespaces.Find(name)) stores.emplace_back(name, s->Recovery());
+    }
+    std::string body;
+    res.status = FormatHealth(stores, &body);
+    if (raft) {
+      // Without a known leader the group takes no writes and serves no reads.
+      const kv::RaftStatus st = raft->Status();
+      body += "raft_leader=" + std::to_string(st.leader) + "\n";
+      if (st.leader == 0) res.status = 503;
+    }
+    res.set_content(body, "text/plain");
+  });
+
   // POST /put?key=...  (body=value)
   svr.Post("/put", [&](const httplib::Request& req, httplib::Response& res) {
     auto key = req.get_param_value("key");
@@ -30,7 +482,16 @@ int main(int argc, char** argv) {
       res.set_content("missing key\n", "text/plain");
       return;
     }
-    if (!store.Put(key, req.body)) {
+    if (raft) {
+      std::string err;
+      if (!raft->Put(key, req.body, &err)) return RaftUnavailable(raft->Status().leader, err, res);
+      res.status = 200;
+      res.set_content("OK\n", "text/plain");
+      return;
+    }
+    bool ok = false;
+    if (!io.Run(kv::IoPriority::kWrite, [&]() { ok = store->Put(key, req.body); }, res)) return;
+    if (!ok) {
       res.status = 500;
       res.set_content("put failed\n", "text/plain");
       return;
@@ -47,7 +508,13 @@ int main(int argc, char** argv) {
       res.set_content("missing key\n", "text/plain");
       return;
     }
-    auto v = store.Get(key);
+    std::optional<std::string> v;
+    if (raft) {
+      std::string err;
+      if (!raft->Get(key, &v, &err)) return RaftUnavailable(raft->Status().leader, err, res);
+    } else if (!io.Run(kv::IoPriority::kRead, [&]() { v = store->Get(key); }, res)) {
+      return;
+    }
     if (!v) {
       res.status = 404;
       res.set_content("(nil)\n", "text/plain");
@@ -65,14 +532,102 @@ int main(int argc, char** argv) {
       res.set_content("missing key\n", "text/plain");
       return;
     }
-    bool deleted = store.Del(key);
+    bool deleted = false;
+    if (raft) {
+      std::string err;
+      if (!raft->Del(key, &deleted, &err)) return RaftUnavailable(raft->Status().leader, err, res);
+    } else if (!io.Run(kv::IoPriority::kWrite, [&]() { deleted = store->Del(key); }, res)) {
+      return;
+    }
     res.status = 200;
     res.set_content(deleted ? "1\n" : "0\n", "text/plain");
   });
 
   // POST /compact
   svr.Post("/compact", [&](const httplib::Request&, httplib::Response& res) {
-    if (!store.Compact()) {
+    if (raft) {
+      res.status = 409;
+      res.set_content("the Raft state machine compacts at each snapshot\n", "text/plain");
+      return;
+    }
+    bool ok = false;
+    if (!io.Run(kv::IoPriority::kBackground, [&]() { ok = store->Compact(); }, res)) return;
+    if (!ok) {
+      res.status = 500;
+      res.set_content("compact failed\n", "text/plain");
+      return;
+    }
+    res.status = 200;
+    res.set_content("OK\n", "text/plain");
+  });
+
+  // ---------- Namespaces: /ns/{name}/... ----------
+  // GET /ns/{name}/get?key=...
+  svr.Get(R"(/ns/([^/]+)/get)", [&](const httplib::Request& req, httplib::Response& res) {
+    kv::KVStore* ns = namespaces.Find(req.matches[1]);
+    auto key = req.get_param_value("key");
+    if (key.empty()) {
+      res.status = 400;
+      res.set_content("missing key\n", "text/plain");
+      return;
+    }
+    std::optional<std::string> v;
+    if (ns && !io.Run(kv::IoPriority::kRead, [&]() { v = ns->Get(key); }, res)) return;
+    if (!v) {
+      res.status = 404;
+      res.set_content("(nil)\n", "text/plain");
+      return;
+    }
+    res.status = 200;
+    res.set_content(*v, "text/plain");
+  });
+
+  // POST /ns/{name}/put?key=...  (body=value; creates the namespace)
+  svr.Post(R"(/ns/([^/]+)/put)", [&](const httplib::Request& req, httplib::Response& res) {
+    kv::KVStore* ns = namespaces.Open(req.matches[1]);
+    auto key = req.get_param_value("key");
+    if (!ns || key.empty()) {
+      res.status = 400;
+      res.set_content(ns ? "missing key\n" : "bad namespace\n", "text/plain");
+      return;
+    }
+    bool ok = false;
+    if (!io.Run(kv::IoPriority::kWrite, [&]() { ok = ns->Put(key, req.body); }, res)) return;
+    if (!ok) {
+      res.status = 500;
+      res.set_content("put failed\n", "text/plain");
+      return;
+    }
+    res.status = 200;
+    res.set_content("OK\n", "text/plain");
+  });
+
+  // POST /ns/{name}/del?key=...
+  svr.Post(R"(/ns/([^/]+)/del)", [&](const httplib::Request& req, httplib::Response& res) {
+    kv::KVStore* ns = namespaces.Find(req.matches[1]);
+    auto key = req.get_param_value("key");
+    if (key.empty()) {
+      res.status = 400;
+      res.set_content("missing key\n", "text/plain");
+      return;
+    }
+    bool deleted = false;
+    if (ns && !io.Run(kv::IoPriority::kWrite, [&]() { deleted = ns->Del(key); }, res)) return;
+    res.status = 200;
+    res.set_content(deleted ? "1\n" : "0\n", "text/plain");
+  });
+
+  // POST /ns/{name}/compact
+  svr.Post(R"(/ns/([^/]+)/compact)", [&](const httplib::Request& req, httplib::Response& res) {
+    kv::KVStore* ns = namespaces.Find(req.matches[1]);
+    if (!ns) {
+      res.status = 404;
+      res.set_content("no such namespace\n", "text/plain");
+      return;
+    }
+    bool ok = false;
+    if (!io.Run(kv::IoPriority::kBackground, [&]() { ok = ns->Compact(); }, res)) return;
+    if (!ok) {
       res.status = 500;
       res.set_content("compact failed\n", "text/plain");
       return;
@@ -81,7 +636,116 @@ int main(int argc, char** argv) {
     res.set_content("OK\n", "text/plain");
   });
 
+  // GET /ns/{name}/stats
+  svr.Get(R"(/ns/([^/]+)/stats)", [&](const httplib::Request& req, httplib::Response& res) {
+    kv::KVStore* ns = namespaces.Find(req.matches[1]);
+    if (!ns) {
+      res.status = 404;
+      res.set_content("no such namespace\n", "text/plain");
+      return;
+    }
+    res.status = 200;
+    res.set_content(FormatStats(ns->Stats()), "text/plain");
+  });
+
+  // POST /batch  (body: see ParseBatchBody; atomic across namespaces)
+  svr.Post("/batch", [&](const httplib::Request& req, httplib::Response& res) {
+    std::vector<kv::NamespaceOp> ops;
+    if (!ParseBatchBody(req.body, &ops)) {
+      res.status = 400;
+      res.set_content("bad batch\n", "text/plain");
+      return;
+    }
+    bool ok = false;
+    if (!io.Run(kv::IoPriority::kWrite, [&]() { ok = namespaces.Write(ops); }, res)) return;
+    if (!ok) {
+      res.status = 500;
+      res.set_content("batch failed\n", "text/plain");
+      return;
+    }
+    res.status = 200;
+    res.set_content("OK\n", "text/plain");
+  });
+
+  // GET /raft
+  svr.Get("/raft", [&](const httplib::Request&, httplib::Response& res) {
+    if (!raft) {
+      res.status = 404;
+      res.set_content("raft disabled\n", "text/plain");
+      return;
+    }
+    res.status = 200;
+    res.set_content(FormatRaft(raft->Status()), "text/plain");
+  });
+
+  // GET /io_pool
+  svr.Get("/io_pool", [&](const httplib::Request&, httplib::Response& res) {
+    res.status = 200;
+    res.set_content(FormatIoPool(io.pool.get()), "text/plain");
+  });
+
+  // Each namespace is compacted on its own schedule, by its own garbage ratio,
+  // as background work on the pool: it starts once no reads or writes are
+  // queued (or it has aged), and is skipped for a round if it cannot start.
+  std::atomic<bool> stop{false};
+  std::thread compactor([&]() {
+    if (compact_interval_s <= 0) return;
+    auto next = std::chrono::steady_clock::now();
+    while (!stop.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      if (std::chrono::steady_clock::now() < next) continue;
+      if (io.pool) {
+        io.pool->Run(kv::IoPriority::kBackground, [&]() { namespaces.CompactDue(); },
+                     std::chrono::seconds(compact_interval_s));
+      } else {
+        namespaces.CompactDue();
+      }
+      next = std::chrono::steady_clock::now() + std::chrono::seconds(compact_interval_s);
+    }
+  });
+
+  // Scrubs every store in turn; all of them share the one I/O budget.
+  std::thread scrubber([&]() {
+    if (scrub_interval_s <= 0) return;
+    auto scrub = [scrub_quarantine](const std::string& name, kv::KVStore* s) {
+      kv::ScrubOptions opts;
+      opts.quarantine = scrub_quarantine;
+      kv::ScrubReport r = s->Scrub(opts);
+      for (const auto& b : r.bad_ranges) {
+        std::cerr << "scrub " << name << ": " << b.reason << " at [" << b.begin << ", " << b.end
+                  << ")\n";
+      }
+      if (r.index_mismatches > 0) {
+        std::cerr << "scrub " << name << ": " << r.index_mismatches << " index mismatches, "
+                  << r.keys_quarantined << " keys quarantined\n";
+      }
+    };
+    auto next = std::chrono::steady_clock::now() + std::chrono::seconds(scrub_interval_s);
+    while (!stop.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      if (std::chrono::steady_clock::now() < next) continue;
+      if (store) scrub("(default)", store.get());
+      for (const auto& name : namespaces.Names()) {
+        if (stop.load()) break;
+        if (kv::KVStore* s = namespaces.Find(name)) scrub(name, s);
+      }
+      next = std::chrono::steady_clock::now() + std::chrono::seconds(scrub_interval_s);
+    }
+  });
+
+  std::thread([&svr, stop_signals]() {
+    int sig = 0;
+    sigwait(&stop_signals, &sig);
+    svr.stop();
+  }).detach();
+
   std::cout << "Listening on http://127.0.0.1:" << port << "\n";
   svr.listen("127.0.0.1", port);
+
+  local.Stop();
+  raft.reset();
+  stop.store(true);
+  compactor.join();
+  scrubber.join();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "kvstore/io_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace kv {
+
+IoPool::IoPool(const IoPoolOptions& options) : options_(options) {
+  const int n = std::max(1, options_.threads);
+  for (int i = 0; i < n; i++) workers_.emplace_back(&IoPool::Work, this, i);
+}
+
+IoPool::~IoPool() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& t : workers_) t.join();
+}
+
+bool IoPool::Submit(IoPriority priority, std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    const int p = static_cast<int>(priority);
+    Queue& q = queues_[p];
+    const size_t limit = priority == IoPriority::kBackground ? options_.max_background_queued : options_.max_queued;
+    if (stop_ || q.tasks.size() >= limit) {
+      q.rejected++;
+      return false;
+    }
+    q.tasks.push_back(Task{std::move(fn), Clock::now(), p});
+    queued_++;
+  }
+  cv_.notify_one();
+  return true;
+}
+
+bool IoPool::Run(IoPriority priority, const std::function<void()>& fn, std::chrono::milliseconds timeout) {
+  enum State { kQueued, kRunning, kDone, kCancelled };
+  struct Call {
+    std::mutex mu;
+    std::condition_variable cv;
+    State state = kQueued;
+  };
+  auto call = std::make_shared<Call>();
+  // The task outlives this frame when cancelled, so it touches fn only after
+  // claiming it.
+  bool submitted = Submit(priority, [call, &fn]() {
+    {
+      std::lock_guard<std::mutex> lock(call->mu);
+      if (call->state == kCancelled) return;
+      call->state = kRunning;
+    }
+    fn();
+    {
+      std::lock_guard<std::mutex> lock(call->mu);
+      call->state = kDone;
+    }
+    call->cv.notify_all();
+  });
+  if (!submitted) return false;
+  std::unique_lock<std::mutex> lock(call->mu);
+  if (!call->cv.wait_for(lock, timeout, [&]() { return call->state != kQueued; })) {
+    call->state = kCancelled;
+    lock.unlock();
+    std::lock_guard<std::mutex> pool_lock(mu_);
+    queues_[static_cast<int>(priority)].cancelled++;
+    return false;
+  }
+  call->cv.wait(lock, [&]() { return call->state == kDone; });
+  return true;
+}
+
+int IoPool::PickLocked(Clock::time_point now) const {
+  const int background = static_cast<int>(IoPriority::kBackground);
+  int pick = -1;
+  for (int p = 0; p < kIoPriorities; p++) {
+    const auto& tasks = queues_[p].tasks;
+    if (tasks.empty()) continue;
+    if (p == background && running_background_ >= std::max(1, options_.background_threads)) continue;
+    if (pick < 0) pick = p;
+    if (now - tasks.front().queued_at >= options_.aging) return p;  // aged beats fresh work anywhere
+  }
+  return pick;
+}
+
+IoPool::Task IoPool::PopLocked(int p, Clock::time_point now) {
+  Queue& q = queues_[p];
+  Task t = std::move(q.tasks.front());
+  q.tasks.pop_front();
+  queued_--;
+  if (p == static_cast<int>(IoPriority::kBackground)) running_background_++;
+  const uint64_t us = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(now - t.queued_at).count());
+  int b = 0;
+  while (b + 1 < kWaitBuckets && (uint64_t{1} << b) <= us) b++;
+  q.wait_hist[b]++;
+  q.wait_us_total += us;
+  q.wait_us_max = std::max(q.wait_us_max, us);
+  q.executed++;
+  return t;
+}
+
+void IoPool::Work(int index) {
+  if (options_.pin_first_cpu >= 0) {
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET((static_cast<unsigned>(options_.pin_first_cpu) + static_cast<unsigned>(index)) % cpus, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+  std::unique_lock<std::mutex> lock(mu_);
+  for (;;) {
+    int p = -1;
+    cv_.wait(lock, [&]() { return (stop_ && queued_ == 0) || (p = PickLocked(Clock::now())) >= 0; });
+    if (p < 0) return;  // stopping, and drained
+    Task t = PopLocked(p, Clock::now());
+    lock.unlock();
+    t.fn();
+    t.fn = nullptr;  // release captures outside the lock
+    lock.lock();
+    if (t.priority == static_cast<int>(IoPriority::kBackground)) {
+      running_background_--;
+      cv_.notify_all();  // a worker may be waiting for the slot
+    }
+  }
+}
+
+IoQueueStats IoPool::Stats(IoPriority priority) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  const Queue& q = queues_[static_cast<int>(priority)];
+  IoQueueStats s;
+  s.queued = q.tasks.size();
+  s.executed = q.executed;
+  s.rejected = q.rejected;
+  s.cancelled = q.cancelled;
+  s.wait_us_total = q.wait_us_total;
+  s.wait_us_max = q.wait_us_max;
+  auto percentile = [&](double p) -> uint64_t {
+    const uint64_t want = static_cast<uint64_t>(p * static_cast<double>(q.executed));
+    uint64_t seen = 0;
+    for (int b = 0; b < kWaitBuckets; b++) {
+      seen += q.wait_hist[b];
+      if (seen > want) return uint64_t{1} << b;
+    }
+    return 0;
+  };
+  if (q.executed > 0) {
+    s.wait_us_p50 = percentile(0.50);
+    s.wait_us_p99 = percentile(0.99);
+  }
+  return s;
+}
+
+}  // namespace kv
@@ -0,0 +1,167 @@
+#include "kvstore/key_codec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace kv {
+
+static uint32_t Prefix2(const char* p) {
+  return (static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 8) |
+         static_cast<unsigned char>(p[1]);
+}
+
+KeySymbolTable::KeySymbolTable(std::vector<std::string> symbols)
+    : symbols_(std::move(symbols)), multi_start_(65537, 0) {
+  std::fill(std::begin(single_), std::end(single_), -1);
+  for (size_t code = 0; code < symbols_.size(); code++) {
+    const std::string& sym = symbols_[code];
+    uint64_t word = 0;
+    std::memcpy(&word, sym.data(), sym.size());
+    sym_word_.push_back(word);
+    sym_mask_.push_back(sym.size() == 8 ? ~0ull : (1ull << (8 * sym.size())) - 1);
+    if (sym.size() == 1) {
+      single_[static_cast<unsigned char>(sym[0])] = static_cast<int16_t>(code);
+    } else {
+      multi_.push_back(static_cast<uint8_t>(code));
+    }
+  }
+  std::stable_sort(multi_.begin(), multi_.end(), [this](uint8_t a, uint8_t b) {
+    uint32_t pa = Prefix2(symbols_[a].data()), pb = Prefix2(symbols_[b].data());
+    return pa != pb ? pa < pb : symbols_[a].size() > symbols_[b].size();
+  });
+  for (uint8_t code : multi_) multi_start_[Prefix2(symbols_[code].data()) + 1]++;
+  for (size_t i = 1; i < multi_start_.size(); i++) multi_start_[i] += multi_start_[i - 1];
+}
+
+// Greedy longest match, as in FSST. The key is copied into a zero-padded
+// buffer so every position can be read as a full 8-byte word.
+void KeySymbolTable::Encode(const std::string& key, std::string* out) const {
+  const size_t n = key.size();
+  // Short keys stay on the stack, so the result lands in `out`'s inline
+  // buffer without a heap allocation. Worst case every byte is escaped.
+  char stack[192];
+  std::string heap;
+  char* in = stack;
+  if (3 * n + 8 > sizeof(stack)) {
+    heap.resize(3 * n + 8);
+    in = &heap[0];
+  }
+  char* o = in + n + 8;
+  std::memcpy(in, key.data(), n);
+  std::memset(in + n, 0, 8);
+
+  size_t len = 0;
+  size_t pos = 0;
+  while (pos < n) {
+    uint64_t word;
+    std::memcpy(&word, in + pos, sizeof(word));
+    size_t matched = 0;
+    if (n - pos >= 2) {
+      uint32_t b = Prefix2(in + pos);
+      for (uint32_t i = multi_start_[b], end = multi_start_[b + 1]; i < end; i++) {
+        uint8_t code = multi_[i];
+        // The length check rules out matches that run into the padding.
+        if ((word & sym_mask_[code]) == sym_word_[code] && symbols_[code].size() <= n - pos) {
+          o[len++] = static_cast<char>(code);
+          matched = symbols_[code].size();
+          break;
+        }
+      }
+    }
+    if (matched == 0) {
+      int16_t code = single_[static_cast<unsigned char>(in[pos])];
+      if (code >= 0) {
+        o[len++] = static_cast<char>(code);
+      } else {
+        o[len++] = static_cast<char>(kEscape);
+        o[len++] = in[pos];
+      }
+      matched = 1;
+    }
+    pos += matched;
+  }
+  out->assign(o, len);
+}
+
+std::string KeySymbolTable::Decode(const std::string& code) const {
+  std::string key;
+  key.reserve(code.size() * 2);
+  for (size_t i = 0; i < code.size(); i++) {
+    uint8_t c = static_cast<uint8_t>(code[i]);
+    if (c == kEscape) {
+      if (++i < code.size()) key.push_back(code[i]);
+    } else {
+      key.append(symbols_[c]);
+    }
+  }
+  return key;
+}
+
+// A few rounds of FSST's training loop: parse the samples with the current
+// table, count every token and every adjacent pair, and keep the candidates
+// that cover the most bytes (count * length).
+std::unique_ptr<KeySymbolTable> KeySymbolTable::Train(const std::vector<std::string>& samples) {
+  constexpr int kRounds = 5;
+  constexpr size_t kMaxSymbols = 255;
+
+  uint64_t byte_counts[256] = {};
+  for (const auto& s : samples) {
+    for (unsigned char c : s) byte_counts[c]++;
+  }
+
+  std::unique_ptr<KeySymbolTable> table(new KeySymbolTable({}));
+  for (int round = 0; round < kRounds; round++) {
+    std::unordered_map<std::string, uint64_t> counts;
+    std::string code;
+    std::vector<std::string> tokens;
+    for (const auto& s : samples) {
+      // Tokenize with the current table; escaped bytes count as 1-byte tokens.
+      table->Encode(s, &code);
+      tokens.clear();
+      for (size_t i = 0; i < code.size(); i++) {
+        uint8_t c = static_cast<uint8_t>(code[i]);
+        if (c == kEscape) tokens.emplace_back(1, code[++i]);
+        else tokens.push_back(table->symbols_[c]);
+      }
+      for (size_t i = 0; i < tokens.size(); i++) {
+        counts[tokens[i]]++;
+        // Credit proper prefixes too: keys that only partly match a long
+        // symbol, e.g. user:17 against "user:100", then still find "user:".
+        for (size_t len = 2; len < tokens[i].size(); len++) counts[tokens[i].substr(0, len)]++;
+        if (i + 1 < tokens.size()) {
+          std::string pair = tokens[i] + tokens[i + 1];
+          if (pair.size() > kMaxSymbolLen) pair.resize(kMaxSymbolLen);
+          counts[pair]++;
+        }
+      }
+    }
+
+    // Bytes seen in the samples always get a code (up to half the table) so
+    // unmatched positions cost one byte, not an escape pair; the rest goes to
+    // the multi-byte candidates with the best gain.
+    std::vector<std::pair<uint64_t, std::string>> singles, multis;
+    for (int c = 0; c < 256; c++) {
+      if (byte_counts[c] > 0) singles.emplace_back(byte_counts[c], std::string(1, static_cast<char>(c)));
+    }
+    for (auto& [sym, n] : counts) {
+      if (sym.size() > 1 && n > 1) multis.emplace_back(n * sym.size(), sym);
+    }
+    auto by_gain = [](const auto& a, const auto& b) {
+      return a.first != b.first ? a.first > b.first : a.second < b.second;
+    };
+    std::sort(singles.begin(), singles.end(), by_gain);
+    std::sort(multis.begin(), multis.end(), by_gain);
+    if (singles.size() > kMaxSymbols / 2) singles.resize(kMaxSymbols / 2);
+    if (multis.size() > kMaxSymbols - singles.size()) multis.resize(kMaxSymbols - singles.size());
+
+    std::vector<std::string> symbols;
+    symbols.reserve(singles.size() + multis.size());
+    for (auto& r : singles) symbols.push_back(std::move(r.second));
+    for (auto& r : multis) symbols.push_back(std::move(r.second));
+    table.reset(new KeySymbolTable(std::move(symbols)));
+  }
+  return table;
+}
+
+}  // namespace kv
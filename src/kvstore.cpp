@@ -1,83 +1,627 @@
 #include "kvstore/kvstore.h"
+#include "kvstore/file_util.h"
+#include "kvstore/log_format.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
-#include <sstream>
 #include <stdexcept>
 #include <shared_mutex>
 
 
 namespace kv {
 
+// Where Compact() writes the new log before swapping it in.
+static std::string CompactionTmpPath(const std::string& log_path) { return log_path + ".tmp"; }
+
 // ---------- Constructors ----------
 KVStore::KVStore() {
   // in-memory mode: values are cached in Entry
 }
 
-KVStore::KVStore(const std::string& log_path)
-    : persistence_enabled_(true), log_path_(log_path) {
+KVStore::KVStore(const Options& options) : options_(options) {
+  if (options_.concurrent_index) cindex_ = std::make_unique<ConcurrentIndex>(0, Placement());
+  PlaceIndex();
+}
+
+KVStore::KVStore(const std::string& log_path, const Options& options)
+    : persistence_enabled_(true), log_path_(log_path), options_(options) {
+  if (options_.static_table) {
+    static_ = std::make_unique<StaticTable>();
+    std::string err;
+    if (!static_->Open(log_path_, &err)) throw std::runtime_error(err);
+    log_bytes_ = live_bytes_ = static_->file_bytes();
+    return;
+  }
+  if (options_.sorted_table) {
+    sorted_ = std::make_unique<SortedTable>();
+    std::string err;
+    if (!sorted_->Open(log_path_, &err)) throw std::runtime_error(err);
+    log_bytes_ = live_bytes_ = sorted_->file_bytes();
+    return;
+  }
+  if (options_.read_only_follower) {
+    OpenFollower();
+    return;
+  }
+  if (options_.publish_watermark) {
+    watermark_ = std::make_unique<LogWatermark>();
+    std::string err;
+    if (!watermark_->Open(WatermarkPath(), /*writer=*/true, &err)) throw std::runtime_error(err);
+  }
+  if (options_.persistent_index) {
+    pindex_ = std::make_unique<PersistentIndex>();
+  } else if (options_.concurrent_index) {
+    cindex_ = std::make_unique<ConcurrentIndex>(0, Placement());
+  } else if (options_.hot_cache_bytes > 0 && options_.mutable_log_bytes == 0) {
+    // ~1 counter per 16 cached bytes: enough to tell apart the keys that
+    // compete for the budget without growing with the whole key space.
+    sketch_ = std::make_unique<FrequencySketch>(options_.hot_cache_bytes / 16);
+  }
+  PlaceIndex();
+  RecoverInterruptedCompaction();
+  if (options_.preallocate_bytes > 0) ReleasePreallocated(log_path_);  // a crash skips Close's trim
+  SetDictionary(LoadDictionary(DictionaryPath(log_path_)));
+  dict_trained_ = Dictionary() != nullptr;
+  if (options_.background_recovery && !pindex_) {
+    RecoverInBackground();
+    return;
+  }
+  std::unique_lock lock(mu_);
   ReplayLog();
   OpenFiles();
+  PublishWatermark(/*new_file=*/true);
+}
+
+KVStore::~KVStore() {
+  if (recovery_thread_.joinable()) recovery_thread_.join();
+  follow_stop_ = true;
+  if (follow_thread_.joinable()) follow_thread_.join();
+  FlushHybridLog(log_bytes_);
+  if (pindex_) CheckpointIndex(/*clean=*/true);
+  else if (HintsEnabled() && log_out_.is_open()) WriteHint();
+  CloseFiles();
 }
 
 // ---------- Public API ----------
 bool KVStore::Put(const std::string& key, const std::string& value) {
+  if (static_ || sorted_ || options_.read_only_follower || !ValidKey(key)) return false;
+  if (cindex_ && !persistence_enabled_) {
+    std::shared_lock lock(mu_);  // only whole-store operations exclude it
+    puts_++;
+    Entry e;
+    e.in_memory = true;
+    e.cached = value;
+    cindex_->Put(key, std::move(e));
+    return true;
+  }
   std::unique_lock lock(mu_);
+  puts_++;
 
   if (!persistence_enabled_) {
     Entry e;
     e.in_memory = true;
     e.cached = value;
-    index_[key] = std::move(e);
+    std::string scratch;
+    index_[IndexKey(key, &scratch)] = std::move(e);
+    MaybeTrainKeys();
     return true;
   }
 
-  uint64_t value_offset = 0;
-  if (!AppendPut(key, value, &value_offset)) return false;
-
+  if (HybridLog() && UpdateInPlace(key, value)) return true;
   Entry e;
-  e.offset = value_offset;
-  e.size = static_cast<uint64_t>(value.size());
-  index_[key] = std::move(e);
+  if (!AppendPut(key, value, &e)) return false;
+  IndexPut(key, std::move(e), &value);
+  MaybeCheckpointIndex();
   return true;
 }
 
 std::optional<std::string> KVStore::Get(const std::string& key) const {
+  return Get(key, HashKey(key));
+}
+
+std::optional<std::string> KVStore::Get(const std::string& key, uint64_t hash) const {
+  if (static_) return GetStatic(key);
+  if (sorted_) return GetSorted(key);
+  std::optional<std::string> hinted;
+  const bool ready = recovery_state_.load(std::memory_order_acquire) == RecoveryState::kReady;
+  if (!ready && GetFromHint(key, hash, &hinted)) return hinted;
+  if (cindex_ && ready) {
+    // Seqlock-style: a Get that overlapped a compaction may have paired an
+    // old offset with the new log, so it is redone under mu_.
+    const uint64_t seq = compaction_seq_.load(std::memory_order_acquire);
+    if (seq % 2 == 0) {
+      std::optional<uint64_t> promote;
+      auto v = GetLocked(key, hash, &promote);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (compaction_seq_.load(std::memory_order_relaxed) == seq) return v;
+    }
+  }
   std::shared_lock lock(mu_);
+  std::optional<uint64_t> promote;
+  auto v = GetLocked(key, hash, &promote);
+  if (promote) {
+    lock.unlock();
+    Promote(key, *promote, *v);
+  }
+  return v;
+}
+
+std::vector<std::optional<std::string>> KVStore::MultiGet(const std::vector<std::string>& keys) const {
+  std::vector<uint64_t> hashes(keys.size());
+  HashKeys(keys, hashes.data());
+
+  std::vector<std::optional<std::string>> values(keys.size());
+  if (options_.compaction_order == CompactionOrder::kCoAccess && keys.size() > 1) NoteCoAccess(hashes);
+  if (static_) {
+    for (size_t i = 0; i < keys.size(); i++) values[i] = GetStatic(keys[i]);
+    return values;
+  }
+  if (sorted_) {
+    for (size_t i = 0; i < keys.size(); i++) values[i] = GetSorted(keys[i]);
+    return values;
+  }
+  if (cindex_ || recovery_state_.load(std::memory_order_acquire) != RecoveryState::kReady) {
+    for (size_t i = 0; i < keys.size(); i++) values[i] = Get(keys[i], hashes[i]);
+    return values;
+  }
+  std::vector<std::pair<size_t, uint64_t>> promotions;
+  {
+    std::shared_lock lock(mu_);
+    for (size_t i = 0; i < keys.size(); i++) {
+      std::optional<uint64_t> promote;
+      values[i] = GetLocked(keys[i], hashes[i], &promote);
+      if (promote) promotions.emplace_back(i, *promote);
+    }
+  }
+  for (const auto& [i, offset] : promotions) Promote(keys[i], offset, *values[i]);
+  return values;
+}
+
+std::optional<std::string> KVStore::GetLocked(const std::string& key, uint64_t hash,
+                                              std::optional<uint64_t>* promote) const {
+  gets_++;
 
-  auto it = index_.find(key);
-  if (it == index_.end()) return std::nullopt;
+  if (pindex_) {
+    std::string record;
+    const IndexSlot* slot = FindSlot(key, hash, &record);
+    Entry e;
+    if (!slot || !SlotEntry(*slot, record, &e)) return std::nullopt;
+    std::optional<std::string> v = record.substr(slot->header_len, e.size);
+    if (options_.verify_checksums && !VerifyStored(key, e, *v)) v.reset();
+    if (v && e.codec != 0) v = DecodeStored(e, std::move(*v));
+    return v;
+  }
 
-  const Entry& e = it->second;
+  std::string scratch;
+  const std::string& ik = IndexKey(key, &scratch);
+  // The index hashes encoded keys; the caller's hash only fits a plain one.
+  const uint64_t h = key_table_ ? HashKey(ik) : hash;
+  Entry copied;  // cindex_ hands out copies; index_ entries are read in place
+  const Entry* found = &copied;
+  if (cindex_) {
+    if (!cindex_->Find(key, hash, &copied)) return std::nullopt;
+  } else {
+    KnownHash known(ik, h);
+    auto it = index_.find(ik);
+    if (it == index_.end()) return std::nullopt;
+    found = &it->second;
+  }
+
+  const Entry& e = *found;
   if (!persistence_enabled_ || e.in_memory) {
+    if (sketch_) {
+      hot_hits_++;
+      sketch_->Increment(h);
+    }
     return e.cached;
   }
-  return ReadValueAt(e.offset, e.size);
+
+  auto v = ReadValueAt(e.offset, e.size);
+  if (v && options_.verify_checksums && !VerifyStored(key, e, *v)) v.reset();
+  if (v && e.codec != 0) v = DecodeStored(e, std::move(*v));
+  if (v && sketch_) {
+    hot_misses_++;
+    // Seen at least twice recently: worth a unique lock to try promotion.
+    if (sketch_->Increment(h) >= 2) *promote = e.offset;
+  }
+  return v;
 }
 
 bool KVStore::Del(const std::string& key) {
+  if (static_ || sorted_ || options_.read_only_follower || !ValidKey(key)) return false;
+  if (cindex_ && !persistence_enabled_) {
+    std::shared_lock lock(mu_);
+    dels_++;
+    return cindex_->Erase(key);
+  }
   std::unique_lock lock(mu_);
+  dels_++;
 
-  bool existed = (index_.erase(key) > 0);
+  bool existed = IndexDel(key);
   if (persistence_enabled_) {
     AppendDel(key);  // log deletes even if key missing
+    MaybeCheckpointIndex();
   }
   return existed;
 }
 
+bool KVStore::Write(const WriteBatch& batch) {
+  if (static_ || sorted_ || options_.read_only_follower) return false;
+  std::unique_lock lock(mu_);
+  return WriteLocked(batch);
+}
+
+StoreStats KVStore::Stats() const {
+  std::shared_lock lock(mu_);
+  StoreStats st;
+  st.keys = static_ ? static_->count()
+            : sorted_ ? sorted_->count()
+            : pindex_ ? pindex_->count()
+            : cindex_ ? cindex_->size()
+                      : index_.size();
+  st.puts = puts_.load();
+  st.gets = gets_.load();
+  st.dels = dels_.load();
+  st.log_bytes = log_bytes_;
+  st.garbage_bytes = log_bytes_ - live_bytes_;
+  st.compactions = compactions_;
+  st.hot_hits = hot_hits_.load();
+  st.hot_misses = hot_misses_.load();
+  st.hot_bytes = hot_bytes_;
+  st.hot_keys = hot_.size();
+  st.compressed_values = compressed_values_;
+  st.compress_in_bytes = compress_in_bytes_;
+  st.compress_out_bytes = compress_out_bytes_;
+  st.decompress_ns = decompress_ns_.load();
+  st.has_dictionary = Dictionary() != nullptr;
+  st.checksum_verifies = checksum_verifies_.load();
+  st.checksum_failures = checksum_failures_.load();
+  st.checksum_ns = checksum_ns_.load();
+  st.scrubs = scrubs_.load();
+  st.scrub_problems = scrub_problems_.load();
+  st.in_place_updates = in_place_updates_.load();
+  st.unflushed_bytes = HybridLog() ? log_bytes_ - hlog_flushed_.load() : 0;
+  return st;
+}
+
 void KVStore::Close() {
   if (!persistence_enabled_) return;
+  std::unique_lock lock(mu_);
+  FlushHybridLog(log_bytes_);
+  if (pindex_) CheckpointIndex(/*clean=*/true);
+  else if (HintsEnabled() && log_out_.is_open()) WriteHint();
   CloseFiles();
 }
 
 
-// ---------- Persistence helpers ----------
-static void WriteLine(std::ofstream& out, const std::string& s) {
-  out.write(s.data(), static_cast<std::streamsize>(s.size()));
-  out.put('\n');
+// ---------- Index helpers ----------
+
+void KVStore::PlaceIndex() {
+  if (!Placement().enabled() || cindex_ || pindex_) return;
+  index_ = Index(0, KeyHasher(), std::equal_to<std::string>(),
+                 Index::allocator_type(std::make_shared<LargePageArena>(Placement())));
+}
+static uint64_t PutRecordSize(const std::string& key, const Entry& e, const ValueEncoding& enc) {
+  return PutHeaderSize(key, e.size, enc, e.has_crc) + e.size + 1;
+}
+
+void KVStore::IndexPut(const std::string& key, Entry e, const std::string* value) {
+  const uint64_t record_size = PutRecordSize(key, e, EncodingOf(e));
+  if (pindex_) {
+    IndexSlot slot;
+    slot.hash = HashKey(key);
+    slot.record_len = static_cast<uint32_t>(record_size);
+    slot.header_len = static_cast<uint32_t>(record_size - e.size - 1);
+    slot.record_offset = e.offset - slot.header_len;
+    IndexSlot old;
+    if (record_size > UINT32_MAX || !pindex_->Put(slot, SlotHasKey(key), &old)) {
+      throw std::runtime_error("persistent index " + IndexFilePath() + " is full or the record is over 4 GiB");
+    }
+    live_bytes_ += slot.record_len - old.record_len * old.live();
+    return;
+  }
+  live_bytes_ += record_size;
+  if (cindex_) {
+    Entry old;
+    if (cindex_->Put(key, std::move(e), &old)) live_bytes_ -= PutRecordSize(key, old, EncodingOf(old));
+    return;
+  }
+  std::string scratch;
+  const std::string& ik = IndexKey(key, &scratch);
+  auto it = index_.find(ik);
+  if (it == index_.end()) {
+    index_.emplace(ik, std::move(e));
+    MaybeTrainKeys();
+    return;
+  }
+  live_bytes_ -= PutRecordSize(key, it->second, EncodingOf(it->second));
+
+  // Overwriting a hot key keeps it hot (write-through) when the value is known.
+  bool was_hot = sketch_ && it->second.in_memory;
+  if (was_hot) EvictHot(&*it);
+  it->second = std::move(e);
+  if (was_hot && value) AdmitHot(&*it, *value);
+}
+
+bool KVStore::IndexDel(const std::string& key) {
+  if (pindex_) {
+    IndexSlot old = pindex_->Del(HashKey(key), SlotHasKey(key));
+    if (old.live()) live_bytes_ -= old.record_len;
+    return old.live();
+  }
+  if (cindex_) {
+    Entry old;
+    if (!cindex_->Erase(key, &old)) return false;
+    if (persistence_enabled_) live_bytes_ -= PutRecordSize(key, old, EncodingOf(old));
+    return true;
+  }
+  std::string scratch;
+  auto it = index_.find(IndexKey(key, &scratch));
+  if (it == index_.end()) return false;
+  if (persistence_enabled_) {
+    live_bytes_ -= PutRecordSize(key, it->second, EncodingOf(it->second));
+  }
+  if (sketch_ && it->second.in_memory) EvictHot(&*it);
+  index_.erase(it);
+  return true;
+}
+
+void KVStore::ForEachEntry(const std::function<void(const std::string&, Entry&)>& fn) {
+  if (cindex_) {
+    cindex_->ForEach(fn);
+    return;
+  }
+  for (auto& [index_key, e] : index_) fn(index_key, e);
+}
+
+// ---------- Key compression ----------
+const std::string& KVStore::IndexKey(const std::string& key, std::string* scratch) const {
+  if (!key_table_) return key;
+  key_table_->Encode(key, scratch);
+  return *scratch;
+}
+
+std::string KVStore::UserKey(const std::string& index_key) const {
+  return key_table_ ? key_table_->Decode(index_key) : index_key;
+}
+
+// Trains once the index holds enough keys to be representative, then
+// re-keys every node in place. Node handles keep their addresses, so hot_
+// pointers stay valid.
+void KVStore::MaybeTrainKeys() {
+  constexpr size_t kKeySamples = 1024;
+  if (!options_.compress_keys || pindex_ || cindex_ || key_table_ || index_.size() < kKeySamples) return;
+
+  std::vector<std::string> samples;
+  samples.reserve(index_.size());
+  for (const auto& kv : index_) samples.push_back(kv.first);
+  key_table_ = KeySymbolTable::Train(samples);
+
+  using Node = Index::node_type;
+  std::vector<Node> nodes;
+  nodes.reserve(index_.size());
+  while (!index_.empty()) nodes.push_back(index_.extract(index_.begin()));
+  std::string code;
+  for (auto& node : nodes) {
+    key_table_->Encode(node.key(), &code);
+    std::string(code).swap(node.key());  // assignment would keep the old heap buffer
+    index_.insert(std::move(node));
+  }
+}
+
+// ---------- Hot tier ----------
+void KVStore::Promote(const std::string& key, uint64_t offset, const std::string& value) const {
+  if (!sketch_) return;  // only index_ entries can hold a hot value
+  std::unique_lock lock(mu_);
+  std::string scratch;
+  auto it = index_.find(IndexKey(key, &scratch));
+  // Skip if the key changed or someone else promoted it while we were unlocked.
+  if (it == index_.end() || it->second.in_memory || it->second.offset != offset) return;
+  AdmitHot(&*it, value);
+}
+
+// TinyLFU-style admission: make room by evicting the least frequent of a few
+// sampled residents, but only if the candidate is accessed more often.
+bool KVStore::AdmitHot(IndexNode* node, const std::string& value) const {
+  const uint64_t need = value.size();
+  if (need > options_.hot_cache_bytes) return false;
+
+  uint32_t freq = sketch_->Estimate(HashKey(node->first));
+  while (hot_bytes_ + need > options_.hot_cache_bytes) {
+    IndexNode* victim = nullptr;
+    uint32_t victim_freq = 0;
+    for (int i = 0; i < 5 && !hot_.empty(); i++) {
+      hot_rng_ ^= hot_rng_ << 13;
+      hot_rng_ ^= hot_rng_ >> 7;
+      hot_rng_ ^= hot_rng_ << 17;
+      IndexNode* n = hot_[hot_rng_ % hot_.size()];
+      uint32_t f = sketch_->Estimate(HashKey(n->first));
+      if (!victim || f < victim_freq) {
+        victim = n;
+        victim_freq = f;
+      }
+    }
+    if (!victim || victim_freq >= freq) return false;
+    EvictHot(victim);
+  }
+
+  Entry& e = node->second;
+  e.cached = value;
+  e.in_memory = true;
+  e.hot_slot = static_cast<uint32_t>(hot_.size());
+  hot_.push_back(node);
+  hot_bytes_ += need;
+  return true;
+}
+
+// Drops the resident copy; the value stays reachable through offset/size.
+void KVStore::EvictHot(IndexNode* node) const {
+  Entry& e = node->second;
+  IndexNode* last = hot_.back();
+  hot_[e.hot_slot] = last;
+  last->second.hot_slot = e.hot_slot;
+  hot_.pop_back();
+
+  hot_bytes_ -= e.cached.size();
+  std::string().swap(e.cached);
+  e.in_memory = false;
+}
+
+bool KVStore::WriteLocked(const WriteBatch& batch) {
+  if (static_ || sorted_) return false;
+  if (batch.ops.empty()) return true;
+  for (const auto& op : batch.ops) {
+    if (!ValidKey(op.key)) return false;
+  }
+
+  for (const auto& op : batch.ops) {
+    if (op.value) puts_++;
+    else dels_++;
+  }
+
+  if (!persistence_enabled_) {
+    std::string scratch;
+    for (const auto& op : batch.ops) {
+      if (cindex_ && op.value) {
+        Entry e;
+        e.in_memory = true;
+        e.cached = *op.value;
+        cindex_->Put(op.key, std::move(e));
+      } else if (cindex_) {
+        cindex_->Erase(op.key);
+      } else if (op.value) {
+        Entry e;
+        e.in_memory = true;
+        e.cached = *op.value;
+        index_[IndexKey(op.key, &scratch)] = std::move(e);
+        MaybeTrainKeys();
+      } else {
+        index_.erase(IndexKey(op.key, &scratch));
+      }
+    }
+    return true;
+  }
+
+  // One buffer, one write: the BEGIN header makes replay all-or-nothing.
+  std::string records;
+  EncodeBegin(&records, batch.ops.size());
+  std::vector<Entry> entries(batch.ops.size());
+  std::string scratch;
+  for (size_t i = 0; i < batch.ops.size(); i++) {
+    const auto& op = batch.ops[i];
+    if (op.value) {
+      ValueEncoding enc;
+      const std::string& stored = EncodeValue(*op.value, &scratch, &enc);
+      Entry& e = entries[i];
+      e.offset = records.size() + PutHeaderSize(op.key, stored.size(), enc);
+      e.size = stored.size();
+      e.codec = enc.codec;
+      e.raw_size = enc.raw_size;
+      e.has_crc = true;
+      EncodePut(&records, op.key, stored, enc, &e.crc);
+    } else {
+      EncodeDel(&records, op.key);
+    }
+  }
+
+  uint64_t start = 0;
+  // A batch reaches the file before it returns, as without the hybrid log:
+  // NamespaceStore retires its batch log on the strength of it.
+  if (!AppendRecords(records, &start) || !FlushHybridLog(log_bytes_)) return false;
+
+  for (size_t i = 0; i < batch.ops.size(); i++) {
+    const auto& op = batch.ops[i];
+    if (op.value) {
+      Entry& e = entries[i];
+      e.offset += start;
+      IndexPut(op.key, std::move(e), &*op.value);
+    } else {
+      IndexDel(op.key);
+    }
+  }
+  MaybeCheckpointIndex();
+  return true;
+}
+
+
+// ---------- Compression ----------
+// Returns the bytes to store for `value`: the value itself, or its compressed
+// form in *scratch. Values below the threshold, and values that don't shrink,
+// are stored raw.
+const std::string& KVStore::EncodeValue(const std::string& value, std::string* scratch,
+                                        ValueEncoding* enc) {
+  *enc = ValueEncoding();
+  if (options_.compress_min_bytes == 0) return value;
+  if (options_.compress_dictionary && !dict_trained_) SampleForDictionary(value);
+  if (value.size() < options_.compress_min_bytes) return value;
+
+  scratch->clear();
+  const LzDictionary* dict = Dictionary();
+  if (!LzCompress(value.data(), value.size(), dict, scratch)) return value;
+
+  enc->codec = static_cast<uint8_t>(dict ? Codec::kLzDict : Codec::kLz);
+  enc->raw_size = value.size();
+  enc->dict_id = dict ? dict->id() : 0;
+  compressed_values_++;
+  compress_in_bytes_ += value.size();
+  compress_out_bytes_ += scratch->size();
+  return *scratch;
+}
+
+// Collects the first kDictSamples values, then trains once. The dictionary is
+// saved before any record refers to it, so a log never names a dictionary
+// that is missing on disk.
+void KVStore::SampleForDictionary(const std::string& value) {
+  constexpr size_t kDictSamples = 256;
+  constexpr size_t kSampleBytes = 4096;
+  constexpr size_t kDictBytes = 16 * 1024;
+
+  dict_samples_.push_back(value.substr(0, kSampleBytes));
+  if (dict_samples_.size() < kDictSamples) return;
+
+  dict_trained_ = true;
+  std::string bytes = TrainDictionary(dict_samples_, kDictBytes);
+  std::vector<std::string>().swap(dict_samples_);
+  if (bytes.empty()) return;
+
+  auto dict = std::make_unique<LzDictionary>(std::move(bytes));
+  if (SaveDictionary(DictionaryPath(log_path_), *dict)) SetDictionary(std::move(dict));
 }
 
+// Lock-free readers (the concurrent index's Get, hinted Gets) load dict_
+// without mu_, so the dictionary is published once and never freed early.
+void KVStore::SetDictionary(std::unique_ptr<LzDictionary> dict) {
+  if (!dict || Dictionary()) return;
+  dict_owner_ = std::move(dict);
+  dict_.store(dict_owner_.get(), std::memory_order_release);
+}
+
+ValueEncoding KVStore::EncodingOf(const Entry& e) const {
+  ValueEncoding enc;
+  enc.codec = e.codec;
+  enc.raw_size = e.raw_size;
+  if (e.codec == static_cast<uint8_t>(Codec::kLzDict)) enc.dict_id = Dictionary()->id();
+  return enc;
+}
+
+std::optional<std::string> KVStore::DecodeStored(const Entry& e, std::string stored) const {
+  auto t0 = std::chrono::steady_clock::now();
+  std::string value;
+  bool ok = DecodeValue(EncodingOf(e), Dictionary(), stored, &value);
+  decompress_ns_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              std::chrono::steady_clock::now() - t0)
+                                              .count());
+  if (!ok) return std::nullopt;
+  return value;
+}
+
+// ---------- Persistence helpers ----------
 bool KVStore::OpenFiles() {
   if (!persistence_enabled_) return true;
 
@@ -86,9 +630,12 @@ bool KVStore::OpenFiles() {
     if (!log_out_) return false;
   }
 
-  if (!log_in_.is_open()) {
-    log_in_.open(log_path_, std::ios::binary);
-    if (!log_in_) return false;
+  // Get may be reading without mu_ (hinted or concurrent-index reads).
+  std::lock_guard<std::mutex> io_lock(io_mu_);
+  if (log_fd_ < 0) {
+    log_fd_ = ::open(log_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (log_fd_ < 0) return false;
+    if (options_.access_hints) ::posix_fadvise(log_fd_, 0, 0, POSIX_FADV_RANDOM);
   }
 
   return true;
@@ -96,127 +643,245 @@ bool KVStore::OpenFiles() {
 
 void KVStore::CloseFiles() {
   if (log_out_.is_open()) log_out_.close();
-  if (log_in_.is_open()) log_in_.close();
+  if (prealloc_fd_ >= 0) {
+    ::close(prealloc_fd_);
+    prealloc_fd_ = -1;
+    ReleasePreallocated(log_path_);
+  }
+  prealloc_end_ = 0;
+  std::lock_guard<std::mutex> io_lock(io_mu_);
+  if (log_fd_ >= 0) ::close(log_fd_);
+  log_fd_ = -1;
+}
+
+// Allocates whole chunks ahead of the file's end. KEEP_SIZE leaves the size,
+// and so replay, alone; a filesystem without fallocate turns this off.
+void KVStore::Preallocate(uint64_t file_end) {
+  const uint64_t chunk = options_.preallocate_bytes;
+  if (chunk == 0 || file_end <= prealloc_end_) return;
+  if (prealloc_fd_ < 0) prealloc_fd_ = ::open(log_path_.c_str(), O_WRONLY | O_CLOEXEC);
+  const uint64_t from = std::max(prealloc_end_, file_end - (file_end % chunk));
+  const uint64_t to = (file_end / chunk + 1) * chunk;
+  if (prealloc_fd_ < 0 || ::fallocate(prealloc_fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(from),
+                                      static_cast<off_t>(to - from)) != 0) {
+    prealloc_end_ = UINT64_MAX;  // give up until the file is reopened
+    return;
+  }
+  prealloc_end_ = to;
 }
 
 
-bool KVStore::AppendPut(const std::string& key, const std::string& value, uint64_t* value_offset_out) {
+bool KVStore::AppendRecords(const std::string& records, uint64_t* start_offset_out) {
+  if (recovery_state_.load() == RecoveryState::kFailed) return false;  // the log is not understood
+  if (HybridLog()) {
+    // A full mutable region turns read-only; the read-only one before it
+    // goes to the file.
+    if (log_bytes_ - hlog_read_only_ >= options_.mutable_log_bytes) {
+      if (!FlushHybridLog(hlog_read_only_)) return false;
+      hlog_read_only_ = log_bytes_;
+    }
+    *start_offset_out = log_bytes_;
+    hlog_tail_ += records;
+    log_bytes_ += records.size();
+    return true;
+  }
   if (!OpenFiles()) return false;
 
   // Ensure we are at end (app mode should already be end, but safe)
   log_out_.clear();
   log_out_.seekp(0, std::ios::end);
 
-  std::string header = "PUT " + key + " " + std::to_string(value.size());
-  WriteLine(log_out_, header);
-
-  std::streampos value_pos = log_out_.tellp();
-  *value_offset_out = static_cast<uint64_t>(value_pos);
+  std::streampos record_pos = log_out_.tellp();
+  *start_offset_out = static_cast<uint64_t>(record_pos);
+  Preallocate(*start_offset_out + records.size());
 
-  log_out_.write(value.data(), static_cast<std::streamsize>(value.size()));
-  log_out_.put('\n');
+  log_out_.write(records.data(), static_cast<std::streamsize>(records.size()));
 
   // Keep durability simple for now: flush every op (still faster than reopening files)
   log_out_.flush();
-  return static_cast<bool>(log_out_);
+  if (!log_out_) return false;
+
+  log_bytes_ = *start_offset_out + records.size();
+  PublishWatermark();
+  return true;
 }
 
 
-bool KVStore::AppendDel(const std::string& key) {
-  if (!OpenFiles()) return false;
+bool KVStore::AppendPut(const std::string& key, const std::string& value, Entry* e) {
+  std::string scratch;
+  ValueEncoding enc;
+  const std::string& stored = EncodeValue(value, &scratch, &enc);
 
-  log_out_.clear();
-  log_out_.seekp(0, std::ios::end);
+  std::string rec;
+  EncodePut(&rec, key, stored, enc, &e->crc);
 
-  WriteLine(log_out_, "DEL " + key);
-  log_out_.flush();
-  return static_cast<bool>(log_out_);
+  uint64_t start = 0;
+  if (!AppendRecords(rec, &start)) return false;
+  e->offset = start + PutHeaderSize(key, stored.size(), enc);
+  e->size = stored.size();
+  e->codec = enc.codec;
+  e->raw_size = enc.raw_size;
+  e->has_crc = true;
+  return true;
 }
 
 
-std::optional<std::string> KVStore::ReadValueAt(uint64_t offset, uint64_t size) const {
-  std::lock_guard<std::mutex> io_lock(io_mu_);
+bool KVStore::AppendDel(const std::string& key) {
+  std::string rec;
+  EncodeDel(&rec, key);
+
+  uint64_t start = 0;
+  return AppendRecords(rec, &start);
+}
+
 
+std::optional<std::string> KVStore::ReadValueAt(uint64_t offset, uint64_t size) const {
+  if (HybridLog() && offset >= hlog_flushed_.load()) {
+    // Not in the file yet (the caller holds mu_).
+    const uint64_t at = offset - hlog_flushed_.load();
+    if (at + size > hlog_tail_.size()) return std::nullopt;
+    return hlog_tail_.substr(at, size);
+  }
   if (!persistence_enabled_) return std::nullopt;
-  if (!log_in_.is_open()) {
-    log_in_.open(log_path_, std::ios::binary);
-    if (!log_in_) return std::nullopt;
+  if (mapped_) {
+    // Followers read the shared mapping (the caller holds mu_).
+    if (offset > log_bytes_ || size > log_bytes_ - offset) return std::nullopt;
+    return std::string(mapped_->data() + offset, size);
   }
+  return ReadLogFile(offset, size);
+}
 
-  log_in_.clear();
-  log_in_.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
-  if (!log_in_) return std::nullopt;
+std::optional<std::string> KVStore::ReadLogFile(uint64_t offset, uint64_t size) const {
+  std::lock_guard<std::mutex> io_lock(io_mu_);
+  if (log_fd_ < 0) {
+    log_fd_ = ::open(log_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (log_fd_ < 0) return std::nullopt;
+    if (options_.access_hints) ::posix_fadvise(log_fd_, 0, 0, POSIX_FADV_RANDOM);
+  }
 
   std::string value;
   value.resize(size);
-  log_in_.read(&value[0], static_cast<std::streamsize>(size));
-  if (log_in_.gcount() != static_cast<std::streamsize>(size)) return std::nullopt;
-
+  uint64_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pread(log_fd_, &value[done], size - done, static_cast<off_t>(offset + done));
+    if (n <= 0) return std::nullopt;
+    done += static_cast<uint64_t>(n);
+  }
   return value;
 }
 
-void KVStore::ReplayLog() {
-  std::unique_lock lock(mu_);
-
-  index_.clear();
-
-  std::ifstream in(log_path_, std::ios::binary);
-  if (!in) return;  // no file yet
-
-  std::string header;
-  while (std::getline(in, header)) {
-    if (header.empty()) continue;
+// Counts into the checksum metrics. Entries from before checksums pass.
+bool KVStore::VerifyStored(const std::string& key, const Entry& e, const std::string& stored) const {
+  if (!e.has_crc) return true;
+  auto t0 = std::chrono::steady_clock::now();
+  bool ok = RecordChecksum(key, stored.data(), stored.size()) == e.crc;
+  checksum_ns_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                            std::chrono::steady_clock::now() - t0)
+                                            .count());
+  checksum_verifies_++;
+  if (!ok) checksum_failures_++;
+  return ok;
+}
 
-    std::istringstream iss(header);
-    std::string op;
-    iss >> op;
+// A crash mid-compaction can leave a partial .tmp behind. Older builds
+// renamed the log to .bak before moving the new one in, so a crash between
+// the two renames left only the .bak.
+void KVStore::RecoverInterruptedCompaction() {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::remove(CompactionTmpPath(log_path_), ec);
+  const std::string bak = log_path_ + ".bak";
+  if (!fs::exists(log_path_, ec) && fs::exists(bak, ec)) fs::rename(bak, log_path_, ec);
+}
 
-    if (op == "PUT") {
-      std::string key;
-      uint64_t value_size = 0;
-      iss >> key >> value_size;
-      if (key.empty()) throw std::runtime_error("Bad PUT header in log");
-
-      // value bytes begin at current position
-      std::streampos value_pos = in.tellg();
-      if (value_pos == std::streampos(-1)) break;
-
-      // Skip over the value bytes without allocating
-      in.seekg(static_cast<std::streamoff>(value_size), std::ios::cur);
-      if (!in) break;
-
-      // Consume trailing newline after value
-      char nl = 0;
-      in.get(nl);
-      if (!in || nl != '\n') {
-        // truncated/corrupt record -> stop replay safely
-        break;
+void KVStore::ReplayLog() {
+  index_.clear();
+  if (cindex_) cindex_->Clear();
+  live_bytes_ = 0;
+  hot_.clear();
+  hot_bytes_ = 0;
+  const uint64_t start = pindex_ ? OpenPersistentIndex() : 0;
+  std::error_code ec;
+  replay_total_ = std::filesystem::file_size(log_path_, ec);
+  replayed_bytes_ = start;
+
+  // Reading every value to check it costs a full pass over the log instead
+  // of a header scan, but a bad record is caught here rather than served.
+  LogReader reader(log_path_, /*verify_values=*/true);
+  if (start > 0) reader.Seek(start);
+  std::optional<ScanHints> hints;
+  if (options_.access_hints) hints.emplace(log_path_);
+  std::vector<LogRecord> group;
+  while (reader.NextGroup(&group)) {
+    replayed_bytes_.store(reader.offset(), std::memory_order_relaxed);
+    if (hints) hints->Advance(reader.offset());
+    for (auto& rec : group) {
+      if (!rec.checksum_ok) {
+        // Framing is intact, so later records are still good. A bad PUT
+        // leaves its key absent rather than at a stale or garbage value;
+        // a bad DEL is ignored, since the key it names can't be trusted.
+        checksum_failures_++;
+        if (rec.op == RecordOp::kPut) IndexDel(rec.key);
+        continue;
       }
+      if (rec.op == RecordOp::kPut) {
+        IndexPut(rec.key, ReplayedEntry(rec));
+      } else {
+        IndexDel(rec.key);
+      }
+    }
+  }
 
-      Entry e;
-      e.offset = static_cast<uint64_t>(value_pos);
-      e.size = value_size;
-      index_[key] = std::move(e);
+  // A truncated tail or unknown op stops replay safely; a malformed header
+  // for a known op means the log is not ours to guess about.
+  if (reader.status() == LogReader::Status::kBadHeader) {
+    throw std::runtime_error("Bad record header in log at offset " +
+                             std::to_string(reader.offset()));
+  }
 
-    } else if (op == "DEL") {
-      std::string key;
-      iss >> key;
-      if (key.empty()) throw std::runtime_error("Bad DEL header in log");
-      index_.erase(key);
+  // Cut off a torn tail so new appends don't land behind it and get
+  // swallowed by the next replay.
+  if (reader.status() == LogReader::Status::kTruncated) {
+    std::filesystem::resize_file(log_path_, reader.offset(), ec);
+  }
+  auto size = std::filesystem::file_size(log_path_, ec);
+  log_bytes_ = ec ? 0 : static_cast<uint64_t>(size);
+  replay_total_ = replayed_bytes_ = log_bytes_;
+  hlog_tail_.clear();
+  hlog_flushed_ = hlog_read_only_ = log_bytes_;
+  if (pindex_) CheckpointIndex(/*clean=*/false);
+}
 
-    } else {
-      // unknown op -> stop safely
-      break;
-    }
+Entry KVStore::ReplayedEntry(const LogRecord& rec) const {
+  if (rec.enc.codec > static_cast<uint8_t>(Codec::kLzDict) ||
+      (rec.enc.dict_id != 0 && (!Dictionary() || Dictionary()->id() != rec.enc.dict_id))) {
+    throw std::runtime_error("Record at offset " + std::to_string(rec.offset) +
+                             " needs a codec or dictionary this store does not have");
   }
+  Entry e;
+  e.offset = rec.value_offset;
+  e.size = rec.value_size;
+  e.codec = rec.enc.codec;
+  e.raw_size = rec.enc.raw_size;
+  e.has_crc = rec.has_crc;
+  e.crc = rec.crc;
+  return e;
 }
 
 // ---------- Compaction ----------
+// Commit protocol: write every live record to <log>.tmp, fsync it, rename it
+// over the log and fsync the directory (ReplaceFile). Until the rename the old
+// log is untouched, and after it the new one is complete and synced, so a
+// crash anywhere leaves one whole log; a leftover .tmp is deleted on open.
+// The new offsets are known while writing, so the index is updated in place
+// instead of being rebuilt by replaying the new log.
 bool KVStore::Compact() {
+  if (!persistence_enabled_ || static_ || sorted_) return true;
+  if (options_.read_only_follower) return false;  // the writer compacts
   std::unique_lock lock(mu_);
-  CloseFiles();
-
-  if (!persistence_enabled_) return true;
+  if (recovery_state_.load() == RecoveryState::kFailed) return false;  // the index is incomplete
+  if (pindex_) return CompactPersistentIndex();
+  if (!FlushHybridLog(log_bytes_)) return false;
 
   namespace fs = std::filesystem;
   auto parent = fs::path(log_path_).parent_path();
@@ -224,53 +889,709 @@ bool KVStore::Compact() {
     fs::create_directories(parent);
   }
 
+  const std::string tmp = CompactionTmpPath(log_path_);
+  std::vector<Moved> moved;
+  std::vector<std::string> lost;  // keys whose value could not be read back
+  uint64_t size = 0, live = 0;
+  const bool written =
+      options_.compaction_threads > 1
+          ? WriteCompactedPartitioned(tmp, options_.compaction_threads, &moved, &lost, &size, &live)
+          : WriteCompacted(tmp, &moved, &lost, &size, &live);
+  if (!written) {
+    std::remove(tmp.c_str());
+    return false;
+  }
 
-  const std::string tmp = log_path_ + ".tmp";
-  const std::string bak = log_path_ + ".bak";
+  compaction_seq_++;  // odd: lock-free Gets retry under mu_
+  const bool replaced = ReplaceFile(tmp, log_path_);
+  // Handles on the old log must not see the new one; reopen lazily on next
+  // use. Closed only after the rename: a lock-free Get may reopen log_fd_ at
+  // any time, and before the rename that would be the old file again.
+  CloseFiles();
+  if (!replaced) {
+    // The log is the old one or, if only the directory sync failed, the new
+    // one; either is complete, so rebuild from whichever it is.
+    ReplayLog();
+    PublishWatermark(/*new_file=*/true);
+    compaction_seq_++;
+    return false;
+  }
 
-  // Write a brand-new compacted log containing only latest live keys
   {
-    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
-    if (!out) return false;
+    ConcurrentIndex::AllLocked entries(cindex_.get());
+    for (const auto& m : moved) {
+      m.entry->offset = m.offset;
+      m.entry->crc = m.crc;
+      m.entry->has_crc = true;
+    }
+  }
+  compaction_seq_++;
+  for (const auto& key : lost) IndexDel(key);
+  if (options_.access_hints) DropCachedPages(log_path_);  // written once; Gets fault in what they need
+  log_bytes_ = size;
+  live_bytes_ = live;
+  hlog_flushed_ = hlog_read_only_ = size;
+  compactions_++;
+  PublishWatermark(/*new_file=*/true);
+  // The old hint names a file that no longer exists, whose inode may be reused.
+  if (HintsEnabled()) WriteHint();
+  else std::remove(HintFilePath().c_str());
+  return true;
+}
 
-    for (const auto& [key, entry] : index_) {
-      std::optional<std::string> v;
-      if (!persistence_enabled_ || entry.in_memory) {
-        v = entry.cached;
-      } else {
-        v = ReadValueAt(entry.offset, entry.size);
-      }
-      if (!v) continue;
+// One pass in layout order, values read through ReadValueAt.
+bool KVStore::WriteCompacted(const std::string& tmp, std::vector<Moved>* moved,
+                             std::vector<std::string>* lost, uint64_t* size, uint64_t* live) {
+  std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+  if (!out) return false;
+  moved->reserve(cindex_ ? cindex_->size() : index_.size());
+  RateLimiter* limiter = options_.background_io.get();
+
+  constexpr size_t kWriteChunk = 1 << 20;
+  std::string buf;
+  buf.reserve(kWriteChunk + 4096);
+  uint64_t read_bytes = 0;
+  bool damaged = false;
+  auto copy = [&](const std::string& key, Entry& entry) {
+    if (damaged) return;
+    // Compressed values are copied as stored; the hot tier only has them decoded.
+    const bool from_cache = entry.in_memory && entry.codec == 0;
+    std::optional<std::string> v;
+    if (from_cache) {
+      v = entry.cached;
+    } else {
+      v = ReadValueAt(entry.offset, entry.size);
+      read_bytes += entry.size;
+    }
+    if (!v) {
+      lost->push_back(key);
+      return;
+    }
+
+    // Rewriting a damaged value under a fresh checksum would launder it;
+    // keep the old log, where the damage stays detectable.
+    if (!from_cache && !VerifyStored(key, entry, *v)) {
+      damaged = true;
+      return;
+    }
 
+    const ValueEncoding enc = EncodingOf(entry);
+    Moved m{&entry, *size + buf.size() + PutHeaderSize(key, v->size(), enc), 0};
+    EncodePut(&buf, key, *v, enc, &m.crc);
+    moved->push_back(m);
+    if (buf.size() >= kWriteChunk) {
+      if (limiter) limiter->Acquire(read_bytes + buf.size());
+      read_bytes = 0;
+      out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+      *size += buf.size();
+      buf.clear();
+    }
+  };
+  if (options_.compaction_order == CompactionOrder::kIndex) {
+    ForEachEntry([&](const std::string& index_key, Entry& entry) { copy(UserKey(index_key), entry); });
+  } else {
+    for (const auto& item : LayoutOrder()) copy(item.key, *item.entry);
+  }
+  out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+  *size += buf.size();
+  *live = *size;
+  out.flush();
+  return !damaged && static_cast<bool>(out);
+}
 
-      std::string header = "PUT " + key + " " + std::to_string(v->size());
-      out.write(header.data(), static_cast<std::streamsize>(header.size()));
-      out.put('\n');
-      out.write(v->data(), static_cast<std::streamsize>(v->size()));
-      out.put('\n');
-    OpenFiles();
+// ---------- Persistent index ----------
+std::string KVStore::IndexFilePath() const { return log_path_ + ".idx"; }
+
+// Reuses the table if it was built for this very log file and is not ahead
+// of it; otherwise starts an empty one and replay rebuilds it from offset 0.
+uint64_t KVStore::OpenPersistentIndex() {
+  { std::ofstream touch(log_path_, std::ios::binary | std::ios::app); }  // the table names the file
+  std::error_code ec;
+  const uint64_t size = std::filesystem::file_size(log_path_, ec);
+  const uint64_t id = LogFileId(log_path_);
+  if (!ec && pindex_->Open(IndexFilePath(), id) && pindex_->applied() <= size &&
+      (pindex_->was_clean() || pindex_->Recount(size))) {
+    live_bytes_ = pindex_->live_bytes();
+    return pindex_->applied();
+  }
+  if (!pindex_->Create(IndexFilePath(), id)) {
+    throw std::runtime_error("Cannot create persistent index " + IndexFilePath());
+  }
+  return 0;
+}
+
+// Slots hold only a hash; a candidate is the key if its record header says so.
+PersistentIndex::IsKey KVStore::SlotHasKey(const std::string& key) const {
+  return [this, prefix = "PUT " + key + " "](const IndexSlot& s) {
+    if (s.header_len < prefix.size()) return false;
+    auto head = ReadValueAt(s.record_offset, prefix.size());
+    return head && *head == prefix;
+  };
+}
+
+const IndexSlot* KVStore::FindSlot(const std::string& key, uint64_t hash,
+                                   std::string* record) const {
+  const std::string prefix = "PUT " + key + " ";
+  return pindex_->Find(hash, [&](const IndexSlot& s) {
+    auto r = ReadValueAt(s.record_offset, s.record_len);
+    if (!r || r->compare(0, prefix.size(), prefix) != 0) return false;
+    *record = std::move(*r);
+    return true;
+  });
+}
 
+bool KVStore::SlotEntry(const IndexSlot& slot, const std::string& record, Entry* e,
+                        std::string* key) const {
+  LogRecord rec;
+  if (record.size() != slot.record_len ||
+      !ParsePutHeader(record.substr(0, slot.header_len - 1), &rec) ||
+      rec.value_size != slot.value_size()) {
+    return false;
+  }
+  e->offset = slot.value_offset();
+  e->size = rec.value_size;
+  e->codec = rec.enc.codec;
+  e->raw_size = rec.enc.raw_size;
+  e->has_crc = rec.has_crc;
+  e->crc = rec.crc;
+  if (key) *key = std::move(rec.key);
+  return true;
+}
+
+// The log must be durable up to `applied` before the table claims it.
+bool KVStore::CheckpointIndex(bool clean) {
+  if (log_out_.is_open()) log_out_.flush();
+  if (!SyncFile(log_path_) || !pindex_->Checkpoint(log_bytes_, clean)) return false;
+  pindex_checkpointed_ = log_bytes_;
+  return true;
+}
+
+// Bounds how much log a restart has to replay.
+void KVStore::MaybeCheckpointIndex() {
+  constexpr uint64_t kCheckpointBytes = 64ull << 20;
+  if (pindex_ && log_bytes_ >= pindex_checkpointed_ + kCheckpointBytes) CheckpointIndex(false);
+}
+
+// Same commit protocol as Compact(). Records are copied verbatim in log
+// order, and the new table is built beside the new log and renamed into
+// place after it; a crash in between leaves a table naming the old log
+// file, which the next open discards and rebuilds.
+bool KVStore::CompactPersistentIndex() {
+  std::vector<IndexSlot> slots;
+  slots.reserve(pindex_->count());
+  pindex_->ForEach([&](const IndexSlot& s) { slots.push_back(s); });
+  std::sort(slots.begin(), slots.end(), [](const IndexSlot& a, const IndexSlot& b) {
+    return a.record_offset < b.record_offset;
+  });
+
+  const std::string tmp = CompactionTmpPath(log_path_);
+  uint64_t size = 0;
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    constexpr size_t kWriteChunk = 1 << 20;
+    std::string buf;
+    for (auto& s : slots) {
+      auto record = ReadValueAt(s.record_offset, s.record_len);
+      Entry e;
+      std::string key;
+      // As in Compact(): never launder a damaged value under a new log.
+      if (!record || !SlotEntry(s, *record, &e, &key) ||
+          !VerifyStored(key, e, record->substr(s.header_len, e.size))) {
+        out.close();
+        std::remove(tmp.c_str());
+        return false;
+      }
+      s.record_offset = size + buf.size();
+      buf += *record;
+      if (buf.size() >= kWriteChunk) {
+        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        size += buf.size();
+        buf.clear();
+      }
     }
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    size += buf.size();
     out.flush();
-    if (!out) return false;
+    if (!out) {
+      out.close();
+      std::remove(tmp.c_str());
+      return false;
+    }
   }
 
-  // Replace old log atomically-ish (safe enough for this stage)
+  const uint64_t new_id = LogFileId(tmp);
+  const std::string idx_tmp = IndexFilePath() + ".compact";
+  {
+    PersistentIndex next;
+    bool ok = next.Create(idx_tmp, new_id, slots.size() * 2);
+    IndexSlot replaced;
+    auto never = [](const IndexSlot&) { return false; };  // keys are already unique
+    for (size_t i = 0; ok && i < slots.size(); i++) ok = next.Put(slots[i], never, &replaced);
+    if (!ok || !next.Checkpoint(size, false)) {
+      std::remove(idx_tmp.c_str());
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+
+  CloseFiles();
+  if (!ReplaceFile(tmp, log_path_)) {
+    std::remove(idx_tmp.c_str());
+    ReplayLog();
+    PublishWatermark(/*new_file=*/true);
+    return false;
+  }
+  log_bytes_ = size;
+  live_bytes_ = size;
+  compactions_++;
+  PublishWatermark(/*new_file=*/true);
+  if (!ReplaceFile(idx_tmp, IndexFilePath()) || !pindex_->Open(IndexFilePath(), new_id)) {
+    ReplayLog();  // the log is compacted either way; rebuild its table from it
+    return true;
+  }
+  pindex_checkpointed_ = size;
+  return true;
+}
+
+// ---------- Background recovery ----------
+std::string KVStore::HintFilePath() const { return log_path_ + ".hint"; }
+
+bool KVStore::HintsEnabled() const {
+  return persistence_enabled_ && options_.background_recovery && !pindex_ && !static_ && !sorted_ &&
+         recovery_state_.load() == RecoveryState::kReady;
+}
+
+// The thread takes mu_ before the constructor returns, so every other call
+// waits for the replay, except Get, which may be answered from the hint.
+void KVStore::RecoverInBackground() {
+  recovery_state_ = RecoveryState::kReplaying;
+  hint_state_ = HintState::kLoading;
+  std::error_code ec;
+  replay_total_ = std::filesystem::file_size(log_path_, ec);  // for Recovery() until replay starts
+  bool locked = false;
+  recovery_thread_ = std::thread([this, &locked] {
+    std::unique_lock lock(mu_);
+    {
+      std::lock_guard<std::mutex> l(recovery_mu_);
+      locked = true;
+    }
+    recovery_cv_.notify_all();
+
+    LoadHint();
+    if (before_replay_for_testing) before_replay_for_testing();
+    std::string error;
+    try {
+      ReplayLog();
+      OpenFiles();
+      PublishWatermark(/*new_file=*/true);
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+    recovery_state_.store(error.empty() ? RecoveryState::kReady : RecoveryState::kFailed,
+                          std::memory_order_release);
+    {
+      std::unique_lock hint_lock(hint_mu_);  // waits out hinted Gets in flight
+      std::lock_guard<std::mutex> l(recovery_mu_);
+      hint_state_ = HintState::kRetired;
+      recovery_error_ = error;
+      hint_.Close();
+      hint_tail_.clear();
+    }
+    recovery_cv_.notify_all();
+  });
+  std::unique_lock<std::mutex> l(recovery_mu_);
+  recovery_cv_.wait(l, [&] { return locked; });
+}
+
+// The hint covers the log up to hint_.covers(); what was written after that
+// is read here, as replay would apply it, into hint_tail_.
+void KVStore::LoadHint() {
+  std::error_code ec;
+  const uint64_t size = std::filesystem::file_size(log_path_, ec);
+  bool ok = !ec && hint_.Open(HintFilePath(), LogFileId(log_path_)) && hint_.covers() <= size;
   try {
-    if (fs::exists(bak)) fs::remove(bak);
-    if (fs::exists(log_path_)) fs::rename(log_path_, bak);
-    fs::rename(tmp, log_path_);
-    if (fs::exists(bak)) fs::remove(bak);
-  } catch (...) {
+    LogReader reader(log_path_, /*verify_values=*/true);
+    if (ok) reader.Seek(hint_.covers());
+    std::vector<LogRecord> group;
+    while (ok && reader.NextGroup(&group)) {
+      for (const auto& rec : group) {
+        if (rec.op == RecordOp::kPut && rec.checksum_ok) {
+          hint_tail_[rec.key] = ReplayedEntry(rec);
+        } else if (rec.op == RecordOp::kPut || rec.checksum_ok) {
+          hint_tail_[rec.key] = std::nullopt;  // a bad DEL is ignored, as in replay
+        }
+      }
+    }
+    ok = ok && reader.status() != LogReader::Status::kBadHeader;
+  } catch (const std::exception&) {
+    ok = false;  // replay will report it
+  }
+  if (!ok) {
+    hint_.Close();
+    hint_tail_.clear();
+  }
+  {
+    std::lock_guard<std::mutex> l(recovery_mu_);
+    hint_state_ = ok ? HintState::kServing : HintState::kUnavailable;
+  }
+  recovery_cv_.notify_all();
+}
+
+bool KVStore::GetFromHint(const std::string& key, uint64_t hash,
+                          std::optional<std::string>* value) const {
+  {
+    std::unique_lock<std::mutex> l(recovery_mu_);
+    recovery_cv_.wait(l, [&] { return hint_state_ != HintState::kLoading; });
+  }
+  if (recovery_state_.load(std::memory_order_acquire) == RecoveryState::kFailed) {
+    value->reset();
+    return true;
+  }
+  std::shared_lock hint_lock(hint_mu_);
+  {
+    std::lock_guard<std::mutex> l(recovery_mu_);
+    if (hint_state_ != HintState::kServing) return false;
+  }
+
+  Entry e;
+  auto t = hint_tail_.find(key);
+  if (t != hint_tail_.end()) {
+    if (!t->second) {
+      value->reset();
+      return true;
+    }
+    e = *t->second;
+  } else {
+    HintEntry h;
+    if (!hint_.Find(key, hash, &h)) {
+      value->reset();
+      return true;
+    }
+    e.offset = h.value_offset;
+    e.size = h.size;
+    e.codec = h.codec;
+    e.raw_size = h.raw_size;
+    e.has_crc = h.has_crc != 0;
+    e.crc = h.crc;
+  }
+  gets_++;
+  // Everything the hint names is in the file, and replay holds mu_ and owns
+  // the hybrid log's in-memory tail, so read the file directly.
+  auto v = ReadLogFile(e.offset, e.size);
+  // The hint's entries are not checksummed; the values they lead to are.
+  if (v && !VerifyStored(key, e, *v)) v.reset();
+  if (v && e.codec != 0) v = DecodeStored(e, std::move(*v));
+  *value = std::move(v);
+  return true;
+}
+
+// Rewritten whole, so that it matches the index exactly. Best effort: a
+// store without a hint still recovers, just without serving reads early.
+void KVStore::WriteHint() {
+  std::vector<std::pair<HintEntry, std::string>> entries;
+  entries.reserve(cindex_ ? cindex_->size() : index_.size());
+  ForEachEntry([&](const std::string& index_key, Entry& e) {
+    HintEntry h;
+    std::string key = UserKey(index_key);
+    h.hash = HashKey(key);
+    h.value_offset = e.offset;
+    h.size = e.size;
+    h.raw_size = e.raw_size;
+    h.crc = e.crc;
+    h.codec = e.codec;
+    h.has_crc = e.has_crc ? 1 : 0;
+    entries.emplace_back(h, std::move(key));
+  });
+  if (log_out_.is_open()) log_out_.flush();
+  if (!SyncFile(log_path_) ||
+      !WriteHintFile(HintFilePath(), LogFileId(log_path_), log_bytes_, &entries)) {
+    std::remove(HintFilePath().c_str());
+  }
+}
+
+RecoveryStatus KVStore::Recovery() const {
+  RecoveryStatus st;
+  const RecoveryState state = recovery_state_.load();
+  st.ready = state == RecoveryState::kReady;
+  st.failed = state == RecoveryState::kFailed;
+  {
+    std::lock_guard<std::mutex> l(recovery_mu_);
+    st.serving_reads = state == RecoveryState::kReplaying && hint_state_ == HintState::kServing;
+    st.error = recovery_error_;
+  }
+  st.total_bytes = replay_total_.load();
+  st.replayed_bytes = replayed_bytes_.load();
+  return st;
+}
+
+// ---------- Hybrid log ----------
+bool KVStore::HybridLog() const {
+  return persistence_enabled_ && options_.mutable_log_bytes > 0 && !pindex_ && !cindex_ && !static_ && !sorted_;
+}
+
+// Overwrites the key's record where it lies if it is in the mutable region
+// and the new record has the same length: same value size, stored raw (a
+// value that may be compressed always appends).
+bool KVStore::UpdateInPlace(const std::string& key, const std::string& value) {
+  if (options_.compress_min_bytes != 0 && value.size() >= options_.compress_min_bytes) return false;
+  std::string scratch;
+  auto it = index_.find(IndexKey(key, &scratch));
+  if (it == index_.end()) return false;
+  Entry& e = it->second;
+  if (e.offset < hlog_read_only_ || e.codec != 0 || !e.has_crc || e.size != value.size()) return false;
+
+  std::string rec;
+  uint32_t crc = 0;
+  EncodePut(&rec, key, value, ValueEncoding(), &crc);
+  const uint64_t start = e.offset - PutHeaderSize(key, value.size());
+  rec.copy(&hlog_tail_[start - hlog_flushed_.load()], rec.size());
+  e.crc = crc;
+  in_place_updates_++;
+  return true;
+}
+
+bool KVStore::FlushHybridLog(uint64_t upto) {
+  const uint64_t flushed = hlog_flushed_.load();
+  if (!HybridLog() || upto <= flushed) return true;
+  if (!OpenFiles()) return false;
+  const uint64_t n = upto - flushed;
+  Preallocate(upto);
+  log_out_.clear();
+  log_out_.seekp(0, std::ios::end);
+  log_out_.write(hlog_tail_.data(), static_cast<std::streamsize>(n));
+  log_out_.flush();
+  if (!log_out_) return false;
+  hlog_tail_.erase(0, n);
+  hlog_flushed_ = upto;
+  hlog_read_only_ = std::max(hlog_read_only_, upto);  // what is in the file can't change in place
+  PublishWatermark();
+  return true;
+}
+
+// ---------- Watermark ----------
+std::string KVStore::WatermarkPath() const { return log_path_ + ".wm"; }
+
+// Only whole records that are in the file: the hybrid log's tail is not.
+void KVStore::PublishWatermark(bool new_file) {
+  if (!watermark_) return;
+  if (new_file || watermark_file_id_ == 0) watermark_file_id_ = LogFileId(log_path_);
+  watermark_->Publish(watermark_file_id_, HybridLog() ? hlog_flushed_.load() : log_bytes_);
+}
+
+// ---------- Read-only follower ----------
+static int64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Nothing that writes, caches or keeps files of its own applies.
+void KVStore::OpenFollower() {
+  const Options given = options_;
+  options_ = Options();
+  options_.read_only_follower = true;
+  options_.verify_checksums = given.verify_checksums;
+  options_.huge_pages = given.huge_pages;
+  options_.numa_node = given.numa_node;
+  options_.follow_poll_ms = std::max(1, given.follow_poll_ms);
+  PlaceIndex();
+
+  watermark_ = std::make_unique<LogWatermark>();
+  std::string err;
+  if (!watermark_->Open(WatermarkPath(), /*writer=*/false, &err) || !FollowReplay(&err)) {
+    throw std::runtime_error(err);
+  }
+  caught_up_ns_ = SteadyNowNs();
+  follow_thread_ = std::thread([this] { FollowLoop(); });
+}
+
+void KVStore::ApplyFollowed(const LogRecord& rec, Index* index, uint64_t* live) const {
+  auto it = index->find(rec.key);
+  const bool drop = rec.op == RecordOp::kDel ? rec.checksum_ok : !rec.checksum_ok;
+  if (it != index->end() && drop) {
+    *live -= PutRecordSize(rec.key, it->second, EncodingOf(it->second));
+    index->erase(it);
+    it = index->end();
+  }
+  // As in replay, a bad PUT leaves its key absent and a bad DEL is ignored.
+  if (!rec.checksum_ok) checksum_failures_++;
+  if (rec.op != RecordOp::kPut || !rec.checksum_ok) return;
+  Entry e = ReplayedEntry(rec);
+  *live += PutRecordSize(rec.key, e, EncodingOf(e));
+  if (it == index->end()) {
+    index->emplace(rec.key, std::move(e));
+  } else {
+    *live -= PutRecordSize(rec.key, it->second, EncodingOf(it->second));
+    it->second = std::move(e);
+  }
+}
+
+bool KVStore::FollowReplay(std::string* err) {
+  // Around a compaction the file at log_path_ and the mark can briefly name
+  // different logs (rename, then publish); wait for them to agree.
+  std::unique_ptr<MappedLog> log;
+  LogWatermark::Mark mark;
+  for (int attempt = 0;; attempt++) {
+    mark = watermark_->Read();
+    log = std::make_unique<MappedLog>();
+    if (!log->Open(log_path_, err)) return false;
+    if (mark.file_id == log->file_id()) break;
+    if (attempt == 100) {
+      *err = mark.file_id == 0 ? WatermarkPath() + ": nothing published yet"
+                               : WatermarkPath() + " names another file than " + log_path_;
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (!log->Reserve(mark.bytes)) {
+    *err = log_path_ + ": mmap failed";
     return false;
   }
 
-  // Rebuild index from the compacted log
-  lock.unlock();
-  ReplayLog();
+  Index fresh(0, KeyHasher(), std::equal_to<std::string>(), index_.get_allocator());
+  uint64_t live = 0;
+  LogReader reader(log->data(), mark.bytes, /*verify_values=*/true);
+  std::vector<LogRecord> group;
+  while (reader.NextGroup(&group)) {
+    for (const auto& rec : group) {
+      if (rec.enc.dict_id != 0 && !Dictionary()) {
+        // The writer saves its dictionary before any record names it.
+        std::unique_lock lock(mu_);
+        SetDictionary(LoadDictionary(DictionaryPath(log_path_)));
+      }
+      ApplyFollowed(rec, &fresh, &live);
+    }
+  }
+  if (reader.status() != LogReader::Status::kEof) {
+    *err = log_path_ + ": " + LogStatusName(reader.status()) + " record at offset " +
+           std::to_string(reader.offset());
+    return false;
+  }
+  {
+    std::unique_lock lock(mu_);
+    index_.swap(fresh);
+    live_bytes_ = live;
+    log_bytes_ = mark.bytes;
+    mapped_.swap(log);
+  }
+  followed_bytes_ = mark.bytes;
+  return true;  // the old index and mapping go here, outside the lock
+}
 
-  ReplayLog();
+bool KVStore::FollowTail(const LogWatermark::Mark& mark, std::string* err) {
+  constexpr uint64_t kChunk = 16ull << 20;  // bounds how long one apply holds mu_
+  if (mark.bytes > mapped_->mapped()) {
+    std::unique_lock lock(mu_);
+    if (!mapped_->Reserve(mark.bytes)) {
+      *err = log_path_ + ": mmap failed";
+      return false;
+    }
+  }
+  // Parsed without the lock: only this thread changes the mapping.
+  const uint64_t from = followed_bytes_.load();
+  LogReader reader(mapped_->data(), mark.bytes, /*verify_values=*/true);
+  reader.Seek(from);
+  std::vector<LogRecord> records, group;
+  bool need_dict = false;
+  while (reader.offset() - from < kChunk && reader.NextGroup(&group)) {
+    for (auto& rec : group) {
+      need_dict = need_dict || (rec.enc.dict_id != 0 && !Dictionary());
+      records.push_back(std::move(rec));
+    }
+  }
+  if (reader.offset() - from < kChunk && reader.status() != LogReader::Status::kEof) {
+    *err = log_path_ + ": " + LogStatusName(reader.status()) + " record at offset " +
+           std::to_string(reader.offset());
+    return false;
+  }
+  std::unique_lock lock(mu_);
+  if (need_dict) SetDictionary(LoadDictionary(DictionaryPath(log_path_)));
+  for (const auto& rec : records) ApplyFollowed(rec, &index_, &live_bytes_);
+  log_bytes_ = reader.offset();
+  followed_bytes_ = reader.offset();
   return true;
 }
 
+void KVStore::FollowLoop() {
+  const auto poll = std::chrono::milliseconds(options_.follow_poll_ms);
+  while (!follow_stop_.load()) {
+    const uint32_t seen = watermark_->version();
+    const int64_t checked = SteadyNowNs();
+    const LogWatermark::Mark mark = watermark_->Read();
+    std::string err;
+    bool ok = true;
+    try {
+      if (mark.file_id != mapped_->file_id() || mark.bytes < followed_bytes_.load()) {
+        ok = FollowReplay(&err);  // compacted, or replaced under us
+        if (ok) follow_reloads_++;
+      } else if (mark.bytes > followed_bytes_.load()) {
+        ok = FollowTail(mark, &err);
+      }
+    } catch (const std::exception& e) {
+      ok = false;
+      err = e.what();
+    }
+    {
+      std::lock_guard<std::mutex> l(follow_mu_);
+      follow_error_ = err;
+    }
+    if (ok && mark.file_id == mapped_->file_id() && followed_bytes_.load() >= mark.bytes) {
+      caught_up_ns_ = checked;  // everything published before `checked` is in
+    } else if (ok) {
+      continue;  // more than a chunk behind
+    }
+    watermark_->Wait(seen, poll);
+  }
+}
+
+FollowerStatus KVStore::Follower() const {
+  FollowerStatus st;
+  if (!options_.read_only_follower) return st;
+  st.following = true;
+  st.applied_bytes = followed_bytes_.load();
+  st.published_bytes = watermark_->Read().bytes;
+  st.staleness_ms = static_cast<uint64_t>(std::max<int64_t>(0, SteadyNowNs() - caught_up_ns_.load()) / 1000000);
+  st.reloads = follow_reloads_.load();
+  std::lock_guard<std::mutex> l(follow_mu_);
+  st.error = follow_error_;
+  return st;
+}
+
+// ---------- Static table ----------
+// No lock: the table never changes, and the counters are atomic.
+std::optional<std::string> KVStore::GetStatic(const std::string& key) const {
+  gets_++;
+  StaticTable::Record rec;
+  if (!static_->Find(key, &rec)) return std::nullopt;
+  std::optional<std::string> v(std::in_place, rec.value, rec.size);
+  Entry e;
+  e.has_crc = true;
+  e.crc = rec.crc;
+  if (options_.verify_checksums && !VerifyStored(key, e, *v)) v.reset();
+  return v;
+}
+
+// ---------- Sorted table ----------
+// No lock either: the table never changes, and reads use pread.
+std::optional<std::string> KVStore::GetSorted(const std::string& key) const {
+  gets_++;
+  const bool verify = options_.verify_checksums;
+  bool damaged = false;
+  std::string value;
+  const bool found = sorted_->Find(key, &value, verify, &damaged);
+  if (verify && (found || damaged)) checksum_verifies_++;
+  if (damaged) checksum_failures_++;
+  if (!found) return std::nullopt;
+  return value;
+}
+
+bool KVStore::Scan(const std::string& start, const std::string& end,
+                   const std::function<bool(const std::string&, const std::string&)>& fn) const {
+  if (!sorted_) return false;
+  if (sorted_->Scan(start, end, options_.verify_checksums, fn)) return true;
+  checksum_failures_++;
+  return false;
+}
+
 }  // namespace kv
@@ -0,0 +1,243 @@
+#include "kvstore/backup.h"
+#include "kvstore/log_tools.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Offline inspection and maintenance of AOF files, e.g. data/http.aof.
+// Do not run `compact` in place against a log a live server has open.
+
+static void PrintHelp() {
+  std::cout << "usage: kvtool <command> <log> [options]\n"
+            << "commands:\n"
+            << "  dump <log>      write live keys/values (--format binary|jsonl, --out FILE)\n"
+            << "  load <log>      append records from a dump (--format binary|jsonl, --in FILE)\n"
+            << "  verify <log>    check framing and re-read every value; prints first bad offset\n"
+            << "  stats <log>     key count, size histograms, garbage ratio\n"
+            << "  compact <log>   rewrite keeping only live keys (--out FILE, default in place)\n"
+            << "                  --sorted: write a sorted table to --out FILE instead\n"
+            << "  backup <log>    copy what is new since the last backup into --dest DIR\n"
+            << "  restore <dir>   rebuild a log from backup DIR into --out FILE\n"
+            << "  build <log>     write live keys as an immutable static table to --out FILE\n"
+            << "options:\n"
+            << "  --threads N     worker threads (default: all cores)\n";
+}
+
+struct Args {
+  std::string cmd;
+  std::string log;
+  std::string format = "jsonl";
+  std::string in;
+  std::string out;
+  std::string dest;
+  int threads = 0;
+  bool sorted = false;
+};
+
+static bool ParseArgs(int argc, char** argv, Args* a) {
+  std::vector<std::string> pos;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    auto next = [&](std::string* out) {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << x << "\n";
+        return false;
+      }
+      *out = argv[++i];
+      return true;
+    };
+    if (x == "--format") {
+      if (!next(&a->format)) return false;
+    } else if (x == "--in") {
+      if (!next(&a->in)) return false;
+    } else if (x == "--out") {
+      if (!next(&a->out)) return false;
+    } else if (x == "--dest") {
+      if (!next(&a->dest)) return false;
+    } else if (x == "--threads") {
+      std::string n;
+      if (!next(&n)) return false;
+      char* end = nullptr;
+      errno = 0;
+      const long v = std::strtol(n.c_str(), &end, 10);
+      if (n.empty() || *end != '\0' || errno != 0 || v < 0 || v > 1024) {
+        std::cerr << "Bad value for --threads: " << n << "\n";
+        return false;
+      }
+      a->threads = static_cast<int>(v);
+    } else if (x == "--sorted") {
+      a->sorted = true;
+    } else if (x == "--help" || x == "-h") {
+      return false;
+    } else {
+      pos.push_back(x);
+    }
+  }
+  if (pos.size() != 2) return false;
+  a->cmd = pos[0];
+  a->log = pos[1];
+  return a->format == "jsonl" || a->format == "binary";
+}
+
+static void PrintHist(const char* name, const std::vector<uint64_t>& hist) {
+  std::cout << name << ":\n";
+  for (size_t i = 0; i < hist.size(); i++) {
+    if (hist[i] == 0) continue;
+    uint64_t lo = i == 0 ? 0 : (1ull << (i - 1));
+    uint64_t hi = i == 0 ? 0 : (1ull << i) - 1;
+    std::cout << "  [" << lo << ", " << hi << "] " << hist[i] << "\n";
+  }
+}
+
+int main(int argc, char** argv) {
+  Args a;
+  if (!ParseArgs(argc, argv, &a)) {
+    PrintHelp();
+    return 2;
+  }
+  kv::DumpFormat fmt = a.format == "binary" ? kv::DumpFormat::kBinary : kv::DumpFormat::kJsonLines;
+  std::string err;
+
+  if (a.cmd == "dump") {
+    bool ok;
+    if (a.out.empty()) {
+      std::ios::sync_with_stdio(false);
+      ok = kv::DumpLog(a.log, fmt, std::cout, a.threads, &err);
+    } else {
+      std::ofstream out(a.out, std::ios::binary | std::ios::trunc);
+      ok = out && kv::DumpLog(a.log, fmt, out, a.threads, &err);
+    }
+    if (!ok) {
+      std::cerr << "dump failed: " << err << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (a.cmd == "load") {
+    uint64_t n = 0;
+    bool ok;
+    if (a.in.empty()) {
+      ok = kv::LoadDump(std::cin, fmt, a.log, &n, &err);
+    } else {
+      std::ifstream in(a.in, std::ios::binary);
+      ok = in && kv::LoadDump(in, fmt, a.log, &n, &err);
+    }
+    std::cout << "loaded=" << n << "\n";
+    if (!ok) {
+      std::cerr << "load failed: " << err << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (a.cmd == "verify") {
+    kv::VerifyReport rep = kv::VerifyLog(a.log, a.threads);
+    std::cout << "records=" << rep.records << " valid_bytes=" << rep.bytes << "\n";
+    if (!rep.ok) {
+      std::cout << "BAD first_bad_offset=" << rep.first_bad_offset << " reason=" << rep.reason
+                << "\n";
+      return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+  }
+
+  if (a.cmd == "stats") {
+    kv::LogStats st;
+    if (!kv::ComputeLogStats(a.log, &st)) {
+      std::cerr << "cannot open " << a.log << "\n";
+      return 1;
+    }
+    std::cout << "file_size=" << st.scan.file_size << "\n"
+              << "records=" << st.scan.records << " puts=" << st.scan.puts
+              << " dels=" << st.scan.dels << "\n"
+              << "live_keys=" << st.live_keys << " live_bytes=" << st.live_bytes << "\n"
+              << "garbage_ratio=" << st.garbage_ratio << "\n"
+              << "compressed_values=" << st.compressed_values
+              << " raw_bytes=" << st.compressed_raw_bytes
+              << " stored_bytes=" << st.compressed_stored_bytes << "\n"
+              << "tail=" << kv::LogStatusName(st.scan.status) << "\n";
+    PrintHist("key_size_hist", st.key_size_hist);
+    PrintHist("value_size_hist", st.value_size_hist);
+    return 0;
+  }
+
+  if (a.cmd == "compact" && a.sorted) {
+    if (a.out.empty()) {
+      std::cerr << "compact --sorted needs --out FILE\n";
+      return 2;
+    }
+    kv::SortedBuildReport rep;
+    if (!kv::CompactToSortedTable(a.log, a.out, a.threads, &rep, &err)) {
+      std::cerr << "compact failed: " << err << "\n";
+      return 1;
+    }
+    std::cout << "keys=" << rep.keys << " blocks=" << rep.blocks << " file_bytes=" << rep.file_bytes
+              << " resident_bytes=" << rep.resident_bytes << "\n";
+    return 0;
+  }
+
+  if (a.cmd == "compact") {
+    std::string out = a.out.empty() ? a.log : a.out;
+    if (!kv::CompactLogFile(a.log, out, a.threads, &err)) {
+      std::cerr << "compact failed: " << err << "\n";
+      return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+  }
+
+  if (a.cmd == "backup") {
+    if (a.dest.empty()) {
+      std::cerr << "backup needs --dest DIR\n";
+      return 2;
+    }
+    kv::BackupResult res;
+    if (!kv::BackupLog(a.log, a.dest, &res, &err)) {
+      std::cerr << "backup failed: " << err << "\n";
+      return 1;
+    }
+    std::cout << (res.full ? "full" : "incremental") << " generation=" << res.generation
+              << " chunk=" << res.chunk_seq << " bytes_copied=" << res.bytes_copied
+              << " log_end=" << res.log_end << "\n";
+    return 0;
+  }
+
+  if (a.cmd == "restore") {
+    if (a.out.empty()) {
+      std::cerr << "restore needs --out FILE\n";
+      return 2;
+    }
+    uint64_t bytes = 0;
+    if (!kv::RestoreLog(a.log, a.out, &bytes, &err)) {
+      std::cerr << "restore failed: " << err << "\n";
+      return 1;
+    }
+    std::cout << "restored_bytes=" << bytes << "\n";
+    return 0;
+  }
+
+  if (a.cmd == "build") {
+    if (a.out.empty()) {
+      std::cerr << "build needs --out FILE\n";
+      return 2;
+    }
+    kv::StaticBuildReport rep;
+    if (!kv::BuildStaticTable(a.log, a.out, a.threads, &rep, &err)) {
+      std::cerr << "build failed: " << err << "\n";
+      return 1;
+    }
+    std::cout << "keys=" << rep.keys << " file_bytes=" << rep.file_bytes
+              << " index_bits_per_key=" << rep.index_bits_per_key << " attempts=" << rep.attempts
+              << "\n";
+    return 0;
+  }
+
+  PrintHelp();
+  return 2;
+}
@@ -0,0 +1,114 @@
+#include "kvstore/large_pages.h"
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <new>
+
+namespace kv {
+
+namespace {
+
+constexpr size_t kHugePage = 2u << 20;
+
+size_t RoundUp(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+size_t MappedSize(size_t bytes, const MemoryPlacement& placement) {
+  return placement.huge_pages == HugePages::kOff ? bytes : RoundUp(bytes, kHugePage);
+}
+
+// THP only backs 2 MB-aligned ranges: map a huge page extra and trim.
+void* MapAligned(size_t size) {
+  void* p = ::mmap(nullptr, size + kHugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return nullptr;
+  const uintptr_t start = reinterpret_cast<uintptr_t>(p);
+  const uintptr_t aligned = RoundUp(start, kHugePage);
+  if (aligned > start) ::munmap(p, aligned - start);
+  const size_t tail = start + size + kHugePage - (aligned + size);
+  if (tail > 0) ::munmap(reinterpret_cast<void*>(aligned + size), tail);
+  return reinterpret_cast<void*>(aligned);
+}
+
+}  // namespace
+
+int CurrentNumaNode() {
+  unsigned cpu = 0, node = 0;
+  if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return 0;
+  return static_cast<int>(node);
+}
+
+void* MapLarge(size_t bytes, const MemoryPlacement& placement) {
+  if (bytes == 0) return nullptr;
+  const size_t size = MappedSize(bytes, placement);
+  void* p = nullptr;
+  if (placement.huge_pages == HugePages::kExplicit) {
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED) p = nullptr;
+  }
+  if (!p && placement.huge_pages != HugePages::kOff) {
+    p = MapAligned(size);
+    if (p) ::madvise(p, size, MADV_HUGEPAGE);
+  }
+  if (!p) {
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+  }
+  // Before the first touch, so every page is allocated on the node.
+  if (placement.numa_node >= 0 && placement.numa_node < 64) {
+    unsigned long mask = 1ul << placement.numa_node;
+    ::syscall(SYS_mbind, p, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+  }
+  return p;
+}
+
+void UnmapLarge(void* p, size_t bytes, const MemoryPlacement& placement) {
+  if (p) ::munmap(p, MappedSize(bytes, placement));
+}
+
+LargePageArena::~LargePageArena() {
+  for (void* c : chunks_) UnmapLarge(c, kChunkBytes, placement_);
+}
+
+void* LargePageArena::Allocate(size_t bytes) {
+  if (bytes > kMaxSmallBytes) {
+    void* p = MapLarge(bytes, placement_);
+    if (!p) throw std::bad_alloc();
+    mapped_bytes_ += MappedSize(bytes, placement_);
+    return p;
+  }
+  const size_t size = RoundUp(bytes == 0 ? 1 : bytes, kAlign);
+  void*& head = free_[size / kAlign];
+  if (head) {
+    void* p = head;
+    head = *static_cast<void**>(p);
+    return p;
+  }
+  if (left_ < size) {
+    void* c = MapLarge(kChunkBytes, placement_);
+    if (!c) throw std::bad_alloc();
+    chunks_.push_back(c);
+    mapped_bytes_ += kChunkBytes;
+    next_ = static_cast<char*>(c);
+    left_ = kChunkBytes;  // the old tail is abandoned
+  }
+  void* p = next_;
+  next_ += size;
+  left_ -= size;
+  return p;
+}
+
+void LargePageArena::Deallocate(void* p, size_t bytes) {
+  if (bytes > kMaxSmallBytes) {
+    UnmapLarge(p, bytes, placement_);
+    mapped_bytes_ -= MappedSize(bytes, placement_);
+    return;
+  }
+  void*& head = free_[RoundUp(bytes == 0 ? 1 : bytes, kAlign) / kAlign];
+  *static_cast<void**>(p) = head;
+  head = p;
+}
+
+}  // namespace kv
@@ -0,0 +1,415 @@
+#include "kvstore/local_transport.h"
+
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace kv {
+
+namespace {
+
+constexpr uint32_t kMaxFrame = 64u << 20;
+constexpr int kRingPollMs = 100;  // how often a ring reader checks for a dead peer
+
+void PutU16(std::string* out, uint16_t v) { out->append(reinterpret_cast<const char*>(&v), 2); }
+void PutU32(std::string* out, uint32_t v) { out->append(reinterpret_cast<const char*>(&v), 4); }
+
+std::string EncodeRequest(const LocalRequest& req) {
+  std::string out;
+  out.reserve(7 + req.ns.size() + req.key.size() + req.value.size());
+  out.push_back(static_cast<char>(req.op));
+  PutU16(&out, static_cast<uint16_t>(req.ns.size()));
+  PutU32(&out, static_cast<uint32_t>(req.key.size()));
+  out += req.ns;
+  out += req.key;
+  out += req.value;
+  return out;
+}
+
+bool DecodeRequest(const std::string& body, LocalRequest* req) {
+  if (body.size() < 7) return false;
+  uint16_t ns_len;
+  uint32_t key_len;
+  std::memcpy(&ns_len, body.data() + 1, 2);
+  std::memcpy(&key_len, body.data() + 3, 4);
+  if (body.size() - 7 < static_cast<size_t>(ns_len) + key_len) return false;
+  req->op = static_cast<LocalOp>(body[0]);
+  req->ns.assign(body, 7, ns_len);
+  req->key.assign(body, 7 + ns_len, key_len);
+  req->value.assign(body, 7 + ns_len + key_len, std::string::npos);
+  return true;
+}
+
+std::string EncodeResponse(const LocalResponse& resp) {
+  std::string out;
+  out.reserve(1 + resp.value.size());
+  out.push_back(static_cast<char>(resp.status));
+  out += resp.value;
+  return out;
+}
+
+bool DecodeResponse(const std::string& body, LocalResponse* resp) {
+  if (body.empty()) return false;
+  resp->status = static_cast<LocalStatus>(body[0]);
+  resp->value.assign(body, 1, std::string::npos);
+  return true;
+}
+
+bool WriteAll(int fd, const char* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+    p += w;
+    n -= static_cast<size_t>(w);
+  }
+  return true;
+}
+
+bool ReadAll(int fd, char* p, size_t n) {
+  while (n > 0) {
+    ssize_t r = ::recv(fd, p, n, 0);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    p += r;
+    n -= static_cast<size_t>(r);
+  }
+  return true;
+}
+
+bool WriteFrame(int fd, const std::string& body) {
+  std::string frame;
+  frame.reserve(4 + body.size());
+  PutU32(&frame, static_cast<uint32_t>(body.size()));
+  frame += body;
+  return WriteAll(fd, frame.data(), frame.size());
+}
+
+bool ReadFrame(int fd, std::string* body) {
+  uint32_t len;
+  if (!ReadAll(fd, reinterpret_cast<char*>(&len), 4) || len > kMaxFrame) return false;
+  body->resize(len);
+  return ReadAll(fd, &(*body)[0], len);
+}
+
+// True once the other end of the socket has closed.
+bool PeerGone(int fd) {
+  pollfd p{fd, POLLRDHUP, 0};
+  return ::poll(&p, 1, 0) != 0 && (p.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL)) != 0;
+}
+
+size_t RingRegionBytes() { return 2 * (ShmRing::kHeaderBytes + LocalServer::kRingBytes); }
+
+}  // namespace
+
+// ---------- ShmRing ----------
+
+struct ShmRing::Header {
+  alignas(64) std::atomic<uint64_t> head;   // bytes consumed
+  alignas(64) std::atomic<uint64_t> tail;   // bytes produced
+  alignas(64) std::atomic<uint32_t> futex;  // bumped by every Write
+  std::atomic<uint32_t> sleepers;
+};
+static_assert(sizeof(std::atomic<uint64_t>) == 8 && std::atomic<uint64_t>::is_always_lock_free,
+              "ring counters are shared between processes");
+
+ShmRing::ShmRing(void* mem, size_t bytes)
+    : h_(static_cast<Header*>(mem)),
+      data_(static_cast<char*>(mem) + kHeaderBytes),
+      capacity_(bytes - kHeaderBytes),
+      spins_(std::thread::hardware_concurrency() > 1 ? 4000 : 0) {  // one CPU: the writer needs it
+  static_assert(sizeof(Header) <= kHeaderBytes, "header");
+}
+
+void ShmRing::CopyIn(uint64_t at, const char* src, size_t n) {
+  const size_t off = static_cast<size_t>(at & (capacity_ - 1));
+  const size_t first = std::min(n, capacity_ - off);
+  std::memcpy(data_ + off, src, first);
+  std::memcpy(data_, src + first, n - first);
+}
+
+void ShmRing::CopyOut(uint64_t at, char* dst, size_t n) const {
+  const size_t off = static_cast<size_t>(at & (capacity_ - 1));
+  const size_t first = std::min(n, capacity_ - off);
+  std::memcpy(dst, data_ + off, first);
+  std::memcpy(dst + first, data_, n - first);
+}
+
+bool ShmRing::Write(const std::string& body) {
+  const uint64_t tail = h_->tail.load(std::memory_order_relaxed);
+  const uint64_t head = h_->head.load(std::memory_order_acquire);
+  if (body.size() > max_frame() || 4 + body.size() > capacity_ - (tail - head)) return false;
+  const uint32_t len = static_cast<uint32_t>(body.size());
+  CopyIn(tail, reinterpret_cast<const char*>(&len), 4);
+  CopyIn(tail + 4, body.data(), body.size());
+  // seq_cst against the reader's sleepers/futex/tail sequence: either it
+  // sees the new tail before sleeping, or we see it asleep.
+  h_->tail.store(tail + 4 + body.size());
+  h_->futex.fetch_add(1);
+  if (h_->sleepers.load() > 0) ::syscall(SYS_futex, &h_->futex, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+  return true;
+}
+
+bool ShmRing::Read(std::string* body, int timeout_ms) {
+  if (broken_) return false;
+  const uint64_t head = h_->head.load(std::memory_order_relaxed);
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  for (int i = 0; h_->tail.load(std::memory_order_acquire) == head; i++) {
+    if (i < spins_) continue;
+    const auto left = deadline - std::chrono::steady_clock::now();
+    if (left <= std::chrono::steady_clock::duration::zero()) return false;
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+    timespec ts{static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+    h_->sleepers.fetch_add(1);
+    const uint32_t seen = h_->futex.load();
+    if (h_->tail.load() == head) ::syscall(SYS_futex, &h_->futex, FUTEX_WAIT, seen, &ts, nullptr, 0);
+    h_->sleepers.fetch_sub(1);
+  }
+  const uint64_t avail = h_->tail.load(std::memory_order_acquire) - head;
+  uint32_t len = 0;
+  if (avail >= 4 && avail <= capacity_) CopyOut(head, reinterpret_cast<char*>(&len), 4);
+  if (avail < 4 || avail > capacity_ || len > max_frame() || 4 + len > avail) {
+    broken_ = true;
+    return false;
+  }
+  body->resize(len);
+  CopyOut(head + 4, &(*body)[0], len);
+  h_->head.store(head + 4 + len, std::memory_order_release);
+  return true;
+}
+
+// ---------- LocalServer ----------
+
+bool LocalServer::Listen(const std::string& path, std::string* err) {
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    if (err) *err = "socket path too long: " + path;
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ::unlink(path.c_str());
+  if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      ::listen(listen_fd_, 128) != 0) {
+    if (err) *err = "listen on " + path + " failed: " + std::strerror(errno);
+    if (listen_fd_ >= 0) ::close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  path_ = path;
+  acceptor_ = std::thread(&LocalServer::AcceptLoop, this);
+  return true;
+}
+
+void LocalServer::Stop() {
+  if (stop_.exchange(true)) return;
+  if (listen_fd_ >= 0) ::shutdown(listen_fd_, SHUT_RDWR);
+  if (acceptor_.joinable()) acceptor_.join();
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (int fd : conn_fds_) ::shutdown(fd, SHUT_RDWR);  // unblocks socket reads; ring readers poll stop_
+    idle_.wait(lock, [&]() { return conn_fds_.empty(); });
+  }
+  if (listen_fd_ >= 0) {
+    ::close(listen_fd_);
+    ::unlink(path_.c_str());
+    listen_fd_ = -1;
+  }
+}
+
+void LocalServer::AcceptLoop() {
+  while (!stop_.load()) {
+    int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return;  // shut down
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    if (stop_.load()) {
+      ::close(fd);
+      return;
+    }
+    conn_fds_.push_back(fd);
+    std::thread(&LocalServer::Serve, this, fd).detach();
+  }
+}
+
+void LocalServer::Serve(int fd) {
+  std::string body;
+  LocalRequest req;
+  while (!stop_.load() && ReadFrame(fd, &body)) {
+    if (!DecodeRequest(body, &req)) break;
+    if (req.op == LocalOp::kShm) {
+      ServeRings(fd);
+      break;
+    }
+    if (!WriteFrame(fd, EncodeResponse(handler_(req)))) break;
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  conn_fds_.erase(std::find(conn_fds_.begin(), conn_fds_.end(), fd));
+  ::close(fd);
+  idle_.notify_all();
+}
+
+// Creates the ring pair, sends its memfd (SCM_RIGHTS) with an OK reply
+// carrying the region size, then serves frames from the rings until the
+// client closes its socket.
+void LocalServer::ServeRings(int fd) {
+  const size_t bytes = RingRegionBytes();
+  int mfd = static_cast<int>(::syscall(SYS_memfd_create, "kv-local-rings", 1u /* MFD_CLOEXEC */));
+  void* mem = MAP_FAILED;
+  if (mfd >= 0 && ::ftruncate(mfd, static_cast<off_t>(bytes)) == 0) {
+    mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0);
+  }
+  std::string reply;
+  PutU32(&reply, 9);
+  reply.push_back(static_cast<char>(mem == MAP_FAILED ? LocalStatus::kError : LocalStatus::kOk));
+  const uint64_t size = bytes;
+  reply.append(reinterpret_cast<const char*>(&size), 8);
+  iovec iov{&reply[0], reply.size()};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (mem != MAP_FAILED) {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(c), &mfd, sizeof(int));
+  }
+  const bool sent = ::sendmsg(fd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(reply.size());
+  if (mfd >= 0) ::close(mfd);
+  if (mem == MAP_FAILED) return;
+
+  const size_t half = bytes / 2;
+  ShmRing requests(mem, half);
+  ShmRing responses(static_cast<char*>(mem) + half, half);
+  std::string body;
+  LocalRequest req;
+  while (sent && !stop_.load()) {
+    if (!requests.Read(&body, kRingPollMs)) {
+      if (requests.broken() || PeerGone(fd)) break;
+      continue;
+    }
+    LocalResponse resp;
+    if (!DecodeRequest(body, &req) || req.op == LocalOp::kShm) {
+      resp.status = LocalStatus::kError;
+    } else {
+      resp = handler_(req);
+    }
+    std::string out = EncodeResponse(resp);
+    if (out.size() > responses.max_frame()) out = EncodeResponse(LocalResponse{LocalStatus::kError, ""});
+    if (!responses.Write(out)) break;  // the client never read its last reply
+  }
+  ::munmap(mem, bytes);
+}
+
+// ---------- LocalClient ----------
+
+LocalClient::~LocalClient() {
+  requests_.reset();
+  responses_.reset();
+  if (shm_) ::munmap(shm_, shm_bytes_);
+  if (fd_ >= 0) ::close(fd_);
+}
+
+bool LocalClient::Connect(const std::string& path, bool shared_memory, std::string* err) {
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    if (err) *err = "socket path too long: " + path;
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    if (err) *err = "connect to " + path + " failed: " + std::strerror(errno);
+    return false;
+  }
+  if (!shared_memory) return true;
+
+  LocalRequest req;
+  req.op = LocalOp::kShm;
+  if (!WriteFrame(fd_, EncodeRequest(req))) {
+    if (err) *err = "shared memory request failed";
+    return false;
+  }
+  char reply[13];
+  iovec iov{reply, sizeof(reply)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t n = ::recvmsg(fd_, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  int mfd = -1;
+  cmsghdr* c = CMSG_FIRSTHDR(&msg);
+  if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) std::memcpy(&mfd, CMSG_DATA(c), sizeof(int));
+  uint64_t size = 0;
+  std::memcpy(&size, reply + 5, 8);
+  if (n != static_cast<ssize_t>(sizeof(reply)) || reply[4] != static_cast<char>(LocalStatus::kOk) || mfd < 0) {
+    if (mfd >= 0) ::close(mfd);
+    if (err) *err = "server could not set up shared memory";
+    return false;
+  }
+  void* mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0);
+  ::close(mfd);
+  if (mem == MAP_FAILED) {
+    if (err) *err = std::string("mmap failed: ") + std::strerror(errno);
+    return false;
+  }
+  shm_ = mem;
+  shm_bytes_ = size;
+  requests_ = std::make_unique<ShmRing>(mem, size / 2);
+  responses_ = std::make_unique<ShmRing>(static_cast<char*>(mem) + size / 2, size / 2);
+  return true;
+}
+
+bool LocalClient::Call(const LocalRequest& req, LocalResponse* resp) {
+  if (fd_ < 0 || req.op == LocalOp::kShm) return false;
+  std::string body = EncodeRequest(req);
+  if (!requests_) {
+    return WriteFrame(fd_, body) && ReadFrame(fd_, &body) && DecodeResponse(body, resp);
+  }
+  if (!requests_->Write(body)) return false;
+  while (!responses_->Read(&body, kRingPollMs)) {
+    if (responses_->broken() || PeerGone(fd_)) return false;
+  }
+  return DecodeResponse(body, resp);
+}
+
+LocalStatus LocalClient::Get(const std::string& key, std::string* value, const std::string& ns) {
+  LocalResponse resp;
+  if (!Call(LocalRequest{LocalOp::kGet, ns, key, ""}, &resp)) return LocalStatus::kError;
+  if (resp.status == LocalStatus::kOk) *value = std::move(resp.value);
+  return resp.status;
+}
+
+LocalStatus LocalClient::Put(const std::string& key, const std::string& value, const std::string& ns) {
+  LocalResponse resp;
+  if (!Call(LocalRequest{LocalOp::kPut, ns, key, value}, &resp)) return LocalStatus::kError;
+  return resp.status;
+}
+
+LocalStatus LocalClient::Del(const std::string& key, const std::string& ns) {
+  LocalResponse resp;
+  if (!Call(LocalRequest{LocalOp::kDel, ns, key, ""}, &resp)) return LocalStatus::kError;
+  return resp.status;
+}
+
+}  // namespace kv
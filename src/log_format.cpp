@@ -0,0 +1,331 @@
+#include "kvstore/log_format.h"
+#include "kvstore/crc32c.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace kv {
+
+// ---------- Encoding ----------
+constexpr uint64_t kChecksumAttrSize = 13;  // " crc=" + 8 hex digits
+
+static void AppendChecksum(std::string* out, uint32_t crc) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), " crc=%08x", crc);
+  out->append(buf);
+}
+
+static void AppendPutHeader(std::string* out, const std::string& key, uint64_t value_size,
+                            const ValueEncoding& enc, uint32_t crc) {
+  out->append("PUT ");
+  out->append(key);
+  out->push_back(' ');
+  out->append(std::to_string(value_size));
+  if (enc.codec != 0) {
+    out->append(" c=");
+    out->append(std::to_string(enc.codec));
+    out->append(" r=");
+    out->append(std::to_string(enc.raw_size));
+    if (enc.dict_id != 0) {
+      out->append(" d=");
+      out->append(std::to_string(enc.dict_id));
+    }
+  }
+  AppendChecksum(out, crc);
+  out->push_back('\n');
+}
+
+uint32_t RecordChecksum(const std::string& key, const char* value, size_t value_size) {
+  return Crc32c(value, value_size, Crc32c(key));
+}
+
+bool ValidKey(const std::string& key) {
+  return !key.empty() &&
+         std::none_of(key.begin(), key.end(), [](char c) { return std::isspace(static_cast<unsigned char>(c)); });
+}
+
+void EncodePut(std::string* out, const std::string& key, const std::string& value,
+               const ValueEncoding& enc, uint32_t* crc_out) {
+  uint32_t crc = RecordChecksum(key, value.data(), value.size());
+  if (crc_out) *crc_out = crc;
+  AppendPutHeader(out, key, value.size(), enc, crc);
+  out->append(value);
+  out->push_back('\n');
+}
+
+void EncodeDel(std::string* out, const std::string& key) {
+  out->append("DEL ");
+  out->append(key);
+  AppendChecksum(out, RecordChecksum(key, nullptr, 0));
+  out->push_back('\n');
+}
+
+void EncodeBegin(std::string* out, uint64_t count) {
+  out->append("BEGIN ");
+  out->append(std::to_string(count));
+  out->push_back('\n');
+}
+
+uint64_t PutHeaderSize(const std::string& key, uint64_t value_size, const ValueEncoding& enc,
+                       bool has_crc) {
+  uint64_t n = 4 + key.size() + 1 + std::to_string(value_size).size() + 1;
+  if (enc.codec != 0) {
+    n += 3 + std::to_string(enc.codec).size() + 3 + std::to_string(enc.raw_size).size();
+    if (enc.dict_id != 0) n += 3 + std::to_string(enc.dict_id).size();
+  }
+  return has_crc ? n + kChecksumAttrSize : n;
+}
+
+// Optional "name=value" fields after a record's fixed fields. Unknown ones
+// are an error because ignoring them could hand back still-encoded bytes.
+static bool ParseAttrs(std::istringstream& iss, LogRecord* rec) {
+  rec->enc = ValueEncoding();
+  rec->has_crc = false;
+  rec->crc = 0;
+  std::string tok;
+  while (iss >> tok) {
+    auto eq = tok.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == tok.size()) return false;
+    const std::string name = tok.substr(0, eq);
+    const char* text = tok.c_str() + eq + 1;
+    char* end = nullptr;
+    uint64_t v = std::strtoull(text, &end, name == "crc" ? 16 : 10);
+    if (*end != '\0') return false;
+
+    if (name == "c") rec->enc.codec = static_cast<uint8_t>(v);
+    else if (name == "r") rec->enc.raw_size = v;
+    else if (name == "d") rec->enc.dict_id = static_cast<uint32_t>(v);
+    else if (name == "crc") {
+      rec->has_crc = true;
+      rec->crc = static_cast<uint32_t>(v);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParsePutHeader(const std::string& header, LogRecord* rec) {
+  std::istringstream iss(header);
+  std::string op;
+  rec->key.clear();
+  rec->value_size = 0;
+  iss >> op >> rec->key >> rec->value_size;
+  return op == "PUT" && !rec->key.empty() && iss && ParseAttrs(iss, rec);
+}
+
+// ---------- Scanning ----------
+LogReader::LogReader(const std::string& path, bool verify_values)
+    : in_(path, std::ios::binary), verify_values_(verify_values) {
+  if (!in_) status_ = Status::kEof;  // no file yet == empty log
+}
+
+LogReader::LogReader(const char* data, uint64_t size, bool verify_values)
+    : data_(data), size_(size), verify_values_(verify_values) {}
+
+LogReader::Status LogReader::ReadLine(std::string* line) {
+  if (data_) {
+    if (pos_ >= size_) return Status::kEof;
+    const char* nl = static_cast<const char*>(std::memchr(data_ + pos_, '\n', size_ - pos_));
+    if (!nl) return Status::kTruncated;
+    line->assign(data_ + pos_, static_cast<size_t>(nl - (data_ + pos_)));
+    pos_ = static_cast<uint64_t>(nl - data_) + 1;
+    return Status::kOk;
+  }
+  if (!std::getline(in_, *line)) return Status::kEof;
+  return in_.eof() ? Status::kTruncated : Status::kOk;
+}
+
+bool LogReader::ReadBytes(char* out, size_t n) {
+  if (!data_) return static_cast<bool>(in_.read(out, static_cast<std::streamsize>(n)));
+  if (pos_ > size_ || n > size_ - pos_) return false;
+  std::memcpy(out, data_ + pos_, n);
+  pos_ += n;
+  return true;
+}
+
+void LogReader::SkipBytes(uint64_t n) {
+  if (data_) pos_ += n;
+  else in_.seekg(static_cast<std::streamoff>(n), std::ios::cur);
+}
+
+bool LogReader::ReadNewline() {
+  if (data_) return pos_ < size_ && data_[pos_++] == '\n';
+  char nl = 0;
+  return in_ && in_.get(nl) && nl == '\n';
+}
+
+bool LogReader::Next(LogRecord* rec) {
+  if (status_ != Status::kOk) return false;
+
+  std::string header;
+  while (true) {
+    const Status line = ReadLine(&header);
+    if (line != Status::kOk) {
+      // kTruncated: header line without its newline, a crash mid-write
+      status_ = line;
+      return false;
+    }
+    if (!header.empty()) break;
+    offset_ += 1;
+  }
+
+  const uint64_t header_end = offset_ + header.size() + 1;
+
+  std::istringstream iss(header);
+  std::string op;
+  iss >> op;
+
+  if (op == "PUT") {
+    if (!ParsePutHeader(header, rec)) {
+      status_ = Status::kBadHeader;
+      return false;
+    }
+    const uint64_t value_size = rec->value_size;
+
+    rec->checksum_ok = true;
+    if (verify_values_ && rec->has_crc) {
+      // Streamed through a fixed buffer: value_size may itself be corrupt.
+      value_buf_.resize(64 * 1024);
+      uint32_t crc = Crc32c(rec->key);
+      uint64_t left = value_size;
+      while (left > 0) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(left, value_buf_.size()));
+        if (!ReadBytes(&value_buf_[0], n)) {
+          status_ = Status::kTruncated;
+          return false;
+        }
+        crc = Crc32c(value_buf_.data(), n, crc);
+        left -= n;
+      }
+      rec->checksum_ok = crc == rec->crc;
+    } else {
+      // Skip over the value bytes without allocating.
+      SkipBytes(value_size);
+    }
+    if (!ReadNewline()) {
+      status_ = Status::kTruncated;
+      return false;
+    }
+
+    rec->op = RecordOp::kPut;
+    rec->offset = offset_;
+    rec->value_offset = header_end;
+    rec->end = header_end + value_size + 1;
+
+  } else if (op == "DEL") {
+    std::string key;
+    iss >> key;
+    if (key.empty() || !ParseAttrs(iss, rec)) {
+      status_ = Status::kBadHeader;
+      return false;
+    }
+    rec->checksum_ok = !rec->has_crc || RecordChecksum(key, nullptr, 0) == rec->crc;
+
+    rec->op = RecordOp::kDel;
+    rec->key = std::move(key);
+    rec->offset = offset_;
+    rec->value_offset = 0;
+    rec->value_size = 0;
+    rec->end = header_end;
+
+  } else if (op == "BEGIN") {
+    uint64_t count = 0;
+    iss >> count;
+    if (!iss || count == 0) {
+      status_ = Status::kBadHeader;
+      return false;
+    }
+
+    rec->op = RecordOp::kBegin;
+    rec->key.clear();
+    rec->enc = ValueEncoding();
+    rec->has_crc = false;
+    rec->checksum_ok = true;
+    rec->offset = offset_;
+    rec->value_offset = 0;
+    rec->value_size = 0;
+    rec->count = count;
+    rec->end = header_end;
+
+  } else {
+    status_ = Status::kUnknownOp;
+    return false;
+  }
+
+  offset_ = rec->end;
+  return true;
+}
+
+void LogReader::Seek(uint64_t offset) {
+  if (!is_open()) return;
+  if (data_) {
+    pos_ = offset;
+  } else {
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+  }
+  offset_ = offset;
+  status_ = Status::kOk;
+}
+
+bool LogReader::NextGroup(std::vector<LogRecord>* group) {
+  group->clear();
+  LogRecord rec;
+  if (!Next(&rec)) return false;
+  if (rec.op != RecordOp::kBegin) {
+    group->push_back(std::move(rec));
+    return true;
+  }
+
+  const uint64_t begin_offset = rec.offset;
+  const uint64_t count = rec.count;
+  while (group->size() < count) {
+    if (!Next(&rec)) {
+      // A clean EOF inside a batch is still a torn batch.
+      if (status_ == Status::kEof) status_ = Status::kTruncated;
+      offset_ = begin_offset;
+      group->clear();
+      return false;
+    }
+    if (rec.op == RecordOp::kBegin) {
+      status_ = Status::kBadHeader;  // batches do not nest
+      offset_ = rec.offset;
+      group->clear();
+      return false;
+    }
+    group->push_back(std::move(rec));
+  }
+  return true;
+}
+
+const char* LogStatusName(LogReader::Status s) {
+  switch (s) {
+    case LogReader::Status::kOk: return "ok";
+    case LogReader::Status::kEof: return "eof";
+    case LogReader::Status::kTruncated: return "truncated";
+    case LogReader::Status::kBadHeader: return "bad_header";
+    case LogReader::Status::kUnknownOp: return "unknown_op";
+  }
+  return "?";
+}
+
+bool ReadRecordValue(std::ifstream& in, const LogRecord& rec, std::string* value) {
+  in.clear();
+  in.seekg(static_cast<std::streamoff>(rec.value_offset), std::ios::beg);
+  if (!in) return false;
+
+  value->resize(rec.value_size);
+  in.read(&(*value)[0], static_cast<std::streamsize>(rec.value_size));
+  if (in.gcount() != static_cast<std::streamsize>(rec.value_size)) return false;
+
+  char nl = 0;
+  if (!in.get(nl) || nl != '\n') return false;
+  return !rec.has_crc || RecordChecksum(rec.key, value->data(), value->size()) == rec.crc;
+}
+
+}  // namespace kv
@@ -0,0 +1,147 @@
+#include "kvstore/log_tail.h"
+#include "kvstore/persistent_index.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+namespace kv {
+
+// ---------- LogWatermark ----------
+
+// Two slots: Publish fills the one `seq` does not point at, then moves seq
+// to it, so a reader that finds seq unchanged around its read of a slot has
+// a whole mark, and a writer that dies mid-Publish leaves the previous one.
+struct LogWatermark::Page {
+  struct Slot {
+    std::atomic<uint64_t> file_id;
+    std::atomic<uint64_t> bytes;
+  };
+  uint64_t magic;
+  alignas(64) std::atomic<uint64_t> seq;
+  Slot slots[2];
+  alignas(64) std::atomic<uint32_t> futex;  // bumped by every Publish
+  std::atomic<uint32_t> sleepers;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "the watermark is shared between processes");
+
+static constexpr uint64_t kWatermarkMagic = 0x314d574c4f4c564bull;  // "KVLOLWM1"
+static constexpr size_t kWatermarkBytes = 4096;
+
+LogWatermark::~LogWatermark() {
+  if (page_) ::munmap(page_, kWatermarkBytes);
+}
+
+bool LogWatermark::Open(const std::string& path, bool writer, std::string* err) {
+  // Followers write too: they count themselves in `sleepers`.
+  int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (writer ? O_CREAT : 0), 0644);
+  struct stat st;
+  if (fd < 0 || ::fstat(fd, &st) != 0 ||
+      (static_cast<size_t>(st.st_size) < kWatermarkBytes &&
+       (!writer || ::ftruncate(fd, kWatermarkBytes) != 0))) {
+    if (err) *err = path + ": " + (fd < 0 ? std::strerror(errno) : "not a watermark file");
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+  void* mem = ::mmap(nullptr, kWatermarkBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    if (err) *err = path + ": mmap: " + std::strerror(errno);
+    return false;
+  }
+  page_ = static_cast<Page*>(mem);
+  if (page_->magic != kWatermarkMagic) {
+    if (!writer) {
+      if (err) *err = path + ": not a watermark file";
+      ::munmap(mem, kWatermarkBytes);
+      page_ = nullptr;
+      return false;
+    }
+    page_->magic = kWatermarkMagic;  // a new file is zeros: nothing published
+  }
+  return true;
+}
+
+void LogWatermark::Publish(uint64_t file_id, uint64_t bytes) {
+  const uint64_t seq = page_->seq.load(std::memory_order_relaxed);
+  Page::Slot& next = page_->slots[(seq + 1) & 1];
+  next.file_id.store(file_id, std::memory_order_relaxed);
+  next.bytes.store(bytes, std::memory_order_relaxed);
+  page_->seq.store(seq + 1, std::memory_order_release);
+  // seq_cst against Wait's sleepers/futex sequence: either the follower
+  // sees the bump before sleeping, or we see it asleep.
+  page_->futex.fetch_add(1);
+  if (page_->sleepers.load() > 0) ::syscall(SYS_futex, &page_->futex, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+LogWatermark::Mark LogWatermark::Read() const {
+  while (true) {
+    const uint64_t seq = page_->seq.load(std::memory_order_acquire);
+    const Page::Slot& slot = page_->slots[seq & 1];
+    Mark m;
+    m.file_id = slot.file_id.load(std::memory_order_relaxed);
+    m.bytes = slot.bytes.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (page_->seq.load(std::memory_order_relaxed) == seq) return m;
+  }
+}
+
+uint32_t LogWatermark::version() const { return page_->futex.load(); }
+
+void LogWatermark::Wait(uint32_t seen, std::chrono::milliseconds timeout) const {
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+  timespec ts{static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+  page_->sleepers.fetch_add(1);
+  if (page_->futex.load() == seen) ::syscall(SYS_futex, &page_->futex, FUTEX_WAIT, seen, &ts, nullptr, 0);
+  page_->sleepers.fetch_sub(1);
+}
+
+// ---------- MappedLog ----------
+
+MappedLog::~MappedLog() {
+  if (data_) ::munmap(const_cast<char*>(data_), mapped_);
+  if (fd_ >= 0) ::close(fd_);
+}
+
+bool MappedLog::Open(const std::string& path, std::string* err) {
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd_ < 0 || ::fstat(fd_, &st) != 0) {
+    if (err) *err = path + ": " + std::strerror(errno);
+    return false;
+  }
+  file_id_ = LogFileIdOf(fd_);
+  if (!Reserve(static_cast<uint64_t>(st.st_size))) {
+    if (err) *err = path + ": mmap: " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool MappedLog::Reserve(uint64_t size) {
+  if (data_ && size <= mapped_) return true;
+  constexpr uint64_t kMinReserve = 64ull << 20;
+  const uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+  const uint64_t len = (std::max(size * 2, kMinReserve) + page - 1) / page * page;
+  // Pages past the end of the file fault (SIGBUS) only if touched, and
+  // become readable as the file grows into them.
+  void* mem = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd_, 0);
+  if (mem == MAP_FAILED) return false;
+  if (data_) ::munmap(const_cast<char*>(data_), mapped_);
+  data_ = static_cast<const char*>(mem);
+  mapped_ = len;
+  return true;
+}
+
+}  // namespace kv
@@ -0,0 +1,661 @@
+#include "kvstore/log_tools.h"
+#include "kvstore/compression.h"
+#include "kvstore/file_util.h"
+#include "kvstore/sorted_table.h"
+#include "kvstore/static_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+
+namespace kv {
+
+namespace {
+
+constexpr char kDumpMagic[] = "KVDUMP1\n";
+constexpr uint64_t kBatchBytes = 16ull << 20;  // value bytes in flight per batch
+
+int ClampThreads(int threads) {
+  if (threads > 0) return threads;
+  unsigned hw = std::thread::hardware_concurrency();
+  return hw == 0 ? 1 : static_cast<int>(hw);
+}
+
+// Runs fn(begin, end, worker) over [0, n) split into contiguous slices.
+void ParallelFor(size_t n, int threads, const std::function<void(size_t, size_t, int)>& fn) {
+  if (n == 0) return;
+  size_t workers = std::min<size_t>(static_cast<size_t>(threads), n);
+  if (workers <= 1) {
+    fn(0, n, 0);
+    return;
+  }
+  std::vector<std::thread> pool;
+  pool.reserve(workers);
+  size_t per = (n + workers - 1) / workers;
+  for (size_t w = 0; w < workers; w++) {
+    size_t begin = w * per;
+    size_t end = std::min(n, begin + per);
+    if (begin >= end) break;
+    pool.emplace_back(fn, begin, end, static_cast<int>(w));
+  }
+  for (auto& t : pool) t.join();
+}
+
+uint64_t FileSize(const std::string& path) {
+  std::error_code ec;
+  auto n = std::filesystem::file_size(path, ec);
+  return ec ? 0 : static_cast<uint64_t>(n);
+}
+
+size_t Log2Bucket(uint64_t n) {
+  size_t b = 0;
+  while (n > 0) {
+    n >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void Bump(std::vector<uint64_t>* hist, uint64_t n) {
+  size_t b = Log2Bucket(n);
+  if (hist->size() <= b) hist->resize(b + 1, 0);
+  (*hist)[b]++;
+}
+
+// ---------- Dump encodings ----------
+void PutFixed(std::string* out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) out->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+bool GetFixed(std::istream& in, uint64_t* v, int bytes) {
+  unsigned char buf[8];
+  if (!in.read(reinterpret_cast<char*>(buf), bytes)) return false;
+  *v = 0;
+  for (int i = 0; i < bytes; i++) *v |= static_cast<uint64_t>(buf[i]) << (8 * i);
+  return true;
+}
+
+// Bytes outside printable ASCII are written as \u00XX so arbitrary binary
+// values survive a round trip through LoadDump.
+void AppendJsonString(std::string* out, const std::string& s) {
+  static const char* kHex = "0123456789abcdef";
+  out->push_back('"');
+  for (unsigned char c : s) {
+    switch (c) {
+      case '"': out->append("\\\""); break;
+      case '\\': out->append("\\\\"); break;
+      case '\n': out->append("\\n"); break;
+      case '\r': out->append("\\r"); break;
+      case '\t': out->append("\\t"); break;
+      default:
+        if (c < 0x20 || c >= 0x7f) {
+          out->append("\\u00");
+          out->push_back(kHex[c >> 4]);
+          out->push_back(kHex[c & 0xf]);
+        } else {
+          out->push_back(static_cast<char>(c));
+        }
+    }
+  }
+  out->push_back('"');
+}
+
+void EncodeDumpRecord(std::string* out, DumpFormat fmt, const std::string& key,
+                      const std::string& value) {
+  if (fmt == DumpFormat::kBinary) {
+    PutFixed(out, key.size(), 4);
+    PutFixed(out, value.size(), 8);
+    out->append(key);
+    out->append(value);
+  } else {
+    out->append("{\"key\":");
+    AppendJsonString(out, key);
+    out->append(",\"value\":");
+    AppendJsonString(out, value);
+    out->append("}\n");
+  }
+}
+
+// Minimal parser for the JSON lines DumpLog writes.
+class JsonLineParser {
+ public:
+  explicit JsonLineParser(const std::string& line) : s_(line) {}
+
+  bool Parse(std::string* key, std::string* value) {
+    if (!Expect('{')) return false;
+    bool have_key = false, have_value = false;
+    while (true) {
+      std::string name, str;
+      if (!String(&name) || !Expect(':') || !String(&str)) return false;
+      if (name == "key") {
+        *key = std::move(str);
+        have_key = true;
+      } else if (name == "value") {
+        *value = std::move(str);
+        have_value = true;
+      }
+      SkipSpace();
+      if (pos_ < s_.size() && s_[pos_] == ',') {
+        pos_++;
+        continue;
+      }
+      return Expect('}') && have_key && have_value;
+    }
+  }
+
+ private:
+  void SkipSpace() {
+    while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\r')) pos_++;
+  }
+
+  bool Expect(char c) {
+    SkipSpace();
+    if (pos_ >= s_.size() || s_[pos_] != c) return false;
+    pos_++;
+    return true;
+  }
+
+  static int HexVal(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  bool String(std::string* out) {
+    if (!Expect('"')) return false;
+    while (pos_ < s_.size()) {
+      char c = s_[pos_++];
+      if (c == '"') return true;
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (pos_ >= s_.size()) return false;
+      char e = s_[pos_++];
+      switch (e) {
+        case '"': out->push_back('"'); break;
+        case '\\': out->push_back('\\'); break;
+        case '/': out->push_back('/'); break;
+        case 'n': out->push_back('\n'); break;
+        case 'r': out->push_back('\r'); break;
+        case 't': out->push_back('\t'); break;
+        case 'b': out->push_back('\b'); break;
+        case 'f': out->push_back('\f'); break;
+        case 'u': {
+          if (pos_ + 4 > s_.size()) return false;
+          int cp = 0;
+          for (int i = 0; i < 4; i++) {
+            int h = HexVal(s_[pos_++]);
+            if (h < 0) return false;
+            cp = cp * 16 + h;
+          }
+          if (cp <= 0xff) {
+            out->push_back(static_cast<char>(cp));  // byte escape (see AppendJsonString)
+          } else if (cp <= 0x7ff) {
+            out->push_back(static_cast<char>(0xc0 | (cp >> 6)));
+            out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+          } else {
+            out->push_back(static_cast<char>(0xe0 | (cp >> 12)));
+            out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+            out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+          }
+          break;
+        }
+        default: return false;
+      }
+    }
+    return false;
+  }
+
+  const std::string& s_;
+  size_t pos_ = 0;
+};
+
+// Reads the stored bytes of `live` on `threads` workers in batches of roughly
+// kBatchBytes, encodes each with `encode`, and hands every finished batch to
+// `sink` in log order. Memory stays bounded regardless of log size.
+bool ExportLive(const std::string& path, const std::vector<LogRecord>& live, int threads,
+                const std::function<bool(std::string*, const LogRecord&, const std::string&)>& encode,
+                const std::function<bool(const std::string&)>& sink, std::string* err) {
+  threads = ClampThreads(threads);
+
+  std::vector<std::ifstream> inputs(static_cast<size_t>(threads));
+  for (auto& in : inputs) {
+    in.open(path, std::ios::binary);
+    if (!in) {
+      if (err) *err = "cannot open " + path;
+      return false;
+    }
+  }
+
+  size_t i = 0;
+  while (i < live.size()) {
+    size_t batch_end = i;
+    uint64_t bytes = 0;
+    while (batch_end < live.size() && (bytes < kBatchBytes || batch_end == i)) {
+      bytes += live[batch_end].value_size;
+      batch_end++;
+    }
+
+    std::vector<std::string> outs(static_cast<size_t>(threads));
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t> bad_offset{0};
+    ParallelFor(batch_end - i, threads, [&](size_t b, size_t e, int w) {
+      std::string value;
+      for (size_t j = i + b; j < i + e; j++) {
+        if (!ReadRecordValue(inputs[static_cast<size_t>(w)], live[j], &value) ||
+            !encode(&outs[static_cast<size_t>(w)], live[j], value)) {
+          failed = true;
+          bad_offset = live[j].offset;
+          return;
+        }
+      }
+    });
+    if (failed) {
+      if (err) *err = "unreadable record at offset " + std::to_string(bad_offset.load());
+      return false;
+    }
+    for (const auto& o : outs) {
+      if (!sink(o)) {
+        if (err) *err = "write failed";
+        return false;
+      }
+    }
+    i = batch_end;
+  }
+  return true;
+}
+
+}  // namespace
+
+// ---------- Scanning ----------
+bool CollectLive(const std::string& path, std::vector<LogRecord>* live, ScanSummary* summary) {
+  ScanSummary sum;
+  sum.file_size = FileSize(path);
+
+  LogReader reader(path);
+  if (!reader.is_open()) return false;
+
+  std::unordered_map<std::string, LogRecord> latest;
+  std::vector<LogRecord> group;
+  while (reader.NextGroup(&group)) {
+    for (auto& rec : group) {
+      sum.records++;
+      sum.valid_bytes = rec.end;
+      if (rec.op == RecordOp::kPut) {
+        sum.puts++;
+        latest[rec.key] = std::move(rec);
+      } else {
+        sum.dels++;
+        latest.erase(rec.key);
+      }
+    }
+  }
+  sum.status = reader.status();
+
+  live->clear();
+  live->reserve(latest.size());
+  for (auto& kv : latest) live->push_back(std::move(kv.second));
+  std::sort(live->begin(), live->end(),
+            [](const LogRecord& a, const LogRecord& b) { return a.offset < b.offset; });
+
+  if (summary) *summary = sum;
+  return true;
+}
+
+// ---------- dump / load ----------
+bool DumpLog(const std::string& path, DumpFormat fmt, std::ostream& out, int threads,
+             std::string* err) {
+  std::vector<LogRecord> live;
+  if (!CollectLive(path, &live, nullptr)) {
+    if (err) *err = "cannot open " + path;
+    return false;
+  }
+
+  if (fmt == DumpFormat::kBinary) out.write(kDumpMagic, sizeof(kDumpMagic) - 1);
+
+  // Dumps hold plain values whatever the log's codecs were.
+  auto dict = LoadDictionary(DictionaryPath(path));
+  auto encode = [fmt, &dict](std::string* o, const LogRecord& r, const std::string& stored) {
+    if (r.enc.codec == 0) {
+      EncodeDumpRecord(o, fmt, r.key, stored);
+      return true;
+    }
+    std::string value;
+    if (!DecodeValue(r.enc, dict.get(), stored, &value)) return false;
+    EncodeDumpRecord(o, fmt, r.key, value);
+    return true;
+  };
+  auto sink = [&out](const std::string& chunk) {
+    out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    return static_cast<bool>(out);
+  };
+  if (!ExportLive(path, live, threads, encode, sink, err)) return false;
+  out.flush();
+  return static_cast<bool>(out);
+}
+
+bool LoadDump(std::istream& in, DumpFormat fmt, const std::string& log_path, uint64_t* loaded,
+              std::string* err) {
+  std::ofstream out(log_path, std::ios::binary | std::ios::app);
+  if (!out) {
+    if (err) *err = "cannot open " + log_path;
+    return false;
+  }
+
+  uint64_t n = 0;
+  std::string buf, key, value;
+  auto flush_buf = [&]() {
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    buf.clear();
+    return static_cast<bool>(out);
+  };
+
+  if (fmt == DumpFormat::kBinary) {
+    char magic[sizeof(kDumpMagic) - 1];
+    if (!in.read(magic, sizeof(magic)) ||
+        std::string(magic, sizeof(magic)) != std::string(kDumpMagic, sizeof(magic))) {
+      if (err) *err = "not a binary dump";
+      return false;
+    }
+    uint64_t klen = 0, vlen = 0;
+    while (GetFixed(in, &klen, 4)) {
+      if (!GetFixed(in, &vlen, 8)) {
+        if (err) *err = "truncated dump after " + std::to_string(n) + " records";
+        return false;
+      }
+      key.resize(klen);
+      value.resize(vlen);
+      if (!in.read(&key[0], static_cast<std::streamsize>(klen)) ||
+          !in.read(&value[0], static_cast<std::streamsize>(vlen))) {
+        if (err) *err = "truncated dump after " + std::to_string(n) + " records";
+        return false;
+      }
+      if (!ValidKey(key)) {
+        if (err) *err = "record " + std::to_string(n + 1) + ": key is empty or contains whitespace";
+        return false;
+      }
+      EncodePut(&buf, key, value);
+      n++;
+      if (buf.size() >= kBatchBytes && !flush_buf()) break;
+    }
+  } else {
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty()) continue;
+      key.clear();
+      value.clear();
+      if (!JsonLineParser(line).Parse(&key, &value)) {
+        if (err) *err = "bad JSON on line " + std::to_string(n + 1);
+        return false;
+      }
+      if (!ValidKey(key)) {
+        if (err) *err = "line " + std::to_string(n + 1) + ": key is empty or contains whitespace";
+        return false;
+      }
+      EncodePut(&buf, key, value);
+      n++;
+      if (buf.size() >= kBatchBytes && !flush_buf()) break;
+    }
+  }
+
+  if (!flush_buf()) {
+    if (err) *err = "write failed";
+    return false;
+  }
+  out.flush();
+  if (loaded) *loaded = n;
+  return static_cast<bool>(out);
+}
+
+// ---------- verify ----------
+VerifyReport VerifyLog(const std::string& path, int threads) {
+  VerifyReport rep;
+  threads = ClampThreads(threads);
+
+  // Pass 1: framing. Cheap, sequential, header-only.
+  std::vector<LogRecord> puts;
+  LogReader reader(path);
+  if (!reader.is_open()) {
+    rep.ok = false;
+    rep.reason = "cannot open " + path;
+    return rep;
+  }
+  std::vector<LogRecord> group;
+  while (reader.NextGroup(&group)) {
+    for (auto& rec : group) {
+      if (!rec.checksum_ok && rep.ok) {
+        rep.ok = false;
+        rep.first_bad_offset = rec.offset;
+        rep.reason = "checksum mismatch";
+      }
+      rep.records++;
+      rep.bytes = rec.end;
+      if (rec.op == RecordOp::kPut) {
+        puts.push_back(std::move(rec));  // the key is part of the checksum
+      }
+    }
+  }
+  if (reader.status() != LogReader::Status::kEof && rep.ok) {
+    rep.ok = false;
+    rep.first_bad_offset = reader.offset();
+    rep.reason = LogStatusName(reader.status());
+  }
+
+  // Pass 2: read back (and decompress) every value in parallel.
+  auto dict = LoadDictionary(DictionaryPath(path));
+  std::atomic<uint64_t> first_bad{UINT64_MAX};
+  ParallelFor(puts.size(), threads, [&](size_t b, size_t e, int) {
+    std::ifstream in(path, std::ios::binary);
+    std::string stored, value;
+    for (size_t i = b; i < e; i++) {
+      if (!in || !ReadRecordValue(in, puts[i], &stored) ||
+          (puts[i].enc.codec != 0 && !DecodeValue(puts[i].enc, dict.get(), stored, &value))) {
+        uint64_t off = puts[i].offset;
+        uint64_t cur = first_bad.load();
+        while (off < cur && !first_bad.compare_exchange_weak(cur, off)) {
+        }
+        return;  // later records in this slice can only be further along
+      }
+    }
+  });
+
+  if (first_bad.load() != UINT64_MAX && (rep.ok || first_bad.load() < rep.first_bad_offset)) {
+    rep.ok = false;
+    rep.first_bad_offset = first_bad.load();
+    rep.reason = "unreadable value or checksum mismatch";
+  }
+  return rep;
+}
+
+// ---------- stats ----------
+bool ComputeLogStats(const std::string& path, LogStats* stats) {
+  std::vector<LogRecord> live;
+  LogStats st;
+  if (!CollectLive(path, &live, &st.scan)) return false;
+
+  st.live_keys = live.size();
+  for (const auto& r : live) {
+    st.live_bytes += r.end - r.offset;
+    Bump(&st.key_size_hist, r.key.size());
+    if (r.enc.codec != 0) {
+      st.compressed_values++;
+      st.compressed_raw_bytes += r.enc.raw_size;
+      st.compressed_stored_bytes += r.value_size;
+      Bump(&st.value_size_hist, r.enc.raw_size);
+    } else {
+      Bump(&st.value_size_hist, r.value_size);
+    }
+  }
+  if (st.scan.file_size > 0) {
+    st.garbage_ratio = 1.0 - static_cast<double>(st.live_bytes) /
+                                 static_cast<double>(st.scan.file_size);
+  }
+  *stats = std::move(st);
+  return true;
+}
+
+// ---------- compact ----------
+bool CompactLogFile(const std::string& in_path, const std::string& out_path, int threads,
+                    std::string* err) {
+  std::vector<LogRecord> live;
+  if (!CollectLive(in_path, &live, nullptr)) {
+    if (err) *err = "cannot open " + in_path;
+    return false;
+  }
+
+  namespace fs = std::filesystem;
+  bool in_place = fs::exists(out_path) && fs::equivalent(in_path, out_path);
+  const std::string write_path = in_place ? out_path + ".tmp" : out_path;
+
+  {
+    std::ofstream out(write_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      if (err) *err = "cannot open " + write_path;
+      return false;
+    }
+    // Stored bytes are copied as-is, compressed or not.
+    auto encode = [](std::string* o, const LogRecord& r, const std::string& stored) {
+      EncodePut(o, r.key, stored, r.enc);
+      return true;
+    };
+    auto sink = [&out](const std::string& chunk) {
+      out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+      return static_cast<bool>(out);
+    };
+    if (!ExportLive(in_path, live, threads, encode, sink, err)) {
+      out.close();
+      std::remove(write_path.c_str());
+      return false;
+    }
+    out.flush();
+    if (!out) {
+      if (err) *err = "write failed";
+      return false;
+    }
+  }
+
+  if (in_place) {
+    if (!ReplaceFile(write_path, out_path, err)) return false;
+  } else if (fs::exists(DictionaryPath(in_path))) {
+    std::error_code ec;
+    fs::copy_file(DictionaryPath(in_path), DictionaryPath(out_path),
+                  fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+      if (err) *err = "cannot copy dictionary: " + ec.message();
+      return false;
+    }
+  }
+  return true;
+}
+
+// ---------- static tables ----------
+bool BuildStaticTable(const std::string& log_path, const std::string& out_path, int threads,
+                      StaticBuildReport* report, std::string* err) {
+  std::vector<LogRecord> live;
+  if (!CollectLive(log_path, &live, nullptr)) {
+    if (err) *err = "cannot open " + log_path;
+    return false;
+  }
+  std::unique_ptr<LzDictionary> dict = LoadDictionary(DictionaryPath(log_path));
+
+  std::vector<std::string> keys;
+  std::vector<uint64_t> sizes;
+  keys.reserve(live.size());
+  sizes.reserve(live.size());
+  for (const auto& r : live) {
+    keys.push_back(r.key);
+    sizes.push_back(r.enc.codec != 0 ? r.enc.raw_size : r.value_size);
+  }
+  StaticTableWriter writer;
+  if (!writer.Begin(out_path, keys, sizes, err)) return false;
+  keys = std::vector<std::string>();
+
+  // ReadRecordValue has checked the stored bytes; the table keeps them decoded.
+  auto encode = [&dict](std::string* o, const LogRecord& r, const std::string& stored) {
+    std::string value;
+    if (!DecodeValue(r.enc, dict.get(), stored, &value)) return false;
+    StaticTableWriter::EncodeStaticRecord(o, r.key, value);
+    return true;
+  };
+  auto sink = [&writer](const std::string& chunk) { return writer.AppendData(chunk); };
+  if (!ExportLive(log_path, live, threads, encode, sink, err) || !writer.Finish(err)) {
+    std::remove((out_path + ".tmp").c_str());
+    return false;
+  }
+
+  StaticTable table;
+  if (!table.Open(out_path, err)) return false;
+  if (report) {
+    report->keys = table.count();
+    report->file_bytes = table.file_bytes();
+    report->index_bits_per_key = table.index_bits_per_key();
+    report->attempts = writer.attempts();
+  }
+  return true;
+}
+
+bool CompactToSortedTable(const std::string& log_path, const std::string& out_path, int threads,
+                          SortedBuildReport* report, std::string* err) {
+  std::vector<LogRecord> live;
+  if (!CollectLive(log_path, &live, nullptr)) {
+    if (err) *err = "cannot open " + log_path;
+    return false;
+  }
+  std::sort(live.begin(), live.end(), [](const LogRecord& a, const LogRecord& b) { return a.key < b.key; });
+  std::unique_ptr<LzDictionary> dict = LoadDictionary(DictionaryPath(log_path));
+
+  SortedTableWriter writer;
+  if (!writer.Open(out_path, err)) return false;
+  // Workers frame decoded pairs as <u32 key len><u32 value len><key><value>;
+  // the sink adds them to the writer, which needs them one at a time in order.
+  auto encode = [&dict](std::string* o, const LogRecord& r, const std::string& stored) {
+    std::string value;
+    if (!DecodeValue(r.enc, dict.get(), stored, &value)) return false;
+    const uint32_t lens[2] = {static_cast<uint32_t>(r.key.size()), static_cast<uint32_t>(value.size())};
+    o->append(reinterpret_cast<const char*>(lens), sizeof(lens));
+    *o += r.key;
+    *o += value;
+    return true;
+  };
+  std::string key, value;
+  auto sink = [&](const std::string& chunk) {
+    for (size_t pos = 0; pos < chunk.size();) {
+      uint32_t lens[2];
+      std::memcpy(lens, chunk.data() + pos, sizeof(lens));
+      pos += sizeof(lens);
+      key.assign(chunk, pos, lens[0]);
+      value.assign(chunk, pos + lens[0], lens[1]);
+      pos += static_cast<size_t>(lens[0]) + lens[1];
+      if (!writer.Add(key, value)) return false;
+    }
+    return true;
+  };
+  if (!ExportLive(log_path, live, threads, encode, sink, err) || !writer.Finish(err)) {
+    std::remove((out_path + ".tmp").c_str());
+    return false;
+  }
+
+  SortedTable table;
+  if (!table.Open(out_path, err)) return false;
+  if (report) {
+    report->keys = table.count();
+    report->blocks = table.blocks();
+    report->file_bytes = table.file_bytes();
+    report->resident_bytes = table.resident_bytes();
+  }
+  return true;
+}
+
+}  // namespace kv
@@ -0,0 +1,129 @@
+#include "kvstore/manifest.h"
+#include "kvstore/crc32c.h"
+#include "kvstore/file_util.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <sstream>
+
+namespace kv {
+
+namespace fs = std::filesystem;
+
+static const char kHeader[] = "kvmanifest 1";
+
+static std::string SealEdit(const std::string& edit) {
+  char crc[16];
+  std::snprintf(crc, sizeof(crc), "%08x", Crc32c(edit));
+  return edit + " crc=" + crc + "\n";
+}
+
+// Splits a sealed line back into its edit; false if the checksum is missing or wrong.
+static bool UnsealEdit(const std::string& line, std::string* edit) {
+  size_t pos = line.rfind(" crc=");
+  if (pos == std::string::npos) return false;
+  *edit = line.substr(0, pos);
+  char* end = nullptr;
+  unsigned long crc = std::strtoul(line.c_str() + pos + 5, &end, 16);
+  return *end == '\0' && static_cast<uint32_t>(crc) == Crc32c(*edit);
+}
+
+bool Manifest::Open(const std::string& dir, std::string* err) {
+  path_ = (fs::path(dir) / "MANIFEST").string();
+  files_.clear();
+  edits_ = 0;
+
+  std::ifstream in(path_, std::ios::binary);
+  exists_ = static_cast<bool>(in);
+  if (!exists_) return true;
+
+  std::string line;
+  if (!std::getline(in, line) || line != kHeader) {
+    if (err) *err = path_ + ": not a manifest";
+    return false;
+  }
+  bool clean = true;
+  while (std::getline(in, line)) {
+    std::string edit;
+    // A torn final edit was never acknowledged; a damaged one ends what we trust.
+    if (in.eof() || !UnsealEdit(line, &edit)) {
+      clean = false;
+      break;
+    }
+    std::istringstream iss(edit);
+    std::string op, name, file;
+    iss >> op >> name;
+    if ((op == "file" || op == "add") && (iss >> file)) {
+      files_[name] = file;
+    } else if (op == "del" && !name.empty()) {
+      files_.erase(name);
+    } else {
+      clean = false;
+      break;
+    }
+    if (op != "file") edits_++;
+  }
+  in.close();
+
+  // Rewrite a damaged tail before appending after it.
+  if (!clean) return Checkpoint();
+  return true;
+}
+
+// files_ changes first so that a checkpoint triggered by the edit includes
+// it; a failed edit is rolled back.
+bool Manifest::Add(const std::string& name, const std::string& file) {
+  auto it = files_.find(name);
+  std::optional<std::string> prev;
+  if (it != files_.end()) prev = it->second;
+  files_[name] = file;
+  if (AppendEdit("add " + name + " " + file)) return true;
+  if (prev) files_[name] = *prev;
+  else files_.erase(name);
+  return false;
+}
+
+bool Manifest::Remove(const std::string& name) {
+  auto it = files_.find(name);
+  if (it == files_.end()) return true;
+  std::string prev = it->second;
+  files_.erase(it);
+  if (AppendEdit("del " + name)) return true;
+  files_[name] = prev;
+  return false;
+}
+
+bool Manifest::AppendEdit(const std::string& edit) {
+  if (!exists_ && !Checkpoint()) return false;
+  if (!out_.is_open()) {
+    out_.open(path_, std::ios::binary | std::ios::app);
+    if (!out_) return false;
+  }
+  const std::string line = SealEdit(edit);
+  out_.write(line.data(), static_cast<std::streamsize>(line.size()));
+  out_.flush();
+  if (!out_ || !SyncFile(path_)) return false;
+  if (++edits_ >= kCheckpointEdits) return Checkpoint();
+  return true;
+}
+
+bool Manifest::Checkpoint() {
+  const std::string tmp = path_ + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out << kHeader << "\n";
+    for (const auto& [name, file] : files_) out << SealEdit("file " + name + " " + file);
+    out.flush();
+    if (!out) return false;
+  }
+  // The append handle points at the file being replaced.
+  if (out_.is_open()) out_.close();
+  if (!ReplaceFile(tmp, path_)) return false;
+  exists_ = true;
+  edits_ = 0;
+  return true;
+}
+
+}  // namespace kv
@@ -0,0 +1,267 @@
+#include "kvstore/namespaces.h"
+#include "kvstore/file_util.h"
+#include "kvstore/log_format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+namespace kv {
+
+namespace fs = std::filesystem;
+
+// Keys in the redo log are qualified as "<ns>/<key>"; names never contain '/'.
+static std::string QualifiedKey(const std::string& ns, const std::string& key) {
+  return ns + "/" + key;
+}
+
+// ---------- Constructors ----------
+NamespaceStore::NamespaceStore() = default;
+
+NamespaceStore::NamespaceStore(const std::string& dir, const Options& options)
+    : persistent_(true), dir_(dir), options_(options) {
+  fs::create_directories(dir_);
+
+  std::string err;
+  if (!manifest_.Open(dir_, &err)) throw std::runtime_error(err);
+  if (!manifest_.exists()) {
+    // Directory from before the manifest: list it once and record what is there.
+    for (const auto& ent : fs::directory_iterator(dir_)) {
+      if (!ent.is_regular_file() || ent.path().extension() != ".aof") continue;
+      std::string name = ent.path().stem().string();
+      if (ValidName(name) && !manifest_.Add(name, ent.path().filename().string())) {
+        throw std::runtime_error("cannot write manifest in " + dir_);
+      }
+    }
+    if (!manifest_.exists() && !manifest_.Checkpoint()) {
+      throw std::runtime_error("cannot write manifest in " + dir_);
+    }
+  }
+  OpenAll();
+
+  RecoverBatches();
+  batch_log_.open(BatchLogPath(), std::ios::binary | std::ios::app);
+}
+
+// Opens exactly the manifest's namespaces, replaying their logs in parallel.
+// A listed log that is missing means lost data, not an empty namespace.
+void NamespaceStore::OpenAll() {
+  std::vector<std::pair<std::string, std::string>> todo(manifest_.files().begin(),
+                                                        manifest_.files().end());
+  for (const auto& [name, file] : todo) {
+    if (!fs::exists(fs::path(dir_) / file)) {
+      throw std::runtime_error("manifest lists " + file + " but it is missing from " + dir_);
+    }
+  }
+
+  std::vector<std::unique_ptr<KVStore>> stores(todo.size());
+  std::vector<std::string> errors(todo.size());
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i; (i = next.fetch_add(1)) < todo.size();) {
+      try {
+        stores[i] = std::make_unique<KVStore>((fs::path(dir_) / todo[i].second).string(), options_);
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+    }
+  };
+  size_t n = std::min<size_t>(todo.size(), std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < n; t++) pool.emplace_back(worker);
+  worker();
+  for (auto& t : pool) t.join();
+
+  for (size_t i = 0; i < todo.size(); i++) {
+    if (!errors[i].empty()) throw std::runtime_error(todo[i].first + ": " + errors[i]);
+    Namespace ns;
+    ns.store = std::move(stores[i]);
+    namespaces_.emplace(todo[i].first, std::move(ns));
+  }
+}
+
+bool NamespaceStore::ValidName(const std::string& name) {
+  if (name.empty() || name.size() > 64 || name[0] == '_') return false;
+  for (char c : name) {
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '_' || c == '-';
+    if (!ok) return false;
+  }
+  return true;
+}
+
+std::string NamespaceStore::LogPathFor(const std::string& name) const {
+  return (fs::path(dir_) / (name + ".aof")).string();
+}
+
+std::string NamespaceStore::BatchLogPath() const {
+  return (fs::path(dir_) / "_batches.aof").string();
+}
+
+// ---------- Lookup ----------
+KVStore* NamespaceStore::Find(const std::string& name) const {
+  std::shared_lock lock(mu_);
+  auto it = namespaces_.find(name);
+  return it == namespaces_.end() ? nullptr : it->second.store.get();
+}
+
+KVStore* NamespaceStore::Open(const std::string& name) {
+  if (KVStore* s = Find(name)) return s;
+  if (!ValidName(name)) return nullptr;
+
+  std::unique_lock lock(mu_);
+  auto it = namespaces_.find(name);
+  if (it != namespaces_.end()) return it->second.store.get();
+
+  Namespace ns;
+  ns.store = persistent_ ? std::make_unique<KVStore>(LogPathFor(name), options_)
+                         : std::make_unique<KVStore>();
+  // The store created its log; make that durable, then record it.
+  if (persistent_ && (!SyncParentDir(LogPathFor(name)) || !manifest_.Add(name, name + ".aof"))) {
+    return nullptr;
+  }
+  KVStore* s = ns.store.get();
+  namespaces_.emplace(name, std::move(ns));
+  return s;
+}
+
+std::vector<std::string> NamespaceStore::Names() const {
+  std::shared_lock lock(mu_);
+  std::vector<std::string> names;
+  names.reserve(namespaces_.size());
+  for (const auto& [name, ns] : namespaces_) names.push_back(name);
+  return names;
+}
+
+// ---------- Cross-namespace batches ----------
+bool NamespaceStore::Write(const std::vector<NamespaceOp>& ops) {
+  if (ops.empty()) return true;
+
+  // Group by namespace; std::map order is also our lock order.
+  std::map<std::string, WriteBatch> parts;
+  // Everything a namespace could refuse is checked before the commit point.
+  for (const auto& op : ops) {
+    if (!ValidName(op.ns) || !ValidKey(op.key)) return false;
+    auto& b = parts[op.ns];
+    if (op.value) b.Put(op.key, *op.value);
+    else b.Del(op.key);
+  }
+
+  std::lock_guard<std::mutex> batch_lock(batch_mu_);
+
+  std::vector<KVStore*> stores;
+  std::vector<std::unique_lock<std::shared_mutex>> locks;
+  for (const auto& [name, batch] : parts) {
+    KVStore* s = Open(name);
+    if (!s) return false;
+    stores.push_back(s);
+  }
+  for (KVStore* s : stores) locks.emplace_back(s->mu_);
+
+  if (persistent_) {
+    std::string records;
+    EncodeBegin(&records, ops.size());
+    for (const auto& op : ops) {
+      if (op.value) EncodePut(&records, QualifiedKey(op.ns, op.key), *op.value);
+      else EncodeDel(&records, QualifiedKey(op.ns, op.key));
+    }
+    batch_log_.write(records.data(), static_cast<std::streamsize>(records.size()));
+    batch_log_.flush();
+    if (!batch_log_) {
+      ClearBatchLog();  // a torn batch is not committed anyway
+      return false;
+    }
+  }
+
+  // Past the commit point. A crash here is repaired by RecoverBatches(); an
+  // I/O error is retried, since each store's part lands whole or not at all.
+  std::vector<bool> done(stores.size(), false);
+  bool ok = false;
+  for (int attempt = 0; attempt < 3 && !ok; attempt++) {
+    ok = true;
+    size_t i = 0;
+    for (const auto& [name, batch] : parts) {
+      if (!done[i]) done[i] = stores[i]->WriteLocked(batch);
+      ok = ok && done[i];
+      i++;
+    }
+  }
+  // Cleared even after a persistent failure: once these locks are released,
+  // replaying the slot could overwrite newer writes to the namespaces that
+  // took their part.
+  if (persistent_) ClearBatchLog();
+  return ok;
+}
+
+void NamespaceStore::ClearBatchLog() {
+  std::error_code ec;
+  fs::resize_file(BatchLogPath(), 0, ec);  // app-mode stream keeps writing at the new end
+  batch_log_.clear();
+}
+
+void NamespaceStore::RecoverBatches() {
+  LogReader reader(BatchLogPath());
+  std::vector<LogRecord> group;
+  std::ifstream in(BatchLogPath(), std::ios::binary);
+  std::string value;
+
+  while (reader.NextGroup(&group)) {
+    std::map<std::string, WriteBatch> parts;
+    for (const auto& rec : group) {
+      if (!rec.checksum_ok) continue;
+      auto slash = rec.key.find('/');
+      if (slash == std::string::npos) continue;
+      std::string ns = rec.key.substr(0, slash);
+      std::string key = rec.key.substr(slash + 1);
+      if (rec.op == RecordOp::kPut) {
+        if (!ReadRecordValue(in, rec, &value)) continue;
+        parts[ns].Put(key, value);
+      } else {
+        parts[ns].Del(key);
+      }
+    }
+    // Re-applying is idempotent: the slot is cleared before the batch's locks
+    // are released, so nothing was written to these namespaces after it.
+    // A batch that cannot be applied keeps the directory from opening,
+    // rather than being dropped.
+    for (const auto& [name, batch] : parts) {
+      KVStore* s = Open(name);
+      if (!s || !s->Write(batch)) {
+        throw std::runtime_error("cannot apply the batch in " + BatchLogPath() + " to namespace " + name);
+      }
+    }
+  }
+
+  std::error_code ec;
+  fs::resize_file(BatchLogPath(), 0, ec);
+}
+
+// ---------- Compaction ----------
+void NamespaceStore::SetCompactionPolicy(const std::string& name, const CompactionPolicy& policy) {
+  if (!Open(name)) return;
+  std::unique_lock lock(mu_);
+  namespaces_[name].policy = policy;
+}
+
+std::vector<std::string> NamespaceStore::CompactDue() {
+  std::vector<std::pair<std::string, KVStore*>> due;
+  {
+    std::shared_lock lock(mu_);
+    for (const auto& [name, ns] : namespaces_) {
+      StoreStats st = ns.store->Stats();
+      if (st.log_bytes == 0 || st.garbage_bytes < ns.policy.min_garbage_bytes) continue;
+      double ratio = static_cast<double>(st.garbage_bytes) / static_cast<double>(st.log_bytes);
+      if (ratio >= ns.policy.min_garbage_ratio) due.emplace_back(name, ns.store.get());
+    }
+  }
+
+  std::vector<std::string> compacted;
+  for (auto& [name, store] : due) {
+    if (store->Compact()) compacted.push_back(name);
+  }
+  return compacted;
+}
+
+}  // namespace kv
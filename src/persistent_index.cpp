@@ -0,0 +1,272 @@
+#include "kvstore/persistent_index.h"
+#include "kvstore/crc32c.h"
+#include "kvstore/file_util.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace kv {
+
+namespace {
+
+constexpr size_t kHeaderSize = 4096;  // slots start on their own page
+constexpr char kMagic[8] = {'K', 'V', 'I', 'D', 'X', '0', '1', '\0'};
+constexpr uint32_t kVersion = 1;  // bump when HashKey or the slot layout changes
+
+}  // namespace
+
+struct PersistentIndex::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t clean;
+  uint64_t capacity;
+  uint64_t count;
+  uint64_t tombstones;
+  uint64_t live_bytes;
+  uint64_t applied;
+  uint64_t log_id;
+  uint32_t crc;  // of everything above
+};
+
+static uint64_t FileId(const struct stat& st) {
+  return (static_cast<uint64_t>(st.st_dev) << 40) ^ static_cast<uint64_t>(st.st_ino);
+}
+
+uint64_t LogFileId(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 ? FileId(st) : 0;
+}
+
+uint64_t LogFileIdOf(int fd) {
+  struct stat st;
+  return ::fstat(fd, &st) == 0 ? FileId(st) : 0;
+}
+
+PersistentIndex::~PersistentIndex() { Close(); }
+
+// ---------- Mapping ----------
+bool PersistentIndex::Map(const std::string& path, size_t size, bool create) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+  if (fd < 0) return false;
+  struct stat st;
+  if (create ? ::ftruncate(fd, static_cast<off_t>(size)) != 0
+             : (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kHeaderSize)) {
+    ::close(fd);
+    return false;
+  }
+  if (!create) size = static_cast<size_t>(st.st_size);
+  void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    ::close(fd);
+    return false;
+  }
+  path_ = path;
+  fd_ = fd;
+  map_ = static_cast<char*>(p);
+  map_size_ = size;
+  slots_ = reinterpret_cast<IndexSlot*>(map_ + kHeaderSize);
+  return true;
+}
+
+void PersistentIndex::Unmap() {
+  if (map_) ::munmap(map_, map_size_);
+  if (fd_ >= 0) ::close(fd_);
+  map_ = nullptr;
+  slots_ = nullptr;
+  map_size_ = 0;
+  fd_ = -1;
+}
+
+bool PersistentIndex::Open(const std::string& path, uint64_t log_id) {
+  Close();
+  if (!Map(path, 0, false)) return false;
+
+  Header h;
+  std::memcpy(&h, map_, sizeof(h));
+  const bool ok =
+      std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && h.version == kVersion &&
+      h.crc == Crc32c(reinterpret_cast<const char*>(&h), offsetof(Header, crc)) &&
+      h.log_id == log_id && h.capacity >= kMinCapacity && (h.capacity & (h.capacity - 1)) == 0 &&
+      map_size_ == kHeaderSize + h.capacity * sizeof(IndexSlot);
+  if (!ok) {
+    Unmap();
+    return false;
+  }
+  capacity_ = h.capacity;
+  count_ = h.count;
+  tombstones_ = h.tombstones;
+  live_bytes_ = h.live_bytes;
+  applied_ = h.applied;
+  log_id_ = log_id;
+  was_clean_ = h.clean != 0;
+
+  // From here on a crash must be detectable as one.
+  return WriteHeader(false) && ::msync(map_, kHeaderSize, MS_SYNC) == 0;
+}
+
+bool PersistentIndex::Create(const std::string& path, uint64_t log_id, uint64_t capacity) {
+  Close();
+  uint64_t cap = kMinCapacity;
+  while (cap < capacity) cap <<= 1;
+  // A fresh file reads as zeros: every slot starts empty.
+  if (!Map(path, kHeaderSize + cap * sizeof(IndexSlot), true)) return false;
+  capacity_ = cap;
+  count_ = tombstones_ = live_bytes_ = applied_ = 0;
+  log_id_ = log_id;
+  was_clean_ = false;
+  return WriteHeader(false) && ::msync(map_, map_size_, MS_SYNC) == 0 && SyncParentDir(path);
+}
+
+void PersistentIndex::Close() { Unmap(); }
+
+bool PersistentIndex::WriteHeader(bool clean) {
+  Header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.clean = clean ? 1 : 0;
+  h.capacity = capacity_;
+  h.count = count_;
+  h.tombstones = tombstones_;
+  h.live_bytes = live_bytes_;
+  h.applied = applied_;
+  h.log_id = log_id_;
+  h.crc = Crc32c(reinterpret_cast<const char*>(&h), offsetof(Header, crc));
+  std::memcpy(map_, &h, sizeof(h));
+  return true;
+}
+
+bool PersistentIndex::Checkpoint(uint64_t applied, bool clean) {
+  if (!map_) return false;
+  // Slots first: the header must never claim more than the slots hold.
+  if (::msync(map_, map_size_, MS_SYNC) != 0) return false;
+  applied_ = applied;
+  WriteHeader(clean);
+  return ::msync(map_, kHeaderSize, MS_SYNC) == 0;
+}
+
+bool PersistentIndex::Recount(uint64_t log_size) {
+  count_ = tombstones_ = live_bytes_ = 0;
+  for (uint64_t i = 0; i < capacity_; i++) {
+    const IndexSlot& s = slots_[i];
+    if (s.live()) {
+      if (s.record_offset + s.record_len > log_size) return false;
+      count_++;
+      live_bytes_ += s.record_len;
+    } else if (s.record_len != 0) {
+      tombstones_++;
+    }
+  }
+  return true;
+}
+
+// ---------- Lookup and update ----------
+size_t PersistentIndex::Probe(uint64_t hash, const IsKey& is_key, bool* found) const {
+  const uint64_t mask = capacity_ - 1;
+  size_t first_free = SIZE_MAX;
+  uint64_t i = hash & mask;
+  for (uint64_t n = 0; n < capacity_; n++, i = (i + 1) & mask) {
+    const IndexSlot& s = slots_[i];
+    if (s.live()) {
+      if (s.hash == hash && is_key(s)) {
+        *found = true;
+        return i;
+      }
+    } else {
+      if (first_free == SIZE_MAX) first_free = i;
+      if (s.record_len == 0) break;  // empty ends the chain; a tombstone doesn't
+    }
+  }
+  *found = false;
+  return first_free;  // SIZE_MAX only if the table is full of live slots
+}
+
+const IndexSlot* PersistentIndex::Find(uint64_t hash, const IsKey& is_key) const {
+  bool found = false;
+  size_t i = Probe(hash, is_key, &found);
+  return found ? &slots_[i] : nullptr;
+}
+
+bool PersistentIndex::Put(const IndexSlot& slot, const IsKey& is_key, IndexSlot* replaced) {
+  bool found = false;
+  size_t i = Probe(slot.hash, is_key, &found);
+  if (i == SIZE_MAX) return false;
+  *replaced = found ? slots_[i] : IndexSlot();
+  if (found) {
+    live_bytes_ -= replaced->record_len;
+  } else {
+    if (slots_[i].record_len != 0) tombstones_--;
+    count_++;
+  }
+  slots_[i] = slot;
+  live_bytes_ += slot.record_len;
+  // Keep probe chains short: grow (or just drop tombstones) past 70% use.
+  // If that fails the table keeps working, only slower, until it is full.
+  if ((count_ + tombstones_) * 10 > capacity_ * 7) Grow();
+  return true;
+}
+
+IndexSlot PersistentIndex::Del(uint64_t hash, const IsKey& is_key) {
+  bool found = false;
+  size_t i = Probe(hash, is_key, &found);
+  if (!found) return IndexSlot();
+  IndexSlot old = slots_[i];
+  IndexSlot tomb;
+  tomb.record_len = 1;
+  slots_[i] = tomb;
+  count_--;
+  tombstones_++;
+  live_bytes_ -= old.record_len;
+  return old;
+}
+
+void PersistentIndex::ForEach(const std::function<void(const IndexSlot&)>& fn) const {
+  for (uint64_t i = 0; i < capacity_; i++) {
+    if (slots_[i].live()) fn(slots_[i]);
+  }
+}
+
+// Rehashes into a new file and renames it over the old one. The new table
+// holds everything the old one did, so the header's `applied` still holds.
+bool PersistentIndex::Grow() {
+  uint64_t cap = capacity_;
+  while ((count_ + 1) * 2 > cap) cap <<= 1;
+
+  PersistentIndex next;
+  const std::string tmp = path_ + ".tmp";
+  if (!next.Create(tmp, log_id_, cap)) return false;
+  const uint64_t mask = next.capacity_ - 1;
+  ForEach([&](const IndexSlot& s) {
+    uint64_t i = s.hash & mask;
+    while (next.slots_[i].record_len != 0) i = (i + 1) & mask;
+    next.slots_[i] = s;
+  });
+  next.count_ = count_;
+  next.live_bytes_ = live_bytes_;
+  next.applied_ = applied_;
+  next.WriteHeader(false);
+  if (::msync(next.map_, next.map_size_, MS_SYNC) != 0 || std::rename(tmp.c_str(), path_.c_str()) != 0) {
+    next.Close();
+    std::remove(tmp.c_str());
+    return false;
+  }
+  SyncParentDir(path_);
+
+  Unmap();
+  std::swap(fd_, next.fd_);
+  std::swap(map_, next.map_);
+  std::swap(map_size_, next.map_size_);
+  std::swap(slots_, next.slots_);
+  capacity_ = next.capacity_;
+  tombstones_ = 0;
+  return true;
+}
+
+}  // namespace kv
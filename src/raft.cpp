@@ -0,0 +1,1299 @@
+#include "kvstore/raft.h"
+#include "kvstore/crc32c.h"
+#include "kvstore/file_util.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace kv {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t kMaxFrame = 256u << 20;
+
+// Message types; replies are the lower-case letter.
+constexpr char kVote = 'V';
+constexpr char kAppend = 'A';
+constexpr char kSnapshot = 'S';
+
+class Encoder {
+ public:
+  explicit Encoder(char type) { s_.push_back(type); }
+  void U8(uint8_t v) { s_.push_back(static_cast<char>(v)); }
+  void U32(uint32_t v) { s_.append(reinterpret_cast<const char*>(&v), 4); }
+  void U64(uint64_t v) { s_.append(reinterpret_cast<const char*>(&v), 8); }
+  void Str(const std::string& v) {
+    U32(static_cast<uint32_t>(v.size()));
+    s_ += v;
+  }
+  std::string& str() { return s_; }
+
+ private:
+  std::string s_;
+};
+
+class Decoder {
+ public:
+  explicit Decoder(const std::string& s) : s_(s), pos_(1) {}
+  bool U8(uint8_t* v) { return Raw(v, 1); }
+  bool U32(uint32_t* v) { return Raw(v, 4); }
+  bool U64(uint64_t* v) { return Raw(v, 8); }
+  bool Str(std::string* v) {
+    uint32_t n;
+    if (!U32(&n) || s_.size() - pos_ < n) return false;
+    v->assign(s_, pos_, n);
+    pos_ += n;
+    return true;
+  }
+
+ private:
+  bool Raw(void* out, size_t n) {
+    if (s_.size() - pos_ < n) return false;
+    std::memcpy(out, s_.data() + pos_, n);
+    pos_ += n;
+    return true;
+  }
+  const std::string& s_;
+  size_t pos_;
+};
+
+bool WriteAll(int fd, const char* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+    p += w;
+    n -= static_cast<size_t>(w);
+  }
+  return true;
+}
+
+bool ReadAll(int fd, char* p, size_t n) {
+  while (n > 0) {
+    ssize_t r = ::recv(fd, p, n, 0);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    p += r;
+    n -= static_cast<size_t>(r);
+  }
+  return true;
+}
+
+bool WriteFrame(int fd, const std::string& body) {
+  uint32_t len = static_cast<uint32_t>(body.size());
+  std::string frame(reinterpret_cast<const char*>(&len), 4);
+  frame += body;
+  return WriteAll(fd, frame.data(), frame.size());
+}
+
+bool ReadFrame(int fd, std::string* body) {
+  uint32_t len;
+  if (!ReadAll(fd, reinterpret_cast<char*>(&len), 4) || len == 0 || len > kMaxFrame) return false;
+  body->resize(len);
+  return ReadAll(fd, &(*body)[0], len);
+}
+
+void NoDelay(int fd) {
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int ConnectTo(const RaftPeer& peer) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  if (::getaddrinfo(peer.host.c_str(), std::to_string(peer.port).c_str(), &hints, &res) != 0) return -1;
+  int fd = -1;
+  for (addrinfo* a = res; a && fd < 0; a = a->ai_next) {
+    fd = ::socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+    if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  ::freeaddrinfo(res);
+  if (fd >= 0) NoDelay(fd);
+  return fd;
+}
+
+std::string Seal(const std::string& line) {
+  char crc[16];
+  std::snprintf(crc, sizeof(crc), "%08x", Crc32c(line));
+  return line + " crc=" + crc + "\n";
+}
+
+bool Unseal(const std::string& line, std::string* body) {
+  size_t pos = line.rfind(" crc=");
+  if (pos == std::string::npos) return false;
+  *body = line.substr(0, pos);
+  char* end = nullptr;
+  unsigned long crc = std::strtoul(line.c_str() + pos + 5, &end, 16);
+  return *end == '\0' && static_cast<uint32_t>(crc) == Crc32c(*body);
+}
+
+}  // namespace
+
+bool ParseRaftPeers(const std::string& spec, std::vector<RaftPeer>* peers, std::string* err) {
+  peers->clear();
+  std::stringstream ss(spec);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    size_t eq = item.find('=');
+    size_t colon = item.rfind(':');
+    RaftPeer p;
+    if (eq == std::string::npos || colon == std::string::npos || colon < eq) {
+      if (err) *err = "bad peer (want id=host:port): " + item;
+      return false;
+    }
+    try {
+      p.id = std::stoi(item.substr(0, eq));
+      p.port = std::stoi(item.substr(colon + 1));
+    } catch (...) {
+      p.id = 0;
+    }
+    p.host = item.substr(eq + 1, colon - eq - 1);
+    if (p.id <= 0 || p.port <= 0 || p.host.empty()) {
+      if (err) *err = "bad peer (want id=host:port): " + item;
+      return false;
+    }
+    for (const auto& q : *peers) {
+      if (q.id == p.id) {
+        if (err) *err = "duplicate peer id " + std::to_string(p.id);
+        return false;
+      }
+    }
+    peers->push_back(p);
+  }
+  if (peers->empty()) {
+    if (err) *err = "no peers";
+    return false;
+  }
+  return true;
+}
+
+// One follower as seen from this node: the outgoing connection (opened by
+// the sender thread, read by a reader thread it starts), and, while this
+// node leads, that follower's replication progress.
+struct RaftNode::Link {
+  RaftPeer peer;
+  std::thread sender;
+  std::thread reader;
+  int fd = -1;
+  bool connected = false;
+
+  uint64_t next_index = 1;
+  uint64_t match_index = 0;
+  uint64_t seq = 0;           // of the latest request sent
+  uint64_t ignore_below = 0;  // replies to requests sent before a reset are stale
+  struct Inflight {
+    uint64_t seq;
+    Clock::time_point sent;
+    uint64_t from;  // first entry it carries
+  };
+  std::deque<Inflight> inflight;  // AppendEntries awaiting a reply, oldest first
+  Clock::time_point acked_sent;   // send time of the newest acknowledged request, this term
+  Clock::time_point next_heartbeat;
+  bool vote_due = false;
+  uint64_t vote_counted_term = 0;
+
+  // InstallSnapshot in progress: chunks go one at a time.
+  int snap_fd = -1;
+  uint64_t snap_index = 0;
+  uint64_t snap_term = 0;
+  uint64_t snap_size = 0;
+  uint64_t snap_offset = 0;  // acknowledged so far
+  uint64_t snap_chunk = 0;   // bytes in the chunk awaiting a reply, 0 if none
+  Clock::time_point snap_sent;
+
+  void EndSnapshot() {
+    if (snap_fd >= 0) ::close(snap_fd);
+    snap_fd = -1;
+    snap_chunk = 0;
+  }
+  // Forget what is in flight; replication resumes from the oldest entry
+  // not known to have arrived.
+  void Reset() {
+    if (!inflight.empty()) next_index = std::max(match_index + 1, inflight.front().from);
+    inflight.clear();
+    ignore_below = seq + 1;
+    EndSnapshot();
+  }
+};
+
+struct RaftNode::Waiter {
+  uint64_t term = 0;
+  bool done = false;
+  bool ok = false;      // the entry committed in this term
+  bool result = false;  // Put succeeded / Del found the key
+};
+
+RaftNode::RaftNode(const RaftOptions& options) : options_(options) {}
+
+RaftNode::~RaftNode() { Stop(); }
+
+std::string RaftNode::MetaPath() const { return (fs::path(options_.dir) / "raft.meta").string(); }
+std::string RaftNode::LogPath() const { return (fs::path(options_.dir) / "raft.log").string(); }
+std::string RaftNode::StatePath() const { return (fs::path(options_.dir) / "state.aof").string(); }
+std::string RaftNode::SnapshotPath() const { return (fs::path(options_.dir) / "snapshot.aof").string(); }
+
+// ---------- Persistence ----------
+
+uint64_t RaftNode::LastIndexLocked() const { return snapshot_index_ + log_.size(); }
+
+uint64_t RaftNode::TermAtLocked(uint64_t index) const {
+  if (index == snapshot_index_) return snapshot_term_;
+  if (index < snapshot_index_ || index > LastIndexLocked()) return 0;
+  return EntryAtLocked(index).term;
+}
+
+const RaftNode::Entry& RaftNode::EntryAtLocked(uint64_t index) const {
+  return log_[static_cast<size_t>(index - snapshot_index_ - 1)];
+}
+
+bool RaftNode::SaveMetaLocked() {
+  const std::string tmp = MetaPath() + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << Seal("term=" + std::to_string(term_) + " vote=" + std::to_string(voted_for_) +
+                " snapshot=" + std::to_string(snapshot_index_) + ":" + std::to_string(snapshot_term_));
+    if (!out.flush()) return false;
+  }
+  return ReplaceFile(tmp, MetaPath());
+}
+
+static std::string EncodeLogRecord(uint64_t index, uint64_t term, char type, const std::string& key,
+                                   const std::string& value) {
+  std::string header = "E " + std::to_string(index) + " " + std::to_string(term) + " " + type + " " +
+                       std::to_string(key.size()) + " " + std::to_string(value.size());
+  char crc[16];
+  std::snprintf(crc, sizeof(crc), "%08x", Crc32c(value, Crc32c(key, Crc32c(header))));
+  std::string out = header + " crc=" + crc + "\n";
+  out += key;
+  out += value;
+  out += '\n';
+  return out;
+}
+
+bool RaftNode::LoadLocked(std::string* err) {
+  std::error_code ec;
+  fs::create_directories(options_.dir, ec);
+  {
+    std::ifstream in(MetaPath(), std::ios::binary);
+    std::string line, body;
+    if (in && std::getline(in, line)) {
+      unsigned long long t = 0, s = 0, st = 0;
+      int v = 0;
+      if (!Unseal(line, &body) ||
+          std::sscanf(body.c_str(), "term=%llu vote=%d snapshot=%llu:%llu", &t, &v, &s, &st) != 4) {
+        if (err) *err = MetaPath() + ": damaged";
+        return false;
+      }
+      term_ = t;
+      voted_for_ = v;
+      snapshot_index_ = s;
+      snapshot_term_ = st;
+    }
+  }
+
+  // Entries up to the first torn or damaged record; nothing after it was
+  // ever acknowledged.
+  std::string data;
+  {
+    std::ifstream in(LogPath(), std::ios::binary);
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    data = ss.str();
+  }
+  size_t pos = 0;
+  uint64_t valid_end = 0;
+  std::vector<Entry> kept;
+  while (pos < data.size()) {
+    size_t nl = data.find('\n', pos);
+    if (nl == std::string::npos) break;
+    const std::string line = data.substr(pos, nl - pos);
+    unsigned long long index = 0, term = 0, ks = 0, vs = 0;
+    char type = 0;
+    size_t crc_at = line.rfind(" crc=");
+    if (crc_at == std::string::npos ||
+        std::sscanf(line.c_str(), "E %llu %llu %c %llu %llu", &index, &term, &type, &ks, &vs) != 5) {
+      break;
+    }
+    const size_t body = nl + 1;
+    if (data.size() - body < ks + vs + 1 || data[body + ks + vs] != '\n') break;
+    const std::string header = line.substr(0, crc_at);
+    const uint32_t want = static_cast<uint32_t>(std::strtoul(line.c_str() + crc_at + 5, nullptr, 16));
+    const uint32_t got = Crc32c(data.data() + body + ks, vs, Crc32c(data.data() + body, ks, Crc32c(header)));
+    if (got != want) break;
+    Entry e;
+    e.term = term;
+    e.type = type;
+    e.key.assign(data, body, ks);
+    e.value.assign(data, body + ks, vs);
+    e.offset = pos;
+    pos = body + ks + vs + 1;
+    valid_end = pos;
+    // Left over from before a rewrite that the crash interrupted.
+    if (index <= snapshot_index_) continue;
+    if (index != snapshot_index_ + 1 + kept.size()) break;
+    kept.push_back(std::move(e));
+  }
+  log_.assign(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()));
+
+  log_fd_ = ::open(LogPath().c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (log_fd_ < 0 || ::ftruncate(log_fd_, static_cast<off_t>(valid_end)) != 0 ||
+      ::lseek(log_fd_, 0, SEEK_END) < 0) {
+    if (err) *err = LogPath() + ": " + std::strerror(errno);
+    return false;
+  }
+  log_end_ = valid_end;
+  written_index_ = LastIndexLocked();
+  // Written by a previous run, maybe never synced.
+  if (options_.sync && ::fdatasync(log_fd_) != 0) {
+    if (err) *err = LogPath() + ": fdatasync failed";
+    return false;
+  }
+  synced_index_ = written_index_;
+
+  store_ = std::make_unique<KVStore>(StatePath(), options_.store_options);
+  commit_index_ = snapshot_index_;
+  applied_ = snapshot_index_;
+  return true;
+}
+
+bool RaftNode::AppendToFileLocked(uint64_t from_index) {
+  std::string out;
+  uint64_t offset = log_end_;
+  for (uint64_t i = from_index; i <= LastIndexLocked(); i++) {
+    Entry& e = log_[static_cast<size_t>(i - snapshot_index_ - 1)];
+    e.offset = offset + out.size();
+    out += EncodeLogRecord(i, e.term, e.type, e.key, e.value);
+  }
+  const char* p = out.data();
+  size_t n = out.size();
+  while (n > 0) {
+    ssize_t w = ::write(log_fd_, p, n);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+    p += w;
+    n -= static_cast<size_t>(w);
+  }
+  log_end_ += out.size();
+  written_index_ = LastIndexLocked();
+  return true;
+}
+
+bool RaftNode::TruncateFileLocked(uint64_t from_index) {
+  if (from_index <= commit_index_ || from_index > LastIndexLocked()) return false;  // never drop committed entries
+  const uint64_t offset = EntryAtLocked(from_index).offset;
+  {
+    std::lock_guard<std::mutex> io(log_io_mu_);
+    if (::ftruncate(log_fd_, static_cast<off_t>(offset)) != 0) return false;
+    log_gen_++;
+  }
+  log_end_ = offset;
+  log_.erase(log_.begin() + static_cast<std::ptrdiff_t>(from_index - snapshot_index_ - 1), log_.end());
+  written_index_ = std::min(written_index_, from_index - 1);
+  synced_index_ = std::min(synced_index_, from_index - 1);
+  for (auto it = waiters_.lower_bound(from_index); it != waiters_.end(); it = waiters_.erase(it)) {
+    it->second->done = true;
+  }
+  applied_cv_.notify_all();
+  return true;
+}
+
+// raft.log with only the entries past the snapshot, replaced atomically.
+bool RaftNode::RewriteFileLocked() {
+  const std::string tmp = LogPath() + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return false;
+  std::string out;
+  for (uint64_t i = snapshot_index_ + 1; i <= LastIndexLocked(); i++) {
+    Entry& e = log_[static_cast<size_t>(i - snapshot_index_ - 1)];
+    e.offset = out.size();
+    out += EncodeLogRecord(i, e.term, e.type, e.key, e.value);
+  }
+  bool ok = ::write(fd, out.data(), out.size()) == static_cast<ssize_t>(out.size());
+  ::close(fd);
+  if (!ok || !ReplaceFile(tmp, LogPath())) return false;
+  int nfd = ::open(LogPath().c_str(), O_WRONLY | O_CLOEXEC);
+  if (nfd < 0 || ::lseek(nfd, 0, SEEK_END) < 0) return false;
+  {
+    std::lock_guard<std::mutex> io(log_io_mu_);
+    ::close(log_fd_);
+    log_fd_ = nfd;
+    log_gen_++;
+  }
+  log_end_ = out.size();
+  written_index_ = synced_index_ = LastIndexLocked();
+  return true;
+}
+
+bool RaftNode::SyncLogLocked() {
+  if (options_.sync) {
+    std::lock_guard<std::mutex> io(log_io_mu_);
+    if (::fdatasync(log_fd_) != 0) return false;
+  }
+  synced_index_ = written_index_;
+  counters_.log_syncs++;
+  return true;
+}
+
+// ---------- Roles ----------
+
+void RaftNode::ResetElectionTimerLocked() {
+  const auto base = options_.election_timeout.count();
+  std::uniform_int_distribution<long long> jitter(0, std::max<long long>(1, base) - 1);
+  election_deadline_ = Clock::now() + std::chrono::milliseconds(base + jitter(rng_));
+}
+
+void RaftNode::BecomeFollowerLocked(uint64_t term, int leader) {
+  if (term > term_) {
+    term_ = term;
+    voted_for_ = 0;
+    SaveMetaLocked();
+  }
+  if (role_ != RaftRole::kFollower) {
+    role_ = RaftRole::kFollower;
+    ResetElectionTimerLocked();
+    for (auto& l : links_) l->EndSnapshot();
+  }
+  leader_ = leader;
+  cv_.notify_all();
+}
+
+void RaftNode::StartElectionLocked() {
+  role_ = RaftRole::kCandidate;
+  term_++;
+  voted_for_ = options_.id;
+  SaveMetaLocked();
+  leader_ = 0;
+  votes_ = 1;
+  ResetElectionTimerLocked();
+  for (auto& l : links_) l->vote_due = true;
+  if (votes_ >= static_cast<int>(links_.size() + 1) / 2 + 1) BecomeLeaderLocked();
+  cv_.notify_all();
+}
+
+// Takes over replication from each follower's presumed end of log, and
+// appends a no-op: entries from earlier terms commit with it, and reads wait
+// for it (the leader cannot know the commit index before).
+void RaftNode::BecomeLeaderLocked() {
+  role_ = RaftRole::kLeader;
+  leader_ = options_.id;
+  leader_since_ = Clock::now();
+  log_.push_back(Entry{term_, 'N', "", "", 0});
+  leader_term_start_ = LastIndexLocked();
+  AppendToFileLocked(leader_term_start_);
+  for (auto& l : links_) {
+    l->Reset();
+    l->match_index = 0;
+    l->next_index = leader_term_start_;
+    l->acked_sent = Clock::time_point();
+    l->next_heartbeat = Clock::time_point();
+  }
+  cv_.notify_all();
+}
+
+void RaftNode::AdvanceCommitLocked() {
+  if (role_ != RaftRole::kLeader) return;
+  std::vector<uint64_t> match{synced_index_};
+  for (const auto& l : links_) match.push_back(l->match_index);
+  std::sort(match.begin(), match.end(), std::greater<uint64_t>());
+  const uint64_t n = match[match.size() / 2];  // held by a majority
+  // Only an entry of the current term commits by counting (Raft §5.4.2).
+  if (n > commit_index_ && TermAtLocked(n) == term_) {
+    commit_index_ = n;
+    cv_.notify_all();
+  }
+}
+
+RaftNode::Clock::time_point RaftNode::QuorumAckLocked() const {
+  std::vector<Clock::time_point> acked{Clock::now()};
+  for (const auto& l : links_) acked.push_back(l->acked_sent);
+  std::sort(acked.begin(), acked.end(), std::greater<Clock::time_point>());
+  return acked[acked.size() / 2];
+}
+
+RaftNode::Clock::time_point RaftNode::LeaseExpiryLocked() const {
+  const Clock::time_point quorum = QuorumAckLocked();
+  if (quorum == Clock::time_point()) return quorum;
+  return quorum + std::chrono::duration_cast<Clock::duration>(options_.election_timeout * options_.lease_fraction);
+}
+
+// ---------- Lifecycle ----------
+
+bool RaftNode::Start(std::string* err) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (running_) return true;
+  const RaftPeer* self = nullptr;
+  for (const auto& p : options_.peers) {
+    if (p.id == options_.id) self = &p;
+  }
+  if (!self) {
+    if (err) *err = "id " + std::to_string(options_.id) + " is not among the peers";
+    return false;
+  }
+  if (!LoadLocked(err)) return false;
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo* res = nullptr;
+  if (::getaddrinfo(self->host.c_str(), std::to_string(self->port).c_str(), &hints, &res) == 0) {
+    listen_fd_ = ::socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+    int one = 1;
+    if (listen_fd_ >= 0) ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (listen_fd_ >= 0 && (::bind(listen_fd_, res->ai_addr, res->ai_addrlen) != 0 || ::listen(listen_fd_, 64) != 0)) {
+      ::close(listen_fd_);
+      listen_fd_ = -1;
+    }
+    ::freeaddrinfo(res);
+  }
+  if (listen_fd_ < 0) {
+    if (err) *err = "listen on " + self->host + ":" + std::to_string(self->port) + " failed: " + std::strerror(errno);
+    store_.reset();
+    ::close(log_fd_);
+    log_fd_ = -1;
+    return false;
+  }
+
+  rng_.seed(std::random_device{}() ^ static_cast<unsigned>(options_.id));
+  last_leader_contact_ = Clock::now();
+  ResetElectionTimerLocked();
+  stop_ = false;
+  running_ = true;
+  counters_ = RaftStatus();
+  for (const auto& p : options_.peers) {
+    if (p.id == options_.id) continue;
+    links_.push_back(std::make_unique<Link>());
+    links_.back()->peer = p;
+    links_.back()->next_index = LastIndexLocked() + 1;
+  }
+  if (links_.empty()) StartElectionLocked();  // a group of one elects itself
+  threads_.emplace_back(&RaftNode::Ticker, this);
+  threads_.emplace_back(&RaftNode::Syncer, this);
+  threads_.emplace_back(&RaftNode::Applier, this);
+  threads_.emplace_back(&RaftNode::AcceptLoop, this);
+  for (auto& l : links_) l->sender = std::thread(&RaftNode::SendLoop, this, l.get());
+  return true;
+}
+
+void RaftNode::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!running_) return;
+    running_ = false;
+    stop_ = true;
+    for (auto& l : links_) {
+      if (l->fd >= 0) ::shutdown(l->fd, SHUT_RDWR);
+    }
+    cv_.notify_all();
+    applied_cv_.notify_all();
+  }
+  ::shutdown(listen_fd_, SHUT_RDWR);
+  for (auto& t : threads_) t.join();
+  threads_.clear();
+  for (auto& l : links_) l->sender.join();  // each joins its reader
+  {
+    std::unique_lock<std::mutex> lock(conns_mu_);
+    for (int fd : conn_fds_) ::shutdown(fd, SHUT_RDWR);
+    conns_idle_.wait(lock, [&]() { return conn_fds_.empty(); });
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (auto& l : links_) l->EndSnapshot();
+    links_.clear();
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    ::close(log_fd_);
+    log_fd_ = -1;
+    log_.clear();
+    waiters_.clear();
+    role_ = RaftRole::kFollower;
+    leader_ = 0;
+  }
+  std::unique_lock<std::shared_mutex> store_lock(store_mu_);
+  store_.reset();
+}
+
+// ---------- Client calls ----------
+
+bool RaftNode::Propose(char type, const std::string& key, const std::string& value, bool* result,
+                       std::string* err) {
+  std::unique_lock<std::mutex> lock(mu_);
+  if (!running_ || role_ != RaftRole::kLeader) {
+    if (err) *err = "not leader";
+    return false;
+  }
+  log_.push_back(Entry{term_, type, key, value, 0});
+  const uint64_t index = LastIndexLocked();
+  if (!AppendToFileLocked(index)) {
+    log_.pop_back();
+    if (err) *err = "raft log write failed";
+    return false;
+  }
+  Waiter w;
+  w.term = term_;
+  waiters_[index] = &w;
+  cv_.notify_all();  // senders and the syncer
+  const auto deadline = Clock::now() + options_.request_timeout;
+  applied_cv_.wait_until(lock, deadline, [&]() { return w.done || stop_; });
+  auto it = waiters_.find(index);
+  if (it != waiters_.end() && it->second == &w) waiters_.erase(it);
+  if (!w.done) {
+    if (err) *err = stop_ ? "stopped" : "timed out";
+    return false;
+  }
+  if (!w.ok) {
+    if (err) *err = "lost leadership";
+    return false;
+  }
+  *result = w.result;
+  return true;
+}
+
+bool RaftNode::Put(const std::string& key, const std::string& value, std::string* err) {
+  bool ok = false;
+  if (!Propose('P', key, value, &ok, err)) return false;
+  if (!ok && err) *err = "put failed";
+  return ok;
+}
+
+bool RaftNode::Del(const std::string& key, bool* existed, std::string* err) {
+  bool found = false;
+  if (!Propose('D', key, "", &found, err)) return false;
+  if (existed) *existed = found;
+  return true;
+}
+
+bool RaftNode::Get(const std::string& key, std::optional<std::string>* value, std::string* err) {
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    const auto deadline = Clock::now() + options_.request_timeout;
+    bool ready = cv_.wait_until(lock, deadline, [&]() {
+      return stop_ || role_ != RaftRole::kLeader ||
+             (commit_index_ >= leader_term_start_ && Clock::now() < LeaseExpiryLocked());
+    });
+    if (stop_ || role_ != RaftRole::kLeader) {
+      if (err) *err = "not leader";
+      return false;
+    }
+    if (!ready) {
+      if (err) *err = "no lease";
+      return false;
+    }
+    const uint64_t read_index = commit_index_;
+    if (!applied_cv_.wait_until(lock, deadline, [&]() { return stop_ || applied_ >= read_index; }) || stop_) {
+      if (err) *err = "timed out";
+      return false;
+    }
+  }
+  std::shared_lock<std::shared_mutex> store_lock(store_mu_);
+  if (!store_) {
+    if (err) *err = "stopped";
+    return false;
+  }
+  *value = store_->Get(key);
+  return true;
+}
+
+std::optional<std::string> RaftNode::GetLocal(const std::string& key) {
+  std::shared_lock<std::shared_mutex> store_lock(store_mu_);
+  if (!store_) return std::nullopt;
+  return store_->Get(key);
+}
+
+RaftStatus RaftNode::Status() {
+  std::lock_guard<std::mutex> lock(mu_);
+  RaftStatus s = counters_;
+  s.id = options_.id;
+  s.role = role_;
+  s.term = term_;
+  s.leader = leader_;
+  s.last_index = LastIndexLocked();
+  s.commit_index = commit_index_;
+  s.applied_index = applied_;
+  s.snapshot_index = snapshot_index_;
+  if (role_ == RaftRole::kLeader) {
+    s.lease_ms = std::chrono::duration_cast<std::chrono::milliseconds>(LeaseExpiryLocked() - Clock::now()).count();
+  }
+  for (const auto& l : links_) {
+    s.peers.push_back(RaftPeerStatus{l->peer.id, l->connected, l->match_index, l->next_index});
+  }
+  return s;
+}
+
+// ---------- Background threads ----------
+
+// Elections, and a leader's step-down once no majority has answered for two
+// election timeouts (clients then look elsewhere instead of timing out).
+void RaftNode::Ticker() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stop_) {
+    const auto now = Clock::now();
+    if (role_ != RaftRole::kLeader && now >= election_deadline_) {
+      StartElectionLocked();
+    } else if (role_ == RaftRole::kLeader && now - std::max(leader_since_, QuorumAckLocked()) >
+                                                   2 * options_.election_timeout) {
+      BecomeFollowerLocked(term_, 0);
+    }
+    cv_.wait_until(lock, std::min(election_deadline_, now + options_.heartbeat));
+  }
+}
+
+// Group commit for the leader's own log: one fdatasync covers every entry
+// written while the previous one ran. Followers sync before they reply.
+void RaftNode::Syncer() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stop_) {
+    cv_.wait(lock, [&]() { return stop_ || written_index_ > synced_index_; });
+    if (stop_) break;
+    const uint64_t target = written_index_;
+    const uint64_t gen = log_gen_;
+    lock.unlock();
+    bool ok = true;
+    if (options_.sync) {
+      std::lock_guard<std::mutex> io(log_io_mu_);
+      ok = gen != log_gen_ || ::fdatasync(log_fd_) == 0;
+    }
+    lock.lock();
+    if (!ok || gen != log_gen_) continue;
+    synced_index_ = std::max(synced_index_, std::min(target, written_index_));
+    counters_.log_syncs++;
+    AdvanceCommitLocked();
+  }
+}
+
+// Applies committed entries to state.aof in order, answers the proposers
+// waiting on them, and takes a snapshot every snapshot_entries.
+void RaftNode::Applier() {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait(lock, [&]() { return stop_ || applied_ < commit_index_; });
+      if (stop_) return;
+    }
+    std::shared_lock<std::shared_mutex> store_lock(store_mu_);
+    std::vector<Entry> batch;
+    uint64_t first;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      first = applied_ + 1;
+      for (uint64_t i = first; i <= commit_index_ && batch.size() < 256; i++) batch.push_back(EntryAtLocked(i));
+    }
+    std::vector<bool> results;
+    for (const Entry& e : batch) {
+      results.push_back(e.type == 'P' ? store_->Put(e.key, e.value) : e.type == 'D' ? store_->Del(e.key) : true);
+    }
+    bool snapshot_due;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      for (size_t k = 0; k < batch.size(); k++) {
+        auto it = waiters_.find(first + k);
+        if (it == waiters_.end()) continue;
+        it->second->done = true;
+        it->second->ok = it->second->term == batch[k].term;
+        it->second->result = results[k];
+        waiters_.erase(it);
+      }
+      applied_ = std::max(applied_, first + batch.size() - 1);
+      applied_cv_.notify_all();
+      snapshot_due = applied_ - snapshot_index_ >= options_.snapshot_entries;
+    }
+    if (snapshot_due) TakeSnapshot();
+  }
+}
+
+// Compacts state.aof, which then holds exactly the state at applied_, copies
+// it to snapshot.aof, and drops the log up to there. Only the applier writes
+// to the store, so nothing changes it meanwhile.
+bool RaftNode::TakeSnapshot() {
+  uint64_t index, term;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    index = applied_;
+    term = TermAtLocked(index);
+  }
+  if (!store_->Compact()) return false;
+  const std::string tmp = SnapshotPath() + ".tmp";
+  std::error_code ec;
+  fs::copy_file(StatePath(), tmp, fs::copy_options::overwrite_existing, ec);
+  if (ec || !ReplaceFile(tmp, SnapshotPath())) return false;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (index <= snapshot_index_) return true;
+  log_.erase(log_.begin(), log_.begin() + static_cast<std::ptrdiff_t>(index - snapshot_index_));
+  snapshot_index_ = index;
+  snapshot_term_ = term;
+  // Meta first: a crash before the rewrite leaves old entries in raft.log,
+  // which loading skips.
+  if (!SaveMetaLocked() || !RewriteFileLocked()) return false;
+  counters_.snapshots_taken++;
+  return true;
+}
+
+// Replaces state.aof with the received snapshot and keeps whatever of the
+// log follows it, if the log agrees with it there. Caller holds store_mu_
+// exclusively and mu_.
+bool RaftNode::InstallSnapshotLocked(uint64_t index, uint64_t term, const std::string& file) {
+  if (!ReplaceFile(file, SnapshotPath())) return false;
+  store_->Close();
+  store_.reset();
+  const std::string tmp = StatePath() + ".tmp";
+  std::error_code ec;
+  fs::copy_file(SnapshotPath(), tmp, fs::copy_options::overwrite_existing, ec);
+  if (!ec) ReplaceFile(tmp, StatePath());
+  store_ = std::make_unique<KVStore>(StatePath(), options_.store_options);
+  if (ec) return false;
+
+  if (index < LastIndexLocked() && TermAtLocked(index) == term) {
+    log_.erase(log_.begin(), log_.begin() + static_cast<std::ptrdiff_t>(index - snapshot_index_));
+  } else {
+    log_.clear();
+    for (auto& w : waiters_) w.second->done = true;
+    waiters_.clear();
+    applied_cv_.notify_all();
+  }
+  snapshot_index_ = index;
+  snapshot_term_ = term;
+  if (!SaveMetaLocked() || !RewriteFileLocked()) return false;
+  commit_index_ = std::max(commit_index_, index);
+  applied_ = index;
+  counters_.snapshots_installed++;
+  applied_cv_.notify_all();
+  return true;
+}
+
+// ---------- Incoming requests ----------
+
+void RaftNode::AcceptLoop() {
+  for (;;) {
+    int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return;  // shut down
+    }
+    NoDelay(fd);
+    std::lock_guard<std::mutex> lock(conns_mu_);
+    {
+      std::lock_guard<std::mutex> state(mu_);
+      if (stop_) {
+        ::close(fd);
+        return;
+      }
+    }
+    conn_fds_.push_back(fd);
+    std::thread(&RaftNode::ServeConn, this, fd).detach();
+  }
+}
+
+void RaftNode::ServeConn(int fd) {
+  std::string body;
+  while (ReadFrame(fd, &body)) {
+    std::string reply;
+    switch (body[0]) {
+      case kVote:
+        reply = HandleVote(body);
+        break;
+      case kAppend:
+        reply = HandleAppend(body);
+        break;
+      case kSnapshot:
+        reply = HandleSnapshot(body);
+        break;
+    }
+    if (reply.empty() || !WriteFrame(fd, reply)) break;
+  }
+  std::lock_guard<std::mutex> lock(conns_mu_);
+  conn_fds_.erase(std::find(conn_fds_.begin(), conn_fds_.end(), fd));
+  ::close(fd);
+  conns_idle_.notify_all();
+}
+
+std::string RaftNode::HandleVote(const std::string& body) {
+  Decoder d(body);
+  uint64_t term, last_index, last_term;
+  uint32_t candidate;
+  if (!d.U64(&term) || !d.U32(&candidate) || !d.U64(&last_index) || !d.U64(&last_term)) return "";
+  std::lock_guard<std::mutex> lock(mu_);
+  Encoder reply(static_cast<char>(kVote + 32));
+  // A node that has heard from a live leader within the election timeout
+  // neither votes nor adopts the term: that leader's lease may still run.
+  // Start counts as such contact, since a restart forgets the leader.
+  const bool leader_alive =
+      role_ == RaftRole::kLeader || Clock::now() - last_leader_contact_ < options_.election_timeout;
+  bool granted = false;
+  if (!(term > term_ && leader_alive)) {
+    if (term > term_) BecomeFollowerLocked(term, 0);
+    const uint64_t my_last = LastIndexLocked();
+    const uint64_t my_term = TermAtLocked(my_last);
+    const bool up_to_date = last_term > my_term || (last_term == my_term && last_index >= my_last);
+    const int c = static_cast<int>(candidate);
+    if (term == term_ && up_to_date && (voted_for_ == 0 || voted_for_ == c)) {
+      voted_for_ = c;
+      granted = SaveMetaLocked();
+      if (granted) ResetElectionTimerLocked();
+    }
+  }
+  reply.U64(term_);
+  reply.U8(granted ? 1 : 0);
+  return reply.str();
+}
+
+std::string RaftNode::HandleAppend(const std::string& body) {
+  Decoder d(body);
+  uint64_t term, seq, prev_index, prev_term, leader_commit;
+  uint32_t leader, count;
+  if (!d.U64(&term) || !d.U32(&leader) || !d.U64(&seq) || !d.U64(&prev_index) || !d.U64(&prev_term) ||
+      !d.U64(&leader_commit) || !d.U32(&count)) {
+    return "";
+  }
+  std::vector<Entry> entries(count);
+  for (auto& e : entries) {
+    uint8_t type;
+    if (!d.U64(&e.term) || !d.U8(&type) || !d.Str(&e.key) || !d.Str(&e.value)) return "";
+    e.type = static_cast<char>(type);
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto reply = [&](bool success, uint64_t index) {
+    Encoder r(static_cast<char>(kAppend + 32));
+    r.U64(term_);
+    r.U64(seq);
+    r.U8(success ? 1 : 0);
+    r.U64(index);
+    return r.str();
+  };
+  if (term < term_) return reply(false, 0);
+  BecomeFollowerLocked(term, static_cast<int>(leader));
+  last_leader_contact_ = Clock::now();
+  ResetElectionTimerLocked();
+
+  // Entries up to the snapshot are committed, so they match.
+  if (prev_index < snapshot_index_) {
+    const uint64_t skip = std::min<uint64_t>(snapshot_index_ - prev_index, entries.size());
+    entries.erase(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(skip));
+    if (entries.empty()) return reply(true, prev_index + skip);
+    prev_index = snapshot_index_;
+    prev_term = snapshot_term_;
+  }
+  if (prev_index > LastIndexLocked()) return reply(false, LastIndexLocked() + 1);
+  if (TermAtLocked(prev_index) != prev_term) {
+    // Skip back over the whole conflicting term in one round trip.
+    const uint64_t t = TermAtLocked(prev_index);
+    uint64_t i = prev_index;
+    while (i > snapshot_index_ + 1 && i > commit_index_ + 1 && TermAtLocked(i - 1) == t) i--;
+    return reply(false, i);
+  }
+  const uint64_t last_new = prev_index + entries.size();
+  uint64_t index = prev_index + 1;
+  size_t k = 0;
+  for (; k < entries.size(); k++, index++) {
+    if (index > LastIndexLocked()) break;
+    if (TermAtLocked(index) != entries[k].term) {
+      if (!TruncateFileLocked(index)) return reply(false, commit_index_ + 1);
+      break;
+    }
+  }
+  if (k < entries.size()) {
+    const uint64_t from = LastIndexLocked() + 1;
+    for (; k < entries.size(); k++) log_.push_back(std::move(entries[k]));
+    if (!AppendToFileLocked(from)) return "";
+  }
+  if (written_index_ > synced_index_ && !SyncLogLocked()) return "";
+  if (leader_commit > commit_index_) {
+    // A stale, rewound AppendEntries can carry a smaller last_new.
+    commit_index_ = std::max(commit_index_, std::min(leader_commit, last_new));
+    cv_.notify_all();
+  }
+  counters_.append_batches++;
+  counters_.appended_entries += count;
+  return reply(true, last_new);
+}
+
+std::string RaftNode::HandleSnapshot(const std::string& body) {
+  Decoder d(body);
+  uint64_t term, seq, index, snap_term, offset;
+  uint32_t leader;
+  uint8_t done;
+  std::string data;
+  if (!d.U64(&term) || !d.U32(&leader) || !d.U64(&seq) || !d.U64(&index) || !d.U64(&snap_term) ||
+      !d.U64(&offset) || !d.U8(&done) || !d.Str(&data)) {
+    return "";
+  }
+  // Lock order: store_mu_, then mu_ (as the applier).
+  std::unique_lock<std::shared_mutex> store_lock(store_mu_, std::defer_lock);
+  if (done) store_lock.lock();
+  std::lock_guard<std::mutex> lock(mu_);
+  auto reply = [&](bool ok) {
+    Encoder r(static_cast<char>(kSnapshot + 32));
+    r.U64(term_);
+    r.U64(seq);
+    r.U8(ok ? 1 : 0);
+    return r.str();
+  };
+  if (term < term_) return reply(false);
+  BecomeFollowerLocked(term, static_cast<int>(leader));
+  last_leader_contact_ = Clock::now();
+  ResetElectionTimerLocked();
+
+  const std::string recv = SnapshotPath() + ".recv";
+  if (offset != (offset == 0 ? 0 : snapshot_recv_bytes_)) return reply(false);
+  {
+    std::ofstream out(recv, std::ios::binary | (offset == 0 ? std::ios::trunc : std::ios::app));
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!out.flush()) return reply(false);
+  }
+  snapshot_recv_bytes_ = offset + data.size();
+  if (!done) return reply(true);
+  snapshot_recv_bytes_ = 0;
+  if (index <= applied_) {  // already have it all
+    std::remove(recv.c_str());
+    return reply(true);
+  }
+  return reply(InstallSnapshotLocked(index, snap_term, recv));
+}
+
+// ---------- Outgoing requests ----------
+
+std::string RaftNode::NextMessageLocked(Link* link, Clock::time_point now) {
+  if (role_ == RaftRole::kCandidate && link->vote_due) {
+    link->vote_due = false;
+    Encoder m(kVote);
+    m.U64(term_);
+    m.U32(static_cast<uint32_t>(options_.id));
+    m.U64(LastIndexLocked());
+    m.U64(TermAtLocked(LastIndexLocked()));
+    return m.str();
+  }
+  if (role_ != RaftRole::kLeader) return "";
+
+  // The follower needs entries we no longer have: stream the snapshot.
+  if (link->snap_fd < 0 && link->next_index <= snapshot_index_) {
+    link->inflight.clear();
+    link->ignore_below = link->seq + 1;
+    link->snap_fd = ::open(SnapshotPath().c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (link->snap_fd < 0 || ::fstat(link->snap_fd, &st) != 0) {
+      link->EndSnapshot();
+      return "";
+    }
+    link->snap_index = snapshot_index_;
+    link->snap_term = snapshot_term_;
+    link->snap_size = static_cast<uint64_t>(st.st_size);
+    link->snap_offset = 0;
+  }
+  if (link->snap_fd >= 0) {
+    if (link->snap_chunk > 0) return "";  // awaiting the reply
+    std::string data(std::min<uint64_t>(options_.snapshot_chunk_bytes, link->snap_size - link->snap_offset), '\0');
+    if (!data.empty() &&
+        ::pread(link->snap_fd, &data[0], data.size(), static_cast<off_t>(link->snap_offset)) !=
+            static_cast<ssize_t>(data.size())) {
+      link->EndSnapshot();
+      return "";
+    }
+    const bool done = link->snap_offset + data.size() == link->snap_size;
+    Encoder m(kSnapshot);
+    m.U64(term_);
+    m.U32(static_cast<uint32_t>(options_.id));
+    m.U64(++link->seq);
+    m.U64(link->snap_index);
+    m.U64(link->snap_term);
+    m.U64(link->snap_offset);
+    m.U8(done ? 1 : 0);
+    m.Str(data);
+    link->snap_chunk = std::max<uint64_t>(data.size(), 1);
+    link->snap_sent = now;
+    link->next_heartbeat = now + options_.heartbeat;
+    return m.str();
+  }
+
+  const uint64_t last = LastIndexLocked();
+  const bool has_entries =
+      link->next_index <= last && link->inflight.size() < static_cast<size_t>(options_.max_inflight);
+  if (!has_entries && now < link->next_heartbeat) return "";
+  const uint64_t prev = link->next_index - 1;
+  Encoder m(kAppend);
+  m.U64(term_);
+  m.U32(static_cast<uint32_t>(options_.id));
+  m.U64(++link->seq);
+  m.U64(prev);
+  m.U64(TermAtLocked(prev));
+  m.U64(commit_index_);
+  std::string entries;
+  uint32_t count = 0;
+  size_t bytes = 0;
+  for (uint64_t i = link->next_index; has_entries && i <= last; i++) {
+    const Entry& e = EntryAtLocked(i);
+    if (count > 0 && (count >= options_.max_batch_entries || bytes >= options_.max_batch_bytes)) break;
+    Encoder one(0);
+    one.U64(e.term);
+    one.U8(static_cast<uint8_t>(e.type));
+    one.Str(e.key);
+    one.Str(e.value);
+    entries.append(one.str(), 1, std::string::npos);
+    bytes += e.key.size() + e.value.size();
+    count++;
+  }
+  m.U32(count);
+  m.str() += entries;
+  link->next_index += count;  // pipelined: don't wait for this one's reply
+  link->inflight.push_back(Link::Inflight{link->seq, now, link->next_index - count});
+  link->next_heartbeat = now + options_.heartbeat;
+  counters_.append_batches++;
+  counters_.appended_entries += count;
+  return m.str();
+}
+
+void RaftNode::SendLoop(Link* link) {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stop_) {
+    if (!link->connected) {
+      const int old = link->fd;
+      link->fd = -1;
+      lock.unlock();
+      if (link->reader.joinable()) link->reader.join();
+      if (old >= 0) ::close(old);
+      const int fd = ConnectTo(link->peer);
+      lock.lock();
+      if (fd < 0 || stop_) {
+        if (fd >= 0) ::close(fd);
+        cv_.wait_for(lock, options_.heartbeat, [&]() { return stop_; });
+        continue;
+      }
+      link->fd = fd;
+      link->connected = true;
+      link->Reset();
+      link->reader = std::thread(&RaftNode::ReadLoop, this, link, fd);
+    }
+    const auto now = Clock::now();
+    std::string msg = NextMessageLocked(link, now);
+    if (msg.empty()) {
+      auto wake = now + options_.heartbeat;
+      if (role_ == RaftRole::kLeader && link->snap_fd < 0) wake = std::min(wake, link->next_heartbeat);
+      cv_.wait_until(lock, wake);
+      continue;
+    }
+    const int fd = link->fd;
+    lock.unlock();
+    const bool sent = WriteFrame(fd, msg);
+    lock.lock();
+    if (!sent) ::shutdown(fd, SHUT_RDWR);  // the reader notices and marks the link down
+  }
+  const int fd = link->fd;
+  link->fd = -1;
+  if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+  lock.unlock();
+  if (link->reader.joinable()) link->reader.join();
+  if (fd >= 0) ::close(fd);
+}
+
+void RaftNode::ReadLoop(Link* link, int fd) {
+  std::string body;
+  while (ReadFrame(fd, &body)) {
+    switch (body[0]) {
+      case kVote + 32:
+        OnVoteReply(link, body);
+        break;
+      case kAppend + 32:
+        OnAppendReply(link, body);
+        break;
+      case kSnapshot + 32:
+        OnSnapshotReply(link, body);
+        break;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  link->connected = false;
+  link->Reset();
+  cv_.notify_all();
+}
+
+void RaftNode::OnVoteReply(Link* link, const std::string& body) {
+  Decoder d(body);
+  uint64_t term;
+  uint8_t granted;
+  if (!d.U64(&term) || !d.U8(&granted)) return;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (term > term_) {
+    BecomeFollowerLocked(term, 0);
+    return;
+  }
+  if (role_ != RaftRole::kCandidate || term != term_ || !granted || link->vote_counted_term == term) return;
+  link->vote_counted_term = term;
+  if (++votes_ >= static_cast<int>(links_.size() + 1) / 2 + 1) BecomeLeaderLocked();
+}
+
+void RaftNode::OnAppendReply(Link* link, const std::string& body) {
+  Decoder d(body);
+  uint64_t term, seq, index;
+  uint8_t success;
+  if (!d.U64(&term) || !d.U64(&seq) || !d.U8(&success) || !d.U64(&index)) return;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (term > term_) {
+    BecomeFollowerLocked(term, 0);
+    return;
+  }
+  if (role_ != RaftRole::kLeader || term != term_ || seq < link->ignore_below) return;
+  Clock::time_point sent;
+  while (!link->inflight.empty() && link->inflight.front().seq <= seq) {
+    if (link->inflight.front().seq == seq) sent = link->inflight.front().sent;
+    link->inflight.pop_front();
+  }
+  // Either way the follower took us as its leader when we sent this.
+  link->acked_sent = std::max(link->acked_sent, sent);
+  if (success) {
+    link->match_index = std::max(link->match_index, index);
+    link->next_index = std::max(link->next_index, link->match_index + 1);
+    AdvanceCommitLocked();
+  } else {
+    link->Reset();
+    link->next_index = std::max(link->match_index + 1, std::min(index, LastIndexLocked() + 1));
+  }
+  cv_.notify_all();
+}
+
+void RaftNode::OnSnapshotReply(Link* link, const std::string& body) {
+  Decoder d(body);
+  uint64_t term, seq;
+  uint8_t ok;
+  if (!d.U64(&term) || !d.U64(&seq) || !d.U8(&ok)) return;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (term > term_) {
+    BecomeFollowerLocked(term, 0);
+    return;
+  }
+  if (role_ != RaftRole::kLeader || term != term_ || seq < link->ignore_below || link->snap_fd < 0) return;
+  link->acked_sent = std::max(link->acked_sent, link->snap_sent);
+  if (!ok) {
+    link->snap_offset = 0;  // start over
+  } else {
+    link->snap_offset = std::min(link->snap_size, link->snap_offset + link->snap_chunk);
+    if (link->snap_offset == link->snap_size) {
+      link->match_index = std::max(link->match_index, link->snap_index);
+      link->next_index = link->match_index + 1;
+      link->EndSnapshot();
+      AdvanceCommitLocked();
+    }
+  }
+  link->snap_chunk = 0;
+  cv_.notify_all();
+}
+
+}  // namespace kv
@@ -0,0 +1,58 @@
+#include "kvstore/rate_limiter.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace kv {
+
+RateLimiter::RateLimiter(uint64_t bytes_per_sec) : last_(Clock::now()) { SetRate(bytes_per_sec); }
+
+void RateLimiter::SetRate(uint64_t bytes_per_sec) {
+  std::lock_guard<std::mutex> lock(mu_);
+  RefillLocked(Clock::now());
+  rate_ = bytes_per_sec;
+  burst_ = std::max(65536.0, static_cast<double>(bytes_per_sec) / 10.0);
+  available_ = std::min(available_, burst_);
+}
+
+uint64_t RateLimiter::rate() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return rate_;
+}
+
+uint64_t RateLimiter::total_bytes() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return total_bytes_;
+}
+
+uint64_t RateLimiter::waited_us() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return waited_us_;
+}
+
+void RateLimiter::RefillLocked(Clock::time_point now) {
+  double secs = std::chrono::duration<double>(now - last_).count();
+  last_ = now;
+  available_ = std::min(burst_, available_ + secs * static_cast<double>(rate_));
+}
+
+// Takes the bytes up front, then sleeps off any resulting debt outside the
+// lock, so concurrent callers queue up behind each other fairly.
+void RateLimiter::Acquire(uint64_t bytes) {
+  std::chrono::microseconds wait(0);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    total_bytes_ += bytes;
+    if (rate_ == 0) return;
+    RefillLocked(Clock::now());
+    available_ -= static_cast<double>(bytes);
+    if (available_ < 0) {
+      wait = std::chrono::microseconds(
+          static_cast<int64_t>(-available_ * 1e6 / static_cast<double>(rate_)));
+      waited_us_ += static_cast<uint64_t>(wait.count());
+    }
+  }
+  if (wait.count() > 0) std::this_thread::sleep_for(wait);
+}
+
+}  // namespace kv
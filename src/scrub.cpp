@@ -0,0 +1,215 @@
+#include "kvstore/kvstore.h"
+#include "kvstore/log_format.h"
+
+#include <fstream>
+#include <map>
+#include <shared_mutex>
+
+namespace kv {
+
+namespace {
+
+constexpr uint64_t kIoChunk = 64 * 1024;  // bytes per rate limiter request
+
+// Charges scanned bytes to the limiter in chunks rather than per record.
+class IoBudget {
+ public:
+  explicit IoBudget(RateLimiter* limiter) : limiter_(limiter) {}
+  ~IoBudget() { Flush(); }
+
+  void Charge(uint64_t bytes) {
+    pending_ += bytes;
+    if (pending_ >= kIoChunk) Flush();
+  }
+  void Flush() {
+    if (limiter_ && pending_ > 0) limiter_->Acquire(pending_);
+    pending_ = 0;
+  }
+
+ private:
+  RateLimiter* limiter_;
+  uint64_t pending_ = 0;
+};
+
+bool LooksLikeRecord(const std::string& line) {
+  return line.compare(0, 4, "PUT ") == 0 || line.compare(0, 4, "DEL ") == 0 ||
+         line.compare(0, 6, "BEGIN ") == 0;
+}
+
+// Finds the first line start after `from` where a whole, checksum-clean
+// record ending by `limit` begins. Returns `limit` if there is none.
+uint64_t Resync(const std::string& path, uint64_t from, uint64_t limit, IoBudget* budget) {
+  std::ifstream in(path, std::ios::binary);
+  in.seekg(static_cast<std::streamoff>(from), std::ios::beg);
+  std::string line;
+  uint64_t pos = from;
+  bool first = true;  // the damaged line itself is never a candidate
+  while (pos < limit && std::getline(in, line)) {
+    budget->Charge(line.size() + 1);
+    if (!first && LooksLikeRecord(line)) {
+      LogReader probe(path, /*verify_values=*/true);
+      probe.Seek(pos);
+      LogRecord rec;
+      if (probe.Next(&rec) && rec.checksum_ok && rec.end <= limit) return pos;
+    }
+    first = false;
+    pos += line.size() + 1;
+  }
+  return limit;
+}
+
+}  // namespace
+
+// Runs in three phases so foreground requests only ever wait on short ones:
+//   1. scan the log up to its size at the start, with no lock held;
+//   2. cross-check the index under a shared lock;
+//   3. quarantine, if asked, under a unique lock.
+// A compaction between phases swaps the file underneath the scan, which then
+// says nothing about the new log; the report is marked incomplete instead.
+ScrubReport KVStore::Scrub(const ScrubOptions& options) {
+  ScrubReport report;
+  if (!persistence_enabled_ || static_ || sorted_) return report;  // a table has no log
+  if (options_.read_only_follower) return report;  // the log is the writer's to repair
+  scrubs_++;
+
+  uint64_t limit = 0;
+  uint64_t generation = 0;
+  {
+    std::shared_lock lock(mu_);
+    limit = HybridLog() ? hlog_flushed_.load() : log_bytes_;  // the scan reads the file
+    generation = compactions_;
+  }
+
+  // ---- 1. Scan ----
+  struct Seen {
+    uint64_t size;
+    bool has_crc;
+    uint32_t crc;
+  };
+  std::map<uint64_t, Seen> puts;  // value offset -> record, for clean PUTs
+  IoBudget budget(options_.background_io.get());
+  LogReader reader(log_path_, /*verify_values=*/true);
+  LogRecord rec;
+  while (reader.offset() < limit) {
+    if (reader.Next(&rec)) {
+      if (rec.end > limit) break;  // appended after we started
+      budget.Charge(rec.end - rec.offset);
+      report.records++;
+      if (!rec.checksum_ok) {
+        report.checksum_failures++;
+        report.bad_ranges.push_back({rec.offset, rec.end, "checksum mismatch"});
+      } else if (rec.op == RecordOp::kPut) {
+        puts[rec.value_offset] = {rec.value_size, rec.has_crc, rec.crc};
+      }
+      continue;
+    }
+    if (reader.status() == LogReader::Status::kEof) break;
+
+    // Framing is broken: find where records pick up again.
+    const uint64_t bad = reader.offset();
+    const char* reason = reader.status() == LogReader::Status::kTruncated ? "truncated record"
+                         : reader.status() == LogReader::Status::kBadHeader ? "bad header"
+                                                                             : "unknown op";
+    const uint64_t next = Resync(log_path_, bad, limit, &budget);
+    report.bad_ranges.push_back({bad, next, reason});
+    if (next >= limit) break;
+    reader.Seek(next);
+  }
+  budget.Flush();
+  report.bytes_scanned = limit;
+
+  // ---- 2. Cross-check ----
+  struct Suspect {
+    std::string key;
+    uint64_t offset;
+  };
+  std::vector<Suspect> suspects;
+  {
+    std::shared_lock lock(mu_);
+    if (compactions_ != generation) {
+      report.complete = false;
+      scrub_problems_ += report.bad_ranges.size();
+      return report;
+    }
+    // Persistent-index slots carry no crc; offset and size still have to
+    // land on a record the scan saw, and the key comes from its header.
+    if (pindex_) {
+      pindex_->ForEach([&](const IndexSlot& slot) {
+        if (slot.value_offset() >= limit) return;
+        auto it = puts.find(slot.value_offset());
+        if (it != puts.end() && it->second.size == slot.value_size()) return;
+        report.index_mismatches++;
+        auto header = ReadValueAt(slot.record_offset, slot.header_len);
+        LogRecord rec;
+        if (header && ParsePutHeader(header->substr(0, slot.header_len - 1), &rec)) {
+          suspects.push_back({rec.key, slot.value_offset()});
+        }
+      });
+    }
+    ForEachEntry([&](const std::string& index_key, Entry& e) {
+      if (e.offset >= limit) return;
+      auto it = puts.find(e.offset);
+      bool ok = it != puts.end() && it->second.size == e.size &&
+                it->second.has_crc == e.has_crc && (!e.has_crc || it->second.crc == e.crc);
+      if (ok) return;
+      report.index_mismatches++;
+      suspects.push_back({UserKey(index_key), e.offset});
+    });
+  }
+  scrub_problems_ += report.bad_ranges.size() + report.index_mismatches;
+  if (!options.quarantine || report.clean()) return report;
+
+  // ---- 3. Quarantine ----
+  std::unique_lock lock(mu_);
+  if (compactions_ != generation) {
+    report.complete = false;
+    return report;
+  }
+
+  // The damaged bytes are kept for inspection:
+  //   RANGE <begin> <end> <reason>\n<bytes>\n
+  std::ifstream in(log_path_, std::ios::binary);
+  std::ofstream q(log_path_ + ".quarantine", std::ios::binary | std::ios::app);
+  std::fstream log(log_path_, std::ios::binary | std::ios::in | std::ios::out);
+  for (const auto& r : report.bad_ranges) {
+    std::string bytes(r.end - r.begin, '\0');
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(r.begin), std::ios::beg);
+    in.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+    bytes.resize(static_cast<size_t>(in.gcount()));
+    q << "RANGE " << r.begin << " " << r.end << " " << r.reason << "\n" << bytes << "\n";
+
+    // Broken framing would stop the next replay here, losing every record
+    // behind it. Blank lines are skipped by the reader, so overwrite the
+    // range with them. A record that merely fails its checksum stays: replay
+    // already skips it, and removing it could resurrect an older value.
+    if (r.reason != std::string("checksum mismatch")) {
+      log.seekp(static_cast<std::streamoff>(r.begin), std::ios::beg);
+      std::string blank(r.end - r.begin, '\n');
+      log.write(blank.data(), static_cast<std::streamsize>(blank.size()));
+    }
+  }
+  log.flush();
+  q.flush();
+
+  // Entries the log doesn't back read as absent, now and after a restart.
+  for (const auto& s : suspects) {
+    std::string scratch;
+    if (pindex_) {
+      const IndexSlot* slot = FindSlot(s.key, HashKey(s.key), &scratch);
+      if (!slot || slot->value_offset() != s.offset) continue;  // rewritten meanwhile
+    } else if (cindex_) {
+      Entry e;
+      if (!cindex_->Find(s.key, &e) || e.offset != s.offset) continue;
+    } else {
+      auto it = index_.find(IndexKey(s.key, &scratch));
+      if (it == index_.end() || it->second.offset != s.offset) continue;
+    }
+    IndexDel(s.key);
+    AppendDel(s.key);
+    report.keys_quarantined++;
+  }
+  return report;
+}
+
+}  // namespace kv
@@ -0,0 +1,436 @@
+#include "kvstore/sorted_table.h"
+#include "kvstore/crc32c.h"
+#include "kvstore/file_util.h"
+#include "kvstore/hash.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace kv {
+
+namespace {
+
+constexpr char kMagic[8] = {'K', 'V', 'S', 'O', 'R', 'T', '1', '\0'};
+constexpr uint32_t kVersion = 1;  // bump when HashBytes or the layout changes
+constexpr uint64_t kFilterBitsPerKey = 10;
+constexpr uint32_t kFilterProbes = 7;  // ~ln 2 * bits per key
+
+struct Footer {
+  char magic[8];
+  uint32_t version;
+  uint32_t probes;
+  uint64_t count;
+  uint64_t filter_offset;
+  uint64_t filter_size;
+  uint64_t index_offset;
+  uint64_t index_size;
+  uint32_t filter_crc;
+  uint32_t index_crc;
+  uint32_t crc;  // of everything above
+  uint32_t pad;
+};
+static_assert(sizeof(Footer) == 72, "on-disk layout");
+
+void PutVarint(std::string* out, uint32_t v) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+bool GetVarint(const char** p, const char* limit, uint32_t* v) {
+  *v = 0;
+  for (int shift = 0; shift <= 28 && *p < limit; shift += 7) {
+    const uint32_t byte = static_cast<uint8_t>(*(*p)++);
+    *v |= (byte & 0x7f) << shift;
+    if (byte < 0x80) return true;
+  }
+  return false;
+}
+
+template <typename T>
+void PutRaw(std::string* out, T v) {
+  out->append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+template <typename T>
+bool GetRaw(const std::string& in, size_t* pos, T* v) {
+  if (*pos + sizeof(T) > in.size()) return false;
+  std::memcpy(v, in.data() + *pos, sizeof(T));
+  *pos += sizeof(T);
+  return true;
+}
+
+bool PreadAll(int fd, uint64_t offset, uint64_t size, std::string* out) {
+  out->resize(size);
+  uint64_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pread(fd, &(*out)[done], size - done, static_cast<off_t>(offset + done));
+    if (n <= 0) return false;
+    done += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+// Bit i of the filter for probe i: double hashing from one 64-bit hash.
+template <typename Fn>
+void ForEachProbe(uint64_t h, uint64_t bits, uint32_t probes, Fn&& fn) {
+  const uint64_t delta = (h >> 33) | (h << 31);
+  for (uint32_t i = 0; i < probes; i++) {
+    fn(h % bits);
+    h += delta;
+  }
+}
+
+int CompareKeys(const char* a, size_t na, const std::string& b) {
+  int c = std::memcmp(a, b.data(), std::min(na, b.size()));
+  if (c != 0) return c;
+  return na < b.size() ? -1 : na > b.size() ? 1 : 0;
+}
+
+// Walks the entries of one data block (restart array and count at its end).
+class BlockIter {
+ public:
+  explicit BlockIter(const std::string& block) : data_(block.data()) {
+    uint32_t n = 0;
+    if (block.size() < sizeof(n)) return;
+    std::memcpy(&n, data_ + block.size() - sizeof(n), sizeof(n));
+    if (n == 0 || (block.size() - sizeof(n)) / sizeof(uint32_t) < n) return;
+    restarts_ = block.size() - sizeof(n) - n * sizeof(uint32_t);
+    num_restarts_ = n;
+    ok_ = true;
+  }
+
+  bool ok() const { return ok_; }
+  const std::string& key() const { return key_; }
+  const char* value() const { return value_; }
+  uint32_t value_len() const { return value_len_; }
+
+  // Positions before the entry at restart i; Next() then reads it.
+  void SeekToRestart(uint32_t i) {
+    uint32_t off = 0;
+    std::memcpy(&off, data_ + restarts_ + i * sizeof(uint32_t), sizeof(off));
+    pos_ = off <= restarts_ ? data_ + off : data_ + restarts_;
+    key_.clear();
+  }
+
+  // Decodes the next entry; false at the end of the block or on damage.
+  bool Next() {
+    const char* limit = data_ + restarts_;
+    if (!ok_ || pos_ >= limit) return false;
+    uint32_t shared = 0, unshared = 0, vlen = 0;
+    if (!GetVarint(&pos_, limit, &shared) || !GetVarint(&pos_, limit, &unshared) ||
+        !GetVarint(&pos_, limit, &vlen) || shared > key_.size() ||
+        static_cast<uint64_t>(limit - pos_) < static_cast<uint64_t>(unshared) + vlen) {
+      ok_ = false;
+      return false;
+    }
+    key_.resize(shared);
+    key_.append(pos_, unshared);
+    value_ = pos_ + unshared;
+    value_len_ = vlen;
+    pos_ = value_ + vlen;
+    return true;
+  }
+
+  // Moves to the first entry >= target; false if there is none.
+  bool Seek(const std::string& target) {
+    if (!ok_) return false;
+    // Last restart whose key is < target (restart keys are stored whole).
+    uint32_t lo = 0, hi = num_restarts_ - 1;
+    while (lo < hi) {
+      const uint32_t mid = (lo + hi + 1) / 2;
+      SeekToRestart(mid);
+      if (!Next()) return false;
+      if (key_ < target) lo = mid;
+      else hi = mid - 1;
+    }
+    SeekToRestart(lo);
+    while (Next()) {
+      if (!(key_ < target)) return true;
+    }
+    return false;
+  }
+
+ private:
+  const char* data_;
+  size_t restarts_ = 0;  // offset of the restart array
+  uint32_t num_restarts_ = 0;
+  const char* pos_ = nullptr;
+  bool ok_ = false;
+  std::string key_;
+  const char* value_ = nullptr;
+  uint32_t value_len_ = 0;
+};
+
+// order[k] = sorted position stored at Eytzinger slot k (1-based): an
+// in-order walk of the implicit tree visits the slots in key order.
+void EytzingerOrder(size_t n, size_t k, size_t* next, std::vector<size_t>* order) {
+  if (k > n) return;
+  EytzingerOrder(n, 2 * k, next, order);
+  (*order)[k] = (*next)++;
+  EytzingerOrder(n, 2 * k + 1, next, order);
+}
+
+}  // namespace
+
+// ---------- Writing ----------
+bool SortedTableWriter::Open(const std::string& path, std::string* err) {
+  path_ = path;
+  tmp_ = path + ".tmp";
+  out_.open(tmp_, std::ios::binary | std::ios::trunc);
+  if (!out_) {
+    if (err) *err = "cannot open " + tmp_;
+    return false;
+  }
+  return true;
+}
+
+bool SortedTableWriter::Add(const std::string& key, const std::string& value) {
+  if (failed_ || (count_ > 0 && !(last_key_ < key)) || key.size() > UINT32_MAX ||
+      value.size() > UINT32_MAX) {
+    return false;
+  }
+  size_t shared = 0;
+  if (block_.empty() || since_restart_ == kRestartInterval) {
+    restarts_.push_back(static_cast<uint32_t>(block_.size()));
+    since_restart_ = 0;
+  } else {
+    const size_t n = std::min(last_key_.size(), key.size());
+    while (shared < n && last_key_[shared] == key[shared]) shared++;
+  }
+  PutVarint(&block_, static_cast<uint32_t>(shared));
+  PutVarint(&block_, static_cast<uint32_t>(key.size() - shared));
+  PutVarint(&block_, static_cast<uint32_t>(value.size()));
+  block_.append(key, shared, std::string::npos);
+  block_.append(value);
+  since_restart_++;
+  last_key_ = key;
+  hashes_.push_back(HashKey(key));
+  count_++;
+  if (block_.size() >= kBlockBytes) return FlushBlock();
+  return true;
+}
+
+bool SortedTableWriter::FlushBlock() {
+  if (block_.empty()) return true;
+  for (uint32_t r : restarts_) PutRaw(&block_, r);
+  PutRaw(&block_, static_cast<uint32_t>(restarts_.size()));
+  const uint32_t crc = Crc32c(block_);
+  out_.write(block_.data(), static_cast<std::streamsize>(block_.size()));
+  out_.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+  blocks_.push_back({offset_, block_.size(), last_key_});
+  offset_ += block_.size() + sizeof(crc);
+  block_.clear();
+  restarts_.clear();
+  failed_ = failed_ || !out_;
+  return !failed_;
+}
+
+bool SortedTableWriter::Finish(std::string* err) {
+  FlushBlock();
+
+  const uint64_t bits = std::max<uint64_t>(64, (count_ * kFilterBitsPerKey + 7) / 8 * 8);
+  std::string filter(bits / 8, '\0');
+  for (uint64_t h : hashes_) {
+    ForEachProbe(h, bits, kFilterProbes, [&](uint64_t bit) { filter[bit / 8] |= static_cast<char>(1 << (bit % 8)); });
+  }
+  std::vector<uint64_t>().swap(hashes_);
+
+  const size_t n = blocks_.size();
+  std::string index;
+  PutRaw(&index, static_cast<uint64_t>(n));
+  for (const auto& b : blocks_) {
+    PutRaw(&index, b.offset);
+    PutRaw(&index, b.size);
+  }
+  std::vector<size_t> order(n + 1, 0);
+  size_t next = 0;
+  EytzingerOrder(n, 1, &next, &order);
+  for (size_t k = 1; k <= n; k++) {
+    const auto& b = blocks_[order[k]];
+    PutRaw(&index, static_cast<uint32_t>(order[k]));
+    PutRaw(&index, static_cast<uint32_t>(b.last_key.size()));
+    index += b.last_key;
+  }
+
+  Footer f;
+  std::memset(&f, 0, sizeof(f));
+  std::memcpy(f.magic, kMagic, sizeof(kMagic));
+  f.version = kVersion;
+  f.probes = kFilterProbes;
+  f.count = count_;
+  f.filter_offset = offset_;
+  f.filter_size = filter.size();
+  f.index_offset = offset_ + filter.size();
+  f.index_size = index.size();
+  f.filter_crc = Crc32c(filter);
+  f.index_crc = Crc32c(index);
+  f.crc = Crc32c(reinterpret_cast<const char*>(&f), offsetof(Footer, crc));
+  out_.write(filter.data(), static_cast<std::streamsize>(filter.size()));
+  out_.write(index.data(), static_cast<std::streamsize>(index.size()));
+  out_.write(reinterpret_cast<const char*>(&f), sizeof(f));
+  out_.flush();
+  const bool ok = !failed_ && static_cast<bool>(out_);
+  out_.close();
+  if (!ok) {
+    std::remove(tmp_.c_str());
+    if (err) *err = "write failed, or keys out of order";
+    return false;
+  }
+  return ReplaceFile(tmp_, path_, err);
+}
+
+// ---------- Reading ----------
+SortedTable::~SortedTable() { Close(); }
+
+bool SortedTable::Open(const std::string& path, std::string* err) {
+  Close();
+  auto fail = [&](const std::string& why) {
+    Close();
+    if (err) *err = path + ": " + why;
+    return false;
+  };
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) return fail("cannot open");
+  struct stat st;
+  if (::fstat(fd_, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(Footer)) {
+    return fail("not a sorted table");
+  }
+  file_bytes_ = static_cast<uint64_t>(st.st_size);
+
+  std::string raw;
+  Footer f;
+  if (!PreadAll(fd_, file_bytes_ - sizeof(f), sizeof(f), &raw)) return fail("cannot read footer");
+  std::memcpy(&f, raw.data(), sizeof(f));
+  if (std::memcmp(f.magic, kMagic, sizeof(kMagic)) != 0 || f.version != kVersion ||
+      f.crc != Crc32c(reinterpret_cast<const char*>(&f), offsetof(Footer, crc))) {
+    return fail("not a sorted table, or a damaged one");
+  }
+  if (f.filter_offset + f.filter_size != f.index_offset ||
+      f.index_offset + f.index_size + sizeof(f) != file_bytes_ || f.filter_size == 0) {
+    return fail("sections do not match the file size");
+  }
+  if (!PreadAll(fd_, f.filter_offset, f.filter_size, &filter_) || Crc32c(filter_) != f.filter_crc ||
+      !PreadAll(fd_, f.index_offset, f.index_size, &raw) || Crc32c(raw) != f.index_crc) {
+    return fail("damaged filter or index");
+  }
+
+  size_t pos = 0;
+  uint64_t n = 0;
+  if (!GetRaw(raw, &pos, &n) || n > raw.size() / 16) return fail("damaged index");
+  handles_.resize(n);
+  for (auto& h : handles_) {
+    if (!GetRaw(raw, &pos, &h.offset) || !GetRaw(raw, &pos, &h.size) ||
+        h.offset + h.size + sizeof(uint32_t) > f.filter_offset) {
+      return fail("damaged index");
+    }
+  }
+  index_.assign(n + 1, IndexEntry{0, 0, 0});
+  for (uint64_t k = 1; k <= n; k++) {
+    IndexEntry& e = index_[k];
+    if (!GetRaw(raw, &pos, &e.block) || !GetRaw(raw, &pos, &e.key_len) || e.block >= n ||
+        pos + e.key_len > raw.size()) {
+      return fail("damaged index");
+    }
+    e.key_offset = static_cast<uint32_t>(index_keys_.size());
+    index_keys_.append(raw, pos, e.key_len);
+    pos += e.key_len;
+  }
+  count_ = f.count;
+  probes_ = f.probes;
+  return true;
+}
+
+void SortedTable::Close() {
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+  file_bytes_ = count_ = 0;
+  handles_.clear();
+  index_.clear();
+  index_keys_.clear();
+  filter_.clear();
+  probes_ = 0;
+}
+
+uint64_t SortedTable::resident_bytes() const {
+  return handles_.size() * sizeof(Handle) + index_.size() * sizeof(IndexEntry) + index_keys_.size() +
+         filter_.size();
+}
+
+bool SortedTable::MayContain(const std::string& key) const {
+  const uint64_t bits = filter_.size() * 8;
+  bool all = true;
+  ForEachProbe(HashKey(key), bits, probes_, [&](uint64_t bit) {
+    all = all && (static_cast<uint8_t>(filter_[bit / 8]) >> (bit % 8) & 1);
+  });
+  return all;
+}
+
+// Descends the Eytzinger array: k goes left (2k) or right (2k+1) by the
+// comparison alone; the lower bound is where the path last went left, which
+// the trailing one bits of k encode.
+size_t SortedTable::LowerBoundBlock(const std::string& key) const {
+  const size_t n = handles_.size();
+  size_t k = 1;
+  while (k <= n) {
+    const IndexEntry& e = index_[k];
+    k = 2 * k + (CompareKeys(index_keys_.data() + e.key_offset, e.key_len, key) < 0);
+  }
+  k >>= __builtin_ffsll(static_cast<long long>(~k));
+  return k == 0 ? n : index_[k].block;
+}
+
+bool SortedTable::ReadBlock(size_t block, bool verify, std::string* out) const {
+  const Handle& h = handles_[block];
+  if (!PreadAll(fd_, h.offset, h.size + sizeof(uint32_t), out)) return false;
+  uint32_t crc = 0;
+  std::memcpy(&crc, out->data() + h.size, sizeof(crc));
+  out->resize(h.size);
+  return !verify || Crc32c(*out) == crc;
+}
+
+bool SortedTable::Find(const std::string& key, std::string* value, bool verify, bool* damaged) const {
+  if (fd_ < 0 || !MayContain(key)) return false;
+  const size_t b = LowerBoundBlock(key);
+  if (b >= handles_.size()) return false;
+  std::string block;
+  if (!ReadBlock(b, verify, &block)) {
+    if (damaged) *damaged = true;
+    return false;
+  }
+  BlockIter it(block);
+  if (!it.Seek(key)) {
+    if (damaged && !it.ok()) *damaged = true;
+    return false;
+  }
+  if (it.key() != key) return false;
+  value->assign(it.value(), it.value_len());
+  return true;
+}
+
+bool SortedTable::Scan(const std::string& start, const std::string& end, bool verify,
+                       const std::function<bool(const std::string&, const std::string&)>& fn) const {
+  if (fd_ < 0) return true;
+  std::string block, value;
+  for (size_t b = LowerBoundBlock(start); b < handles_.size(); b++) {
+    if (!ReadBlock(b, verify, &block)) return false;
+    BlockIter it(block);
+    bool more = it.Seek(start);  // start is below every key after the first block
+    for (; more; more = it.Next()) {
+      if (!end.empty() && !(it.key() < end)) return true;
+      value.assign(it.value(), it.value_len());
+      if (!fn(it.key(), value)) return true;
+    }
+    if (!it.ok()) return false;
+  }
+  return true;
+}
+
+}  // namespace kv
@@ -0,0 +1,339 @@
+#include "kvstore/static_table.h"
+#include "kvstore/crc32c.h"
+#include "kvstore/file_util.h"
+#include "kvstore/hash.h"
+#include "kvstore/log_format.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace kv {
+
+namespace {
+
+constexpr char kMagic[8] = {'K', 'V', 'S', 'T', 'A', 'T', '1', '\0'};
+constexpr uint32_t kVersion = 1;  // bump when HashBytes or the layout changes
+constexpr double kKeysPerBucket = 4.0;
+constexpr double kAlpha = 0.99;  // keys per position before remapping
+constexpr uint32_t kMaxAttempts = 16;
+constexpr uint64_t kOffsetMask = (1ull << 48) - 1;
+constexpr uint64_t kRecordHeader = 12;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t count;
+  uint64_t buckets;
+  uint64_t positions;
+  uint64_t seed;
+  uint64_t data_bytes;
+  uint32_t crc;  // of everything above
+  uint32_t pad;
+};
+static_assert(sizeof(Header) == 64, "sections start 8-byte aligned");
+
+struct Layout {
+  uint64_t pilots, remap, slots, data, end;
+};
+
+Layout LayoutFor(uint64_t count, uint64_t buckets, uint64_t positions, uint64_t data_bytes) {
+  auto align8 = [](uint64_t x) { return (x + 7) & ~uint64_t{7}; };
+  Layout l;
+  l.pilots = sizeof(Header);
+  l.remap = align8(l.pilots + buckets * sizeof(uint16_t));
+  l.slots = align8(l.remap + (positions - count) * sizeof(uint32_t));
+  l.data = l.slots + count * sizeof(uint64_t);
+  l.end = l.data + data_bytes;
+  return l;
+}
+
+inline uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// Maps x uniformly onto [0, n) without a division.
+inline uint64_t Reduce(uint64_t x, uint64_t n) {
+  return static_cast<uint64_t>((static_cast<__uint128_t>(x) * n) >> 64);
+}
+
+// 60% of keys go to the first 30% of buckets. Those fuller buckets are
+// placed first, while most positions are still free, which keeps the
+// pilots small.
+inline uint64_t BucketOf(uint64_t h, uint64_t buckets) {
+  constexpr uint64_t kDenseKeys = 0x9999999999999999ull;  // 0.6 * 2^64
+  const uint64_t dense = std::max<uint64_t>(1, buckets * 3 / 10);
+  if (h < kDenseKeys || buckets == dense) return Reduce(Mix(h), dense);
+  return dense + Reduce(Mix(h), buckets - dense);
+}
+
+inline uint64_t PositionOf(uint64_t h, uint16_t pilot, uint64_t positions) {
+  return Reduce(Mix(h ^ Mix(pilot + 1ull)), positions);
+}
+
+inline uint64_t Fingerprint(uint64_t h) { return (h >> 16) & 0xffff; }
+
+// Finds a pilot for every bucket; fills in each key's position.
+bool SearchPilots(const std::vector<uint64_t>& hashes, uint64_t buckets, uint64_t positions,
+                  std::vector<uint16_t>* pilots, std::vector<uint64_t>* key_position) {
+  const size_t n = hashes.size();
+  std::vector<uint64_t> bucket_of(n);
+  std::vector<uint32_t> start(buckets + 1, 0);
+  for (size_t i = 0; i < n; i++) {
+    bucket_of[i] = BucketOf(hashes[i], buckets);
+    start[bucket_of[i] + 1]++;
+  }
+  uint32_t max_size = 0;
+  for (uint64_t b = 0; b < buckets; b++) max_size = std::max(max_size, start[b + 1]);
+  for (uint64_t b = 0; b < buckets; b++) start[b + 1] += start[b];
+  std::vector<uint32_t> members(n);
+  {
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < n; i++) members[fill[bucket_of[i]]++] = static_cast<uint32_t>(i);
+  }
+
+  // Largest buckets first (counting sort by size).
+  std::vector<std::vector<uint64_t>> by_size(max_size + 1);
+  for (uint64_t b = 0; b < buckets; b++) by_size[start[b + 1] - start[b]].push_back(b);
+
+  std::vector<bool> taken(positions, false);
+  std::vector<uint64_t> placed;
+  pilots->assign(buckets, 0);
+  key_position->assign(n, 0);
+  for (uint32_t size = max_size; size > 0; size--) {
+    for (uint64_t b : by_size[size]) {
+      bool found = false;
+      for (uint32_t pilot = 0; pilot <= UINT16_MAX && !found; pilot++) {
+        placed.clear();
+        found = true;
+        for (uint32_t j = start[b]; j < start[b + 1]; j++) {
+          uint64_t p = PositionOf(hashes[members[j]], static_cast<uint16_t>(pilot), positions);
+          if (taken[p] || std::find(placed.begin(), placed.end(), p) != placed.end()) {
+            found = false;
+            break;
+          }
+          placed.push_back(p);
+        }
+        if (!found) continue;
+        (*pilots)[b] = static_cast<uint16_t>(pilot);
+        for (uint32_t j = start[b]; j < start[b + 1]; j++) {
+          taken[placed[j - start[b]]] = true;
+          (*key_position)[members[j]] = placed[j - start[b]];
+        }
+      }
+      if (!found) return false;  // e.g. two keys with the same hash: try another seed
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+// ---------- Writing ----------
+void StaticTableWriter::EncodeStaticRecord(std::string* out, const std::string& key,
+                                           const std::string& value) {
+  uint32_t head[3] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size()),
+                      RecordChecksum(key, value.data(), value.size())};
+  out->append(reinterpret_cast<const char*>(head), sizeof(head));
+  out->append(key);
+  out->append(value);
+}
+
+bool StaticTableWriter::Begin(const std::string& path, const std::vector<std::string>& keys,
+                              const std::vector<uint64_t>& value_sizes, std::string* err) {
+  const uint64_t n = keys.size();
+  const uint64_t buckets = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(n / kKeysPerBucket)));
+  const uint64_t positions = std::max<uint64_t>(n, static_cast<uint64_t>(std::ceil(n / kAlpha)));
+
+  std::vector<uint64_t> hashes(n);
+  std::vector<uint16_t> pilots;
+  std::vector<uint64_t> key_position;
+  uint64_t seed = 0;
+  bool built = false;
+  for (attempts_ = 1; attempts_ <= kMaxAttempts && !built; attempts_++) {
+    seed = Mix(0x5eedull + attempts_);
+    for (uint64_t i = 0; i < n; i++) hashes[i] = HashBytes(keys[i].data(), keys[i].size(), seed);
+    built = SearchPilots(hashes, buckets, positions, &pilots, &key_position);
+  }
+  attempts_--;
+  if (!built) {
+    if (err) *err = "no perfect hash found (duplicate keys?)";
+    return false;
+  }
+
+  // Positions past n are spare; each one in use moves to a hole below n.
+  std::vector<bool> used(n, false);
+  for (uint64_t p : key_position) {
+    if (p < n) used[p] = true;
+  }
+  std::vector<uint32_t> remap(positions - n, 0);
+  uint64_t hole = 0;
+  for (uint64_t& p : key_position) {
+    if (p < n) continue;
+    while (used[hole]) hole++;
+    used[hole] = true;
+    remap[p - n] = static_cast<uint32_t>(hole);
+    p = hole;
+  }
+
+  std::vector<uint64_t> slots(n);
+  uint64_t offset = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    if (keys[i].size() > UINT32_MAX || value_sizes[i] > UINT32_MAX || offset > kOffsetMask) {
+      if (err) *err = "key, value or table too large for the format";
+      return false;
+    }
+    slots[key_position[i]] = (Fingerprint(hashes[i]) << 48) | offset;
+    offset += kRecordHeader + keys[i].size() + value_sizes[i];
+  }
+
+  Header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.count = n;
+  h.buckets = buckets;
+  h.positions = positions;
+  h.seed = seed;
+  h.data_bytes = offset;
+  h.crc = Crc32c(reinterpret_cast<const char*>(&h), offsetof(Header, crc));
+  const Layout l = LayoutFor(n, buckets, positions, offset);
+
+  path_ = path;
+  tmp_ = path + ".tmp";
+  out_.open(tmp_, std::ios::binary | std::ios::trunc);
+  if (!out_) {
+    if (err) *err = "cannot open " + tmp_;
+    return false;
+  }
+  const std::string zeros(8, '\0');
+  out_.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out_.write(reinterpret_cast<const char*>(pilots.data()),
+             static_cast<std::streamsize>(pilots.size() * sizeof(uint16_t)));
+  out_.write(zeros.data(), static_cast<std::streamsize>(l.remap - l.pilots - pilots.size() * 2));
+  out_.write(reinterpret_cast<const char*>(remap.data()),
+             static_cast<std::streamsize>(remap.size() * sizeof(uint32_t)));
+  out_.write(zeros.data(), static_cast<std::streamsize>(l.slots - l.remap - remap.size() * 4));
+  out_.write(reinterpret_cast<const char*>(slots.data()),
+             static_cast<std::streamsize>(slots.size() * sizeof(uint64_t)));
+  data_expected_ = offset;
+  data_written_ = 0;
+  return static_cast<bool>(out_);
+}
+
+bool StaticTableWriter::AppendData(const std::string& records) {
+  out_.write(records.data(), static_cast<std::streamsize>(records.size()));
+  data_written_ += records.size();
+  return static_cast<bool>(out_);
+}
+
+bool StaticTableWriter::Finish(std::string* err) {
+  out_.flush();
+  const bool ok = static_cast<bool>(out_) && data_written_ == data_expected_;
+  out_.close();
+  if (!ok) {
+    std::remove(tmp_.c_str());
+    if (err) *err = data_written_ == data_expected_ ? "write failed" : "record sizes do not match";
+    return false;
+  }
+  return ReplaceFile(tmp_, path_, err);
+}
+
+// ---------- Reading ----------
+StaticTable::~StaticTable() { Close(); }
+
+bool StaticTable::Open(const std::string& path, std::string* err) {
+  Close();
+  auto fail = [&](const std::string& why) {
+    Close();
+    if (err) *err = path + ": " + why;
+    return false;
+  };
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return fail("cannot open");
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    ::close(fd);
+    return fail("not a static table");
+  }
+  void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) return fail("cannot map");
+  map_ = static_cast<char*>(p);
+  map_size_ = static_cast<size_t>(st.st_size);
+
+  Header h;
+  std::memcpy(&h, map_, sizeof(h));
+  if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion ||
+      h.crc != Crc32c(reinterpret_cast<const char*>(&h), offsetof(Header, crc))) {
+    return fail("not a static table, or a damaged one");
+  }
+  if (h.positions < h.count || h.buckets == 0 ||
+      LayoutFor(h.count, h.buckets, h.positions, h.data_bytes).end != map_size_) {
+    return fail("sections do not match the file size");
+  }
+  const Layout l = LayoutFor(h.count, h.buckets, h.positions, h.data_bytes);
+  count_ = h.count;
+  buckets_ = h.buckets;
+  positions_ = h.positions;
+  seed_ = h.seed;
+  data_bytes_ = h.data_bytes;
+  pilots_ = reinterpret_cast<const uint16_t*>(map_ + l.pilots);
+  remap_ = reinterpret_cast<const uint32_t*>(map_ + l.remap);
+  slots_ = reinterpret_cast<const uint64_t*>(map_ + l.slots);
+  data_ = map_ + l.data;
+  return true;
+}
+
+void StaticTable::Close() {
+  if (map_) ::munmap(map_, map_size_);
+  map_ = nullptr;
+  map_size_ = 0;
+  count_ = buckets_ = positions_ = seed_ = data_bytes_ = 0;
+  pilots_ = nullptr;
+  remap_ = nullptr;
+  slots_ = nullptr;
+  data_ = nullptr;
+}
+
+bool StaticTable::Find(const std::string& key, Record* rec) const {
+  if (count_ == 0) return false;
+  const uint64_t h = HashBytes(key.data(), key.size(), seed_);
+  uint64_t p = PositionOf(h, pilots_[BucketOf(h, buckets_)], positions_);
+  if (p >= count_) p = remap_[p - count_];
+  if (p >= count_) return false;  // damaged
+
+  const uint64_t slot = slots_[p];
+  if ((slot >> 48) != Fingerprint(h)) return false;
+  const uint64_t off = slot & kOffsetMask;
+  uint32_t head[3];
+  if (off + kRecordHeader > data_bytes_) return false;
+  std::memcpy(head, data_ + off, sizeof(head));
+  if (off + kRecordHeader + head[0] + head[1] > data_bytes_ || head[0] != key.size() ||
+      std::memcmp(data_ + off + kRecordHeader, key.data(), key.size()) != 0) {
+    return false;
+  }
+  rec->value = data_ + off + kRecordHeader + head[0];
+  rec->size = head[1];
+  rec->crc = head[2];
+  return true;
+}
+
+double StaticTable::index_bits_per_key() const {
+  if (count_ == 0) return 0;
+  return (buckets_ * 16.0 + (positions_ - count_) * 32.0) / static_cast<double>(count_);
+}
+
+}  // namespace kv
@@ -0,0 +1,92 @@
+#include "kvstore/backup.h"
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+
+TEST(BackupTest, IncrementalBackupCopiesOnlyNewRecords) {
+  namespace fs = std::filesystem;
+  const std::string path = "backup_test.aof";
+  const std::string dir = "backup_test_dir";
+  const std::string restored = "backup_test_restored.aof";
+  std::remove(path.c_str());
+  fs::remove_all(dir);
+
+  kv::KVStore s(path);
+  for (int i = 0; i < 100; i++) s.Put("k" + std::to_string(i), "v" + std::to_string(i));
+
+  kv::BackupResult first;
+  std::string err;
+  ASSERT_TRUE(kv::BackupLog(path, dir, &first, &err)) << err;
+  EXPECT_TRUE(first.full);
+  EXPECT_EQ(first.bytes_copied, fs::file_size(path));
+
+  s.Put("k0", "updated");
+  s.Del("k1");
+
+  // A torn record at the tail (writer mid-append) must not be copied.
+  auto before_torn = fs::file_size(path);
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << "PUT torn 9\nabc";
+  }
+
+  kv::BackupResult second;
+  ASSERT_TRUE(kv::BackupLog(path, dir, &second, &err)) << err;
+  EXPECT_FALSE(second.full);
+  EXPECT_EQ(second.log_end, before_torn);
+  EXPECT_EQ(second.bytes_copied, before_torn - first.log_end);
+
+  uint64_t bytes = 0;
+  ASSERT_TRUE(kv::RestoreLog(dir, restored, &bytes, &err)) << err;
+  EXPECT_EQ(bytes, before_torn);
+  {
+    kv::KVStore r(restored);
+    EXPECT_EQ(*r.Get("k0"), "updated");
+    EXPECT_FALSE(r.Get("k1").has_value());
+    EXPECT_EQ(*r.Get("k99"), "v99");
+    EXPECT_FALSE(r.Get("torn").has_value());
+  }
+
+  std::remove(path.c_str());
+  std::remove(restored.c_str());
+  fs::remove_all(dir);
+}
+
+TEST(BackupTest, CompactionStartsNewFullGeneration) {
+  namespace fs = std::filesystem;
+  const std::string path = "backup_compact_test.aof";
+  const std::string dir = "backup_compact_test_dir";
+  const std::string restored = "backup_compact_test_restored.aof";
+  std::remove(path.c_str());
+  fs::remove_all(dir);
+
+  kv::KVStore s(path);
+  for (int i = 0; i < 50; i++) s.Put("hot", std::to_string(i));
+
+  kv::BackupResult res;
+  std::string err;
+  ASSERT_TRUE(kv::BackupLog(path, dir, &res, &err)) << err;
+
+  ASSERT_TRUE(s.Compact());
+  s.Put("after", "compact");
+
+  ASSERT_TRUE(kv::BackupLog(path, dir, &res, &err)) << err;
+  EXPECT_TRUE(res.full);
+  EXPECT_EQ(res.generation, 1u);
+  EXPECT_EQ(res.log_end, fs::file_size(path));
+
+  ASSERT_TRUE(kv::RestoreLog(dir, restored, nullptr, &err)) << err;
+  {
+    kv::KVStore r(restored);
+    EXPECT_EQ(*r.Get("hot"), "49");
+    EXPECT_EQ(*r.Get("after"), "compact");
+  }
+
+  std::remove(path.c_str());
+  std::remove(restored.c_str());
+  fs::remove_all(dir);
+}
@@ -0,0 +1,131 @@
+#include "kvstore/compression.h"
+#include "kvstore/kvstore.h"
+#include "kvstore/log_tools.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+static std::string JsonDoc(int i) {
+  return "{\"id\":" + std::to_string(i) + ",\"name\":\"user" + std::to_string(i * 7) +
+         "\",\"email\":\"user" + std::to_string(i) + "@example.com\",\"active\":true,"
+         "\"roles\":[\"reader\",\"writer\"],\"created_at\":\"2024-01-01T00:00:00Z\"}";
+}
+
+TEST(CompressionTest, LzRoundTripsWithAndWithoutDictionary) {
+  std::string repetitive;
+  for (int i = 0; i < 50; i++) repetitive += JsonDoc(i);
+  std::vector<std::string> inputs = {repetitive, std::string(1000, 'a'), JsonDoc(1)};
+
+  std::vector<std::string> samples;
+  for (int i = 0; i < 100; i++) samples.push_back(JsonDoc(i));
+  kv::LzDictionary dict(kv::TrainDictionary(samples, 4096));
+  ASSERT_FALSE(dict.bytes().empty());
+
+  for (const auto& in : inputs) {
+    const kv::LzDictionary* dicts[] = {nullptr, &dict};
+    for (const kv::LzDictionary* d : dicts) {
+      std::string packed, out;
+      if (!kv::LzCompress(in.data(), in.size(), d, &packed)) continue;
+      EXPECT_LT(packed.size(), in.size());
+      ASSERT_TRUE(kv::LzDecompress(packed.data(), packed.size(), in.size(), d, &out));
+      EXPECT_EQ(out, in);
+    }
+  }
+
+  // A single small document barely compresses alone but does against the dictionary.
+  std::string doc = JsonDoc(4242), alone, with_dict;
+  kv::LzCompress(doc.data(), doc.size(), nullptr, &alone);
+  ASSERT_TRUE(kv::LzCompress(doc.data(), doc.size(), &dict, &with_dict));
+  EXPECT_LT(with_dict.size(), alone.empty() ? doc.size() : alone.size());
+
+  // Incompressible input is rejected, leaving `out` alone.
+  std::string noise = "prefix";
+  uint64_t x = 88172645463325252ull;
+  std::string random;
+  for (int i = 0; i < 256; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    random.push_back(static_cast<char>(x));
+  }
+  EXPECT_FALSE(kv::LzCompress(random.data(), random.size(), nullptr, &noise));
+  EXPECT_EQ(noise, "prefix");
+
+  // Corrupt input fails instead of reading out of bounds.
+  std::string packed, out;
+  ASSERT_TRUE(kv::LzCompress(repetitive.data(), repetitive.size(), nullptr, &packed));
+  EXPECT_FALSE(kv::LzDecompress(packed.data(), packed.size() / 2, repetitive.size(), nullptr, &out));
+}
+
+TEST(CompressionTest, StoreCompressesValuesAcrossReopenCompactionAndTools) {
+  namespace fs = std::filesystem;
+  const std::string path = "compression_test.aof";
+  const std::string copy = "compression_test_copy.aof";
+  for (const auto& p : {path, copy}) {
+    std::remove(p.c_str());
+    std::remove(kv::DictionaryPath(p).c_str());
+  }
+
+  kv::Options opt;
+  opt.compress_min_bytes = 64;
+  opt.compress_dictionary = true;
+  {
+    kv::KVStore s(path, opt);
+    s.Put("tiny", "short");  // under the threshold: stored raw
+    for (int i = 0; i < 1000; i++) s.Put("doc" + std::to_string(i), JsonDoc(i));
+    kv::WriteBatch b;
+    b.Put("batched", JsonDoc(5000));
+    b.Del("doc0");
+    ASSERT_TRUE(s.Write(b));
+
+    kv::StoreStats st = s.Stats();
+    EXPECT_TRUE(st.has_dictionary);
+    EXPECT_GT(st.compressed_values, 900u);
+    EXPECT_LT(st.compress_out_bytes * 2, st.compress_in_bytes);
+    EXPECT_EQ(*s.Get("doc999"), JsonDoc(999));
+    EXPECT_EQ(*s.Get("tiny"), "short");
+    EXPECT_EQ(st.log_bytes, fs::file_size(path));
+  }
+
+  {
+    kv::KVStore s(path, opt);
+    EXPECT_EQ(*s.Get("doc1"), JsonDoc(1));
+    EXPECT_EQ(*s.Get("doc999"), JsonDoc(999));
+    EXPECT_EQ(*s.Get("batched"), JsonDoc(5000));
+    EXPECT_FALSE(s.Get("doc0").has_value());
+
+    s.Put("doc1", JsonDoc(-1));
+    auto before = fs::file_size(path);
+    ASSERT_TRUE(s.Compact());
+    EXPECT_LT(fs::file_size(path), before);
+    EXPECT_EQ(s.Stats().garbage_bytes, 0u);
+    EXPECT_EQ(*s.Get("doc1"), JsonDoc(-1));
+    EXPECT_EQ(*s.Get("doc500"), JsonDoc(500));
+  }
+
+  // Offline tools see plain values; a compacted copy carries the dictionary.
+  EXPECT_TRUE(kv::VerifyLog(path, 2).ok);
+  std::string err;
+  ASSERT_TRUE(kv::CompactLogFile(path, copy, 2, &err)) << err;
+  {
+    kv::KVStore s(copy);
+    EXPECT_EQ(*s.Get("doc42"), JsonDoc(42));
+  }
+  std::ostringstream dump;
+  ASSERT_TRUE(kv::DumpLog(copy, kv::DumpFormat::kJsonLines, dump, 2, &err)) << err;
+  EXPECT_NE(dump.str().find("user42@example.com"), std::string::npos);
+
+  // Without its dictionary the log is refused rather than misread.
+  std::remove(kv::DictionaryPath(copy).c_str());
+  EXPECT_THROW(kv::KVStore s(copy), std::runtime_error);
+  EXPECT_FALSE(kv::VerifyLog(copy, 1).ok);
+
+  for (const auto& p : {path, copy}) {
+    std::remove(p.c_str());
+    std::remove(kv::DictionaryPath(p).c_str());
+  }
+}
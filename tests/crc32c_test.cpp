@@ -0,0 +1,25 @@
+#include "kvstore/crc32c.h"
+#include <gtest/gtest.h>
+#include <string>
+
+
+TEST(Crc32cTest, MatchesKnownValuesOnEveryImplementation) {
+  // Check values from RFC 3720, appendix B.4.
+  EXPECT_EQ(kv::Crc32c("123456789", 9), 0xe3069283u);
+  EXPECT_EQ(kv::Crc32c(std::string(32, '\0')), 0x8a9136aau);
+  EXPECT_EQ(kv::Crc32c(std::string(32, '\xff')), 0x62a8ab43u);
+  EXPECT_EQ(kv::Crc32c("", 0), 0u);
+
+  // The dispatched and portable versions agree at every length and
+  // alignment, and extending a CRC equals hashing the concatenation.
+  std::string data;
+  for (int i = 0; i < 300; i++) data.push_back(static_cast<char>(i * 37 + 11));
+  for (size_t off = 0; off < 8; off++) {
+    for (size_t n = 0; off + n <= data.size(); n += 13) {
+      const char* p = data.data() + off;
+      ASSERT_EQ(kv::Crc32c(p, n), kv::Crc32cPortable(p, n)) << off << " " << n;
+      size_t half = n / 2;
+      EXPECT_EQ(kv::Crc32c(p + half, n - half, kv::Crc32c(p, half)), kv::Crc32c(p, n));
+    }
+  }
+}
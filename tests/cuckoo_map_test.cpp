@@ -0,0 +1,155 @@
+#include "kvstore/cuckoo_map.h"
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+TEST(CuckooMapTest, PutFindEraseAndHighLoad) {
+  kv::CuckooMap<int> m;
+  EXPECT_FALSE(m.Put("a", 1));
+  int old = 0;
+  EXPECT_TRUE(m.Put("a", 2, &old));
+  EXPECT_EQ(old, 1);
+  int v = 0;
+  ASSERT_TRUE(m.Find("a", &v));
+  EXPECT_EQ(v, 2);
+  EXPECT_TRUE(m.Erase("a", &old));
+  EXPECT_EQ(old, 2);
+  EXPECT_FALSE(m.Find("a", &v));
+  EXPECT_FALSE(m.Erase("a"));
+
+  // Fill until the table has to grow, noting how full it got first.
+  double peak = 0;
+  for (int i = 0; i < 200000; i++) {
+    const size_t cap = m.capacity();
+    const double load = m.load_factor();
+    m.Put("key" + std::to_string(i), i);
+    if (m.capacity() != cap && cap >= 4096) peak = std::max(peak, load);
+  }
+  EXPECT_GT(peak, 0.9);
+  EXPECT_EQ(m.size(), 200000u);
+  for (int i = 0; i < 200000; i++) {
+    ASSERT_TRUE(m.Find("key" + std::to_string(i), &v)) << i;
+    EXPECT_EQ(v, i);
+  }
+  size_t seen = 0;
+  m.ForEach([&](const std::string&, int&) { seen++; });
+  EXPECT_EQ(seen, 200000u);
+  m.Clear();
+  EXPECT_EQ(m.size(), 0u);
+  EXPECT_FALSE(m.Find("key1", &v));
+}
+
+TEST(CuckooMapTest, ConcurrentWritersAndReaders) {
+  kv::CuckooMap<std::string> m;
+  constexpr int kThreads = 8, kPerThread = 20000;
+  std::atomic<bool> done{false};
+  std::atomic<int> bad{0};
+  std::thread reader([&] {
+    std::string v;
+    while (!done) {
+      for (int i = 0; i < kPerThread; i += 97) {
+        // Each key only ever holds its own name.
+        const std::string k = "t0-" + std::to_string(i);
+        if (m.Find(k, &v) && v != k) bad++;
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kThreads; t++) {
+    writers.emplace_back([&, t] {
+      for (int i = 0; i < kPerThread; i++) {
+        const std::string k = "t" + std::to_string(t) + "-" + std::to_string(i);
+        m.Put(k, k);
+        if (i % 3 == 0) m.Erase(k);
+      }
+    });
+  }
+  for (auto& w : writers) w.join();
+  done = true;
+  reader.join();
+  EXPECT_EQ(bad.load(), 0);
+  EXPECT_EQ(m.size(), static_cast<size_t>(kThreads * (kPerThread - (kPerThread + 2) / 3)));
+  std::string v;
+  EXPECT_TRUE(m.Find("t7-1", &v));
+  EXPECT_FALSE(m.Find("t7-3", &v));
+}
+
+TEST(CuckooMapTest, StoreWithConcurrentIndexSurvivesCompactionAndReplay) {
+  const std::string path = "cuckoo_store_test.aof";
+  std::remove(path.c_str());
+  kv::Options opts;
+  opts.concurrent_index = true;
+  {
+    kv::KVStore s(path, opts);
+    for (int i = 0; i < 5000; i++) s.Put("k" + std::to_string(i), "v" + std::to_string(i));
+    for (int i = 0; i < 5000; i += 2) s.Put("k" + std::to_string(i), "w" + std::to_string(i));
+    s.Del("k1");
+
+    // Readers take no store lock; they must never see a value from the
+    // wrong offset while Compact() swaps the log under them.
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::thread reader([&] {
+      while (!done) {
+        for (int i = 2; i < 5000; i += 61) {
+          auto v = s.Get("k" + std::to_string(i));
+          if (!v || *v != (i % 2 ? "v" : "w") + std::to_string(i)) bad++;
+        }
+      }
+    });
+    for (int r = 0; r < 5; r++) ASSERT_TRUE(s.Compact());
+    done = true;
+    reader.join();
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_EQ(s.Stats().keys, 4999u);
+    EXPECT_EQ(s.Stats().garbage_bytes, 0u);
+    EXPECT_TRUE(s.Scrub().clean());
+  }
+  kv::KVStore s(path, opts);
+  EXPECT_EQ(s.Stats().keys, 4999u);
+  EXPECT_FALSE(s.Get("k1").has_value());
+  EXPECT_EQ(*s.Get("k4"), "w4");
+  EXPECT_EQ(*s.Get("k5"), "v5");
+
+  kv::KVStore mem(opts);
+  EXPECT_TRUE(mem.Put("a", "1"));
+  EXPECT_EQ(*mem.Get("a"), "1");
+  EXPECT_TRUE(mem.Del("a"));
+  EXPECT_FALSE(mem.Get("a").has_value());
+}
+
+TEST(CuckooMapTest, LockFreeReadersSeeTheDictionaryOnceItIsTrained) {
+  const std::string path = "cuckoo_dict_test.aof";
+  for (const char* suffix : {"", ".dict"}) std::remove((path + suffix).c_str());
+  kv::Options opts;
+  opts.concurrent_index = true;
+  opts.compress_min_bytes = 64;
+  opts.compress_dictionary = true;
+  opts.hot_cache_bytes = 1 << 20;  // not used with this index
+  kv::KVStore s(path, opts);
+  const auto value = [](int i) { return "{\"user\":" + std::to_string(i) + ",\"status\":\"active\",\"plan\":\"basic\"}"; };
+  ASSERT_TRUE(s.Put("first", value(0)));
+
+  std::atomic<bool> done{false};
+  std::atomic<int> bad{0};
+  std::thread reader([&] {
+    while (!done) {
+      auto v = s.Get("first");
+      if (!v || *v != value(0)) bad++;
+    }
+  });
+  for (int i = 1; i < 1000; i++) ASSERT_TRUE(s.Put("k" + std::to_string(i), value(i)));  // trains after 256
+  done = true;
+  reader.join();
+  EXPECT_EQ(bad.load(), 0);
+  const kv::StoreStats st = s.Stats();
+  EXPECT_TRUE(st.has_dictionary);
+  EXPECT_EQ(*s.Get("k999"), value(999));
+  EXPECT_EQ(st.hot_bytes, 0u);
+  for (const char* suffix : {"", ".dict"}) std::remove((path + suffix).c_str());
+}
@@ -0,0 +1,184 @@
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+
+static kv::Options WriterOptions() {
+  kv::Options opts;
+  opts.publish_watermark = true;
+  return opts;
+}
+
+static kv::Options FollowerOptions() {
+  kv::Options opts;
+  opts.read_only_follower = true;
+  opts.follow_poll_ms = 5;
+  return opts;
+}
+
+static void RemoveStore(const std::string& path) {
+  for (const char* suffix : {"", ".wm", ".tmp", ".dict"}) std::remove((path + suffix).c_str());
+}
+
+static bool WaitFor(const std::function<bool()>& done) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+TEST(FollowerTest, TailsPublishedWritesIntoItsOwnIndex) {
+  const std::string path = "follower_tail_test.aof";
+  RemoveStore(path);
+  kv::KVStore writer(path, WriterOptions());
+  for (int i = 0; i < 100; i++) writer.Put("k" + std::to_string(i), "v" + std::to_string(i));
+  writer.Del("k1");
+
+  kv::KVStore follower(path, FollowerOptions());
+  EXPECT_EQ(follower.Get("k0"), "v0");
+  EXPECT_FALSE(follower.Get("k1"));
+  EXPECT_EQ(follower.Stats().keys, 99u);
+
+  kv::WriteBatch batch;
+  batch.Put("k0", "new");
+  batch.Del("k2");
+  batch.Put("k100", std::string(100000, 'x'));
+  ASSERT_TRUE(writer.Write(batch));
+  EXPECT_TRUE(WaitFor([&]() { return follower.Get("k100").has_value(); }));
+  EXPECT_EQ(follower.Get("k0"), "new");  // the whole batch at once
+  EXPECT_FALSE(follower.Get("k2"));
+
+  kv::FollowerStatus st = follower.Follower();
+  EXPECT_TRUE(st.following);
+  EXPECT_EQ(st.applied_bytes, writer.Stats().log_bytes);
+  EXPECT_EQ(st.published_bytes, st.applied_bytes);
+  EXPECT_LT(st.staleness_ms, 1000u);
+  EXPECT_TRUE(st.error.empty()) << st.error;
+  EXPECT_FALSE(writer.Follower().following);
+
+  // Read-only.
+  EXPECT_FALSE(follower.Put("k0", "x"));
+  EXPECT_FALSE(follower.Del("k0"));
+  EXPECT_FALSE(follower.Compact());
+  EXPECT_EQ(writer.Get("k0"), "new");
+}
+
+TEST(FollowerTest, ReplaysTheLogAgainAfterTheWriterCompacts) {
+  const std::string path = "follower_compact_test.aof";
+  RemoveStore(path);
+  kv::KVStore writer(path, WriterOptions());
+  for (int round = 0; round < 5; round++) {
+    for (int i = 0; i < 200; i++) writer.Put("k" + std::to_string(i), std::to_string(round));
+  }
+  kv::KVStore follower(path, FollowerOptions());
+  const uint64_t before = follower.Follower().applied_bytes;
+
+  ASSERT_TRUE(writer.Compact());
+  writer.Put("after", "1");
+  EXPECT_TRUE(WaitFor([&]() { return follower.Get("after").has_value(); }));
+  kv::FollowerStatus st = follower.Follower();
+  EXPECT_EQ(st.reloads, 1u);
+  EXPECT_LT(st.applied_bytes, before);
+  EXPECT_EQ(follower.Get("k199"), "4");
+  EXPECT_EQ(follower.Stats().keys, 201u);
+}
+
+TEST(FollowerTest, SeesOnlyWhatTheHybridLogHasWrittenOut) {
+  const std::string path = "follower_hybrid_test.aof";
+  RemoveStore(path);
+  kv::Options opts = WriterOptions();
+  opts.mutable_log_bytes = 1 << 20;
+  kv::KVStore writer(path, opts);
+  kv::WriteBatch first;  // a batch reaches the file before Write returns
+  first.Put("flushed", "1");
+  ASSERT_TRUE(writer.Write(first));
+  kv::KVStore follower(path, FollowerOptions());
+  EXPECT_EQ(follower.Get("flushed"), "1");
+
+  writer.Put("in_memory", "2");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(follower.Get("in_memory"));
+  kv::WriteBatch batch;
+  batch.Put("batched", "3");
+  ASSERT_TRUE(writer.Write(batch));
+  EXPECT_TRUE(WaitFor([&]() { return follower.Get("batched").has_value(); }));
+  EXPECT_EQ(follower.Get("in_memory"), "2");
+}
+
+TEST(FollowerTest, FollowsAWriterInAnotherProcess) {
+  const std::string path = "follower_process_test.aof";
+  RemoveStore(path);
+  int ready[2];
+  ASSERT_EQ(pipe(ready), 0);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(ready[0]);
+    {
+      kv::KVStore writer(path, WriterOptions());
+      writer.Put("first", "1");
+      char c = 1;
+      if (write(ready[1], &c, 1) != 1) _exit(1);
+      for (int i = 0; i < 1000; i++) writer.Put("k" + std::to_string(i), std::to_string(i));
+    }
+    _exit(0);
+  }
+  close(ready[1]);
+  char c = 0;
+  ASSERT_EQ(read(ready[0], &c, 1), 1);
+  close(ready[0]);
+
+  kv::KVStore follower(path, FollowerOptions());
+  EXPECT_EQ(follower.Get("first"), "1");
+  EXPECT_TRUE(WaitFor([&]() { return follower.Get("k999").has_value(); }));
+  int status = 0;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(status, 0);
+  EXPECT_EQ(follower.Stats().keys, 1001u);
+}
+
+TEST(FollowerTest, NeedsAPublishingWriter) {
+  const std::string path = "follower_missing_test.aof";
+  RemoveStore(path);
+  { kv::KVStore plain(path); plain.Put("a", "1"); }
+  EXPECT_THROW(kv::KVStore(path, FollowerOptions()), std::runtime_error);
+}
+
+TEST(FollowerTest, LogReaderScansASpanUpToItsEnd) {
+  std::string log;
+  kv::EncodePut(&log, "a", "1");
+  const uint64_t batch_at = log.size();
+  kv::EncodeBegin(&log, 2);
+  kv::EncodePut(&log, "b", "2");
+  kv::EncodeDel(&log, "a");
+  const uint64_t batch_end = log.size();
+  kv::EncodePut(&log, "c", std::string(1000, 'c'));
+
+  kv::LogReader all(log.data(), log.size(), /*verify_values=*/true);
+  std::vector<kv::LogRecord> group;
+  int groups = 0;
+  while (all.NextGroup(&group)) groups++;
+  EXPECT_EQ(groups, 3);
+  EXPECT_EQ(all.status(), kv::LogReader::Status::kEof);
+  EXPECT_EQ(all.offset(), log.size());
+
+  // A span that ends inside the batch yields only what precedes it.
+  kv::LogReader cut(log.data(), batch_end - 1, /*verify_values=*/true);
+  ASSERT_TRUE(cut.NextGroup(&group));
+  EXPECT_FALSE(cut.NextGroup(&group));
+  EXPECT_EQ(cut.status(), kv::LogReader::Status::kTruncated);
+  EXPECT_EQ(cut.offset(), batch_at);
+
+  cut = kv::LogReader(log.data(), log.size() - 10, /*verify_values=*/true);
+  cut.Seek(batch_end);
+  EXPECT_FALSE(cut.NextGroup(&group));  // inside the value
+  EXPECT_EQ(cut.status(), kv::LogReader::Status::kTruncated);
+}
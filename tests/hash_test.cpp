@@ -0,0 +1,71 @@
+#include "kvstore/hash.h"
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+
+TEST(HashTest, EveryByteAndLengthMatters) {
+  std::string data;
+  for (int i = 0; i < 300; i++) data.push_back(static_cast<char>(i * 37 + 11));
+
+  // Distinct for every prefix length (covers each size class and lane count).
+  std::unordered_set<uint64_t> seen;
+  for (size_t n = 0; n <= data.size(); n++) {
+    EXPECT_TRUE(seen.insert(kv::HashBytes(data.data(), n)).second) << n;
+  }
+  // Flipping any single bit changes the hash.
+  for (size_t n : {1, 3, 4, 7, 8, 16, 17, 48, 49, 100}) {
+    const uint64_t h = kv::HashBytes(data.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      std::string s = data.substr(0, n);
+      s[i] ^= 1;
+      EXPECT_NE(kv::HashBytes(s.data(), n), h) << n << " " << i;
+    }
+  }
+  EXPECT_NE(kv::HashBytes("key", 3, 1), kv::HashBytes("key", 3, 2));
+
+  std::vector<std::string> keys = {"", "a", "user:100:profile", std::string(200, 'x')};
+  std::vector<uint64_t> hashes(keys.size());
+  kv::HashKeys(keys, hashes.data());
+  for (size_t i = 0; i < keys.size(); i++) EXPECT_EQ(hashes[i], kv::HashKey(keys[i]));
+
+  // A lent hash is used for that key object only, and only inside the scope.
+  std::string k = "user:1";
+  std::string same = k;
+  {
+    kv::KnownHash known(k, 42);
+    EXPECT_EQ(kv::KeyHasher{}(k), 42u);
+    EXPECT_EQ(kv::KeyHasher{}(same), kv::HashKey(k));
+  }
+  EXPECT_EQ(kv::KeyHasher{}(k), kv::HashKey(k));
+}
+
+TEST(HashTest, PrecomputedHashLookups) {
+  // Compressed keys are indexed by their encoding: the caller's hash must
+  // not be used for those.
+  const std::string path = "hash_lookup_test.aof";
+  for (bool compress : {false, true}) {
+    std::remove(path.c_str());
+    kv::Options opts;
+    opts.compress_keys = compress;
+    kv::KVStore s(path, opts);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2000; i++) {
+      keys.push_back("user:" + std::to_string(i));
+      s.Put(keys.back(), "v" + std::to_string(i));
+    }
+    keys.push_back("missing");
+
+    auto values = s.MultiGet(keys);
+    ASSERT_EQ(values.size(), keys.size());
+    for (size_t i = 0; i + 1 < keys.size(); i++) {
+      ASSERT_TRUE(values[i].has_value());
+      EXPECT_EQ(*values[i], "v" + std::to_string(i));
+      EXPECT_EQ(*s.Get(keys[i], kv::HashKey(keys[i])), *values[i]);
+    }
+    EXPECT_FALSE(values.back().has_value());
+  }
+}
@@ -0,0 +1,116 @@
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <string>
+
+
+static kv::Options HybridOptions(uint64_t mutable_bytes) {
+  kv::Options opts;
+  opts.mutable_log_bytes = mutable_bytes;
+  return opts;
+}
+
+static std::string Counter(int n) {
+  std::string s = std::to_string(n);
+  return std::string(8 - s.size(), '0') + s;  // fixed width, so updates fit in place
+}
+
+TEST(HybridLogTest, HotKeysAreUpdatedInPlace) {
+  const std::string path = "hybrid_inplace_test.aof";
+  std::remove(path.c_str());
+  constexpr int kKeys = 100, kRounds = 1000;
+  {
+    kv::KVStore s(path, HybridOptions(64 * 1024));
+    for (int r = 0; r < kRounds; r++) {
+      for (int k = 0; k < kKeys; k++) s.Put("counter" + std::to_string(k), Counter(r));
+    }
+    EXPECT_EQ(*s.Get("counter7"), Counter(kRounds - 1));
+    auto st = s.Stats();
+    EXPECT_EQ(st.in_place_updates, static_cast<uint64_t>(kKeys * (kRounds - 1)));
+    EXPECT_EQ(st.garbage_bytes, 0u);
+    EXPECT_EQ(st.unflushed_bytes, st.log_bytes);  // one record per key, all in memory
+    EXPECT_EQ(std::filesystem::file_size(path), 0u);
+
+    // A different length, or a key already in the file, appends instead.
+    s.Put("counter0", "short");
+    EXPECT_EQ(s.Stats().in_place_updates, st.in_place_updates);
+    EXPECT_GT(s.Stats().garbage_bytes, 0u);
+    EXPECT_TRUE(s.Compact());
+    EXPECT_EQ(s.Stats().unflushed_bytes, 0u);
+    s.Put("counter1", Counter(1));
+    EXPECT_EQ(s.Stats().in_place_updates, st.in_place_updates);
+    EXPECT_EQ(*s.Get("counter1"), Counter(1));
+  }
+  kv::KVStore s(path, HybridOptions(64 * 1024));
+  EXPECT_EQ(s.Stats().keys, static_cast<uint64_t>(kKeys));
+  EXPECT_EQ(*s.Get("counter0"), "short");
+  EXPECT_EQ(*s.Get("counter1"), Counter(1));
+  EXPECT_EQ(*s.Get("counter99"), Counter(kRounds - 1));
+  EXPECT_TRUE(s.Scrub().clean());
+}
+
+TEST(HybridLogTest, RegionsMoveToTheFileAndACrashLosesOnlyTheTail) {
+  const std::string path = "hybrid_regions_test.aof";
+  std::remove(path.c_str());
+  constexpr uint64_t kRegion = 4096;
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    auto* s = new kv::KVStore(path, HybridOptions(kRegion));
+    for (int i = 0; i < 2000; i++) s->Put("key" + std::to_string(i), "value" + std::to_string(i));
+    // Bounded by the two in-memory regions, plus the record that crossed.
+    if (s->Stats().unflushed_bytes > 2 * kRegion + 64) _exit(1);
+    if (*s->Get("key0") != "value0" || *s->Get("key1999") != "value1999") _exit(2);
+    kv::WriteBatch b;
+    b.Put("batched", "yes");
+    s->Write(b);
+    s->Put("after", "lost");
+    _exit(0);  // no destructor: whatever is only in memory is gone
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+
+  kv::KVStore s(path, HybridOptions(kRegion));
+  for (int i = 0; i < 2000; i++) ASSERT_EQ(*s.Get("key" + std::to_string(i)), "value" + std::to_string(i)) << i;
+  EXPECT_EQ(*s.Get("batched"), "yes");
+  EXPECT_FALSE(s.Get("after").has_value());
+}
+
+TEST(HybridLogTest, HintedGetsReadTheFileDuringBackgroundRecovery) {
+  const std::string path = "hybrid_hint_test.aof";
+  for (const char* suffix : {"", ".hint", ".hint.tmp"}) std::remove((path + suffix).c_str());
+  kv::Options opts = HybridOptions(64 * 1024);
+  opts.background_recovery = true;
+  {
+    kv::KVStore s(path, opts);
+    for (int i = 0; i < 1000; i++) s.Put("key" + std::to_string(i), "v" + std::to_string(i));
+  }
+  ASSERT_TRUE(std::filesystem::exists(path + ".hint"));
+
+  // Hold the replay back until the Gets below are done.
+  std::promise<void> entered, release;
+  std::shared_future<void> released = release.get_future().share();
+  kv::KVStore::before_replay_for_testing = [&]() {
+    entered.set_value();
+    released.wait();
+  };
+  kv::KVStore s(path, opts);
+  entered.get_future().wait();
+  kv::KVStore::before_replay_for_testing = nullptr;
+  if (!s.Recovery().serving_reads) release.set_value();  // the Gets would wait for the replay
+  ASSERT_TRUE(s.Recovery().serving_reads);
+  EXPECT_EQ(s.Get("key0"), "v0");
+  EXPECT_EQ(s.Get("key999"), "v999");
+  EXPECT_FALSE(s.Get("missing").has_value());
+  EXPECT_TRUE(s.Recovery().serving_reads);  // all of them from the hint
+  release.set_value();
+
+  EXPECT_TRUE(s.Put("after", "1"));  // waits for the replay
+  EXPECT_EQ(*s.Get("key7"), "v7");
+}
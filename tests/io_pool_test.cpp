@@ -0,0 +1,111 @@
+#include "kvstore/io_pool.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(IoPoolTest, ReadsRunAheadOfQueuedBackgroundWork) {
+  kv::IoPoolOptions opts;
+  opts.threads = 1;
+  opts.aging = 10s;
+  kv::IoPool pool(opts);
+
+  std::promise<void> release;
+  std::shared_future<void> gate = release.get_future().share();
+  ASSERT_TRUE(pool.Submit(kv::IoPriority::kBackground, [gate]() { gate.wait(); }));  // occupies the worker
+  std::this_thread::sleep_for(20ms);
+
+  std::mutex mu;
+  std::vector<std::string> order;
+  auto note = [&](const char* what) {
+    return [&mu, &order, what]() {
+      std::lock_guard<std::mutex> lock(mu);
+      order.push_back(what);
+    };
+  };
+  ASSERT_TRUE(pool.Submit(kv::IoPriority::kBackground, note("compact")));
+  ASSERT_TRUE(pool.Submit(kv::IoPriority::kWrite, note("put")));
+  ASSERT_TRUE(pool.Submit(kv::IoPriority::kRead, note("get1")));
+  ASSERT_TRUE(pool.Submit(kv::IoPriority::kRead, note("get2")));
+  EXPECT_EQ(pool.Stats(kv::IoPriority::kRead).queued, 2u);
+  std::this_thread::sleep_for(20ms);
+  release.set_value();
+
+  bool ran = false;
+  ASSERT_TRUE(pool.Run(kv::IoPriority::kBackground, [&]() { ran = true; }, 5s));  // queued behind the rest
+  EXPECT_TRUE(ran);
+  EXPECT_EQ(order, (std::vector<std::string>{"get1", "get2", "put", "compact"}));
+
+  kv::IoQueueStats reads = pool.Stats(kv::IoPriority::kRead);
+  EXPECT_EQ(reads.executed, 2u);
+  EXPECT_EQ(reads.queued, 0u);
+  EXPECT_GE(reads.wait_us_max, 10000u);  // they waited out the blocked worker
+  EXPECT_GE(reads.wait_us_p99, reads.wait_us_p50);
+  EXPECT_EQ(pool.Stats(kv::IoPriority::kBackground).executed, 3u);
+}
+
+TEST(IoPoolTest, FullQueuesRejectAndRunTimesOutBeforeStarting) {
+  std::mutex mu;
+  std::vector<std::string> order;
+  auto note = [&](const char* what) {
+    return [&mu, &order, what]() {
+      std::lock_guard<std::mutex> lock(mu);
+      order.push_back(what);
+    };
+  };
+  int x = 0;
+  {
+    kv::IoPoolOptions opts;
+    opts.threads = 1;
+    opts.max_background_queued = 2;
+    opts.aging = 20ms;
+    kv::IoPool pool(opts);
+
+    std::promise<void> release;
+    std::shared_future<void> gate = release.get_future().share();
+    ASSERT_TRUE(pool.Submit(kv::IoPriority::kWrite, [gate]() { gate.wait(); }));
+    std::this_thread::sleep_for(20ms);
+
+    ASSERT_TRUE(pool.Submit(kv::IoPriority::kBackground, note("compact1")));
+    ASSERT_TRUE(pool.Submit(kv::IoPriority::kBackground, note("compact2")));
+    EXPECT_FALSE(pool.Submit(kv::IoPriority::kBackground, note("compact3")));
+    EXPECT_EQ(pool.Stats(kv::IoPriority::kBackground).rejected, 1u);
+
+    // Never starts while the worker is blocked, so it never runs at all.
+    EXPECT_FALSE(pool.Run(kv::IoPriority::kRead, [&]() { x = 1; }, 30ms));
+    EXPECT_EQ(pool.Stats(kv::IoPriority::kRead).cancelled, 1u);
+
+    // By now the background tasks have aged past the fresh read.
+    std::this_thread::sleep_for(30ms);
+    ASSERT_TRUE(pool.Submit(kv::IoPriority::kRead, note("get")));
+    release.set_value();
+  }  // drains the queues
+  EXPECT_EQ(order, (std::vector<std::string>{"compact1", "compact2", "get"}));
+  EXPECT_EQ(x, 0);
+}
+
+TEST(IoPoolTest, BackgroundWorkLeavesTheOtherWorkersFree) {
+  kv::IoPoolOptions opts;
+  opts.threads = 2;
+  opts.background_threads = 1;
+  kv::IoPool pool(opts);
+
+  std::promise<void> release;
+  std::shared_future<void> gate = release.get_future().share();
+  ASSERT_TRUE(pool.Submit(kv::IoPriority::kBackground, [gate]() { gate.wait(); }));
+  std::atomic<bool> second{false};
+  ASSERT_TRUE(pool.Submit(kv::IoPriority::kBackground, [&]() { second = true; }));
+  bool read = false;
+  EXPECT_TRUE(pool.Run(kv::IoPriority::kRead, [&]() { read = true; }, 5s));
+  EXPECT_TRUE(read);
+  std::this_thread::sleep_for(20ms);
+  EXPECT_FALSE(second.load());  // an idle worker, but the background slot is taken
+  release.set_value();
+  ASSERT_TRUE(pool.Run(kv::IoPriority::kBackground, []() {}, 5s));
+  EXPECT_TRUE(second.load());
+}
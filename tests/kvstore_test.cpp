@@ -1,5 +1,10 @@
 #include "kvstore/kvstore.h"
+#include "kvstore/log_format.h"
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cstdio>
 #include <fstream>
 #include <filesystem>
@@ -216,3 +221,325 @@ TEST(KVStoreTest, ConcurrentReadsDuringWritesAreSafe) {
   stop.store(true);
   writer.join();
 }
+
+TEST(KVStoreTest, WriteBatchIsAllOrNothingAcrossCrash) {
+  const std::string path = "kvstore_batch_test.aof";
+  std::remove(path.c_str());
+
+  {
+    kv::KVStore s(path);
+    kv::WriteBatch b;
+    b.Put("a", "1");
+    b.Put("b", "2");
+    b.Del("a");
+    ASSERT_TRUE(s.Write(b));
+    EXPECT_FALSE(s.Get("a").has_value());
+    EXPECT_EQ(*s.Get("b"), "2");
+    s.Close();
+  }
+
+  // Simulate a crash halfway through a second batch.
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << "BEGIN 2\nPUT b 4\nlost\n";
+  }
+
+  {
+    kv::KVStore s2(path);
+    EXPECT_EQ(*s2.Get("b"), "2");
+    // The torn batch is trimmed, so later appends survive the next replay.
+    s2.Put("c", "3");
+  }
+
+  {
+    kv::KVStore s3(path);
+    EXPECT_EQ(*s3.Get("b"), "2");
+    EXPECT_EQ(*s3.Get("c"), "3");
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST(KVStoreTest, CompactionLeavesOneWholeLogAcrossCrashes) {
+  namespace fs = std::filesystem;
+  const std::string path = "kvstore_compact_crash_test.aof";
+  std::remove(path.c_str());
+  std::remove((path + ".bak").c_str());
+
+  {
+    kv::KVStore s(path);
+    for (int i = 0; i < 50; i++) s.Put("k" + std::to_string(i % 10), std::to_string(i));
+    ASSERT_TRUE(s.Compact());
+    EXPECT_EQ(s.Stats().garbage_bytes, 0u);
+    EXPECT_EQ(s.Stats().log_bytes, fs::file_size(path));
+    // The index was updated in place: reads and new writes land correctly.
+    EXPECT_EQ(*s.Get("k3"), "43");
+    s.Put("k3", "after");
+    EXPECT_EQ(*s.Get("k3"), "after");
+  }
+
+  // Crash while writing the new log: the partial .tmp is ignored and removed.
+  {
+    std::ofstream tmp(path + ".tmp", std::ios::binary);
+    tmp << "PUT k3 7\ngarbage\nPUT k4";
+  }
+  {
+    kv::KVStore s(path);
+    EXPECT_FALSE(fs::exists(path + ".tmp"));
+    EXPECT_EQ(*s.Get("k3"), "after");
+    EXPECT_EQ(*s.Get("k9"), "49");
+  }
+
+  // An older build crashed between its two renames: only the .bak is left.
+  fs::rename(path, path + ".bak");
+  kv::KVStore s(path);
+  EXPECT_FALSE(fs::exists(path + ".bak"));
+  EXPECT_EQ(*s.Get("k3"), "after");
+  EXPECT_EQ(s.Stats().keys, 10u);
+}
+
+TEST(KVStoreTest, PartitionedCompactionMatchesSinglePass) {
+  namespace fs = std::filesystem;
+  const std::string serial = "kvstore_compact_serial_test.aof";
+  const std::string parallel = "kvstore_compact_parallel_test.aof";
+  auto limiter = std::make_shared<kv::RateLimiter>(0);
+  for (const auto& path : {serial, parallel}) {
+    for (const auto& p : {path, path + ".dict"}) std::remove(p.c_str());
+    kv::Options opts;
+    opts.compress_min_bytes = 32;
+    opts.hot_cache_bytes = 4096;
+    if (path == parallel) {
+      opts.compaction_threads = 4;
+      opts.background_io = limiter;
+    }
+    kv::KVStore s(path, opts);
+    for (int i = 0; i < 3000; i++) s.Put("k" + std::to_string(i), "old");
+    for (int i = 0; i < 3000; i += 2) s.Put("k" + std::to_string(i), std::string(64, 'a' + i % 26));
+    for (int i = 0; i < 3000; i += 7) s.Del("k" + std::to_string(i));
+    for (int i = 0; i < 50; i++) s.Get("k2");  // served from the hot tier when copied
+    ASSERT_TRUE(s.Compact());
+    EXPECT_EQ(s.Stats().garbage_bytes, 0u);
+    EXPECT_EQ(s.Stats().log_bytes, fs::file_size(path));
+    EXPECT_EQ(*s.Get("k2"), std::string(64, 'c'));
+    s.Put("k3", "after");
+  }
+  // Same records, laid out by partition instead of index order.
+  EXPECT_EQ(fs::file_size(serial), fs::file_size(parallel));
+  EXPECT_GE(limiter->total_bytes(), fs::file_size(parallel));
+
+  kv::KVStore s(parallel);
+  EXPECT_EQ(s.Stats().keys, 3000u - 429u);
+  for (int i = 0; i < 3000; i++) {
+    auto v = s.Get("k" + std::to_string(i));
+    if (i % 7 == 0) {
+      EXPECT_FALSE(v.has_value()) << i;
+    } else {
+      ASSERT_TRUE(v.has_value()) << i;
+      EXPECT_EQ(*v, i == 3 ? "after" : i % 2 == 0 ? std::string(64, 'a' + i % 26) : "old") << i;
+    }
+  }
+  EXPECT_TRUE(s.Scrub().clean());
+}
+
+static std::vector<std::string> KeysInLogOrder(const std::string& path) {
+  std::vector<std::string> keys;
+  kv::LogReader reader(path);
+  kv::LogRecord rec;
+  while (reader.Next(&rec)) keys.push_back(rec.key);
+  return keys;
+}
+
+TEST(KVStoreTest, CompactionLaysOutRecordsByKeyOrCoAccess) {
+  const std::string path = "kvstore_compact_layout_test.aof";
+  for (int threads : {1, 3}) {
+    std::remove(path.c_str());
+    kv::Options opts;
+    opts.compaction_threads = threads;
+    opts.compaction_order = kv::CompactionOrder::kKey;
+    {
+      kv::KVStore s(path, opts);
+      for (int i = 0; i < 500; i++) s.Put("k" + std::to_string((i * 7919) % 500), std::to_string(i));
+      ASSERT_TRUE(s.Compact());
+    }
+    auto keys = KeysInLogOrder(path);
+    ASSERT_EQ(keys.size(), 500u);
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end())) << threads;
+
+    // Keys read in one MultiGet end up adjacent; the rest follow by key.
+    std::remove(path.c_str());
+    opts.compaction_order = kv::CompactionOrder::kCoAccess;
+    kv::KVStore s(path, opts);
+    for (int i = 0; i < 500; i++) s.Put("k" + std::to_string(i), "v");
+    s.MultiGet({"k400", "k7", "k250"});
+    s.MultiGet({"k99", "k300"});
+    s.MultiGet({"k7", "k12"});  // joins k7's group
+    ASSERT_TRUE(s.Compact());
+    keys = KeysInLogOrder(path);
+    ASSERT_EQ(keys.size(), 500u);
+    const std::vector<std::string> first(keys.begin(), keys.begin() + 6);
+    EXPECT_EQ(first, (std::vector<std::string>{"k12", "k250", "k400", "k7", "k300", "k99"})) << threads;
+    EXPECT_TRUE(std::is_sorted(keys.begin() + 6, keys.end()));
+    EXPECT_EQ(*s.Get("k12"), "v");
+  }
+}
+
+static uint64_t AllocatedBytes(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_blocks) * 512 : 0;
+}
+
+TEST(KVStoreTest, PreallocatedLogIsTrimmedOnCloseAndAfterACrash) {
+  const std::string path = "kvstore_prealloc_test.aof";
+  std::remove(path.c_str());
+  kv::Options opts;
+  opts.preallocate_bytes = 1 << 20;
+  opts.access_hints = true;
+  {
+    kv::KVStore s(path, opts);
+    for (int i = 0; i < 100; i++) s.Put("k" + std::to_string(i), "v" + std::to_string(i));
+    EXPECT_EQ(s.Stats().log_bytes, std::filesystem::file_size(path));  // the size is untouched
+    if (AllocatedBytes(path) < (1u << 20)) GTEST_SKIP() << "no fallocate on this filesystem";
+    ASSERT_TRUE(s.Compact());
+    s.Put("after", "compaction");
+  }
+  EXPECT_LT(AllocatedBytes(path), 1u << 20);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    auto* s = new kv::KVStore(path, opts);
+    s->Put("crash", "1");
+    _exit(AllocatedBytes(path) >= (1u << 20) ? 0 : 1);  // no Close: the excess stays
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  {
+    kv::KVStore s(path, opts);
+    EXPECT_LT(AllocatedBytes(path), 1u << 20);
+    EXPECT_EQ(*s.Get("k42"), "v42");
+    EXPECT_EQ(*s.Get("after"), "compaction");
+    EXPECT_EQ(*s.Get("crash"), "1");
+    EXPECT_EQ(s.Stats().keys, 102u);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(KVStoreTest, StatsTrackGarbageAndCompaction) {
+  const std::string path = "kvstore_stats_test.aof";
+  std::remove(path.c_str());
+
+  kv::KVStore s(path);
+  for (int i = 0; i < 10; i++) s.Put("hot", std::to_string(i));
+  s.Get("hot");
+
+  auto st = s.Stats();
+  EXPECT_EQ(st.keys, 1u);
+  EXPECT_EQ(st.puts, 10u);
+  EXPECT_EQ(st.gets, 1u);
+  EXPECT_EQ(st.log_bytes, std::filesystem::file_size(path));
+  std::string live;
+  kv::EncodePut(&live, "hot", "9");
+  EXPECT_EQ(st.log_bytes - st.garbage_bytes, live.size());
+
+  ASSERT_TRUE(s.Compact());
+  st = s.Stats();
+  EXPECT_EQ(st.garbage_bytes, 0u);
+  EXPECT_EQ(st.compactions, 1u);
+
+  std::remove(path.c_str());
+}
+
+TEST(KVStoreTest, HotTierKeepsFrequentValuesInMemoryWithinBudget) {
+  const std::string path = "kvstore_hot_tier_test.aof";
+  std::remove(path.c_str());
+
+  kv::Options opts;
+  opts.hot_cache_bytes = 64;
+  kv::KVStore s(path, opts);
+
+  const std::string v16(16, 'x');
+  for (int i = 0; i < 20; i++) s.Put("k" + std::to_string(i), v16);
+
+  // Make k0..k2 hot; everything else is read once.
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 3; i++) EXPECT_EQ(*s.Get("k" + std::to_string(i)), v16);
+  }
+  for (int i = 3; i < 20; i++) EXPECT_EQ(*s.Get("k" + std::to_string(i)), v16);
+
+  auto st = s.Stats();
+  EXPECT_LE(st.hot_bytes, 64u);
+  EXPECT_GE(st.hot_keys, 3u);
+  EXPECT_GT(st.hot_hits, 20u);
+
+  // The frequent keys survived the one-off scan.
+  auto hits_before = st.hot_hits;
+  for (int i = 0; i < 3; i++) s.Get("k" + std::to_string(i));
+  EXPECT_EQ(s.Stats().hot_hits, hits_before + 3);
+
+  // Writes go through to the log and keep the key hot.
+  s.Put("k0", "new");
+  EXPECT_EQ(*s.Get("k0"), "new");
+  s.Del("k1");
+  EXPECT_FALSE(s.Get("k1").has_value());
+  s.Close();
+
+  kv::KVStore s2(path, opts);
+  EXPECT_EQ(*s2.Get("k0"), "new");
+  EXPECT_FALSE(s2.Get("k1").has_value());
+  EXPECT_EQ(*s2.Get("k2"), v16);
+
+  std::remove(path.c_str());
+}
+
+TEST(KVStoreTest, ChecksumsCatchCorruptValues) {
+  const std::string path = "kvstore_checksum_test.aof";
+  std::remove(path.c_str());
+
+  kv::Options opts;
+  opts.verify_checksums = true;
+  uint64_t value_offset = 0;
+  {
+    kv::KVStore s(path, opts);
+    s.Put("a", "alpha");
+    value_offset = std::filesystem::file_size(path);
+    s.Put("b", "bravo");
+    s.Put("c", "charlie");
+  }
+  value_offset += kv::PutHeaderSize("b", 5);
+
+  // Flip one byte of b's value in place: framing stays intact.
+  {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(static_cast<std::streamoff>(value_offset));
+    f.put('X');
+  }
+
+  {
+    kv::KVStore s(path, opts);
+    // Replay skipped the bad record but kept everything after it.
+    EXPECT_FALSE(s.Get("b").has_value());
+    EXPECT_EQ(*s.Get("a"), "alpha");
+    EXPECT_EQ(*s.Get("c"), "charlie");
+    auto st = s.Stats();
+    EXPECT_EQ(st.checksum_failures, 1u);
+    EXPECT_EQ(st.checksum_verifies, 2u);
+  }
+
+  // Corruption after startup is caught by verify-on-read.
+  kv::KVStore s(path, opts);
+  s.Put("d", "delta");
+  {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(-2, std::ios::end);
+    f.put('X');
+  }
+  EXPECT_FALSE(s.Get("d").has_value());
+  EXPECT_EQ(s.Stats().checksum_failures, 2u);  // b at replay, d on read
+  EXPECT_FALSE(s.Compact());  // refuses to rewrite the damaged value
+  EXPECT_EQ(*s.Get("a"), "alpha");
+
+  std::remove(path.c_str());
+}
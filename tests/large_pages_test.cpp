@@ -0,0 +1,68 @@
+#include "kvstore/large_pages.h"
+#include "kvstore/cuckoo_map.h"
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+TEST(LargePagesTest, ArenaReusesFreedBlocksAndMapsLargeOnes) {
+  kv::MemoryPlacement placement{kv::HugePages::kTransparent, kv::CurrentNumaNode()};
+  kv::LargePageArena arena(placement);
+  void* a = arena.Allocate(40);
+  void* b = arena.Allocate(40);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % 16, 0u);
+  EXPECT_EQ(static_cast<char*>(b) - static_cast<char*>(a), 48);
+  EXPECT_EQ(arena.mapped_bytes(), kv::LargePageArena::kChunkBytes);
+  arena.Deallocate(a, 40);
+  EXPECT_EQ(arena.Allocate(33), a);  // same size class
+
+  void* big = arena.Allocate(3u << 20);
+  ASSERT_NE(big, nullptr);
+  static_cast<char*>(big)[(3u << 20) - 1] = 1;
+  EXPECT_EQ(arena.mapped_bytes(), kv::LargePageArena::kChunkBytes + (4u << 20));
+  arena.Deallocate(big, 3u << 20);
+  EXPECT_EQ(arena.mapped_bytes(), kv::LargePageArena::kChunkBytes);
+
+  using Alloc = kv::ArenaAllocator<std::pair<const std::string, int>>;
+  std::unordered_map<std::string, int, std::hash<std::string>, std::equal_to<std::string>, Alloc> m(
+      0, std::hash<std::string>(), std::equal_to<std::string>(),
+      Alloc(std::make_shared<kv::LargePageArena>(placement)));
+  for (int i = 0; i < 100000; i++) m["key" + std::to_string(i)] = i;
+  for (int i = 0; i < 100000; i += 2) m.erase("key" + std::to_string(i));
+  EXPECT_EQ(m.size(), 50000u);
+  EXPECT_EQ(m["key99999"], 99999);
+
+  kv::CuckooMap<int> c(0, placement);
+  for (int i = 0; i < 100000; i++) c.Put("key" + std::to_string(i), i);
+  int v = 0;
+  ASSERT_TRUE(c.Find("key4242", &v));
+  EXPECT_EQ(v, 4242);
+}
+
+TEST(LargePagesTest, StoreWorksWithPlacedIndex) {
+  const std::string path = "kvstore_large_pages_test.aof";
+  std::remove(path.c_str());
+  for (bool concurrent : {false, true}) {
+    kv::Options opts;
+    opts.huge_pages = kv::HugePages::kExplicit;  // falls back without a hugetlb pool
+    opts.numa_node = 0;
+    opts.concurrent_index = concurrent;
+    {
+      kv::KVStore s(path, opts);
+      for (int i = 0; i < 20000; i++) s.Put("k" + std::to_string(i), "v" + std::to_string(i));
+      for (int i = 0; i < 20000; i += 2) s.Del("k" + std::to_string(i));
+      ASSERT_TRUE(s.Compact());
+    }
+    kv::KVStore s(path, opts);
+    EXPECT_EQ(s.Stats().keys, 10000u);
+    EXPECT_EQ(*s.Get("k1"), "v1");
+    EXPECT_FALSE(s.Get("k2").has_value());
+
+    kv::KVStore mem(opts);
+    mem.Put("a", "1");
+    EXPECT_EQ(*mem.Get("a"), "1");
+    std::remove(path.c_str());
+  }
+}
@@ -0,0 +1,120 @@
+#include "kvstore/local_transport.h"
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// The server's handler, minus namespaces: "ns" other than "" is unknown.
+kv::LocalResponse Handle(kv::KVStore* store, const kv::LocalRequest& req) {
+  kv::LocalResponse resp;
+  if (!req.ns.empty()) return resp;
+  switch (req.op) {
+    case kv::LocalOp::kGet:
+      if (auto v = store->Get(req.key)) {
+        resp.status = kv::LocalStatus::kOk;
+        resp.value = std::move(*v);
+      } else {
+        resp.status = kv::LocalStatus::kNotFound;
+      }
+      break;
+    case kv::LocalOp::kPut:
+      resp.status = store->Put(req.key, req.value) ? kv::LocalStatus::kOk : kv::LocalStatus::kError;
+      break;
+    case kv::LocalOp::kDel:
+      resp.status = store->Del(req.key) ? kv::LocalStatus::kOk : kv::LocalStatus::kNotFound;
+      break;
+    default:
+      break;
+  }
+  return resp;
+}
+
+}  // namespace
+
+TEST(LocalTransportTest, SocketAndSharedMemoryClientsSeeOneStore) {
+  const std::string path = "kvstore_local_test.sock";
+  kv::KVStore store;
+  kv::LocalServer server([&](const kv::LocalRequest& req) { return Handle(&store, req); });
+  std::string err;
+  ASSERT_TRUE(server.Listen(path, &err)) << err;
+
+  kv::LocalClient uds, shm;
+  ASSERT_TRUE(uds.Connect(path, false, &err)) << err;
+  ASSERT_TRUE(shm.Connect(path, true, &err)) << err;
+
+  EXPECT_EQ(uds.Put("a", "1"), kv::LocalStatus::kOk);
+  std::string v;
+  EXPECT_EQ(shm.Get("a", &v), kv::LocalStatus::kOk);
+  EXPECT_EQ(v, "1");
+  const std::string big(1 << 20, 'x');  // wraps the ring after a few rounds
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(shm.Put("big", big + std::to_string(i)), kv::LocalStatus::kOk);
+    ASSERT_EQ(uds.Get("big", &v), kv::LocalStatus::kOk);
+    ASSERT_EQ(v, big + std::to_string(i));
+    ASSERT_EQ(shm.Get("big", &v), kv::LocalStatus::kOk);
+    ASSERT_EQ(v.size(), big.size() + 1);
+  }
+  EXPECT_EQ(shm.Put("huge", std::string(kv::LocalServer::kRingBytes, 'x')), kv::LocalStatus::kError);
+  EXPECT_EQ(shm.Del("a"), kv::LocalStatus::kOk);
+  EXPECT_EQ(uds.Del("a"), kv::LocalStatus::kNotFound);
+  EXPECT_EQ(uds.Get("a", &v), kv::LocalStatus::kNotFound);
+  EXPECT_EQ(shm.Get("x", &v, "other"), kv::LocalStatus::kError);
+
+  // Concurrent clients, each with its own connection.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t]() {
+      kv::LocalClient c;
+      std::string e;
+      ASSERT_TRUE(c.Connect(path, t % 2 == 0, &e)) << e;
+      for (int i = 0; i < 200; i++) {
+        const std::string key = "t" + std::to_string(t) + "-" + std::to_string(i);
+        ASSERT_EQ(c.Put(key, key), kv::LocalStatus::kOk);
+        std::string got;
+        ASSERT_EQ(c.Get(key, &got), kv::LocalStatus::kOk);
+        ASSERT_EQ(got, key);
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+  EXPECT_EQ(store.Stats().keys, 801u);
+
+  server.Stop();
+  EXPECT_EQ(shm.Get("big", &v), kv::LocalStatus::kError);  // no hang once the server is gone
+  EXPECT_EQ(uds.Get("big", &v), kv::LocalStatus::kError);
+  std::remove(path.c_str());
+}
+
+TEST(LocalTransportTest, RingRejectsAFrameWithACorruptLength) {
+  constexpr size_t kData = 4096;
+  alignas(64) char mem[kv::ShmRing::kHeaderBytes + kData] = {};  // as a mapping would be
+  char* data = mem + kv::ShmRing::kHeaderBytes;
+  std::string body;
+  {
+    kv::ShmRing ring(mem, sizeof(mem));
+    ASSERT_TRUE(ring.Write("hello"));
+    ASSERT_TRUE(ring.Read(&body, 0));
+    EXPECT_EQ(body, "hello");
+    ASSERT_TRUE(ring.Write("world"));
+    const uint32_t huge = 0xffffffffu;  // what a hostile peer could store
+    std::memcpy(data + 9, &huge, 4);
+    EXPECT_FALSE(ring.Read(&body, 0));
+    EXPECT_TRUE(ring.broken());
+    EXPECT_FALSE(ring.Read(&body, 0));
+  }
+  {
+    // Within max_frame(), but longer than what was produced.
+    std::memset(mem, 0, sizeof(mem));
+    kv::ShmRing ring(mem, sizeof(mem));
+    ASSERT_TRUE(ring.Write("abc"));
+    const uint32_t longer = 100;
+    std::memcpy(data, &longer, 4);
+    EXPECT_FALSE(ring.Read(&body, 0));
+    EXPECT_TRUE(ring.broken());
+  }
+}
@@ -0,0 +1,113 @@
+#include "kvstore/kvstore.h"
+#include "kvstore/log_tools.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+static void WriteSampleLog(const std::string& path) {
+  std::remove(path.c_str());
+  kv::KVStore s(path);
+  for (int i = 0; i < 50; i++) {
+    s.Put("hot", std::to_string(i));
+  }
+  s.Put("bin", std::string("a\0\n\"\xff", 5));
+  s.Put("gone", "x");
+  s.Del("gone");
+  s.Close();
+}
+
+TEST(LogToolsTest, DumpAndLoadRoundTrip) {
+  const std::string path = "log_tools_dump_test.aof";
+  const std::string restored = "log_tools_dump_restored.aof";
+  WriteSampleLog(path);
+
+  for (auto fmt : {kv::DumpFormat::kBinary, kv::DumpFormat::kJsonLines}) {
+    std::remove(restored.c_str());
+    std::stringstream dump;
+    std::string err;
+    ASSERT_TRUE(kv::DumpLog(path, fmt, dump, 4, &err)) << err;
+
+    uint64_t loaded = 0;
+    ASSERT_TRUE(kv::LoadDump(dump, fmt, restored, &loaded, &err)) << err;
+    EXPECT_EQ(loaded, 2u);
+
+    kv::KVStore s(restored);
+    EXPECT_EQ(*s.Get("hot"), "49");
+    EXPECT_EQ(*s.Get("bin"), std::string("a\0\n\"\xff", 5));
+    EXPECT_FALSE(s.Get("gone").has_value());
+  }
+
+  std::remove(path.c_str());
+  std::remove(restored.c_str());
+}
+
+TEST(LogToolsTest, LoadRejectsKeysTheLogCannotHold) {
+  const std::string restored = "log_tools_bad_key.aof";
+  std::remove(restored.c_str());
+  std::stringstream dump("{\"key\":\"ok\",\"value\":\"1\"}\n{\"key\":\"two words\",\"value\":\"2\"}\n");
+  std::string err;
+  EXPECT_FALSE(kv::LoadDump(dump, kv::DumpFormat::kJsonLines, restored, nullptr, &err));
+  EXPECT_NE(err.find("line 2"), std::string::npos) << err;
+
+  kv::KVStore s(restored);
+  EXPECT_FALSE(s.Put("a\nb", "x"));
+  EXPECT_FALSE(s.Put("", "x"));
+  kv::WriteBatch batch;
+  batch.Put("fine", "1");
+  batch.Del("not fine");
+  EXPECT_FALSE(s.Write(batch));
+  EXPECT_FALSE(s.Get("fine").has_value());
+  std::remove(restored.c_str());
+}
+
+TEST(LogToolsTest, VerifyReportsFirstBadOffset) {
+  const std::string path = "log_tools_verify_test.aof";
+  WriteSampleLog(path);
+
+  auto good = kv::VerifyLog(path, 4);
+  EXPECT_TRUE(good.ok);
+  EXPECT_EQ(good.records, 53u);
+
+  auto valid_size = std::filesystem::file_size(path);
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << "PUT torn 10\nabc";
+  }
+
+  auto bad = kv::VerifyLog(path, 4);
+  EXPECT_FALSE(bad.ok);
+  EXPECT_EQ(bad.first_bad_offset, valid_size);
+  EXPECT_EQ(bad.reason, "truncated");
+
+  std::remove(path.c_str());
+}
+
+TEST(LogToolsTest, StatsAndOfflineCompaction) {
+  const std::string path = "log_tools_compact_test.aof";
+  WriteSampleLog(path);
+
+  kv::LogStats before;
+  ASSERT_TRUE(kv::ComputeLogStats(path, &before));
+  EXPECT_EQ(before.live_keys, 2u);
+  EXPECT_EQ(before.scan.dels, 1u);
+  EXPECT_GT(before.garbage_ratio, 0.5);
+
+  std::string err;
+  ASSERT_TRUE(kv::CompactLogFile(path, path, 4, &err)) << err;
+
+  kv::LogStats after;
+  ASSERT_TRUE(kv::ComputeLogStats(path, &after));
+  EXPECT_EQ(after.live_keys, 2u);
+  EXPECT_EQ(after.scan.records, 2u);
+  EXPECT_DOUBLE_EQ(after.garbage_ratio, 0.0);
+
+  kv::KVStore s(path);
+  EXPECT_EQ(*s.Get("hot"), "49");
+
+  std::remove(path.c_str());
+}
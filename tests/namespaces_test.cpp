@@ -0,0 +1,146 @@
+#include "kvstore/namespaces.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+
+TEST(NamespacesTest, NamespacesAreIndependent) {
+  kv::NamespaceStore ns;
+  ASSERT_NE(ns.Open("a"), nullptr);
+  ASSERT_NE(ns.Open("b"), nullptr);
+  EXPECT_EQ(ns.Open("../x"), nullptr);
+  EXPECT_EQ(ns.Open("_batches"), nullptr);
+
+  ns.Open("a")->Put("k", "from-a");
+  ns.Open("b")->Put("k", "from-b");
+  EXPECT_EQ(*ns.Find("a")->Get("k"), "from-a");
+  EXPECT_EQ(*ns.Find("b")->Get("k"), "from-b");
+  EXPECT_EQ(ns.Find("c"), nullptr);
+}
+
+TEST(NamespacesTest, CrossNamespaceBatchSurvivesRestart) {
+  namespace fs = std::filesystem;
+  const std::string dir = "namespaces_batch_test";
+  fs::remove_all(dir);
+
+  {
+    kv::NamespaceStore ns(dir);
+    ASSERT_TRUE(ns.Write({{"orders", "o1", std::string("paid")},
+                          {"users", "u1", std::string("has-o1")},
+                          {"users", "u0", std::nullopt}}));
+  }
+
+  // Crash after the commit point but before any namespace log saw the batch:
+  // the redo slot alone must bring both namespaces forward.
+  {
+    std::ofstream out(fs::path(dir) / "_batches.aof", std::ios::binary | std::ios::app);
+    out << "BEGIN 2\nPUT orders/o2 7\nshipped\nPUT users/u2 6\nhas-o2\n";
+  }
+  // A torn batch was never committed and must not show up anywhere.
+  {
+    std::ofstream out(fs::path(dir) / "_batches.aof", std::ios::binary | std::ios::app);
+    out << "BEGIN 2\nPUT orders/o3 4\nlost\n";
+  }
+
+  {
+    kv::NamespaceStore ns(dir);
+    EXPECT_EQ(*ns.Find("orders")->Get("o1"), "paid");
+    EXPECT_EQ(*ns.Find("users")->Get("u1"), "has-o1");
+    EXPECT_EQ(*ns.Find("orders")->Get("o2"), "shipped");
+    EXPECT_EQ(*ns.Find("users")->Get("u2"), "has-o2");
+    EXPECT_FALSE(ns.Find("orders")->Get("o3").has_value());
+    EXPECT_EQ(fs::file_size(fs::path(dir) / "_batches.aof"), 0u);
+  }
+
+  fs::remove_all(dir);
+}
+
+TEST(NamespacesTest, BatchWithABadKeyChangesNothing) {
+  namespace fs = std::filesystem;
+  const std::string dir = "namespaces_bad_batch_test";
+  fs::remove_all(dir);
+
+  {
+    kv::NamespaceStore ns(dir);
+    ASSERT_TRUE(ns.Open("a")->Put("k", "old"));
+    EXPECT_FALSE(ns.Write({{"a", "k", std::string("new")}, {"b", "bad key", std::string("x")}}));
+    EXPECT_EQ(*ns.Find("a")->Get("k"), "old");
+    EXPECT_EQ(fs::file_size(fs::path(dir) / "_batches.aof"), 0u);
+    ASSERT_TRUE(ns.Find("a")->Put("k", "newer"));
+  }
+  kv::NamespaceStore ns(dir);
+  EXPECT_EQ(*ns.Find("a")->Get("k"), "newer");
+  EXPECT_EQ(ns.Find("b"), nullptr);
+
+  fs::remove_all(dir);
+}
+
+TEST(NamespacesTest, CompactDueFollowsPerNamespacePolicy) {
+  namespace fs = std::filesystem;
+  const std::string dir = "namespaces_compact_test";
+  fs::remove_all(dir);
+
+  kv::NamespaceStore ns(dir);
+  kv::CompactionPolicy eager;
+  eager.min_garbage_ratio = 0.5;
+  eager.min_garbage_bytes = 0;
+  ns.SetCompactionPolicy("churn", eager);
+
+  for (int i = 0; i < 100; i++) {
+    ns.Open("churn")->Put("hot", std::to_string(i));
+    ns.Open("quiet")->Put("k" + std::to_string(i), "v");
+  }
+
+  auto compacted = ns.CompactDue();
+  ASSERT_EQ(compacted.size(), 1u);
+  EXPECT_EQ(compacted[0], "churn");
+  EXPECT_EQ(ns.Find("churn")->Stats().compactions, 1u);
+  EXPECT_EQ(ns.Find("quiet")->Stats().compactions, 0u);
+  EXPECT_EQ(*ns.Find("churn")->Get("hot"), "99");
+
+  fs::remove_all(dir);
+}
+
+TEST(NamespacesTest, ManifestDecidesWhichNamespacesOpen) {
+  namespace fs = std::filesystem;
+  const std::string dir = "namespaces_manifest_test";
+  fs::remove_all(dir);
+
+  // A directory from before the manifest is listed once and adopted.
+  fs::create_directories(dir);
+  { kv::KVStore("namespaces_manifest_test/legacy.aof").Put("k", "old"); }
+  {
+    kv::NamespaceStore ns(dir);
+    EXPECT_EQ(*ns.Find("legacy")->Get("k"), "old");
+    for (int i = 0; i < 70; i++) ns.Open("t" + std::to_string(i))->Put("k", std::to_string(i));
+  }
+  EXPECT_TRUE(fs::exists(fs::path(dir) / "MANIFEST"));
+
+  // A stray log is not a namespace; a torn edit at the tail is cut off.
+  { kv::KVStore("namespaces_manifest_test/stray.aof").Put("k", "v"); }
+  {
+    std::ofstream m(fs::path(dir) / "MANIFEST", std::ios::binary | std::ios::app);
+    m << "add half";
+  }
+  {
+    kv::NamespaceStore ns(dir);
+    EXPECT_EQ(ns.Names().size(), 71u);
+    EXPECT_EQ(ns.Find("stray"), nullptr);
+    EXPECT_EQ(*ns.Find("t69")->Get("k"), "69");
+    ASSERT_NE(ns.Open("fresh"), nullptr);
+  }
+
+  kv::Manifest m;
+  std::string err;
+  ASSERT_TRUE(m.Open(dir, &err)) << err;
+  EXPECT_EQ(m.files().size(), 72u);
+  EXPECT_EQ(m.files().at("fresh"), "fresh.aof");
+  EXPECT_LT(m.edits_since_checkpoint(), static_cast<uint64_t>(kv::Manifest::kCheckpointEdits));
+
+  // A listed log that has gone missing is an error, not an empty namespace.
+  fs::remove(fs::path(dir) / "t5.aof");
+  EXPECT_THROW(kv::NamespaceStore ns(dir), std::runtime_error);
+
+  fs::remove_all(dir);
+}
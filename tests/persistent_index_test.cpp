@@ -0,0 +1,109 @@
+#include "kvstore/kvstore.h"
+#include "kvstore/persistent_index.h"
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+
+static kv::Options IndexedOptions() {
+  kv::Options opts;
+  opts.persistent_index = true;
+  return opts;
+}
+
+static void RemoveStore(const std::string& path) {
+  for (const char* suffix : {"", ".idx", ".idx.compact", ".tmp", ".dict"}) {
+    std::remove((path + suffix).c_str());
+  }
+}
+
+TEST(PersistentIndexTest, SurvivesReopenAndGrows) {
+  const std::string path = "pindex_reopen_test.aof";
+  RemoveStore(path);
+  {
+    kv::KVStore s(path, IndexedOptions());
+    for (int i = 0; i < 3000; i++) s.Put("key" + std::to_string(i), "v" + std::to_string(i));
+    s.Put("key7", "seven");
+    s.Del("key8");
+    EXPECT_EQ(*s.Get("key7"), "seven");
+    EXPECT_FALSE(s.Get("key8").has_value());
+    EXPECT_EQ(s.Stats().keys, 2999u);
+  }
+  ASSERT_TRUE(std::filesystem::exists(path + ".idx"));
+
+  kv::KVStore s(path, IndexedOptions());
+  EXPECT_EQ(s.Stats().keys, 2999u);
+  EXPECT_EQ(*s.Get("key2999"), "v2999");
+  EXPECT_EQ(*s.Get("key7"), "seven");
+  EXPECT_FALSE(s.Get("key8").has_value());
+  EXPECT_FALSE(s.Get("nope").has_value());
+
+  // The table is only trusted for the log it was built from.
+  s.Close();
+  std::filesystem::copy_file(path, path + ".copy", std::filesystem::copy_options::overwrite_existing);
+  std::filesystem::rename(path + ".copy", path);
+  kv::KVStore rebuilt(path, IndexedOptions());
+  EXPECT_EQ(*rebuilt.Get("key7"), "seven");
+  EXPECT_EQ(rebuilt.Stats().keys, 2999u);
+}
+
+TEST(PersistentIndexTest, CrashReplaysTailAndRecounts) {
+  const std::string path = "pindex_crash_test.aof";
+  RemoveStore(path);
+  {
+    kv::KVStore s(path, IndexedOptions());
+    for (int i = 0; i < 100; i++) s.Put("k" + std::to_string(i), "before");
+  }
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // No destructor, no checkpoint: the table is left marked unclean.
+    auto* s = new kv::KVStore(path, IndexedOptions());
+    for (int i = 0; i < 50; i++) s->Put("k" + std::to_string(i), "after");
+    for (int i = 50; i < 60; i++) s->Del("k" + std::to_string(i));
+    s->Put("new", "key");
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status));
+
+  kv::KVStore s(path, IndexedOptions());
+  EXPECT_EQ(s.Stats().keys, 91u);
+  EXPECT_EQ(*s.Get("k0"), "after");
+  EXPECT_EQ(*s.Get("k99"), "before");
+  EXPECT_FALSE(s.Get("k55").has_value());
+  EXPECT_EQ(*s.Get("new"), "key");
+}
+
+TEST(PersistentIndexTest, CompactionRewritesLogAndTable) {
+  const std::string path = "pindex_compact_test.aof";
+  RemoveStore(path);
+  {
+    kv::KVStore s(path, IndexedOptions());
+    for (int round = 0; round < 5; round++) {
+      for (int i = 0; i < 200; i++) s.Put("k" + std::to_string(i), "r" + std::to_string(round));
+    }
+    for (int i = 0; i < 100; i++) s.Del("k" + std::to_string(i));
+    uint64_t before = s.Stats().log_bytes;
+    ASSERT_TRUE(s.Compact());
+    kv::StoreStats st = s.Stats();
+    EXPECT_LT(st.log_bytes, before / 5);
+    EXPECT_EQ(st.garbage_bytes, 0u);
+    EXPECT_EQ(st.keys, 100u);
+    EXPECT_EQ(*s.Get("k150"), "r4");
+    EXPECT_FALSE(s.Get("k50").has_value());
+    s.Put("k0", "fresh");
+    EXPECT_TRUE(s.Scrub().clean());
+  }
+  EXPECT_FALSE(std::filesystem::exists(path + ".idx.compact"));
+
+  kv::KVStore s(path, IndexedOptions());
+  EXPECT_EQ(s.Stats().keys, 101u);
+  EXPECT_EQ(*s.Get("k0"), "fresh");
+  EXPECT_EQ(*s.Get("k199"), "r4");
+}
@@ -0,0 +1,248 @@
+#include "kvstore/raft.h"
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+int FreePort() {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+  ::close(fd);
+  return ntohs(addr.sin_port);
+}
+
+bool WaitFor(const std::function<bool()>& done, int ms = 10000) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+// A group of nodes in this process, talking over loopback TCP.
+class Cluster {
+ public:
+  Cluster(const std::string& dir, int n, uint64_t snapshot_entries = 100000) : dir_(dir) {
+    fs::remove_all(dir);
+    for (int i = 1; i <= n; i++) peers_.push_back(kv::RaftPeer{i, "127.0.0.1", FreePort()});
+    snapshot_entries_ = snapshot_entries;
+    nodes_.resize(static_cast<size_t>(n));
+    for (int i = 1; i <= n; i++) Start(i);
+  }
+  ~Cluster() { fs::remove_all(dir_); }
+
+  void Start(int id) {
+    kv::RaftOptions o;
+    o.id = id;
+    o.peers = peers_;
+    o.dir = dir_ + "/node" + std::to_string(id);
+    o.heartbeat = std::chrono::milliseconds(20);
+    o.election_timeout = std::chrono::milliseconds(150);
+    o.snapshot_entries = snapshot_entries_;
+    o.snapshot_chunk_bytes = 4096;  // several chunks per snapshot
+    auto& node = nodes_[static_cast<size_t>(id - 1)];
+    node = std::make_unique<kv::RaftNode>(o);
+    std::string err;
+    ASSERT_TRUE(node->Start(&err)) << err;
+  }
+  void Stop(int id) { nodes_[static_cast<size_t>(id - 1)].reset(); }
+  int port(int id) const { return peers_[static_cast<size_t>(id - 1)].port; }
+  kv::RaftNode* node(int id) { return nodes_[static_cast<size_t>(id - 1)].get(); }
+
+  // The one leader of the highest term, once there is one.
+  kv::RaftNode* Leader() {
+    kv::RaftNode* leader = nullptr;
+    WaitFor([&]() {
+      leader = nullptr;
+      for (auto& n : nodes_) {
+        if (n && n->Status().role == kv::RaftRole::kLeader && n->Status().lease_ms > 0) leader = n.get();
+      }
+      return leader != nullptr;
+    });
+    return leader;
+  }
+
+ private:
+  std::string dir_;
+  std::vector<kv::RaftPeer> peers_;
+  uint64_t snapshot_entries_ = 0;
+  std::vector<std::unique_ptr<kv::RaftNode>> nodes_;
+};
+
+}  // namespace
+
+TEST(RaftTest, ParsesPeers) {
+  std::vector<kv::RaftPeer> peers;
+  std::string err;
+  ASSERT_TRUE(kv::ParseRaftPeers("1=127.0.0.1:9101,2=localhost:9102", &peers, &err)) << err;
+  ASSERT_EQ(peers.size(), 2u);
+  EXPECT_EQ(peers[1].id, 2);
+  EXPECT_EQ(peers[1].host, "localhost");
+  EXPECT_EQ(peers[1].port, 9102);
+  EXPECT_FALSE(kv::ParseRaftPeers("1=127.0.0.1:9101,1=127.0.0.1:9102", &peers, &err));
+  EXPECT_FALSE(kv::ParseRaftPeers("127.0.0.1:9101", &peers, &err));
+}
+
+TEST(RaftTest, LeaderCommitsToEveryReplicaAndFollowersRefuseClients) {
+  Cluster c("raft_commit_test", 3);
+  kv::RaftNode* leader = c.Leader();
+  ASSERT_NE(leader, nullptr);
+
+  // Concurrent writers share AppendEntries batches and log syncs.
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.emplace_back([&, t]() {
+      for (int i = 0; i < 50; i++) {
+        std::string err;
+        const std::string key = "k" + std::to_string(t) + "-" + std::to_string(i);
+        EXPECT_TRUE(leader->Put(key, "v" + key, &err)) << err;
+      }
+    });
+  }
+  for (auto& w : writers) w.join();
+  bool existed = false;
+  std::string err;
+  ASSERT_TRUE(leader->Del("k0-0", &existed, &err)) << err;
+  EXPECT_TRUE(existed);
+  ASSERT_TRUE(leader->Del("k0-0", &existed, &err)) << err;
+  EXPECT_FALSE(existed);
+
+  std::optional<std::string> v;
+  ASSERT_TRUE(leader->Get("k3-49", &v, &err)) << err;
+  EXPECT_EQ(v, "vk3-49");
+  ASSERT_TRUE(leader->Get("k0-0", &v, &err)) << err;
+  EXPECT_FALSE(v);
+  const kv::RaftStatus s = leader->Status();
+  EXPECT_LT(s.log_syncs, 200u);  // grouped
+
+  for (int id = 1; id <= 3; id++) {
+    kv::RaftNode* n = c.node(id);
+    EXPECT_TRUE(WaitFor([&]() { return n->Status().applied_index == s.commit_index; })) << "node " << id;
+    EXPECT_EQ(n->GetLocal("k2-10"), "vk2-10");
+    EXPECT_FALSE(n->GetLocal("k0-0"));
+    if (n == leader) continue;
+    EXPECT_FALSE(n->Put("x", "y", &err));
+    EXPECT_EQ(err, "not leader");
+    EXPECT_FALSE(n->Get("x", &v, &err));
+    EXPECT_EQ(n->Status().leader, leader->id());
+  }
+}
+
+TEST(RaftTest, NewLeaderKeepsCommittedWritesAndRestartedNodeCatchesUp) {
+  Cluster c("raft_failover_test", 3);
+  kv::RaftNode* leader = c.Leader();
+  ASSERT_NE(leader, nullptr);
+  std::string err;
+  for (int i = 0; i < 20; i++) ASSERT_TRUE(leader->Put("a" + std::to_string(i), "1", &err)) << err;
+  const int old_id = leader->id();
+  const uint64_t old_term = leader->Status().term;
+  c.Stop(old_id);
+
+  kv::RaftNode* next = c.Leader();
+  ASSERT_NE(next, nullptr);
+  EXPECT_NE(next->id(), old_id);
+  EXPECT_GT(next->Status().term, old_term);
+  std::optional<std::string> v;
+  ASSERT_TRUE(next->Get("a19", &v, &err)) << err;
+  EXPECT_EQ(v, "1");
+  for (int i = 0; i < 20; i++) ASSERT_TRUE(next->Put("b" + std::to_string(i), "2", &err)) << err;
+
+  c.Start(old_id);  // from its own files, then the new leader's log
+  kv::RaftNode* back = c.node(old_id);
+  EXPECT_TRUE(WaitFor([&]() { return back->GetLocal("b19") == std::optional<std::string>("2"); }));
+  EXPECT_EQ(back->GetLocal("a0"), "1");
+  EXPECT_EQ(back->Status().leader, next->id());
+}
+
+// Sends a RequestVote straight to a node's peer port, as a candidate would;
+// returns the reply's granted flag, or -1 without a reply.
+static int RequestVote(int port, uint64_t term, uint32_t candidate, uint64_t last_index, uint64_t last_term) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  std::string msg(1, 'V');  // term, candidate, last log index and term
+  msg.append(reinterpret_cast<const char*>(&term), 8);
+  msg.append(reinterpret_cast<const char*>(&candidate), 4);
+  msg.append(reinterpret_cast<const char*>(&last_index), 8);
+  msg.append(reinterpret_cast<const char*>(&last_term), 8);
+  const uint32_t len = static_cast<uint32_t>(msg.size());
+  msg.insert(0, reinterpret_cast<const char*>(&len), 4);
+  char reply[4 + 1 + 8 + 1];
+  const bool ok = ::send(fd, msg.data(), msg.size(), 0) == static_cast<ssize_t>(msg.size()) &&
+                  ::recv(fd, reply, sizeof(reply), MSG_WAITALL) == static_cast<ssize_t>(sizeof(reply));
+  ::close(fd);
+  return ok ? reply[sizeof(reply) - 1] : -1;
+}
+
+TEST(RaftTest, RestartedFollowerWaitsOutTheLeaderLeaseBeforeVoting) {
+  Cluster c("raft_restart_vote_test", 3);
+  kv::RaftNode* leader = c.Leader();
+  ASSERT_NE(leader, nullptr);
+  std::string err;
+  ASSERT_TRUE(leader->Put("k", "v", &err)) << err;
+  const int follower = leader->id() % 3 + 1;
+  const int candidate = 6 - leader->id() - follower;
+  const uint64_t term = leader->Status().term;
+
+  c.Stop(follower);
+  c.Start(follower);
+  // The leader's lease may still run: no vote, however up to date the candidate.
+  EXPECT_EQ(RequestVote(c.port(follower), term + 1, static_cast<uint32_t>(candidate), 1000, term + 1), 0);
+  EXPECT_EQ(c.node(follower)->Status().term, term);
+}
+
+TEST(RaftTest, LaggingFollowerGetsTheSnapshot) {
+  Cluster c("raft_snapshot_test", 3, /*snapshot_entries=*/50);
+  kv::RaftNode* leader = c.Leader();
+  ASSERT_NE(leader, nullptr);
+  const int lagging = leader->id() % 3 + 1;
+  c.Stop(lagging);
+
+  std::string err;
+  for (int i = 0; i < 300; i++) {
+    ASSERT_TRUE(leader->Put("k" + std::to_string(i % 100), std::string(100, 'a' + i % 26), &err)) << err;
+  }
+  bool existed;
+  ASSERT_TRUE(leader->Del("k7", &existed, &err)) << err;
+  EXPECT_TRUE(WaitFor([&]() { return leader->Status().snapshots_taken > 0; }));
+  ASSERT_GT(leader->Status().snapshot_index, 1u);  // the follower's next entry is gone
+
+  c.Start(lagging);
+  kv::RaftNode* n = c.node(lagging);
+  const uint64_t commit = leader->Status().commit_index;
+  EXPECT_TRUE(WaitFor([&]() { return n->Status().applied_index >= commit; }));
+  EXPECT_EQ(n->Status().snapshots_installed, 1u);
+  EXPECT_EQ(n->GetLocal("k99"), std::string(100, 'a' + 299 % 26));
+  EXPECT_FALSE(n->GetLocal("k7"));
+
+  // It takes its own snapshots too, and comes back from them.
+  for (int i = 0; i < 100; i++) ASSERT_TRUE(leader->Put("z" + std::to_string(i), "z", &err)) << err;
+  EXPECT_TRUE(WaitFor([&]() { return n->Status().snapshots_taken > 0 && n->GetLocal("z99").has_value(); }));
+  c.Stop(lagging);
+  c.Start(lagging);
+  EXPECT_EQ(c.node(lagging)->GetLocal("k99"), std::string(100, 'a' + 299 % 26));
+  EXPECT_EQ(c.node(lagging)->GetLocal("z99"), "z");
+}
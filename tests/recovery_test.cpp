@@ -0,0 +1,105 @@
+#include "kvstore/kvstore.h"
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+
+static kv::Options BackgroundOptions() {
+  kv::Options opts;
+  opts.background_recovery = true;
+  return opts;
+}
+
+static void RemoveStore(const std::string& path) {
+  for (const char* suffix : {"", ".hint", ".hint.tmp", ".tmp"}) std::remove((path + suffix).c_str());
+}
+
+static void WaitReady(const kv::KVStore& s) {
+  while (!s.Recovery().ready && !s.Recovery().failed) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+TEST(RecoveryTest, ReadsAreServedFromHintWhileReplaying) {
+  const std::string path = "recovery_hint_test.aof";
+  RemoveStore(path);
+  constexpr int kKeys = 50000;
+  {
+    kv::KVStore s(path, BackgroundOptions());
+    for (int i = 0; i < kKeys; i++) s.Put("key" + std::to_string(i), "v" + std::to_string(i));
+    s.Del("key1");
+  }
+  ASSERT_TRUE(std::filesystem::exists(path + ".hint"));
+
+  kv::KVStore s(path, BackgroundOptions());
+  kv::RecoveryStatus st = s.Recovery();
+  EXPECT_TRUE(st.ready || st.total_bytes > 0);
+  EXPECT_EQ(*s.Get("key0"), "v0");
+  EXPECT_FALSE(s.Get("key1").has_value());
+  EXPECT_EQ(*s.Get("key" + std::to_string(kKeys - 1)), "v" + std::to_string(kKeys - 1));
+  EXPECT_FALSE(s.Get("missing").has_value());
+
+  // Writes wait for the replay rather than racing it.
+  EXPECT_TRUE(s.Put("key0", "new"));
+  st = s.Recovery();
+  EXPECT_TRUE(st.ready);
+  EXPECT_EQ(st.replayed_bytes, st.total_bytes);
+  EXPECT_EQ(*s.Get("key0"), "new");
+  EXPECT_EQ(s.Stats().keys, static_cast<uint64_t>(kKeys - 1));
+}
+
+TEST(RecoveryTest, LogPastTheHintIsApplied) {
+  const std::string path = "recovery_tail_test.aof";
+  RemoveStore(path);
+  {
+    kv::KVStore s(path, BackgroundOptions());
+    for (int i = 0; i < 100; i++) s.Put("k" + std::to_string(i), "old");
+    ASSERT_TRUE(s.Compact());  // writes a hint covering everything so far
+  }
+
+  // Crash after more writes: the hint on disk is the one from Compact().
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    auto* s = new kv::KVStore(path, BackgroundOptions());
+    s->Put("k1", "new");
+    s->Del("k2");
+    s->Put("k200", "added");
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status));
+
+  kv::KVStore s(path, BackgroundOptions());
+  EXPECT_EQ(*s.Get("k0"), "old");
+  EXPECT_EQ(*s.Get("k1"), "new");
+  EXPECT_FALSE(s.Get("k2").has_value());
+  EXPECT_EQ(*s.Get("k200"), "added");
+  WaitReady(s);
+  EXPECT_EQ(*s.Get("k1"), "new");
+  EXPECT_EQ(s.Stats().keys, 100u);
+}
+
+TEST(RecoveryTest, FailedReplayIsReportedAndRefusesWrites) {
+  const std::string path = "recovery_failed_test.aof";
+  RemoveStore(path);
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "PUT a 1\nx\nPUT b nonsense\n";
+  }
+  kv::KVStore s(path, BackgroundOptions());
+  WaitReady(s);
+  kv::RecoveryStatus st = s.Recovery();
+  EXPECT_TRUE(st.failed);
+  EXPECT_FALSE(st.error.empty());
+  EXPECT_FALSE(s.Get("a").has_value());
+  EXPECT_FALSE(s.Put("c", "y"));
+  EXPECT_FALSE(s.Compact());
+}
@@ -0,0 +1,123 @@
+#include "kvstore/kvstore.h"
+#include "kvstore/log_tools.h"
+#include "kvstore/sorted_table.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+static kv::Options SortedOptions() {
+  kv::Options opts;
+  opts.sorted_table = true;
+  return opts;
+}
+
+static std::string Key(int i) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "user:%08d", i);  // zero-padded, so key order is numeric order
+  return buf;
+}
+
+TEST(SortedTableTest, CompactFromLogServesGetsAndScans) {
+  const std::string log = "sorted_build_test.aof";
+  const std::string table = "sorted_build_test.sst";
+  for (const auto& p : {log, log + ".dict", table}) std::remove(p.c_str());
+
+  constexpr int kKeys = 30000;
+  {
+    kv::Options opts;
+    opts.compress_min_bytes = 32;
+    kv::KVStore s(log, opts);
+    for (int i = kKeys - 1; i >= 0; i--) s.Put(Key(i), "old");  // written out of order
+    for (int i = 0; i < kKeys; i += 3) s.Put(Key(i), std::string(100, 'a' + i % 26) + std::to_string(i));
+    s.Del(Key(7));
+    s.Put("a", "first");
+  }
+
+  kv::SortedBuildReport rep;
+  std::string err;
+  ASSERT_TRUE(kv::CompactToSortedTable(log, table, 4, &rep, &err)) << err;
+  EXPECT_EQ(rep.keys, static_cast<uint64_t>(kKeys));  // -Key(7), +"a"
+  EXPECT_GT(rep.blocks, 1u);
+  EXPECT_LT(rep.resident_bytes * 10, rep.file_bytes);  // index and filter only
+
+  kv::KVStore s(table, SortedOptions());
+  EXPECT_EQ(s.Stats().keys, static_cast<uint64_t>(kKeys));
+  for (int i = 0; i < kKeys; i++) {
+    auto v = s.Get(Key(i));
+    if (i == 7) {
+      EXPECT_FALSE(v.has_value());
+    } else {
+      ASSERT_TRUE(v.has_value()) << i;
+      EXPECT_EQ(*v, i % 3 == 0 ? std::string(100, 'a' + i % 26) + std::to_string(i) : "old");
+    }
+  }
+  EXPECT_EQ(*s.Get("a"), "first");
+  EXPECT_FALSE(s.Get("user:").has_value());    // a prefix of every key
+  EXPECT_FALSE(s.Get("zzz").has_value());      // past the last block
+  auto multi = s.MultiGet({Key(0), "nope", Key(1)});
+  EXPECT_TRUE(multi[0] && !multi[1] && multi[2]);
+
+  // A range crossing many blocks and restart points, then an early stop.
+  std::vector<std::string> keys;
+  EXPECT_TRUE(s.Scan(Key(5), Key(9005), [&](const std::string& k, const std::string&) {
+    keys.push_back(k);
+    return true;
+  }));
+  ASSERT_EQ(keys.size(), 8999u);  // 5..9004 without 7
+  EXPECT_EQ(keys.front(), Key(5));
+  EXPECT_EQ(keys[2], Key(8));
+  EXPECT_EQ(keys.back(), Key(9004));
+  int seen = 0;
+  EXPECT_TRUE(s.Scan("", "", [&](const std::string&, const std::string&) { return ++seen < 10; }));
+  EXPECT_EQ(seen, 10);
+
+  EXPECT_FALSE(s.Put(Key(0), "x"));
+  EXPECT_FALSE(s.Del(Key(0)));
+  EXPECT_TRUE(s.Compact());
+  EXPECT_EQ(*s.Get(Key(1)), "old");
+
+  kv::KVStore mem;
+  EXPECT_FALSE(mem.Scan("", "", [](const std::string&, const std::string&) { return true; }));
+}
+
+TEST(SortedTableTest, WriterRejectsUnorderedKeysAndDamageIsDetected) {
+  const std::string table = "sorted_damage_test.sst";
+  std::remove(table.c_str());
+  std::string err;
+  kv::SortedTableWriter w;
+  ASSERT_TRUE(w.Open(table, &err)) << err;
+  EXPECT_TRUE(w.Add("a", "alpha"));
+  EXPECT_FALSE(w.Add("a", "again"));
+  EXPECT_TRUE(w.Add("b", "bravo"));
+  ASSERT_TRUE(w.Finish(&err)) << err;
+
+  // Overwrite a byte of "bravo" in the only block.
+  {
+    std::fstream f(table, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(16);  // each entry is 3 varint bytes, a 1-byte key and 5 value bytes
+    f.put('X');
+  }
+  kv::Options opts = SortedOptions();
+  opts.verify_checksums = true;
+  {
+    kv::KVStore s(table, opts);
+    EXPECT_FALSE(s.Get("a").has_value());
+    EXPECT_EQ(s.Stats().checksum_failures, 1u);
+    EXPECT_FALSE(s.Scan("", "", [](const std::string&, const std::string&) { return true; }));
+  }
+  kv::KVStore unchecked(table, SortedOptions());
+  EXPECT_EQ(*unchecked.Get("a"), "alpha");
+
+  // A damaged footer, or a file that is not a table, is refused.
+  {
+    std::fstream f(table, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(-10, std::ios::end);
+    f.put('\x7f');
+  }
+  kv::SortedTable t;
+  EXPECT_FALSE(t.Open(table, &err));
+  EXPECT_THROW(kv::KVStore(table, SortedOptions()), std::runtime_error);
+}
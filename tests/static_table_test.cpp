@@ -0,0 +1,103 @@
+#include "kvstore/kvstore.h"
+#include "kvstore/log_tools.h"
+#include "kvstore/static_table.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+
+static kv::Options StaticOptions() {
+  kv::Options opts;
+  opts.static_table = true;
+  return opts;
+}
+
+TEST(StaticTableTest, BuildFromLogAndServeReadOnly) {
+  const std::string log = "static_build_test.aof";
+  const std::string table = "static_build_test.kvs";
+  for (const auto& p : {log, log + ".dict", table}) std::remove(p.c_str());
+
+  constexpr int kKeys = 20000;
+  {
+    kv::Options opts;
+    opts.compress_min_bytes = 32;
+    kv::KVStore s(log, opts);
+    for (int i = 0; i < kKeys; i++) s.Put("key" + std::to_string(i), "old");
+    for (int i = 0; i < kKeys; i += 2) {
+      s.Put("key" + std::to_string(i), std::string(100, 'a' + i % 26) + std::to_string(i));
+    }
+    s.Del("key7");
+    s.Put("bin", std::string("a\0\n\xff", 4));
+  }
+
+  kv::StaticBuildReport rep;
+  std::string err;
+  ASSERT_TRUE(kv::BuildStaticTable(log, table, 4, &rep, &err)) << err;
+  EXPECT_EQ(rep.keys, static_cast<uint64_t>(kKeys));  // -key7, +bin
+  EXPECT_LT(rep.index_bits_per_key, 6.0);
+
+  kv::KVStore s(table, StaticOptions());
+  EXPECT_EQ(s.Stats().keys, static_cast<uint64_t>(kKeys));
+  for (int i = 0; i < kKeys; i++) {
+    auto v = s.Get("key" + std::to_string(i));
+    if (i == 7) {
+      EXPECT_FALSE(v.has_value());
+    } else if (i % 2 == 0) {
+      ASSERT_TRUE(v.has_value()) << i;
+      EXPECT_EQ(*v, std::string(100, 'a' + i % 26) + std::to_string(i));  // stored decoded
+    } else {
+      ASSERT_TRUE(v.has_value()) << i;
+      EXPECT_EQ(*v, "old");
+    }
+  }
+  EXPECT_EQ(*s.Get("bin"), std::string("a\0\n\xff", 4));
+  int false_hits = 0;
+  for (int i = 0; i < 100000; i++) false_hits += s.Get("absent" + std::to_string(i)).has_value();
+  EXPECT_EQ(false_hits, 0);
+  auto multi = s.MultiGet({"key0", "nope", "key1"});
+  EXPECT_TRUE(multi[0] && !multi[1] && multi[2]);
+
+  EXPECT_FALSE(s.Put("key0", "x"));
+  EXPECT_FALSE(s.Del("key0"));
+  EXPECT_EQ(*s.Get("key1"), "old");
+}
+
+TEST(StaticTableTest, DamageIsDetected) {
+  const std::string log = "static_damage_test.aof";
+  const std::string table = "static_damage_test.kvs";
+  for (const auto& p : {log, table}) std::remove(p.c_str());
+  {
+    kv::KVStore s(log);
+    s.Put("a", "alpha");
+    s.Put("b", "bravo");
+  }
+  std::string err;
+  ASSERT_TRUE(kv::BuildStaticTable(log, table, 1, nullptr, &err)) << err;
+
+  // Flip the last byte of the data section, which is the end of a value.
+  const auto size = std::filesystem::file_size(table);
+  {
+    std::fstream f(table, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(static_cast<std::streamoff>(size - 1));
+    f.put('X');
+  }
+  kv::Options opts = StaticOptions();
+  opts.verify_checksums = true;
+  kv::KVStore s(table, opts);
+  int served = s.Get("a").has_value() + s.Get("b").has_value();
+  EXPECT_EQ(served, 1);
+  EXPECT_EQ(s.Stats().checksum_failures, 1u);
+
+  // A damaged header, or a file that is not a table, is refused.
+  {
+    std::fstream f(table, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(20);
+    f.put('\x7f');
+  }
+  kv::StaticTable t;
+  EXPECT_FALSE(t.Open(table, &err));
+  EXPECT_FALSE(t.Open(log, &err));
+  EXPECT_THROW(kv::KVStore(log, StaticOptions()), std::runtime_error);
+}
@@ -0,0 +1,256 @@
+// Read scaling with same-host read-only followers: one kv_http_server writes
+// data/http.aof, N more tail it with --read-only-follower. Reports GET
+// throughput and p50/p99 latency against the writer alone and spread over
+// the writer and its followers, then the followers' lag (bytes and
+// staleness) while the writer takes PUTs, then how long a follower takes to
+// serve a write made after the writer compacts.
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httplib.h"
+
+struct Args {
+  std::string server = "./kv_http_server";
+  int followers = 2;
+  int keys = 10000;
+  int ops = 20000;
+  int clients = 8;
+  int value_bytes = 100;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    int* target = x == "--followers"     ? &a.followers
+                  : x == "--keys"        ? &a.keys
+                  : x == "--ops"         ? &a.ops
+                  : x == "--clients"     ? &a.clients
+                  : x == "--value_bytes" ? &a.value_bytes
+                                         : nullptr;
+    if (target && i + 1 < argc) {
+      *target = std::stoi(argv[++i]);
+    } else if (x == "--server" && i + 1 < argc) {
+      a.server = argv[++i];
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "followerbench options:\n"
+                << "  --server PATH     kv_http_server binary (default ./kv_http_server)\n"
+                << "  --followers N     read-only followers (default 2)\n"
+                << "  --keys N          keys loaded before reading (default 10000)\n"
+                << "  --ops N           GETs per run, and PUTs in the lag run (default 20000)\n"
+                << "  --clients N       concurrent GET clients (default 8)\n"
+                << "  --value_bytes N   value size (default 100)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.followers < 1 || a.keys <= 0 || a.ops <= 0 || a.clients <= 0 || a.value_bytes < 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+// Port 18800 is the writer, 18801.. the followers.
+static int Port(int node) { return 18800 + node; }
+
+static std::unique_ptr<httplib::Client> Connect(int node) {
+  auto c = std::make_unique<httplib::Client>("127.0.0.1", Port(node));
+  c->set_keep_alive(true);
+  c->set_tcp_nodelay(true);
+  c->set_connection_timeout(std::chrono::milliseconds(200));
+  c->set_read_timeout(std::chrono::seconds(10));
+  return c;
+}
+
+static std::map<std::string, std::string> FollowerStatus(int node) {
+  std::map<std::string, std::string> kv;
+  auto r = Connect(node)->Get("/follower");
+  if (!r || r->status != 200) return kv;
+  std::istringstream in(r->body);
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t eq = line.find('=');
+    if (eq != std::string::npos) kv[line.substr(0, eq)] = line.substr(eq + 1);
+  }
+  return kv;
+}
+
+static uint64_t Counter(const std::map<std::string, std::string>& st, const std::string& name) {
+  auto it = st.find(name);
+  return it == st.end() ? 0 : std::stoull(it->second);
+}
+
+static double Percentile(std::vector<double>& xs, double p) {
+  if (xs.empty()) return 0;
+  std::sort(xs.begin(), xs.end());
+  return xs[static_cast<size_t>(p * (xs.size() - 1))];
+}
+
+static bool WaitUp(int node) {
+  for (int tries = 0; tries < 200; tries++) {
+    auto r = Connect(node)->Get("/health");
+    if (r && r->status == 200) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  const std::string server = std::filesystem::absolute(args.server).string();
+  const std::string dir = std::filesystem::absolute("data/followerbench").string();
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  std::vector<pid_t> pids;
+  auto spawn = [&](int node) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (chdir(dir.c_str()) != 0) _exit(1);
+      std::string port = std::to_string(Port(node));
+      if (node == 0) {
+        execl(server.c_str(), server.c_str(), "--port", port.c_str(), "--compact-interval", "0", "--scrub-interval",
+              "0", static_cast<char*>(nullptr));
+      } else {
+        execl(server.c_str(), server.c_str(), "--port", port.c_str(), "--read-only-follower",
+              static_cast<char*>(nullptr));
+      }
+      _exit(127);
+    }
+    pids.push_back(pid);
+  };
+  auto stop_all = [&]() {
+    for (pid_t pid : pids) {
+      kill(pid, SIGTERM);
+      waitpid(pid, nullptr, 0);
+    }
+  };
+
+  spawn(0);
+  bool ok = WaitUp(0);
+  const std::string value(static_cast<size_t>(args.value_bytes), 'v');
+  {
+    auto http = Connect(0);
+    for (int i = 0; i < args.keys && ok; i++) {
+      auto r = http->Post("/put?key=k" + std::to_string(i), value, "text/plain");
+      ok = r && r->status == 200;
+    }
+  }
+  for (int f = 1; f <= args.followers && ok; f++) {
+    spawn(f);
+    ok = WaitUp(f);
+  }
+  if (!ok) {
+    std::cerr << "servers did not come up\n";
+    stop_all();
+    return 1;
+  }
+
+  std::cout << "followerbench results (followers=" << args.followers << " keys=" << args.keys
+            << " ops=" << args.ops << " clients=" << args.clients << " value_bytes=" << args.value_bytes << ")\n";
+  std::cout << "op servers ops_per_sec p50_us p99_us\n";
+  for (int servers : {1, args.followers + 1}) {
+    const int per_client = std::max(1, args.ops / args.clients);
+    std::vector<std::vector<double>> us(static_cast<size_t>(args.clients));
+    std::atomic<bool> failed{false};
+    // Connect one at a time: the listen backlog is 5.
+    std::vector<std::unique_ptr<httplib::Client>> conns;
+    for (int c = 0; c < args.clients; c++) {
+      conns.push_back(Connect(c % servers));
+      conns.back()->Get("/health");
+    }
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < args.clients; c++) {
+      threads.emplace_back([&, c]() {
+        httplib::Client* http = conns[static_cast<size_t>(c)].get();
+        auto& lat = us[static_cast<size_t>(c)];
+        uint64_t x = static_cast<uint64_t>(c) * 0x9e3779b97f4a7c15ull + 1;
+        for (int i = 0; i < per_client && !failed.load(); i++) {
+          x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+          const auto t0 = std::chrono::steady_clock::now();
+          auto r = http->Get("/get?key=k" + std::to_string(x % static_cast<uint64_t>(args.keys)));
+          if (!r || r->status != 200 || r->body != value) {
+            failed.store(true);
+            return;
+          }
+          lat.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (failed.load()) {
+      std::cerr << "get failed with " << servers << " servers\n";
+      ok = false;
+      break;
+    }
+    std::vector<double> all;
+    for (auto& lat : us) all.insert(all.end(), lat.begin(), lat.end());
+    std::cout << std::fixed << "get " << servers << " " << std::setprecision(0) << all.size() / secs << " "
+              << std::setprecision(1) << Percentile(all, 0.50) << " " << Percentile(all, 0.99) << "\n";
+  }
+
+  if (ok) {
+    // Lag: one client PUTs as fast as it can while the first follower is
+    // sampled every millisecond.
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+      auto http = Connect(0);
+      for (int i = 0; i < args.ops; i++) http->Post("/put?key=w" + std::to_string(i), value, "text/plain");
+      done.store(true);
+    });
+    std::vector<double> lag_bytes, staleness;
+    while (!done.load()) {
+      const auto st = FollowerStatus(1);
+      lag_bytes.push_back(static_cast<double>(Counter(st, "lag_bytes")));
+      staleness.push_back(static_cast<double>(Counter(st, "staleness_ms")));
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    writer.join();
+    std::cout << std::fixed << std::setprecision(0) << "lag under puts: p50 " << Percentile(lag_bytes, 0.50)
+              << " bytes, p99 " << Percentile(lag_bytes, 0.99) << " bytes, staleness p99 "
+              << Percentile(staleness, 0.99) << " ms, max " << Percentile(staleness, 1.0) << " ms ("
+              << lag_bytes.size() << " samples)\n";
+  }
+
+  if (ok) {
+    // Compaction: the followers must replay the rewritten log before a write
+    // made after it shows up.
+    ok = Connect(0)->Post("/compact", "", "text/plain") != nullptr;
+    const auto t0 = std::chrono::steady_clock::now();
+    Connect(0)->Post("/put?key=after-compact", value, "text/plain");
+    auto http = Connect(1);
+    bool seen = false;
+    while (!seen && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(10)) {
+      auto r = http->Get("/get?key=after-compact");
+      seen = r && r->status == 200;
+      if (!seen) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    ok = ok && seen;
+    std::cout << std::fixed << std::setprecision(1) << "after compaction: follower served the next put after " << ms
+              << " ms, reloads=" << Counter(FollowerStatus(1), "reloads") << (ok ? "" : " (FAILED)") << "\n";
+  }
+
+  stop_all();
+  return ok ? 0 : 1;
+}
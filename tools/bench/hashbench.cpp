@@ -0,0 +1,113 @@
+// Key hashing cost: std::hash<std::string> against kv::HashKey across key
+// lengths, then Get vs Get(key, hash) vs MultiGet on an in-memory store.
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "kvstore/hash.h"
+#include "kvstore/kvstore.h"
+
+struct Args {
+  int keys = 1000000;
+  int rounds = 5;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    if ((x == "--keys" || x == "--rounds") && i + 1 < argc) {
+      (x == "--keys" ? a.keys : a.rounds) = std::stoi(argv[++i]);
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "hashbench options:\n"
+                << "  --keys N     distinct keys (default 1000000)\n"
+                << "  --rounds N   passes over the keys per measurement (default 5)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.keys <= 0 || a.rounds <= 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+static std::vector<std::string> MakeKeys(int n, size_t len) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  for (int i = 0; i < n; i++) {
+    std::string k = "user:" + std::to_string(i) + ":";
+    k.resize(std::max(len, k.size()), 'x');
+    keys.push_back(std::move(k));
+  }
+  return keys;
+}
+
+static volatile uint64_t g_sink;  // keeps hash loops from being optimized out
+
+template <typename F>
+static double NsPerOp(uint64_t ops, F&& f) {
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0)
+                .count();
+  return static_cast<double>(ns) / static_cast<double>(ops);
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  const uint64_t ops = static_cast<uint64_t>(args.keys) * args.rounds;
+
+  std::cout << "key_len std_hash_ns hashkey_ns\n";
+  for (size_t len : {8, 16, 32, 64, 128, 256}) {
+    auto keys = MakeKeys(std::min(args.keys, 100000), len);
+    const uint64_t n = keys.size() * static_cast<uint64_t>(args.rounds) * 10;
+    uint64_t sink = 0;
+    double std_ns = NsPerOp(n, [&] {
+      for (int r = 0; r < args.rounds * 10; r++)
+        for (const auto& k : keys) sink += std::hash<std::string>{}(k);
+    });
+    double kv_ns = NsPerOp(n, [&] {
+      for (int r = 0; r < args.rounds * 10; r++)
+        for (const auto& k : keys) sink += kv::HashKey(k);
+    });
+    g_sink = sink;
+    std::cout << len << " " << std_ns << " " << kv_ns << "\n";
+  }
+
+  auto keys = MakeKeys(args.keys, 24);
+  kv::KVStore store;
+  for (const auto& k : keys) store.Put(k, "v");
+  std::vector<uint64_t> hashes(keys.size());
+  kv::HashKeys(keys, hashes.data());
+
+  uint64_t found = 0;
+  double get_ns = NsPerOp(ops, [&] {
+    for (int r = 0; r < args.rounds; r++)
+      for (const auto& k : keys) found += store.Get(k).has_value();
+  });
+  double hashed_ns = NsPerOp(ops, [&] {
+    for (int r = 0; r < args.rounds; r++)
+      for (size_t i = 0; i < keys.size(); i++) found += store.Get(keys[i], hashes[i]).has_value();
+  });
+  constexpr size_t kBatch = 64;
+  std::vector<std::vector<std::string>> batches;
+  for (size_t i = 0; i < keys.size(); i += kBatch) {
+    batches.emplace_back(keys.begin() + i, keys.begin() + std::min(keys.size(), i + kBatch));
+  }
+  double multi_ns = NsPerOp(ops, [&] {
+    for (int r = 0; r < args.rounds; r++)
+      for (const auto& batch : batches)
+        for (const auto& v : store.MultiGet(batch)) found += v.has_value();
+  });
+  std::cout << "get_ns=" << get_ns << " get_prehashed_ns=" << hashed_ns
+            << " multiget64_ns=" << multi_ns << " found=" << found << "\n";
+  return 0;
+}
@@ -0,0 +1,107 @@
+// Index scaling: an in-memory store with the default index (unordered_map
+// behind the store's shared_mutex) against Options::concurrent_index (cuckoo
+// map with striped locks), at 1..64 threads. Each thread runs its share of
+// uniformly random Gets and Puts over a preloaded key set.
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "kvstore/kvstore.h"
+
+struct Args {
+  int keys = 1000000;
+  int ops = 2000000;  // in total, split between the threads
+  double read_ratio = 0.95;
+  std::vector<int> threads = {1, 2, 4, 8, 16, 32, 64};
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    if ((x == "--keys" || x == "--ops") && i + 1 < argc) {
+      (x == "--keys" ? a.keys : a.ops) = std::stoi(argv[++i]);
+    } else if (x == "--read_ratio" && i + 1 < argc) {
+      a.read_ratio = std::stod(argv[++i]);
+    } else if (x == "--threads" && i + 1 < argc) {
+      a.threads.clear();
+      std::stringstream list(argv[++i]);
+      for (std::string t; std::getline(list, t, ',');) a.threads.push_back(std::stoi(t));
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "indexbench options:\n"
+                << "  --keys N          preloaded keys (default 1000000)\n"
+                << "  --ops N           operations per run, all threads (default 2000000)\n"
+                << "  --read_ratio F    share of Gets (default 0.95)\n"
+                << "  --threads LIST    thread counts, comma-separated (default 1,2,4,8,16,32,64)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.keys <= 0 || a.ops <= 0 || a.read_ratio < 0 || a.read_ratio > 1 || a.threads.empty()) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+static double RunMops(kv::KVStore& store, const std::vector<std::string>& keys, const Args& args,
+                      int threads) {
+  const uint64_t per_thread = static_cast<uint64_t>(args.ops) / threads;
+  const uint64_t read_cut = static_cast<uint64_t>(args.read_ratio * 1000);
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; t++) {
+    pool.emplace_back([&, t] {
+      uint64_t rng = 0x9e3779b97f4a7c15ull * (t + 1);
+      const std::string value(16, 'w');
+      for (uint64_t i = 0; i < per_thread; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        const std::string& key = keys[rng % keys.size()];
+        if ((rng >> 32) % 1000 < read_cut) {
+          store.Get(key);
+        } else {
+          store.Put(key, value);
+        }
+      }
+    });
+  }
+  for (auto& th : pool) th.join();
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return static_cast<double>(per_thread * threads) / secs / 1e6;
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  std::vector<std::string> keys;
+  keys.reserve(args.keys);
+  for (int i = 0; i < args.keys; i++) keys.push_back("user:" + std::to_string(i));
+
+  kv::KVStore map_store;
+  kv::Options opts;
+  opts.concurrent_index = true;
+  kv::KVStore cuckoo_store(opts);
+  for (const auto& k : keys) {
+    map_store.Put(k, "v");
+    cuckoo_store.Put(k, "v");
+  }
+
+  std::cout << "indexbench results (keys=" << args.keys << " ops=" << args.ops
+            << " read_ratio=" << args.read_ratio << " hw_threads=" << std::thread::hardware_concurrency()
+            << ")\n";
+  std::cout << "threads map_mops cuckoo_mops\n";
+  for (int t : args.threads) {
+    double map_mops = RunMops(map_store, keys, args, t);
+    double cuckoo_mops = RunMops(cuckoo_store, keys, args, t);
+    std::cout << t << " " << map_mops << " " << cuckoo_mops << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+// File-level I/O policy (Options::preallocate_bytes, Options::access_hints).
+// Appends --keys records with and without preallocation and reports the
+// throughput and the log's extent count; then, from a cold page cache,
+// replays the log and serves --gets random Gets with and without hints,
+// reporting the time and how much of the log stayed cached afterwards.
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "kvstore/file_util.h"
+#include "kvstore/kvstore.h"
+
+struct Args {
+  int keys = 200000;
+  int value_size = 512;
+  int gets = 20000;
+  int prealloc_mb = 64;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    int* target = x == "--keys"          ? &a.keys
+                  : x == "--value_size"  ? &a.value_size
+                  : x == "--gets"        ? &a.gets
+                  : x == "--prealloc_mb" ? &a.prealloc_mb
+                                         : nullptr;
+    if (target && i + 1 < argc) {
+      *target = std::stoi(argv[++i]);
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "iohintbench options:\n"
+                << "  --keys N          records appended (default 200000)\n"
+                << "  --value_size N    value bytes (default 512)\n"
+                << "  --gets N          random Gets after reopening (default 20000)\n"
+                << "  --prealloc_mb N   preallocation chunk (default 64)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.keys <= 0 || a.value_size <= 0 || a.gets < 0 || a.prealloc_mb <= 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+// -1 if the filesystem does not report extents.
+static long Extents(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return -1;
+  struct fiemap fm = {};
+  fm.fm_length = FIEMAP_MAX_OFFSET;
+  fm.fm_flags = FIEMAP_FLAG_SYNC;
+  long n = ::ioctl(fd, FS_IOC_FIEMAP, &fm) == 0 ? static_cast<long>(fm.fm_mapped_extents) : -1;
+  ::close(fd);
+  return n;
+}
+
+static double CachedFraction(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return 0;
+  const size_t size = std::filesystem::file_size(path);
+  void* p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) return 0;
+  const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> vec((size + page - 1) / page);
+  size_t in = 0;
+  if (::mincore(p, size, vec.data()) == 0) {
+    for (unsigned char v : vec) in += v & 1;
+  }
+  ::munmap(p, size);
+  return vec.empty() ? 0 : static_cast<double>(in) / vec.size();
+}
+
+static double Since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  std::system("mkdir -p data >/dev/null 2>&1");
+  const std::string path = "data/iohintbench.aof";
+  const std::string value(args.value_size, 'v');
+
+  std::cout << "iohintbench results (keys=" << args.keys << " value_size=" << args.value_size
+            << " gets=" << args.gets << " prealloc_mb=" << args.prealloc_mb << ")\n";
+  std::cout << "append: mode puts_per_sec extents\n";
+  for (bool prealloc : {false, true}) {
+    std::filesystem::remove(path);
+    kv::Options opts;
+    if (prealloc) opts.preallocate_bytes = static_cast<uint64_t>(args.prealloc_mb) << 20;
+    auto t0 = std::chrono::steady_clock::now();
+    {
+      kv::KVStore s(path, opts);
+      for (int i = 0; i < args.keys; i++) s.Put("key" + std::to_string(i), value);
+    }
+    const double secs = Since(t0);
+    std::cout << (prealloc ? "prealloc" : "default") << " " << static_cast<uint64_t>(args.keys / secs) << " "
+              << Extents(path) << "\n";
+  }
+
+  // The log from the last run is reused; each mode starts from a cold cache.
+  std::cout << "cold open + gets: mode replay_ms cached_after_replay gets_per_sec cached_after_gets\n";
+  for (bool hints : {false, true}) {
+    kv::DropCachedPages(path);
+    kv::Options opts;
+    opts.access_hints = hints;
+    auto t0 = std::chrono::steady_clock::now();
+    kv::KVStore s(path, opts);
+    const double replay = Since(t0);
+    const double after_replay = CachedFraction(path);
+    uint64_t rng = 0x9e3779b97f4a7c15ull;
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < args.gets; i++) {
+      rng ^= rng << 13;
+      rng ^= rng >> 7;
+      rng ^= rng << 17;
+      s.Get("key" + std::to_string(rng % args.keys));
+    }
+    const double gets = Since(t0);
+    std::cout << (hints ? "hints" : "default") << " " << static_cast<uint64_t>(replay * 1000) << " "
+              << after_replay << " " << static_cast<uint64_t>(args.gets / gets) << " "
+              << CachedFraction(path) << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Drives a real kv_http_server while a burst of admin calls (POST
+// /ns/big/compact from --admins clients at once) competes with readers of
+// another namespace (GET /ns/hot/get from --readers clients) and a /health
+// prober. Runs the server once with storage calls inline on its HTTP threads
+// (--io-threads 0) and once with the I/O pool, and reports read and health
+// latency, compactions done and refused, and the pool's queue waits.
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httplib.h"
+
+struct Args {
+  std::string server = "./kv_http_server";
+  int big_keys = 6000;  // 1 KB values
+  int admins = 40;
+  int readers = 4;
+  int seconds = 10;
+  int io_threads = 4;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    int* target = x == "--big_keys"     ? &a.big_keys
+                  : x == "--admins"     ? &a.admins
+                  : x == "--readers"    ? &a.readers
+                  : x == "--seconds"    ? &a.seconds
+                  : x == "--io_threads" ? &a.io_threads
+                                        : nullptr;
+    if (target && i + 1 < argc) {
+      *target = std::stoi(argv[++i]);
+    } else if (x == "--server" && i + 1 < argc) {
+      a.server = argv[++i];
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "iopoolbench options:\n"
+                << "  --server PATH     kv_http_server binary (default ./kv_http_server)\n"
+                << "  --big_keys N      1 KB values in the compacted namespace (default 6000)\n"
+                << "  --admins N        clients calling compact back to back (default 40)\n"
+                << "  --readers N       clients reading the other namespace (default 4)\n"
+                << "  --seconds N       measured run per mode (default 10)\n"
+                << "  --io_threads N    pool size for the pooled run (default 4)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.big_keys <= 0 || a.admins < 0 || a.readers <= 0 || a.seconds <= 0 || a.io_threads <= 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+static double Percentile(std::vector<double> xs, double p) {
+  if (xs.empty()) return 0;
+  std::sort(xs.begin(), xs.end());
+  return xs[static_cast<size_t>(p * (xs.size() - 1))];
+}
+
+static std::string Field(const std::string& body, const std::string& name) {
+  size_t at = body.find(name + "=");
+  if (at == std::string::npos) return "-";
+  at += name.size() + 1;
+  return body.substr(at, body.find('\n', at) - at);
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  const std::string server = std::filesystem::absolute(args.server).string();
+  const std::string base = std::filesystem::absolute("data/iopoolbench").string();
+
+  std::cout << "iopoolbench results (big_keys=" << args.big_keys << " admins=" << args.admins
+            << " readers=" << args.readers << " seconds=" << args.seconds << ")\n";
+  std::cout << "mode reads_per_sec read_p50_ms read_p99_ms read_max_ms health_p99_ms health_max_ms "
+               "compactions refused read_wait_us_p99\n";
+  int port = 18471;
+  for (int io_threads : {0, args.io_threads}) {
+    port++;
+    std::filesystem::remove_all(base);
+    std::filesystem::create_directories(base);
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (chdir(base.c_str()) != 0) _exit(1);
+      std::string p = std::to_string(port), t = std::to_string(io_threads);
+      execl(server.c_str(), server.c_str(), "--port", p.c_str(), "--io-threads", t.c_str(), "--compact-interval",
+            "0", "--scrub-interval", "0", static_cast<char*>(nullptr));
+      _exit(127);
+    }
+    httplib::Client cli("127.0.0.1", port);
+    bool up = false;
+    for (int i = 0; i < 100 && !up; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      auto r = cli.Get("/health");
+      up = r && r->status == 200;
+    }
+    if (!up) {
+      std::cerr << "server did not start\n";
+      kill(pid, SIGTERM);
+      waitpid(pid, nullptr, 0);
+      return 1;
+    }
+
+    const std::string value(1024, 'v');
+    for (int i = 0; i < args.big_keys;) {
+      std::string body;
+      for (int n = 0; n < 500 && i < args.big_keys; n++, i++) {
+        body += "PUT big k" + std::to_string(i) + " " + std::to_string(value.size()) + "\n" + value + "\n";
+      }
+      cli.Post("/batch", body, "text/plain");
+    }
+    for (int i = 0; i < 1000; i++) cli.Post("/ns/hot/put?key=k" + std::to_string(i), "hot value", "text/plain");
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> compactions{0}, refused{0};
+    std::mutex mu;
+    std::vector<double> read_ms, health_ms;
+    auto ms_since = [](std::chrono::steady_clock::time_point t0) {
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+    std::vector<std::thread> clients;
+    for (int a = 0; a < args.admins; a++) {
+      clients.emplace_back([&]() {
+        httplib::Client c("127.0.0.1", port);
+        c.set_read_timeout(300);
+        while (!stop.load()) {
+          auto r = c.Post("/ns/big/compact", "", "text/plain");
+          if (r && r->status == 200) compactions++;
+          else if (r && r->status == 503) refused++;
+          std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+      });
+    }
+    for (int rd = 0; rd < args.readers; rd++) {
+      clients.emplace_back([&, rd]() {
+        httplib::Client c("127.0.0.1", port);
+        c.set_read_timeout(300);
+        uint64_t rng = 0x9e3779b97f4a7c15ull + static_cast<uint64_t>(rd);
+        std::vector<double> mine;
+        while (!stop.load()) {
+          rng ^= rng << 13;
+          rng ^= rng >> 7;
+          rng ^= rng << 17;
+          auto t0 = std::chrono::steady_clock::now();
+          c.Get("/ns/hot/get?key=k" + std::to_string(rng % 1000));
+          mine.push_back(ms_since(t0));
+        }
+        std::lock_guard<std::mutex> lock(mu);
+        read_ms.insert(read_ms.end(), mine.begin(), mine.end());
+      });
+    }
+    clients.emplace_back([&]() {
+      httplib::Client c("127.0.0.1", port);
+      c.set_read_timeout(300);
+      while (!stop.load()) {
+        auto t0 = std::chrono::steady_clock::now();
+        c.Get("/health");
+        double ms = ms_since(t0);
+        {
+          std::lock_guard<std::mutex> lock(mu);
+          health_ms.push_back(ms);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      }
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(args.seconds));
+    stop.store(true);
+    for (auto& t : clients) t.join();
+
+    auto pool = cli.Get("/io_pool");
+    const std::string pool_body = pool ? pool->body : "";
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+
+    std::cout << (io_threads == 0 ? "inline" : "pool(" + std::to_string(io_threads) + ")") << " "
+              << static_cast<uint64_t>(read_ms.size() / static_cast<double>(args.seconds)) << " "
+              << Percentile(read_ms, 0.50) << " " << Percentile(read_ms, 0.99) << " "
+              << Percentile(read_ms, 1.0) << " " << Percentile(health_ms, 0.99) << " "
+              << Percentile(health_ms, 1.0) << " " << compactions.load() << " " << refused.load() << " "
+              << Field(pool_body, "read_wait_us_p99") << "\n";
+  }
+  std::filesystem::remove_all(base);
+  return 0;
+}
@@ -0,0 +1,101 @@
+// Index memory and lookup cost with and without key compression
+// (Options::compress_keys). Values are empty, so heap growth while loading is
+// almost entirely index nodes and key bytes. Probed keys are promoted to the
+// hot tier first, so Get timings are index lookups rather than log reads.
+#include <malloc.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "kvstore/kvstore.h"
+
+struct Args {
+  int keys = 1000000;
+  int lookups = 2000000;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    if ((x == "--keys" || x == "--lookups") && i + 1 < argc) {
+      (x == "--keys" ? a.keys : a.lookups) = std::stoi(argv[++i]);
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "keybench options:\n"
+                << "  --keys N      distinct keys (default 1000000)\n"
+                << "  --lookups N   Gets to time (default 2000000)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.keys <= 0 || a.lookups <= 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+// Keys shaped like application keys: shared prefixes and suffixes around an id.
+static std::string MakeKey(int i) {
+  static const char* kKinds[] = {"profile", "settings", "orders", "session"};
+  return "user:" + std::to_string(100000 + i / 4) + ":" + kKinds[i % 4];
+}
+
+static uint64_t HeapBytes() { return mallinfo2().uordblks; }
+
+static void Run(const Args& args, bool compress) {
+  kv::Options opts;
+  opts.compress_keys = compress;
+  opts.hot_cache_bytes = 1 << 20;  // timed Gets hit the hot tier, not the log
+
+  std::system("mkdir -p data >/dev/null 2>&1");
+  std::system("rm -f data/keybench.aof >/dev/null 2>&1");
+  auto* s = new kv::KVStore("data/keybench.aof", opts);
+
+  uint64_t key_bytes = 0;
+  uint64_t before = HeapBytes();
+  for (int i = 0; i < args.keys; i++) {
+    std::string k = MakeKey(i);
+    key_bytes += k.size();
+    s->Put(k, "");
+  }
+  uint64_t after = HeapBytes();
+
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<int> dist(0, args.keys - 1);
+  std::vector<std::string> probes;
+  probes.reserve(4096);
+  for (int i = 0; i < 4096; i++) probes.push_back(MakeKey(dist(rng)));
+
+  for (int r = 0; r < 2; r++) {
+    for (const auto& p : probes) (void)s->Get(p);  // promote the probe keys
+  }
+
+  uint64_t found = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < args.lookups; i++) found += s->Get(probes[static_cast<size_t>(i) & 4095]).has_value();
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / args.lookups;
+
+  std::cout << "  compress_keys=" << (compress ? "true " : "false")
+            << " avg_key_len=" << static_cast<double>(key_bytes) / args.keys
+            << " heap_bytes_per_key=" << static_cast<double>(after - before) / args.keys
+            << " get_ns=" << ns << " found=" << found << "\n";
+  delete s;
+  std::system("rm -f data/keybench.aof >/dev/null 2>&1");
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  std::cout << "keybench results (keys=" << args.keys << " lookups=" << args.lookups << ")\n";
+  Run(args, false);
+  Run(args, true);
+  return 0;
+}
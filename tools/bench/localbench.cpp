@@ -0,0 +1,165 @@
+// Round-trip latency of one client against a real kv_http_server, over
+// loopback HTTP (keep-alive), the Unix domain socket (--uds), and the
+// shared-memory rings negotiated on it. Each transport does --ops Gets then
+// --ops Puts of --value_bytes values, one call at a time, and reports
+// calls/s and p50/p99/p99.9 in microseconds.
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httplib.h"
+#include "kvstore/local_transport.h"
+
+struct Args {
+  std::string server = "./kv_http_server";
+  int ops = 20000;
+  int keys = 1000;
+  int value_bytes = 100;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    int* target = x == "--ops"           ? &a.ops
+                  : x == "--keys"        ? &a.keys
+                  : x == "--value_bytes" ? &a.value_bytes
+                                         : nullptr;
+    if (target && i + 1 < argc) {
+      *target = std::stoi(argv[++i]);
+    } else if (x == "--server" && i + 1 < argc) {
+      a.server = argv[++i];
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "localbench options:\n"
+                << "  --server PATH     kv_http_server binary (default ./kv_http_server)\n"
+                << "  --ops N           calls per transport and operation (default 20000)\n"
+                << "  --keys N          distinct keys (default 1000)\n"
+                << "  --value_bytes N   value size (default 100)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.ops <= 0 || a.keys <= 0 || a.value_bytes < 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+static double Percentile(std::vector<double>& xs, double p) {
+  if (xs.empty()) return 0;
+  std::sort(xs.begin(), xs.end());
+  return xs[static_cast<size_t>(p * (xs.size() - 1))];
+}
+
+// Times `call(i)` for i in [0, ops) and prints one row; a failed call aborts.
+static bool Measure(const std::string& label, int ops, const std::function<bool(int)>& call) {
+  for (int i = 0; i < std::min(ops, 1000); i++) {  // warm up connections and caches
+    if (!call(i)) return false;
+  }
+  std::vector<double> us;
+  us.reserve(static_cast<size_t>(ops));
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ops; i++) {
+    const auto t0 = std::chrono::steady_clock::now();
+    if (!call(i)) {
+      std::cerr << label << ": call " << i << " failed\n";
+      return false;
+    }
+    us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+  }
+  const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(1) << label << " " << std::setprecision(0) << ops / secs << " "
+            << std::setprecision(1) << Percentile(us, 0.50) << " " << Percentile(us, 0.99) << " "
+            << Percentile(us, 0.999) << "\n";
+  return true;
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  const std::string server = std::filesystem::absolute(args.server).string();
+  const std::string base = std::filesystem::absolute("data/localbench").string();
+  const std::string sock = base + "/kv.sock";
+  const int port = 18491;
+
+  std::filesystem::remove_all(base);
+  std::filesystem::create_directories(base);
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (chdir(base.c_str()) != 0) _exit(1);
+    std::string p = std::to_string(port);
+    execl(server.c_str(), server.c_str(), "--port", p.c_str(), "--uds", sock.c_str(), "--compact-interval", "0",
+          "--scrub-interval", "0", static_cast<char*>(nullptr));
+    _exit(127);
+  }
+  auto stop_server = [&]() {
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+  };
+
+  httplib::Client http("127.0.0.1", port);
+  http.set_keep_alive(true);
+  http.set_tcp_nodelay(true);  // as the server does; otherwise a POST waits out a delayed ACK
+  bool up = false;
+  for (int i = 0; i < 100 && !up; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto r = http.Get("/health");
+    up = r && r->status == 200;
+  }
+  std::string err;
+  kv::LocalClient uds, shm;
+  if (!up || !uds.Connect(sock, false, &err) || !shm.Connect(sock, true, &err)) {
+    std::cerr << "server did not start " << err << "\n";
+    stop_server();
+    return 1;
+  }
+
+  const std::string value(static_cast<size_t>(args.value_bytes), 'v');
+  std::vector<std::string> keys;
+  for (int i = 0; i < args.keys; i++) {
+    keys.push_back("k" + std::to_string(i));
+    if (uds.Put(keys.back(), value) != kv::LocalStatus::kOk) {
+      std::cerr << "load failed\n";
+      stop_server();
+      return 1;
+    }
+  }
+  auto key = [&](int i) -> const std::string& { return keys[static_cast<size_t>(i) % keys.size()]; };
+
+  std::cout << "localbench results (ops=" << args.ops << " keys=" << args.keys
+            << " value_bytes=" << args.value_bytes << ")\n";
+  std::cout << "transport_op calls_per_sec p50_us p99_us p999_us\n";
+  std::string v;
+  bool ok = Measure("http_get", args.ops, [&](int i) {
+    auto r = http.Get("/get?key=" + key(i));
+    return r && r->status == 200 && r->body.size() == value.size();
+  });
+  ok = ok && Measure("uds_get", args.ops, [&](int i) {
+    return uds.Get(key(i), &v) == kv::LocalStatus::kOk && v.size() == value.size();
+  });
+  ok = ok && Measure("shm_get", args.ops, [&](int i) {
+    return shm.Get(key(i), &v) == kv::LocalStatus::kOk && v.size() == value.size();
+  });
+  ok = ok && Measure("http_put", args.ops, [&](int i) {
+    auto r = http.Post("/put?key=" + key(i), value, "text/plain");
+    return r && r->status == 200;
+  });
+  ok = ok && Measure("uds_put", args.ops, [&](int i) { return uds.Put(key(i), value) == kv::LocalStatus::kOk; });
+  ok = ok && Measure("shm_put", args.ops, [&](int i) { return shm.Put(key(i), value) == kv::LocalStatus::kOk; });
+
+  stop_server();
+  return ok ? 0 : 1;
+}
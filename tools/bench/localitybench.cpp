@@ -0,0 +1,174 @@
+// Compaction layout and read locality. Each "user" has one key in each of
+// four keyspaces (profile:, cart:, prefs:, session:), written in scattered
+// order, and a request reads all four with one MultiGet. The log is compacted
+// with each Options::compaction_order; key order keeps each keyspace together
+// but not a user's keys, while co-access order (learned from a warm-up run
+// of requests) places a user's keys side by side.
+//
+// The sandbox has no block-device accounting, so page-cache behaviour is
+// simulated over the real layout: the compacted log is parsed for value
+// offsets, and the request stream is replayed against an LRU cache of 4 KB
+// pages (--cache_pct of the file). Reports distinct pages per request, the
+// hit rate, and misses per request (= 4 KB read IOPS per request), plus the
+// measured MultiGet rate on the warm store.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "kvstore/kvstore.h"
+#include "kvstore/log_format.h"
+
+struct Args {
+  int users = 100000;
+  int value_size = 200;
+  int ops = 200000;
+  int cache_pct = 10;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    int* target = x == "--users"        ? &a.users
+                  : x == "--value_size" ? &a.value_size
+                  : x == "--ops"        ? &a.ops
+                  : x == "--cache_pct"  ? &a.cache_pct
+                                        : nullptr;
+    if (target && i + 1 < argc) {
+      *target = std::stoi(argv[++i]);
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "localitybench options:\n"
+                << "  --users N        users, 4 keys each (default 100000)\n"
+                << "  --value_size N   bytes per value (default 200)\n"
+                << "  --ops N          requests (MultiGets of 4 keys) per mode (default 200000)\n"
+                << "  --cache_pct N    simulated page cache, % of the log (default 10)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.users <= 0 || a.value_size <= 0 || a.ops <= 0 || a.cache_pct <= 0 || a.cache_pct > 100) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+static std::vector<std::string> UserKeys(uint64_t u) {
+  const std::string id = std::to_string(u);
+  return {"profile:" + id, "cart:" + id, "prefs:" + id, "session:" + id};
+}
+
+static uint64_t Next(uint64_t* rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+  return *rng;
+}
+
+// Skewed user choice: half the requests go to 10% of the users.
+static uint64_t PickUser(uint64_t* rng, uint64_t users) {
+  const uint64_t r = Next(rng);
+  const uint64_t hot = users / 10 == 0 ? 1 : users / 10;
+  return (r >> 63) ? r % hot : r % users;
+}
+
+class LruPages {
+ public:
+  explicit LruPages(size_t capacity) : capacity_(capacity) {}
+  bool Touch(uint64_t page) {  // true on a hit
+    auto it = pos_.find(page);
+    if (it != pos_.end()) {
+      order_.splice(order_.begin(), order_, it->second);
+      return true;
+    }
+    order_.push_front(page);
+    pos_[page] = order_.begin();
+    if (pos_.size() > capacity_) {
+      pos_.erase(order_.back());
+      order_.pop_back();
+    }
+    return false;
+  }
+
+ private:
+  size_t capacity_;
+  std::list<uint64_t> order_;
+  std::unordered_map<uint64_t, std::list<uint64_t>::iterator> pos_;
+};
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  std::system("mkdir -p data >/dev/null 2>&1");
+  const uint64_t users = static_cast<uint64_t>(args.users);
+  constexpr uint64_t kPage = 4096;
+
+  std::cout << "localitybench results (users=" << args.users << " value_size=" << args.value_size
+            << " ops=" << args.ops << " cache_pct=" << args.cache_pct << ")\n";
+  std::cout << "order pages_per_request hit_rate misses_per_request multigets_per_sec\n";
+  const std::pair<const char*, kv::CompactionOrder> orders[] = {
+      {"index", kv::CompactionOrder::kIndex},
+      {"key", kv::CompactionOrder::kKey},
+      {"co_access", kv::CompactionOrder::kCoAccess},
+  };
+  for (const auto& [name, order] : orders) {
+    const std::string path = "data/localitybench.aof";
+    std::system("rm -f data/localitybench.aof* >/dev/null 2>&1");
+    kv::Options opts;
+    opts.compaction_order = order;
+    kv::KVStore s(path, opts);
+    const std::string value(args.value_size, 'v');
+    uint64_t pow2 = 1;
+    while (pow2 < users) pow2 <<= 1;
+    for (uint64_t i = 0; i < pow2; i++) {  // every user once, in scattered order
+      const uint64_t u = (i * 0x9e3779b97f4a7c15ull) & (pow2 - 1);
+      if (u < users) {
+        for (const auto& k : UserKeys(u)) s.Put(k, value);
+      }
+    }
+    uint64_t rng = 0x2545f4914f6cdd1dull;
+    for (int i = 0; i < args.ops; i++) s.MultiGet(UserKeys(PickUser(&rng, users)));  // warm-up
+    if (!s.Compact()) {
+      std::cerr << "compaction failed\n";
+      return 1;
+    }
+
+    std::unordered_map<std::string, uint64_t> offsets;
+    kv::LogReader reader(path);
+    kv::LogRecord rec;
+    while (reader.Next(&rec)) offsets[rec.key] = rec.value_offset;
+    const uint64_t pages = (s.Stats().log_bytes + kPage - 1) / kPage;
+    LruPages cache(std::max<uint64_t>(1, pages * args.cache_pct / 100));
+
+    // A different request stream than the warm-up, timed, then simulated.
+    rng = 0x9e3779b97f4a7c15ull;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < args.ops; i++) s.MultiGet(UserKeys(PickUser(&rng, users)));
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    rng = 0x9e3779b97f4a7c15ull;
+    uint64_t touched = 0, hits = 0, misses = 0;
+    for (int i = 0; i < args.ops; i++) {
+      const auto keys = UserKeys(PickUser(&rng, users));
+      std::unordered_set<uint64_t> request_pages;
+      for (const auto& k : keys) {
+        const uint64_t off = offsets[k];
+        for (uint64_t p = off / kPage; p <= (off + args.value_size - 1) / kPage; p++) request_pages.insert(p);
+      }
+      touched += request_pages.size();
+      for (uint64_t p : request_pages) (cache.Touch(p) ? hits : misses)++;
+    }
+    std::cout << name << " " << static_cast<double>(touched) / args.ops << " "
+              << static_cast<double>(hits) / (hits + misses) << " " << static_cast<double>(misses) / args.ops
+              << " " << static_cast<uint64_t>(args.ops / secs) << "\n";
+  }
+  return 0;
+}
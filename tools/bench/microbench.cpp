@@ -1,12 +1,21 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
 #include <vector>
 
+#include "kvstore/crc32c.h"
 #include "kvstore/kvstore.h"
 
 struct Args {
@@ -15,6 +24,14 @@ struct Args {
   int value_size = 64;
   double read_ratio = 0.8;   // fraction of ops that are GETs
   bool persistent = false;   // if true, uses data/bench.aof
+  double zipf = 0.0;         // 0 = uniform keys; YCSB uses 0.99
+  int hot_cache_mb = 0;      // persistent mode: hot tier budget
+  bool json = false;         // JSON-like values instead of random letters
+  int compress_min = 0;      // persistent mode: compress values >= N bytes
+  bool dict = false;         // ...against a trained dictionary
+  bool verify = false;       // persistent mode: check checksums on every read
+  std::string huge_pages = "off";  // off | thp | explicit
+  int numa_node = -1;
 };
 
 static bool StartsWith(const std::string& s, const std::string& p) {
@@ -45,6 +62,14 @@ static Args ParseArgs(int argc, char** argv) {
     else if (x == "--value_size") read_int("--value_size", a.value_size);
     else if (x == "--read_ratio") read_double("--read_ratio", a.read_ratio);
     else if (x == "--persistent") a.persistent = true;
+    else if (x == "--zipf") read_double("--zipf", a.zipf);
+    else if (x == "--hot_cache_mb") read_int("--hot_cache_mb", a.hot_cache_mb);
+    else if (x == "--json") a.json = true;
+    else if (x == "--compress_min") read_int("--compress_min", a.compress_min);
+    else if (x == "--dict") a.dict = true;
+    else if (x == "--verify_checksums") a.verify = true;
+    else if (x == "--huge_pages" && i + 1 < argc) a.huge_pages = argv[++i];
+    else if (x == "--numa_node") read_int("--numa_node", a.numa_node);
     else if (x == "--help" || x == "-h") {
       std::cout
         << "microbench options:\n"
@@ -52,7 +77,15 @@ static Args ParseArgs(int argc, char** argv) {
         << "  --ops N           number of operations (default 500000)\n"
         << "  --value_size N    bytes per value (default 64)\n"
         << "  --read_ratio R    fraction GET ops in [0,1] (default 0.8)\n"
-        << "  --persistent      use append-only log at data/bench.aof\n";
+        << "  --persistent      use append-only log at data/bench.aof\n"
+        << "  --zipf S          zipfian key popularity with skew S (default 0 = uniform)\n"
+        << "  --hot_cache_mb N  persistent mode: keep hot values in memory, N MiB budget\n"
+        << "  --json            JSON-like values (repetitive structure, varying fields)\n"
+        << "  --compress_min N  persistent mode: LZ-compress values of at least N bytes\n"
+        << "  --dict            with --compress_min: train and use a shared dictionary\n"
+        << "  --verify_checksums persistent mode: verify record checksums on every read\n"
+        << "  --huge_pages M    index memory: off, thp (transparent) or explicit (hugetlb)\n"
+        << "  --numa_node N     prefer NUMA node N for the index (default -1: first touch)\n";
       std::exit(0);
     } else {
       std::cerr << "Unknown arg: " << x << "\n";
@@ -64,6 +97,14 @@ static Args ParseArgs(int argc, char** argv) {
     std::cerr << "Invalid args.\n";
     std::exit(2);
   }
+  if (a.zipf < 0.0 || a.hot_cache_mb < 0 || a.compress_min < 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  if (a.huge_pages != "off" && a.huge_pages != "thp" && a.huge_pages != "explicit") {
+    std::cerr << "--huge_pages must be off, thp or explicit.\n";
+    std::exit(2);
+  }
   if (a.read_ratio < 0.0 || a.read_ratio > 1.0) {
     std::cerr << "--read_ratio must be in [0,1].\n";
     std::exit(2);
@@ -84,6 +125,107 @@ static std::string MakeValue(int size, std::mt19937& rng) {
   return v;
 }
 
+// A small JSON document with the shape of typical application records,
+// padded or cut to `size` bytes.
+static std::string MakeJsonValue(int size, std::mt19937& rng) {
+  static const char* kCities[] = {"Berlin", "Lisbon", "Osaka", "Toronto", "Nairobi", "Lima"};
+  std::uniform_int_distribution<int> num(0, 999999);
+  std::uniform_int_distribution<int> city(0, 5);
+  std::string v = "{\"user_id\":" + std::to_string(num(rng)) + ",\"name\":\"user_" +
+                  std::to_string(num(rng)) + "\",\"email\":\"user" + std::to_string(num(rng)) +
+                  "@example.com\",\"city\":\"" + kCities[city(rng)] +
+                  "\",\"active\":true,\"plan\":\"standard\",\"score\":" +
+                  std::to_string(num(rng) % 1000) + ",\"tags\":[\"beta\",\"newsletter\"]";
+  while (static_cast<int>(v.size()) + 1 < size) {
+    v += ",\"event_" + std::to_string(v.size()) + "\":{\"ts\":" + std::to_string(1700000000 + num(rng)) +
+         ",\"kind\":\"page_view\"}";
+  }
+  v += "}";
+  if (static_cast<int>(v.size()) > size) v.resize(static_cast<size_t>(size));
+  return v;
+}
+
+// Key i is drawn with probability proportional to 1/(i+1)^s.
+class KeyChooser {
+ public:
+  KeyChooser(int keys, double s) : uniform_(0, keys - 1) {
+    if (s <= 0.0) return;
+    cdf_.resize(static_cast<size_t>(keys));
+    double sum = 0.0;
+    for (int i = 0; i < keys; i++) {
+      sum += 1.0 / std::pow(i + 1.0, s);
+      cdf_[static_cast<size_t>(i)] = sum;
+    }
+    for (auto& c : cdf_) c /= sum;
+  }
+
+  int Next(std::mt19937& rng) {
+    if (cdf_.empty()) return uniform_(rng);
+    double u = unit_(rng);
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+    if (it == cdf_.end()) --it;
+    return static_cast<int>(it - cdf_.begin());
+  }
+
+ private:
+  std::uniform_int_distribution<int> uniform_;
+  std::uniform_real_distribution<double> unit_{0.0, 1.0};
+  std::vector<double> cdf_;
+};
+
+// Counts one hardware event for this process (user space only); n/a where
+// the PMU is not exposed, as in many VMs.
+class PerfCounter {
+ public:
+  PerfCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~PerfCounter() {
+    if (fd_ >= 0) ::close(fd_);
+  }
+  void Start() {
+    if (fd_ >= 0) ::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  void Stop() {
+    if (fd_ >= 0) ::ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+  }
+  bool ok() const { return fd_ >= 0; }
+  uint64_t value() const {
+    uint64_t v = 0;
+    if (fd_ < 0 || ::read(fd_, &v, sizeof(v)) != sizeof(v)) return 0;
+    return v;
+  }
+
+ private:
+  int fd_ = -1;
+};
+
+static uint64_t DtlbConfig(uint64_t result) {
+  return PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+}
+
+// Anonymous memory backed by transparent huge pages, from smaps_rollup.
+static uint64_t AnonHugePagesKb() {
+  std::ifstream in("/proc/self/smaps_rollup");
+  std::string name;
+  uint64_t kb = 0;
+  while (in >> name) {
+    if (name == "AnonHugePages:") {
+      in >> kb;
+      return kb;
+    }
+    in.ignore(1 << 10, '\n');
+  }
+  return 0;
+}
+
 static double Percentile(std::vector<double>& xs, double p) {
   if (xs.empty()) return 0.0;
   std::sort(xs.begin(), xs.end());
@@ -99,33 +241,55 @@ int main(int argc, char** argv) {
 
   // RNG setup
   std::mt19937 rng(12345);
-  std::uniform_int_distribution<int> key_dist(0, args.keys - 1);
+  KeyChooser key_dist(args.keys, args.zipf);
   std::uniform_real_distribution<double> op_dist(0.0, 1.0);
 
   // Create store
+  kv::HugePages huge = args.huge_pages == "thp"        ? kv::HugePages::kTransparent
+                       : args.huge_pages == "explicit" ? kv::HugePages::kExplicit
+                                                       : kv::HugePages::kOff;
   std::unique_ptr<kv::KVStore> store;
   if (args.persistent) {
     // Ensure data directory exists (portable enough for mac)
     std::system("mkdir -p data >/dev/null 2>&1");
     std::system("rm -f data/bench.aof >/dev/null 2>&1");
-    store = std::make_unique<kv::KVStore>("data/bench.aof");
+    kv::Options opts;
+    opts.hot_cache_bytes = static_cast<uint64_t>(args.hot_cache_mb) << 20;
+    opts.compress_min_bytes = static_cast<uint64_t>(args.compress_min);
+    opts.compress_dictionary = args.dict;
+    opts.verify_checksums = args.verify;
+    opts.huge_pages = huge;
+    opts.numa_node = args.numa_node;
+    std::system("rm -f data/bench.aof.dict >/dev/null 2>&1");
+    store = std::make_unique<kv::KVStore>("data/bench.aof", opts);
   } else {
-    store = std::make_unique<kv::KVStore>();
+    kv::Options opts;
+    opts.huge_pages = huge;
+    opts.numa_node = args.numa_node;
+    store = std::make_unique<kv::KVStore>(opts);
   }
 
+  auto make_value = [&]() {
+    return args.json ? MakeJsonValue(args.value_size, rng) : MakeValue(args.value_size, rng);
+  };
+
   // Warmup: pre-fill some keys
   int warm = std::min(args.keys, 20000);
   for (int i = 0; i < warm; i++) {
-    store->Put(MakeKey(i), MakeValue(args.value_size, rng));
+    store->Put(MakeKey(i), make_value());
   }
 
   std::vector<double> lat_us;
   lat_us.reserve(static_cast<size_t>(args.ops));
 
+  PerfCounter tlb_misses(PERF_TYPE_HW_CACHE, DtlbConfig(PERF_COUNT_HW_CACHE_RESULT_MISS));
+  PerfCounter tlb_loads(PERF_TYPE_HW_CACHE, DtlbConfig(PERF_COUNT_HW_CACHE_RESULT_ACCESS));
+  tlb_misses.Start();
+  tlb_loads.Start();
   auto t0 = std::chrono::steady_clock::now();
 
   for (int i = 0; i < args.ops; i++) {
-    int k = key_dist(rng);
+    int k = key_dist.Next(rng);
     std::string key = MakeKey(k);
 
     bool is_read = (op_dist(rng) < args.read_ratio);
@@ -135,7 +299,7 @@ int main(int argc, char** argv) {
     if (is_read) {
       (void)store->Get(key);
     } else {
-      store->Put(key, MakeValue(args.value_size, rng));
+      store->Put(key, make_value());
     }
 
     auto op_end = std::chrono::steady_clock::now();
@@ -144,6 +308,8 @@ int main(int argc, char** argv) {
   }
 
   auto t1 = std::chrono::steady_clock::now();
+  tlb_misses.Stop();
+  tlb_loads.Stop();
   double total_s = std::chrono::duration<double>(t1 - t0).count();
   double ops_per_s = args.ops / total_s;
 
@@ -156,10 +322,51 @@ int main(int argc, char** argv) {
             << " ops=" << args.ops
             << " value_size=" << args.value_size
             << " read_ratio=" << args.read_ratio
-            << " persistent=" << (args.persistent ? "true" : "false") << "\n";
+            << " persistent=" << (args.persistent ? "true" : "false")
+            << " zipf=" << args.zipf
+            << " hot_cache_mb=" << args.hot_cache_mb
+            << " json=" << (args.json ? "true" : "false")
+            << " compress_min=" << args.compress_min
+            << " dict=" << (args.dict ? "true" : "false")
+            << " verify_checksums=" << (args.verify ? "true" : "false")
+            << " huge_pages=" << args.huge_pages
+            << " numa_node=" << args.numa_node << "\n";
   std::cout << "  total_time_s=" << total_s << "\n";
   std::cout << "  throughput_ops_per_s=" << ops_per_s << "\n";
   std::cout << "  latency_us_p50=" << p50 << " p95=" << p95 << " p99=" << p99 << "\n";
+  if (tlb_misses.ok()) {
+    const uint64_t misses = tlb_misses.value(), loads = tlb_loads.value();
+    std::cout << "  dtlb_load_misses=" << misses << " per_op=" << static_cast<double>(misses) / args.ops
+              << " miss_rate=" << (loads > 0 ? static_cast<double>(misses) / loads : 0.0) << "\n";
+  } else {
+    std::cout << "  dtlb_load_misses=n/a (no hardware counters)\n";
+  }
+  std::cout << "  anon_huge_pages_kb=" << AnonHugePagesKb() << "\n";
+  if (args.hot_cache_mb > 0) {
+    kv::StoreStats st = store->Stats();
+    double reads = static_cast<double>(st.hot_hits + st.hot_misses);
+    std::cout << "  hot_tier_hit_rate=" << (reads > 0 ? st.hot_hits / reads : 0.0)
+              << " hot_keys=" << st.hot_keys << " hot_bytes=" << st.hot_bytes << "\n";
+  }
+  if (args.persistent) {
+    kv::StoreStats st = store->Stats();
+    std::cout << "  log_bytes=" << st.log_bytes << "\n";
+    if (args.verify) {
+      std::cout << "  checksum_verifies=" << st.checksum_verifies << " checksum_ns_per_verify="
+                << (st.checksum_verifies > 0 ? static_cast<double>(st.checksum_ns) / st.checksum_verifies : 0.0)
+                << " crc32c_hardware=" << (kv::Crc32cHardware() ? "yes" : "no") << "\n";
+    }
+    if (args.compress_min > 0) {
+      double ratio = st.compress_in_bytes > 0
+                         ? static_cast<double>(st.compress_out_bytes) / st.compress_in_bytes
+                         : 1.0;
+      double misses = static_cast<double>(st.gets - st.hot_hits);
+      std::cout << "  compressed_values=" << st.compressed_values << " stored/raw=" << ratio
+                << " dictionary=" << (st.has_dictionary ? "yes" : "no")
+                << " decompress_ns_per_disk_get=" << (misses > 0 ? st.decompress_ns / misses : 0.0)
+                << "\n";
+    }
+  }
 
   return 0;
 }
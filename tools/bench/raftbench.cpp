@@ -0,0 +1,251 @@
+// Replicated writes against a real group of kv_http_server processes
+// (--raft-id), all on this host. Reports PUT throughput and p50/p99 latency
+// at several client concurrencies, with the entries each AppendEntries batch
+// and log sync carried, then linearizable GET latency, then how long the
+// group takes to accept writes again after the leader is SIGKILLed.
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httplib.h"
+
+struct Args {
+  std::string server = "./kv_http_server";
+  int nodes = 3;
+  int ops = 4000;
+  int value_bytes = 100;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    int* target = x == "--nodes"         ? &a.nodes
+                  : x == "--ops"         ? &a.ops
+                  : x == "--value_bytes" ? &a.value_bytes
+                                         : nullptr;
+    if (target && i + 1 < argc) {
+      *target = std::stoi(argv[++i]);
+    } else if (x == "--server" && i + 1 < argc) {
+      a.server = argv[++i];
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "raftbench options:\n"
+                << "  --server PATH     kv_http_server binary (default ./kv_http_server)\n"
+                << "  --nodes N         group size, 3 or 5 (default 3)\n"
+                << "  --ops N           PUTs per concurrency level, and GETs (default 4000)\n"
+                << "  --value_bytes N   value size (default 100)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if ((a.nodes != 3 && a.nodes != 5) || a.ops <= 0 || a.value_bytes < 0) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+static int HttpPort(int id) { return 18600 + id; }
+static int RaftPort(int id) { return 18700 + id; }
+
+static std::unique_ptr<httplib::Client> Connect(int id) {
+  auto c = std::make_unique<httplib::Client>("127.0.0.1", HttpPort(id));
+  c->set_keep_alive(true);
+  c->set_tcp_nodelay(true);  // otherwise a POST waits out a delayed ACK
+  c->set_connection_timeout(std::chrono::milliseconds(200));
+  c->set_read_timeout(std::chrono::seconds(10));
+  return c;
+}
+
+// GET /raft as a map; empty if the node does not answer.
+static std::map<std::string, std::string> RaftStatus(int id) {
+  std::map<std::string, std::string> kv;
+  auto r = Connect(id)->Get("/raft");
+  if (!r || r->status != 200) return kv;
+  std::istringstream in(r->body);
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t eq = line.find('=');
+    if (eq != std::string::npos) kv[line.substr(0, eq)] = line.substr(eq + 1);
+  }
+  return kv;
+}
+
+static uint64_t Counter(const std::map<std::string, std::string>& st, const std::string& name) {
+  auto it = st.find(name);
+  return it == st.end() ? 0 : std::stoull(it->second);
+}
+
+static double Percentile(std::vector<double>& xs, double p) {
+  if (xs.empty()) return 0;
+  std::sort(xs.begin(), xs.end());
+  return xs[static_cast<size_t>(p * (xs.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  const std::string server = std::filesystem::absolute(args.server).string();
+  const std::string base = std::filesystem::absolute("data/raftbench").string();
+  std::string peers;
+  for (int id = 1; id <= args.nodes; id++) {
+    peers += (id > 1 ? "," : "") + std::to_string(id) + "=127.0.0.1:" + std::to_string(RaftPort(id));
+  }
+
+  std::filesystem::remove_all(base);
+  std::vector<pid_t> pids(static_cast<size_t>(args.nodes) + 1, 0);
+  for (int id = 1; id <= args.nodes; id++) {
+    const std::string dir = base + "/node" + std::to_string(id);
+    std::filesystem::create_directories(dir);
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (chdir(dir.c_str()) != 0) _exit(1);
+      std::string port = std::to_string(HttpPort(id)), raft_id = std::to_string(id);
+      execl(server.c_str(), server.c_str(), "--port", port.c_str(), "--raft-id", raft_id.c_str(), "--raft-peers",
+            peers.c_str(), "--compact-interval", "0", "--scrub-interval", "0", static_cast<char*>(nullptr));
+      _exit(127);
+    }
+    pids[static_cast<size_t>(id)] = pid;
+  }
+  auto stop_all = [&]() {
+    for (pid_t pid : pids) {
+      if (pid <= 0) continue;
+      kill(pid, SIGTERM);
+      waitpid(pid, nullptr, 0);
+    }
+  };
+  // The node that reports itself leader, skipping `down`; 0 after ~10 s.
+  auto find_leader = [&](int down) {
+    for (int tries = 0; tries < 200; tries++) {
+      for (int id = 1; id <= args.nodes; id++) {
+        if (id != down && RaftStatus(id)["role"] == "leader") return id;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return 0;
+  };
+
+  const int leader = find_leader(0);
+  if (leader == 0) {
+    std::cerr << "no leader elected\n";
+    stop_all();
+    return 1;
+  }
+  const std::string value(static_cast<size_t>(args.value_bytes), 'v');
+  std::cout << "raftbench results (nodes=" << args.nodes << " ops=" << args.ops
+            << " value_bytes=" << args.value_bytes << ")\n";
+  std::cout << "op clients ops_per_sec p50_us p99_us entries_per_batch entries_per_sync\n";
+
+  bool ok = true;
+  for (int clients : {1, 8, 32}) {
+    const auto before = RaftStatus(leader);
+    const int per_client = std::max(1, args.ops / clients);
+    std::vector<std::vector<double>> us(static_cast<size_t>(clients));
+    std::atomic<bool> failed{false};
+    // Connect one at a time: the server's listen backlog is 5, and a burst
+    // of 32 SYNs overflows it.
+    std::vector<std::unique_ptr<httplib::Client>> conns;
+    for (int c = 0; c < clients; c++) {
+      conns.push_back(Connect(leader));
+      conns.back()->Get("/health");
+    }
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < clients; c++) {
+      threads.emplace_back([&, c]() {
+        httplib::Client* http = conns[static_cast<size_t>(c)].get();
+        auto& lat = us[static_cast<size_t>(c)];
+        for (int i = 0; i < per_client && !failed.load(); i++) {
+          const std::string key = "k" + std::to_string(c) + "-" + std::to_string(i);
+          const auto t0 = std::chrono::steady_clock::now();
+          auto r = http->Post("/put?key=" + key, value, "text/plain");
+          if (!r || r->status != 200) {
+            if (!failed.exchange(true)) {
+              std::cerr << key << ": " << (r ? std::to_string(r->status) + " " + r->body : httplib::to_string(r.error()))
+                        << "\n";
+            }
+            return;
+          }
+          lat.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (failed.load()) {
+      std::cerr << "put failed at " << clients << " clients\n";
+      ok = false;
+      break;
+    }
+    const auto after = RaftStatus(leader);
+    std::vector<double> all;
+    for (auto& lat : us) all.insert(all.end(), lat.begin(), lat.end());
+    const double entries = static_cast<double>(Counter(after, "last_index") - Counter(before, "last_index"));
+    const double batches = static_cast<double>(Counter(after, "append_batches") - Counter(before, "append_batches"));
+    const double syncs = static_cast<double>(Counter(after, "log_syncs") - Counter(before, "log_syncs"));
+    // Each entry goes to nodes - 1 followers, so per-follower batches are batches / (nodes - 1).
+    std::cout << std::fixed << "put " << clients << " " << std::setprecision(0) << all.size() / secs << " "
+              << std::setprecision(1) << Percentile(all, 0.50) << " " << Percentile(all, 0.99) << " "
+              << (batches > 0 ? entries * (args.nodes - 1) / batches : 0) << " "
+              << (syncs > 0 ? entries / syncs : 0) << "\n";
+  }
+
+  if (ok) {
+    auto http = Connect(leader);
+    std::vector<double> us;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < args.ops && ok; i++) {
+      const auto t0 = std::chrono::steady_clock::now();
+      auto r = http->Get("/get?key=k0-" + std::to_string(i % std::max(1, args.ops / 32)));
+      ok = r && r->status == 200 && r->body == value;
+      us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) std::cerr << "linearizable get failed\n";
+    std::cout << std::fixed << "get 1 " << std::setprecision(0) << us.size() / secs << " " << std::setprecision(1)
+              << Percentile(us, 0.50) << " " << Percentile(us, 0.99) << " - -\n";
+  }
+
+  if (ok) {
+    // Failover: from the kill until some surviving node commits a PUT.
+    const auto t0 = std::chrono::steady_clock::now();
+    kill(pids[static_cast<size_t>(leader)], SIGKILL);
+    waitpid(pids[static_cast<size_t>(leader)], nullptr, 0);
+    pids[static_cast<size_t>(leader)] = 0;
+    int next = 0;
+    while (next == 0 && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(10)) {
+      for (int id = 1; id <= args.nodes && next == 0; id++) {
+        if (id == leader) continue;
+        auto r = Connect(id)->Post("/put?key=failover", value, "text/plain");
+        if (r && r->status == 200) next = id;
+      }
+      if (next == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    ok = next != 0;
+    if (ok) {
+      auto r = Connect(next)->Get("/get?key=k31-0");  // written under the old leader
+      ok = r && r->status == 200 && r->body == value;
+    }
+    std::cout << std::fixed << std::setprecision(1) << "failover: node " << leader << " killed, node " << next
+              << " accepted a put after " << ms << " ms" << (ok ? "" : " (FAILED)") << "\n";
+  }
+
+  stop_all();
+  return ok ? 0 : 1;
+}
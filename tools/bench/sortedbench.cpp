@@ -0,0 +1,164 @@
+// Sorted tables: fill a log in random key order, write it out with
+// `kvtool compact --sorted` (CompactToSortedTable), then compare the log
+// store (whole index in memory) with the sorted table (block index and filter
+// only): resident set per open, random Gets of present and absent keys, and
+// range reads of --range consecutive keys (Gets on the log store, one Scan on
+// the table).
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "kvstore/kvstore.h"
+#include "kvstore/log_tools.h"
+
+struct Args {
+  int keys = 1000000;
+  int value_size = 64;
+  int ops = 200000;
+  int range = 1000;
+};
+
+static Args ParseArgs(int argc, char** argv) {
+  Args a;
+  for (int i = 1; i < argc; i++) {
+    std::string x = argv[i];
+    int* target = x == "--keys"         ? &a.keys
+                  : x == "--value_size" ? &a.value_size
+                  : x == "--ops"        ? &a.ops
+                  : x == "--range"      ? &a.range
+                                        : nullptr;
+    if (target && i + 1 < argc) {
+      *target = std::stoi(argv[++i]);
+    } else if (x == "--help" || x == "-h") {
+      std::cout << "sortedbench options:\n"
+                << "  --keys N         keys written (default 1000000)\n"
+                << "  --value_size N   bytes per value (default 64)\n"
+                << "  --ops N          random Gets per mode (default 200000)\n"
+                << "  --range N        keys per range read (default 1000)\n";
+      std::exit(0);
+    } else {
+      std::cerr << "Unknown arg: " << x << "\n";
+      std::exit(2);
+    }
+  }
+  if (a.keys <= 0 || a.value_size <= 0 || a.ops <= 0 || a.range <= 0 || a.range > a.keys) {
+    std::cerr << "Invalid args.\n";
+    std::exit(2);
+  }
+  return a;
+}
+
+static long RssKb() {
+  std::ifstream in("/proc/self/status");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.rfind("VmRSS:", 0) == 0) return std::atol(line.c_str() + 6);
+  }
+  return 0;
+}
+
+static std::string Key(uint64_t i) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "user:%010llu", static_cast<unsigned long long>(i));
+  return buf;
+}
+
+static uint64_t Next(uint64_t* rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+  return *rng;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+  Args args = ParseArgs(argc, argv);
+  std::system("mkdir -p data >/dev/null 2>&1");
+  std::system("rm -f data/sortedbench.* >/dev/null 2>&1");
+  const std::string log = "data/sortedbench.aof";
+  const std::string table = "data/sortedbench.sst";
+  const uint64_t n = static_cast<uint64_t>(args.keys);
+
+  std::cout << "sortedbench results (keys=" << args.keys << " value_size=" << args.value_size
+            << " ops=" << args.ops << " range=" << args.range << ")" << std::endl;
+  // Each phase runs in a child, so the RSS of one open is not hidden by
+  // memory the allocator kept from the fill or the previous mode.
+  if (fork() == 0) {
+    kv::KVStore s(log);
+    std::string value(args.value_size, 'v');
+    // i -> i * odd mod 2^k visits every key once, in scattered order.
+    uint64_t pow2 = 1;
+    while (pow2 < n) pow2 <<= 1;
+    for (uint64_t i = 0; i < pow2; i++) {
+      uint64_t k = (i * 0x9e3779b97f4a7c15ull) & (pow2 - 1);
+      if (k < n) s.Put(Key(k), value);
+    }
+    s.Close();
+    kv::SortedBuildReport rep;
+    std::string err;
+    auto t0 = std::chrono::steady_clock::now();
+    if (!kv::CompactToSortedTable(log, table, 0, &rep, &err)) {
+      std::cerr << "compact failed: " << err << "\n";
+      _exit(1);
+    }
+    std::cout << "compact_sorted_s=" << Seconds(t0) << " blocks=" << rep.blocks
+              << " file_bytes=" << rep.file_bytes << " resident_bytes=" << rep.resident_bytes << "\n";
+    std::cout << "mode rss_mb gets_per_sec absent_gets_per_sec range_keys_per_sec" << std::endl;
+    _exit(0);
+  }
+  int status = 0;
+  wait(&status);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+
+  for (bool sorted : {false, true}) {
+    if (fork() != 0) {
+      wait(nullptr);
+      continue;
+    }
+    kv::Options opts;
+    opts.sorted_table = sorted;
+    long rss0 = RssKb();
+    kv::KVStore s(sorted ? table : log, opts);
+    long rss1 = RssKb();
+
+    uint64_t rng = 0x9e3779b97f4a7c15ull, found = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < args.ops; i++) found += s.Get(Key(Next(&rng) % n)).has_value();
+    double gets = args.ops / Seconds(t0);
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < args.ops; i++) found += s.Get(Key(n + Next(&rng) % n)).has_value();
+    double absent = args.ops / Seconds(t0);
+
+    const int ranges = std::max(1, args.ops / args.range);
+    uint64_t scanned = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < ranges; r++) {
+      uint64_t first = Next(&rng) % (n - args.range + 1);
+      if (sorted) {
+        s.Scan(Key(first), Key(first + args.range), [&](const std::string&, const std::string&) {
+          scanned++;
+          return true;
+        });
+      } else {
+        for (int i = 0; i < args.range; i++) scanned += s.Get(Key(first + i)).has_value();
+      }
+    }
+    double range_rate = scanned / Seconds(t0);
+    std::cout << (sorted ? "sorted_table" : "log") << " " << (rss1 - rss0) / 1024.0 << " "
+              << static_cast<uint64_t>(gets) << " " << static_cast<uint64_t>(absent) << " "
+              << static_cast<uint64_t>(range_rate) << (found == static_cast<uint64_t>(args.ops) ? "" : " MISMATCH")
+              << std::endl;
+    _exit(0);
+  }
+  return 0;
+}